@@ -0,0 +1,926 @@
+#include "BlockCompression.h"
+#include "Content/BlockDecompression.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <execution>
+#include <numeric>
+#include <vector>
+
+// The palette searches of BC1 to BC5 have SSE2 and NEON versions, which choose the same indices as the scalar ones
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define BC_USE_SSE2 1
+#elif defined(_M_ARM64) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define BC_USE_NEON 1
+#endif
+
+namespace primal::tools
+{
+	bool is_normal_map(const u8 *const pixels, u64 size, bool is_bgr);
+}
+
+namespace primal::tools::block_compression
+{
+	namespace
+	{
+		using texels_t = u8[16][4];
+
+		using content::detail::bc7_partitions2;
+		using content::detail::bc7_anchors2;
+		using content::detail::bc7_weights;
+		using content::detail::bc7_interpolate;
+
+		struct bc7_mode
+		{
+			u32									mode;
+			u32									subsets;
+			u32									color_bits;			// Without the p-bit
+			u32									alpha_bits;			// 0 for opaque modes
+			bool								shared_pbit;		// One p-bit per subset instead of one per endpoint
+			u32									index_bits;
+		};
+
+		constexpr bc7_mode bc7_mode1{ 1, 2, 6, 0, true, 3 };
+		constexpr bc7_mode bc7_mode3{ 3, 2, 7, 0, false, 2 };
+		constexpr bc7_mode bc7_mode6{ 6, 1, 7, 7, false, 4 };
+		constexpr bc7_mode bc7_mode7{ 7, 2, 5, 5, false, 2 };
+
+		u32 popcount(u32 mask)
+		{
+			u32 count{ 0 };
+			for (; mask; mask &= mask - 1) ++count;
+			return count;
+		}
+
+		void load_block(const image& src, u32 block_x, u32 block_y, texels_t& texels)
+		{
+			for (u32 y{ 0 }; y < 4; ++y)
+			{
+				const u8 *const row{ src.pixels + (u64)std::min(block_y * 4 + y, src.height - 1) * src.row_pitch };
+				for (u32 x{ 0 }; x < 4; ++x)
+				{
+					memcpy(texels[y * 4 + x], row + std::min(block_x * 4 + x, src.width - 1) * 4, 4);
+				}
+			}
+		}
+
+		// Mean and principal axis of the texels in mask over their first channel_count channels. The axis is 0 when they're all the same.
+		// Returns the variance that isn't along the axis, which is how badly a line through them fits.
+		f32 principal_axis(const texels_t& texels, u32 mask, u32 channel_count, f32 (&mean)[4], f32 (&axis)[4])
+		{
+			const f32 count{ (f32)std::max(popcount(mask), 1u) };
+			for (u32 c{ 0 }; c < 4; ++c) mean[c] = axis[c] = 0.f;
+			for (u32 i{ 0 }; i < 16; ++i)
+			{
+				if (!(mask & (1 << i))) continue;
+				for (u32 c{ 0 }; c < channel_count; ++c) mean[c] += texels[i][c];
+			}
+			for (u32 c{ 0 }; c < channel_count; ++c) mean[c] /= count;
+
+			f32 covariance[4][4]{};
+			for (u32 i{ 0 }; i < 16; ++i)
+			{
+				if (!(mask & (1 << i))) continue;
+				f32 d[4]{};
+				for (u32 c{ 0 }; c < channel_count; ++c) d[c] = texels[i][c] - mean[c];
+				for (u32 r{ 0 }; r < channel_count; ++r)
+					for (u32 c{ 0 }; c < channel_count; ++c) covariance[r][c] += d[r] * d[c];
+			}
+
+			f32 total{ 0.f };
+			u32 largest{ 0 };
+			for (u32 c{ 0 }; c < channel_count; ++c)
+			{
+				total += covariance[c][c];
+				if (covariance[c][c] > covariance[largest][largest]) largest = c;
+			}
+			if (total < 1e-6f) return 0.f;
+
+			// Power iteration, starting from the row of the channel that varies most
+			f32 v[4]{};
+			for (u32 c{ 0 }; c < channel_count; ++c) v[c] = covariance[largest][c];
+			f32 eigenvalue{ 0.f };
+			for (u32 iteration{ 0 }; iteration < 8; ++iteration)
+			{
+				f32 w[4]{};
+				for (u32 r{ 0 }; r < channel_count; ++r)
+					for (u32 c{ 0 }; c < channel_count; ++c) w[r] += covariance[r][c] * v[c];
+
+				f32 length{ 0.f };
+				for (u32 c{ 0 }; c < channel_count; ++c) length += w[c] * w[c];
+				length = std::sqrt(length);
+				if (length < 1e-12f) break;
+				for (u32 c{ 0 }; c < channel_count; ++c) v[c] = w[c] / length;
+				eigenvalue = length;
+			}
+
+			for (u32 c{ 0 }; c < channel_count; ++c) axis[c] = v[c];
+			return std::max(total - eigenvalue, 0.f);
+		}
+
+		// Sums of the RGB values and their products, which give the covariance of any set of texels without going over them again
+		struct color_moments
+		{
+			f32									count{ 0.f };
+			f32									sum[3]{};
+			f32									products[6]{};		// rr, rg, rb, gg, gb, bb
+
+			color_moments() = default;
+			explicit color_moments(const u8 (&texel)[4])
+				: count{ 1.f }, sum{ (f32)texel[0], (f32)texel[1], (f32)texel[2] },
+				products{ sum[0] * sum[0], sum[0] * sum[1], sum[0] * sum[2], sum[1] * sum[1], sum[1] * sum[2], sum[2] * sum[2] } {}
+
+			color_moments& operator+=(const color_moments& m)
+			{
+				count += m.count;
+				for (u32 i{ 0 }; i < 3; ++i) sum[i] += m.sum[i];
+				for (u32 i{ 0 }; i < 6; ++i) products[i] += m.products[i];
+				return *this;
+			}
+
+			color_moments operator-(const color_moments& m) const
+			{
+				color_moments result{ *this };
+				result.count -= m.count;
+				for (u32 i{ 0 }; i < 3; ++i) result.sum[i] -= m.sum[i];
+				for (u32 i{ 0 }; i < 6; ++i) result.products[i] -= m.products[i];
+				return result;
+			}
+
+			// Same as principal_axis' return value, with fewer power iterations
+			f32 line_fit_error() const
+			{
+				if (count < 2.f) return 0.f;
+				const f32 inv_count{ 1.f / count };
+				const f32 m[3]{ sum[0] * inv_count, sum[1] * inv_count, sum[2] * inv_count };
+				const f32 c[3][3]{
+					{ products[0] - sum[0] * m[0], products[1] - sum[0] * m[1], products[2] - sum[0] * m[2] },
+					{ products[1] - sum[0] * m[1], products[3] - sum[1] * m[1], products[4] - sum[1] * m[2] },
+					{ products[2] - sum[0] * m[2], products[4] - sum[1] * m[2], products[5] - sum[2] * m[2] },
+				};
+				const f32 total{ c[0][0] + c[1][1] + c[2][2] };
+				if (total < 1e-6f) return 0.f;
+
+				f32 v[3]{ 1.f, 1.f, 1.f };
+				f32 eigenvalue{ 0.f };
+				for (u32 iteration{ 0 }; iteration < 4; ++iteration)
+				{
+					const f32 w[3]{ c[0][0] * v[0] + c[0][1] * v[1] + c[0][2] * v[2],
+									c[1][0] * v[0] + c[1][1] * v[1] + c[1][2] * v[2],
+									c[2][0] * v[0] + c[2][1] * v[1] + c[2][2] * v[2] };
+					const f32 length{ std::sqrt(w[0] * w[0] + w[1] * w[1] + w[2] * w[2]) };
+					if (length < 1e-12f) break;
+					for (u32 i{ 0 }; i < 3; ++i) v[i] = w[i] / length;
+					eigenvalue = length;
+				}
+				return std::max(total - eigenvalue, 0.f);
+			}
+		};
+
+		// Ends of the segment along the axis that covers the texels in mask
+		void principal_endpoints(const texels_t& texels, u32 mask, u32 channel_count, f32 (&e0)[4], f32 (&e1)[4])
+		{
+			f32 mean[4], axis[4];
+			principal_axis(texels, mask, channel_count, mean, axis);
+
+			f32 t_min{ 0.f }, t_max{ 0.f };
+			for (u32 i{ 0 }; i < 16; ++i)
+			{
+				if (!(mask & (1 << i))) continue;
+				f32 t{ 0.f };
+				for (u32 c{ 0 }; c < channel_count; ++c) t += (texels[i][c] - mean[c]) * axis[c];
+				t_min = std::min(t_min, t);
+				t_max = std::max(t_max, t);
+			}
+
+			for (u32 c{ 0 }; c < 4; ++c)
+			{
+				e0[c] = std::clamp(mean[c] + axis[c] * t_min, 0.f, 255.f);
+				e1[c] = std::clamp(mean[c] + axis[c] * t_max, 0.f, 255.f);
+			}
+		}
+
+		// Endpoints that minimize the squared error of the texels in mask for their weights towards e1 (in 64ths)
+		bool least_squares(const texels_t& texels, u32 mask, const u32 (&weights)[16], u32 channel_count, f32 (&e0)[4], f32 (&e1)[4])
+		{
+			f32 a00{ 0.f }, a01{ 0.f }, a11{ 0.f };
+			f32 b0[4]{}, b1[4]{};
+			for (u32 i{ 0 }; i < 16; ++i)
+			{
+				if (!(mask & (1 << i))) continue;
+				const f32 w{ weights[i] / 64.f };
+				a00 += (1.f - w) * (1.f - w);
+				a01 += (1.f - w) * w;
+				a11 += w * w;
+				for (u32 c{ 0 }; c < channel_count; ++c)
+				{
+					b0[c] += (1.f - w) * texels[i][c];
+					b1[c] += w * texels[i][c];
+				}
+			}
+
+			const f32 determinant{ a00 * a11 - a01 * a01 };
+			if (std::abs(determinant) < 1e-6f) return false;
+			for (u32 c{ 0 }; c < channel_count; ++c)
+			{
+				e0[c] = std::clamp((a11 * b0[c] - a01 * b1[c]) / determinant, 0.f, 255.f);
+				e1[c] = std::clamp((a00 * b1[c] - a01 * b0[c]) / determinant, 0.f, 255.f);
+			}
+			return true;
+		}
+
+		//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+		// BC1
+
+		u16 to_565(const f32 (&c)[4])
+		{
+			const u32 r{ (u32)std::lround(c[0] * 31.f / 255.f) };
+			const u32 g{ (u32)std::lround(c[1] * 63.f / 255.f) };
+			const u32 b{ (u32)std::lround(c[2] * 31.f / 255.f) };
+			return (u16)((r << 11) | (g << 5) | b);
+		}
+
+		void from_565(u16 c, s32 (&rgb)[3])
+		{
+			const u32 r{ (u32)(c >> 11) & 31 }, g{ (u32)(c >> 5) & 63 }, b{ (u32)c & 31 };
+			rgb[0] = (s32)((r << 3) | (r >> 2));
+			rgb[1] = (s32)((g << 2) | (g >> 4));
+			rgb[2] = (s32)((b << 3) | (b >> 2));
+		}
+
+		// Palette of a color block. Index 3 of three-color blocks is transparent black.
+		void bc1_palette(u16 c0, u16 c1, bool four_colors, s32 (&palette)[4][3])
+		{
+			from_565(c0, palette[0]);
+			from_565(c1, palette[1]);
+			for (u32 c{ 0 }; c < 3; ++c)
+			{
+				if (four_colors)
+				{
+					palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+					palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+				}
+				else
+				{
+					palette[2][c] = (palette[0][c] + palette[1][c] + 1) / 2;
+					palette[3][c] = 0;
+				}
+			}
+		}
+
+		// Chooses the closest of the first color_count palette colors for the texels in mask
+		u32 bc1_indices(const texels_t& texels, u32 mask, const s32 (&palette)[4][3], u32 color_count, u32 (&indices)[16])
+		{
+#if BC_USE_SSE2
+			// Four texels per register. The 16-bit differences are squared and summed in pairs by madd, which leaves
+			// r^2 + g^2 and b^2 (alpha is masked out) for each texel to add up.
+			alignas(16) u32 best_index[16], best_error[16];
+			__m128i quads[4];
+			const __m128i rgb_mask{ _mm_set1_epi32(0x00ffffff) };
+			for (u32 q{ 0 }; q < 4; ++q) quads[q] = _mm_and_si128(_mm_loadu_si128((const __m128i*)texels[q * 4]), rgb_mask);
+
+			const __m128i zero{ _mm_setzero_si128() };
+			for (u32 p{ 0 }; p < color_count; ++p)
+			{
+				const __m128i color{ _mm_setr_epi16((s16)palette[p][0], (s16)palette[p][1], (s16)palette[p][2], 0,
+					(s16)palette[p][0], (s16)palette[p][1], (s16)palette[p][2], 0) };
+				const __m128i index{ _mm_set1_epi32((s32)p) };
+				for (u32 q{ 0 }; q < 4; ++q)
+				{
+					const __m128i d0{ _mm_sub_epi16(_mm_unpacklo_epi8(quads[q], zero), color) };
+					const __m128i d1{ _mm_sub_epi16(_mm_unpackhi_epi8(quads[q], zero), color) };
+					const __m128 s0{ _mm_castsi128_ps(_mm_madd_epi16(d0, d0)) };
+					const __m128 s1{ _mm_castsi128_ps(_mm_madd_epi16(d1, d1)) };
+					const __m128i e{ _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(s0, s1, _MM_SHUFFLE(2, 0, 2, 0))),
+						_mm_castps_si128(_mm_shuffle_ps(s0, s1, _MM_SHUFFLE(3, 1, 3, 1)))) };
+					if (!p)
+					{
+						_mm_store_si128((__m128i*)&best_error[q * 4], e);
+						_mm_store_si128((__m128i*)&best_index[q * 4], index);
+						continue;
+					}
+					const __m128i best{ _mm_load_si128((const __m128i*)&best_error[q * 4]) };
+					const __m128i closer{ _mm_cmplt_epi32(e, best) };
+					_mm_store_si128((__m128i*)&best_error[q * 4], _mm_or_si128(_mm_and_si128(closer, e), _mm_andnot_si128(closer, best)));
+					const __m128i best_p{ _mm_load_si128((const __m128i*)&best_index[q * 4]) };
+					_mm_store_si128((__m128i*)&best_index[q * 4], _mm_or_si128(_mm_and_si128(closer, index), _mm_andnot_si128(closer, best_p)));
+				}
+			}
+#elif BC_USE_NEON
+			// Sixteen texels split into channels, squared differences widened to 32 bits for four texels at a time
+			alignas(16) u32 best_index[16], best_error[16];
+			const uint8x16x4_t channels{ vld4q_u8(texels[0]) };
+			for (u32 p{ 0 }; p < color_count; ++p)
+			{
+				const uint8x16_t dr{ vabdq_u8(channels.val[0], vdupq_n_u8((u8)palette[p][0])) };
+				const uint8x16_t dg{ vabdq_u8(channels.val[1], vdupq_n_u8((u8)palette[p][1])) };
+				const uint8x16_t db{ vabdq_u8(channels.val[2], vdupq_n_u8((u8)palette[p][2])) };
+				const uint16x8_t r2[2]{ vmull_u8(vget_low_u8(dr), vget_low_u8(dr)), vmull_u8(vget_high_u8(dr), vget_high_u8(dr)) };
+				const uint16x8_t g2[2]{ vmull_u8(vget_low_u8(dg), vget_low_u8(dg)), vmull_u8(vget_high_u8(dg), vget_high_u8(dg)) };
+				const uint16x8_t b2[2]{ vmull_u8(vget_low_u8(db), vget_low_u8(db)), vmull_u8(vget_high_u8(db), vget_high_u8(db)) };
+				const uint32x4_t index{ vdupq_n_u32(p) };
+				for (u32 q{ 0 }; q < 4; ++q)
+				{
+					const u32 h{ q >> 1 };
+					const uint32x4_t e{ q & 1 ?
+						vaddw_u16(vaddl_u16(vget_high_u16(r2[h]), vget_high_u16(g2[h])), vget_high_u16(b2[h])) :
+						vaddw_u16(vaddl_u16(vget_low_u16(r2[h]), vget_low_u16(g2[h])), vget_low_u16(b2[h])) };
+					if (!p)
+					{
+						vst1q_u32(&best_error[q * 4], e);
+						vst1q_u32(&best_index[q * 4], index);
+						continue;
+					}
+					const uint32x4_t best{ vld1q_u32(&best_error[q * 4]) };
+					const uint32x4_t closer{ vcltq_u32(e, best) };
+					vst1q_u32(&best_error[q * 4], vminq_u32(e, best));
+					vst1q_u32(&best_index[q * 4], vbslq_u32(closer, index, vld1q_u32(&best_index[q * 4])));
+				}
+			}
+#endif
+
+			u32 error{ 0 };
+			for (u32 i{ 0 }; i < 16; ++i)
+			{
+				if (!(mask & (1 << i))) continue;
+#if BC_USE_SSE2 || BC_USE_NEON
+				indices[i] = best_index[i];
+				error += best_error[i];
+#else
+				u32 best_error{ ~0u };
+				for (u32 p{ 0 }; p < color_count; ++p)
+				{
+					const s32 dr{ texels[i][0] - palette[p][0] }, dg{ texels[i][1] - palette[p][1] }, db{ texels[i][2] - palette[p][2] };
+					const u32 e{ (u32)(dr * dr + dg * dg + db * db) };
+					if (e < best_error)
+					{
+						best_error = e;
+						indices[i] = p;
+					}
+				}
+				error += best_error;
+#endif
+			}
+			return error;
+		}
+
+		// Writes the color half of BC1, BC2 and BC3 blocks. Texels with less alpha than alpha_threshold are encoded
+		// as transparent, which needs a three-color block. BC3 blocks always decode with four colors.
+		void encode_color_block(const texels_t& texels, bool four_colors_only, u8 alpha_threshold, u8* out)
+		{
+			u32 transparent{ 0 };
+			if (!four_colors_only)
+			{
+				for (u32 i{ 0 }; i < 16; ++i) if (texels[i][3] < alpha_threshold) transparent |= 1 << i;
+			}
+			const u32 opaque{ ~transparent & 0xffff };
+			const bool three_colors{ transparent != 0 };
+
+			u16 best_c0{ 0 }, best_c1{ 0 };
+			u32 best_indices{ 0xffffffff };		// All transparent
+			if (opaque)
+			{
+				f32 e0[4], e1[4];
+				principal_endpoints(texels, opaque, 3, e0, e1);
+				u32 best_error{ ~0u };
+				constexpr u32 weights_four[4]{ 0, 64, 21, 43 };
+				constexpr u32 weights_three[4]{ 0, 64, 32, 0 };
+
+				for (u32 iteration{ 0 }; iteration < 3; ++iteration)
+				{
+					u16 c0{ to_565(e0) }, c1{ to_565(e1) };
+					// Four-color blocks need c0 > c1, three-color blocks c0 <= c1
+					if (three_colors ? c0 > c1 : c0 < c1) std::swap(c0, c1);
+					const bool four_colors{ !three_colors && c0 != c1 };
+
+					s32 palette[4][3];
+					bc1_palette(c0, c1, four_colors || four_colors_only, palette);
+					u32 indices[16]{};
+					const u32 error{ bc1_indices(texels, opaque, palette, four_colors || four_colors_only ? 4 : 3, indices) };
+					if (error < best_error)
+					{
+						best_error = error;
+						best_c0 = c0;
+						best_c1 = c1;
+						best_indices = 0;
+						for (u32 i{ 0 }; i < 16; ++i) best_indices |= (opaque & (1 << i) ? indices[i] : 3) << (i * 2);
+					}
+					if (!error) break;
+
+					u32 weights[16]{};
+					for (u32 i{ 0 }; i < 16; ++i) weights[i] = (four_colors || four_colors_only ? weights_four : weights_three)[indices[i]];
+					f32 f0[4]{}, f1[4]{};
+					if (!least_squares(texels, opaque, weights, 3, f0, f1)) break;
+					// The endpoints keep the order the indices were chosen for
+					const bool swapped{ c0 != to_565(e0) };
+					memcpy(swapped ? e1 : e0, f0, sizeof(f0));
+					memcpy(swapped ? e0 : e1, f1, sizeof(f1));
+				}
+			}
+
+			memcpy(&out[0], &best_c0, sizeof(u16));
+			memcpy(&out[2], &best_c1, sizeof(u16));
+			memcpy(&out[4], &best_indices, sizeof(u32));
+		}
+
+		//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+		// BC4
+
+		void bc4_palette(u32 e0, u32 e1, u32 (&palette)[8])
+		{
+			palette[0] = e0;
+			palette[1] = e1;
+			if (e0 > e1)
+			{
+				for (u32 k{ 1 }; k < 7; ++k) palette[k + 1] = ((7 - k) * e0 + k * e1 + 3) / 7;
+			}
+			else
+			{
+				for (u32 k{ 1 }; k < 5; ++k) palette[k + 1] = ((5 - k) * e0 + k * e1 + 2) / 5;
+				palette[6] = 0;
+				palette[7] = 255;
+			}
+		}
+
+		u32 bc4_indices(const u8 (&values)[16], u32 e0, u32 e1, u64& indices)
+		{
+			u32 palette[8];
+			bc4_palette(e0, e1, palette);
+			u32 error{ 0 };
+			indices = 0;
+#if BC_USE_SSE2 || BC_USE_NEON
+			// All 16 values at once. The absolute differences order the palette entries like the squared ones,
+			// so only the closest are squared.
+			alignas(16) u8 best[16];
+#if BC_USE_SSE2
+			auto distance{ [](__m128i a, __m128i b) { return _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a)); } };
+			const __m128i v{ _mm_loadu_si128((const __m128i*)values) };
+			__m128i best_distance{ distance(v, _mm_set1_epi8((char)palette[0])) };
+			__m128i best_index{ _mm_setzero_si128() };
+			for (u32 p{ 1 }; p < 8; ++p)
+			{
+				const __m128i d{ distance(v, _mm_set1_epi8((char)palette[p])) };
+				const __m128i min{ _mm_min_epu8(d, best_distance) };
+				const __m128i not_closer{ _mm_cmpeq_epi8(min, best_distance) };
+				best_index = _mm_or_si128(_mm_and_si128(not_closer, best_index), _mm_andnot_si128(not_closer, _mm_set1_epi8((char)p)));
+				best_distance = min;
+			}
+			_mm_store_si128((__m128i*)best, best_index);
+
+			const __m128i zero{ _mm_setzero_si128() };
+			const __m128i d0{ _mm_unpacklo_epi8(best_distance, zero) }, d1{ _mm_unpackhi_epi8(best_distance, zero) };
+			__m128i sum{ _mm_add_epi32(_mm_madd_epi16(d0, d0), _mm_madd_epi16(d1, d1)) };
+			sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+			sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+			error = (u32)_mm_cvtsi128_si32(sum);
+#else
+			const uint8x16_t v{ vld1q_u8(values) };
+			uint8x16_t best_distance{ vabdq_u8(v, vdupq_n_u8((u8)palette[0])) };
+			uint8x16_t best_index{ vdupq_n_u8(0) };
+			for (u32 p{ 1 }; p < 8; ++p)
+			{
+				const uint8x16_t d{ vabdq_u8(v, vdupq_n_u8((u8)palette[p])) };
+				best_index = vbslq_u8(vcltq_u8(d, best_distance), vdupq_n_u8((u8)p), best_index);
+				best_distance = vminq_u8(d, best_distance);
+			}
+			vst1q_u8(best, best_index);
+
+			const uint16x8_t d0{ vmull_u8(vget_low_u8(best_distance), vget_low_u8(best_distance)) };
+			const uint16x8_t d1{ vmull_u8(vget_high_u8(best_distance), vget_high_u8(best_distance)) };
+			const uint64x2_t sum{ vpaddlq_u32(vpadalq_u16(vpaddlq_u16(d0), d1)) };
+			error = (u32)(vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1));
+#endif
+			for (u32 i{ 0 }; i < 16; ++i) indices |= (u64)best[i] << (i * 3);
+#else
+			for (u32 i{ 0 }; i < 16; ++i)
+			{
+				u32 best{ 0 }, best_error{ ~0u };
+				for (u32 p{ 0 }; p < 8; ++p)
+				{
+					const s32 d{ (s32)values[i] - (s32)palette[p] };
+					if ((u32)(d * d) < best_error)
+					{
+						best_error = (u32)(d * d);
+						best = p;
+					}
+				}
+				error += best_error;
+				indices |= (u64)best << (i * 3);
+			}
+#endif
+			return error;
+		}
+
+		// Tries the eight-value mode around the value range and the six-value mode, which has exact 0 and 255, around
+		// the range of the other values
+		void encode_bc4(const u8 (&values)[16], u8* out)
+		{
+			u32 min{ 255 }, max{ 0 }, inner_min{ 255 }, inner_max{ 0 };
+			for (const u8 v : values)
+			{
+				min = std::min(min, (u32)v);
+				max = std::max(max, (u32)v);
+				if (v == 0 || v == 255) continue;
+				inner_min = std::min(inner_min, (u32)v);
+				inner_max = std::max(inner_max, (u32)v);
+			}
+
+			u32 best_e0{ max }, best_e1{ max }, best_error{ ~0u };
+			u64 best_indices{ 0 };
+			auto try_endpoints{ [&](s32 e0, s32 e1) {
+				if (e0 < 0 || e0 > 255 || e1 < 0 || e1 > 255) return;
+				u64 indices;
+				const u32 error{ bc4_indices(values, (u32)e0, (u32)e1, indices) };
+				if (error < best_error)
+				{
+					best_error = error;
+					best_e0 = (u32)e0;
+					best_e1 = (u32)e1;
+					best_indices = indices;
+				}
+			} };
+
+			if (min == max)
+			{
+				try_endpoints((s32)max, (s32)max);
+			}
+			else
+			{
+				for (s32 d0{ -2 }; d0 <= 0; ++d0)
+					for (s32 d1{ 0 }; d1 <= 2; ++d1) try_endpoints((s32)max + d0, (s32)min + d1);
+			}
+
+			if (best_error && (min == 0 || max == 255) && inner_min <= inner_max)
+			{
+				try_endpoints((s32)inner_min, (s32)inner_max);
+			}
+
+			out[0] = (u8)best_e0;
+			out[1] = (u8)best_e1;
+			for (u32 i{ 0 }; i < 6; ++i) out[2 + i] = (u8)(best_indices >> (i * 8));
+		}
+
+		//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+		// BC7
+
+		struct bit_writer
+		{
+			u8*									out;
+			u32									position{ 0 };
+
+			void write(u32 value, u32 bits)
+			{
+				for (u32 i{ 0 }; i < bits; ++i, ++position)
+				{
+					if ((value >> i) & 1) out[position >> 3] |= (u8)(1 << (position & 7));
+				}
+			}
+		};
+
+		// Endpoint channel with its p-bit to 8 bits
+		constexpr u32 bc7_unquantize(u32 value, u32 pbit, u32 bits)
+		{
+			const u32 v{ (value << 1) | pbit };
+			return bits + 1 >= 8 ? v : (v << (7 - bits)) | (v >> (2 * bits - 6));
+		}
+
+		struct bc7_subset
+		{
+			u32									endpoints[2][4];		// Quantized, without the p-bits
+			u32									pbits[2];
+			u32									error{ ~0u };
+		};
+
+		struct bc7_block
+		{
+			bc7_subset							subsets[2];
+			u32									indices[16];
+			u32									partition{ 0 };
+			u32									error{ ~0u };
+		};
+
+		// Closest palette entry, found from the projection onto the endpoints and checked against the neighbors
+		u32 bc7_index(const u8 (&texel)[4], const u32 (&palette)[16][4], u32 index_count, u32 channel_count, const f32 (&direction)[4],
+			f32 inverse_length_sq, u32& error)
+		{
+			f32 t{ 0.f };
+			for (u32 c{ 0 }; c < channel_count; ++c) t += ((f32)texel[c] - (f32)palette[0][c]) * direction[c];
+			const s32 guess{ std::clamp((s32)std::lround(t * inverse_length_sq * (index_count - 1)), 0, (s32)index_count - 1) };
+
+			u32 best{ 0 };
+			error = ~0u;
+			for (s32 i{ std::max(guess - 1, 0) }; i <= std::min(guess + 1, (s32)index_count - 1); ++i)
+			{
+				u32 e{ 0 };
+				for (u32 c{ 0 }; c < 4; ++c)
+				{
+					const s32 d{ (s32)texel[c] - (s32)palette[i][c] };
+					e += (u32)(d * d);
+				}
+				if (e < error)
+				{
+					error = e;
+					best = (u32)i;
+				}
+			}
+			return best;
+		}
+
+		// Fits the endpoints of the texels in mask for a mode, trying every p-bit choice after each refinement
+		bc7_subset encode_bc7_subset(const texels_t& texels, u32 mask, const bc7_mode& mode, u32 iterations, u32 (&indices)[16])
+		{
+			const u32 channel_count{ mode.alpha_bits ? 4u : 3u };
+			const u32 index_count{ 1u << mode.index_bits };
+			const u32 *const weights{ bc7_weights(mode.index_bits) };
+			const u32 pbit_choices{ mode.shared_pbit ? 2u : 4u };
+
+			f32 e0[4], e1[4];
+			principal_endpoints(texels, mask, channel_count, e0, e1);
+			if (!mode.alpha_bits) e0[3] = e1[3] = 255.f;
+
+			bc7_subset best{};
+			u32 best_indices[16]{};
+			for (u32 iteration{ 0 }; iteration < iterations; ++iteration)
+			{
+				const f32 ends[2][4]{ { e0[0], e0[1], e0[2], e0[3] }, { e1[0], e1[1], e1[2], e1[3] } };
+				for (u32 choice{ 0 }; choice < pbit_choices; ++choice)
+				{
+					bc7_subset subset{};
+					subset.pbits[0] = choice & 1;
+					subset.pbits[1] = mode.shared_pbit ? choice & 1 : choice >> 1;
+
+					u32 palette[16][4];
+					u32 unquantized[2][4];
+					for (u32 e{ 0 }; e < 2; ++e)
+					{
+						for (u32 c{ 0 }; c < 4; ++c)
+						{
+							const u32 bits{ c < 3 ? mode.color_bits : mode.alpha_bits };
+							if (!bits)
+							{
+								unquantized[e][c] = 255;
+								continue;
+							}
+							const u32 max_value{ (1u << bits) - 1 };
+							const f32 scaled{ ends[e][c] * (f32)((2u << bits) - 1) / 255.f };
+							subset.endpoints[e][c] = (u32)std::clamp((s32)std::lround((scaled - (f32)subset.pbits[e]) * .5f), 0, (s32)max_value);
+							unquantized[e][c] = bc7_unquantize(subset.endpoints[e][c], subset.pbits[e], bits);
+						}
+					}
+					for (u32 i{ 0 }; i < index_count; ++i)
+						for (u32 c{ 0 }; c < 4; ++c) palette[i][c] = bc7_interpolate(unquantized[0][c], unquantized[1][c], weights[i]);
+
+					f32 direction[4]{};
+					f32 length_sq{ 0.f };
+					for (u32 c{ 0 }; c < channel_count; ++c)
+					{
+						direction[c] = (f32)palette[index_count - 1][c] - (f32)palette[0][c];
+						length_sq += direction[c] * direction[c];
+					}
+					const f32 inverse_length_sq{ length_sq > 0.f ? 1.f / length_sq : 0.f };
+
+					u32 subset_indices[16]{};
+					subset.error = 0;
+					for (u32 i{ 0 }; i < 16; ++i)
+					{
+						if (!(mask & (1 << i))) continue;
+						u32 error;
+						subset_indices[i] = bc7_index(texels[i], palette, index_count, channel_count, direction, inverse_length_sq, error);
+						subset.error += error;
+					}
+
+					if (subset.error < best.error)
+					{
+						best = subset;
+						memcpy(best_indices, subset_indices, sizeof(best_indices));
+					}
+				}
+
+				if (!best.error) break;
+				u32 refinement_weights[16]{};
+				for (u32 i{ 0 }; i < 16; ++i) refinement_weights[i] = weights[best_indices[i]];
+				if (!least_squares(texels, mask, refinement_weights, channel_count, e0, e1)) break;
+			}
+
+			for (u32 i{ 0 }; i < 16; ++i)
+			{
+				if (mask & (1 << i)) indices[i] = best_indices[i];
+			}
+			return best;
+		}
+
+		// The anchor texel of each subset stores its index without the top bit, so that bit has to be 0
+		void fix_anchors(bc7_block& block, const bc7_mode& mode)
+		{
+			const u32 half{ 1u << (mode.index_bits - 1) };
+			const u32 max_index{ (1u << mode.index_bits) - 1 };
+			for (u32 s{ 0 }; s < mode.subsets; ++s)
+			{
+				const u32 anchor{ s ? bc7_anchors2[block.partition] : 0u };
+				if (block.indices[anchor] < half) continue;
+
+				bc7_subset& subset{ block.subsets[s] };
+				for (u32 c{ 0 }; c < 4; ++c) std::swap(subset.endpoints[0][c], subset.endpoints[1][c]);
+				std::swap(subset.pbits[0], subset.pbits[1]);
+				const u32 mask{ mode.subsets == 1 ? 0xffffu : s ? bc7_partitions2[block.partition] : ~bc7_partitions2[block.partition] & 0xffffu };
+				for (u32 i{ 0 }; i < 16; ++i)
+				{
+					if (mask & (1 << i)) block.indices[i] = max_index - block.indices[i];
+				}
+			}
+		}
+
+		void write_bc7_block(const bc7_block& block, const bc7_mode& mode, u8* out)
+		{
+			memset(out, 0, 16);
+			bit_writer writer{ out };
+			writer.write(1u << mode.mode, mode.mode + 1);
+			if (mode.subsets > 1) writer.write(block.partition, 6);
+
+			for (u32 c{ 0 }; c < 4; ++c)
+			{
+				const u32 bits{ c < 3 ? mode.color_bits : mode.alpha_bits };
+				if (!bits) continue;
+				for (u32 s{ 0 }; s < mode.subsets; ++s)
+					for (u32 e{ 0 }; e < 2; ++e) writer.write(block.subsets[s].endpoints[e][c], bits);
+			}
+
+			for (u32 s{ 0 }; s < mode.subsets; ++s)
+			{
+				writer.write(block.subsets[s].pbits[0], 1);
+				if (!mode.shared_pbit) writer.write(block.subsets[s].pbits[1], 1);
+			}
+
+			for (u32 i{ 0 }; i < 16; ++i)
+			{
+				const bool anchor{ i == 0 || (mode.subsets > 1 && i == bc7_anchors2[block.partition]) };
+				writer.write(block.indices[i], mode.index_bits - (anchor ? 1 : 0));
+			}
+			assert(writer.position == 128);
+		}
+
+		bc7_block encode_bc7_mode(const texels_t& texels, const bc7_mode& mode, u32 partition, u32 iterations)
+		{
+			bc7_block block{};
+			block.partition = partition;
+			block.error = 0;
+			for (u32 s{ 0 }; s < mode.subsets; ++s)
+			{
+				const u32 mask{ mode.subsets == 1 ? 0xffffu : s ? bc7_partitions2[partition] : ~bc7_partitions2[partition] & 0xffffu };
+				block.subsets[s] = encode_bc7_subset(texels, mask, mode, iterations, block.indices);
+				block.error += block.subsets[s].error;
+			}
+			return block;
+		}
+
+		void encode_bc7(const texels_t& texels, bc7_quality::level quality, u8* out)
+		{
+			constexpr u32 iterations[bc7_quality::count]{ 1, 2, 4 };
+			constexpr u32 partition_candidates[bc7_quality::count]{ 0, 4, 64 };
+			// Squared error of the whole block that mode 6 can keep before normal quality tries two subsets, about 1 per channel and texel
+			constexpr u32 good_enough_error[bc7_quality::count]{ ~0u, 64, 0 };
+
+			bc7_block best{ encode_bc7_mode(texels, bc7_mode6, 0, iterations[quality]) };
+			const bc7_mode* best_mode{ &bc7_mode6 };
+
+			bool opaque{ true };
+			for (u32 i{ 0 }; i < 16; ++i) opaque &= texels[i][3] == 255;
+
+			if (best.error > good_enough_error[quality])
+			{
+				// Partitions ordered by how well two lines fit their subsets. Only the colors count, also for mode 7.
+				color_moments moments[16], total{};
+				for (u32 i{ 0 }; i < 16; ++i)
+				{
+					moments[i] = color_moments{ texels[i] };
+					total += moments[i];
+				}
+
+				std::pair<f32, u32> estimates[64];
+				for (u32 p{ 0 }; p < 64; ++p)
+				{
+					color_moments subset{};
+					for (u32 i{ 0 }; i < 16; ++i)
+					{
+						if (bc7_partitions2[p] & (1 << i)) subset += moments[i];
+					}
+					estimates[p] = { (total - subset).line_fit_error() + subset.line_fit_error(), p };
+				}
+				const u32 candidates{ partition_candidates[quality] };
+				std::partial_sort(std::begin(estimates), std::begin(estimates) + candidates, std::end(estimates));
+
+				// Opaque blocks try mode 1 and, at best quality, mode 3, which trades index precision for endpoint precision
+				// and rarely wins. Mode 7 is the only two-subset mode with alpha.
+				const bc7_mode *const modes[2]{ opaque ? &bc7_mode1 : &bc7_mode7, opaque && quality == bc7_quality::best ? &bc7_mode3 : nullptr };
+				for (u32 i{ 0 }; i < candidates && best.error; ++i)
+				{
+					for (const bc7_mode *const mode : modes)
+					{
+						if (!mode) continue;
+						const bc7_block block{ encode_bc7_mode(texels, *mode, estimates[i].second, iterations[quality]) };
+						if (block.error < best.error)
+						{
+							best = block;
+							best_mode = mode;
+						}
+					}
+				}
+			}
+
+			fix_anchors(best, *best_mode);
+			write_bc7_block(best, *best_mode, out);
+		}
+
+		void encode_block(const texels_t& texels, format::type f, bc7_quality::level quality, u8 alpha_threshold, u8* out)
+		{
+			u8 channel[16];
+			switch (f)
+			{
+			case format::bc1:
+				encode_color_block(texels, false, alpha_threshold, out);
+				break;
+			case format::bc3:
+				for (u32 i{ 0 }; i < 16; ++i) channel[i] = texels[i][3];
+				encode_bc4(channel, out);
+				encode_color_block(texels, true, 0, out + 8);
+				break;
+			case format::bc4:
+				for (u32 i{ 0 }; i < 16; ++i) channel[i] = texels[i][0];
+				encode_bc4(channel, out);
+				break;
+			case format::bc5:
+				for (u32 i{ 0 }; i < 16; ++i) channel[i] = texels[i][0];
+				encode_bc4(channel, out);
+				for (u32 i{ 0 }; i < 16; ++i) channel[i] = texels[i][1];
+				encode_bc4(channel, out + 8);
+				break;
+			case format::bc7:
+				encode_bc7(texels, quality, out);
+				break;
+			default: assert(false);
+			}
+		}
+	} // anonymous namespace
+
+	format::type select_format(const image& src, bool prefer_bc7, bool& is_normal_map)
+	{
+		assert(src.pixels && src.width && src.height);
+		is_normal_map = false;
+		bool grayscale{ true }, opaque{ true };
+		for (u32 y{ 0 }; y < src.height && (grayscale || opaque); ++y)
+		{
+			const u8* texel{ src.pixels + (u64)y * src.row_pitch };
+			for (u32 x{ 0 }; x < src.width; ++x, texel += 4)
+			{
+				grayscale &= texel[0] == texel[1] && texel[1] == texel[2];
+				opaque &= texel[3] == 255;
+			}
+		}
+
+		if (grayscale && opaque) return format::bc4;
+		if (src.row_pitch == src.width * 4 && tools::is_normal_map(src.pixels, (u64)src.row_pitch * src.height, false))
+		{
+			is_normal_map = true;
+			return format::bc5;
+		}
+		return prefer_bc7 ? format::bc7 : opaque ? format::bc1 : format::bc3;
+	}
+
+	void compress(const image& src, format::type f, u8* output, bc7_quality::level quality, u8 alpha_threshold)
+	{
+		assert(src.pixels && src.width && src.height && output && f < format::count);
+		const u32 blocks_x{ (src.width + 3) >> 2 };
+		const u32 blocks_y{ (src.height + 3) >> 2 };
+		const u32 pitch{ row_pitch(f, src.width) };
+		const u32 size{ block_size(f) };
+
+		std::vector<u32> rows(blocks_y);
+		std::iota(rows.begin(), rows.end(), 0u);
+		std::for_each(std::execution::par, rows.begin(), rows.end(), [&](u32 block_y) {
+			u8* out{ output + (u64)block_y * pitch };
+			for (u32 block_x{ 0 }; block_x < blocks_x; ++block_x, out += size)
+			{
+				texels_t texels;
+				load_block(src, block_x, block_y, texels);
+				encode_block(texels, f, quality, alpha_threshold, out);
+			}
+		});
+	}
+
+	bool decompress_block(const u8 *const block, format::type f, u8 (&texels)[16][4])
+	{
+		switch (f)
+		{
+		case format::bc1: content::decode_bc1(block, texels); return true;
+		case format::bc3: content::decode_bc3(block, texels); return true;
+		case format::bc4: content::decode_bc4(block, texels); return true;
+		case format::bc5: content::decode_bc5(block, texels); return true;
+		case format::bc7: content::decode_bc7(block, texels); return true;
+		default: break;
+		}
+		return false;
+	}
+}
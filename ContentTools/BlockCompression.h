@@ -0,0 +1,66 @@
+#pragma once
+
+// Only the primitive types and the standard library, so textures can be cooked on platforms without DirectXTex and D3D11
+#include "Common/PrimitiveTypes.h"
+
+namespace primal::tools::block_compression
+{
+	struct format
+	{
+		enum type : u32
+		{
+			bc1 = 0,
+			bc3,
+			bc4,		// Red channel
+			bc5,		// Red and green channels
+			bc7,
+
+			count
+		};
+	};
+
+	// fast only uses BC7 mode 6. normal also tries a two-subset mode for blocks that mode 6 doesn't fit well, mode 1 for opaque
+	// blocks and mode 7 for the others, with the 4 partitions that fit the block best. best tries every partition for every
+	// block, mode 3 as well for opaque ones, and refines the endpoints longer.
+	struct bc7_quality
+	{
+		enum level : u32
+		{
+			fast = 0,
+			normal,
+			best,
+
+			count
+		};
+	};
+
+	constexpr bc7_quality::level default_bc7_quality{ bc7_quality::normal };
+	constexpr u8 default_alpha_threshold{ 128 };		// BC1 texels with less alpha are transparent
+
+	// 8-bit RGBA texels, rows are row_pitch bytes apart
+	struct image
+	{
+		const u8*								pixels;
+		u32										width;
+		u32										height;
+		u32										row_pitch;
+	};
+
+	[[nodiscard]] constexpr u32 block_size(format::type f) { return f == format::bc1 || f == format::bc4 ? 8 : 16; }
+	// Same pitches as the DXGI block compressed formats, so compressed images drop into texture_data's subresources
+	[[nodiscard]] constexpr u32 row_pitch(format::type f, u32 width) { return ((width + 3) >> 2) * block_size(f); }
+	[[nodiscard]] constexpr u32 slice_pitch(format::type f, u32 width, u32 height) { return row_pitch(f, width) * ((height + 3) >> 2); }
+
+	// Portable version of the importer's determine_output_format: BC4 for opaque grayscale images, BC5 for normal maps
+	// (see is_normal_map), otherwise BC7 when it's preferred or BC1 and BC3 for opaque and transparent images.
+	[[nodiscard]] format::type select_format(const image& src, bool prefer_bc7, bool& is_normal_map);
+
+	// Compresses src into output, which has slice_pitch(f, src.width, src.height) bytes. Rows of blocks are compressed in parallel.
+	// Blocks past the right or bottom edge repeat the last column or row.
+	void compress(const image& src, format::type f, u8* output, bc7_quality::level quality = default_bc7_quality,
+		u8 alpha_threshold = default_alpha_threshold);
+
+	// Decodes a block to 16 RGBA texels in row order with the engine's decoders (Content/BlockDecompression.h), so BC4 and BC5
+	// decode to red and to red and green with opaque alpha. Returns false for unknown formats.
+	bool decompress_block(const u8 *const block, format::type f, u8 (&texels)[16][4]);
+}
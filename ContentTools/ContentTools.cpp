@@ -1,12 +1,450 @@
 #include "ToolsCommon.h"
+#include "Geometry.h"
+#include "MeshSimplifier.h"
+#include "ImportPipeline.h"
+#include "BlockCompression.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
 
 namespace primal::tools
 {
 	extern void ShutDownTextureTools();
+	extern bool load_fbx_scene(const char* file, scene& scene, scene_data& data, progression *const progression);
+	extern bool load_obj_scene(const char* file, scene& scene);
+	extern bool load_rgba_image(const char* file_name, utl::vector<u8>& pixels, u32& width, u32& height);
+
+	namespace
+	{
+		// Next argument of a command line, quotes group arguments with spaces
+		std::string next_argument(const char*& cmd_line)
+		{
+			while (*cmd_line == ' ') ++cmd_line;
+			const char delimiter{ *cmd_line == '"' ? '"' : ' ' };
+			if (delimiter == '"') ++cmd_line;
+
+			std::string argument;
+			while (*cmd_line && *cmd_line != delimiter) argument += *cmd_line++;
+			if (*cmd_line) ++cmd_line;
+			return argument;
+		}
+
+		// Generated LODs have fewer triangles than the LOD before them, increasing thresholds
+		// and stay within the error budget of mesh_simplifier
+		bool check_lods(const lod_group& lod)
+		{
+			utl::vector<u32> triangles;
+			utl::vector<f32> thresholds;
+			f32 extent{ 0.f };
+			for (const auto& m : lod.meshes)
+			{
+				const u32 lod_id{ m.lod_id == u32_invalid_id ? 0 : m.lod_id };
+				if (lod_id >= triangles.size())
+				{
+					triangles.resize(lod_id + 1, 0);
+					thresholds.resize(lod_id + 1, m.lod_threshold);
+				}
+				triangles[lod_id] += (u32)m.indices.size() / 3;
+				if (lod_id == 0) extent = std::max(extent, mesh_simplifier::mesh_extent(m.vertices));
+			}
+
+			bool passed{ true };
+			for (u32 i{ 1 }; i < triangles.size(); ++i)
+			{
+				passed &= triangles[i] < triangles[i - 1] && thresholds[i] > thresholds[i - 1];
+			}
+			for (const auto& m : lod.meshes)
+			{
+				passed &= m.lod_error <= mesh_simplifier::max_lod_error * extent;
+			}
+			return passed;
+		}
+
+		// The normal smoothing before positions were welded: every position gathers the references to it and erases the ones
+		// it merges. CheckNormals compares smooth_normals against it.
+		void reference_smooth_normals(mesh& m, f32 smoothing_angle)
+		{
+			using namespace DirectX;
+			const f32 cos_alpha{ XMScalarCos(math::pi - smoothing_angle * math::pi / 180.f) };
+			const bool is_hard_edge{ XMScalarNearEqual(smoothing_angle, 180.f, math::epsilon) };
+			const bool is_soft_edge{ XMScalarNearEqual(smoothing_angle, 0.f, math::epsilon) };
+			const u32 num_indices{ (u32)m.raw_indices.size() };
+			const u32 num_vertices{ (u32)m.positions.size() };
+
+			m.indices.resize(num_indices);
+			m.vertices.clear();
+
+			utl::vector<utl::vector<u32>> idx_ref(num_vertices);
+			for (u32 i{ 0 }; i < num_indices; ++i) idx_ref[m.raw_indices[i]].emplace_back(i);
+			for (u32 i{ 0 }; i < num_vertices; ++i)
+			{
+				auto& refs{ idx_ref[i] };
+				u32 num_refs{ (u32)refs.size() };
+				for (u32 j{ 0 }; j < num_refs; ++j)
+				{
+					m.indices[refs[j]] = (u32)m.vertices.size();
+					vertex& v{ m.vertices.emplace_back() };
+					v.position = m.positions[m.raw_indices[refs[j]]];
+
+					XMVECTOR n1{ XMLoadFloat3(&m.normals[refs[j]]) };
+					if (!is_hard_edge)
+					{
+						for (u32 k{ j + 1 }; k < num_refs; ++k)
+						{
+							f32 cos_theta{ 0.f };
+							XMVECTOR n2{ XMLoadFloat3(&m.normals[refs[k]]) };
+							if (!is_soft_edge)
+							{
+								XMStoreFloat(&cos_theta, XMVector3Dot(n1, n2) * XMVector3ReciprocalLength(n1));
+							}
+
+							if (is_soft_edge || cos_theta >= cos_alpha)
+							{
+								n1 += n2;
+								m.indices[refs[k]] = m.indices[refs[j]];
+								refs.erase(refs.begin() + k);
+								--num_refs;
+								--k;
+							}
+						}
+					}
+					XMStoreFloat3(&v.normal, XMVector3Normalize(n1));
+				}
+			}
+		}
+
+		// size x size quads of a bumpy height field, with the face normal of its triangle for every index. A split grid gives
+		// each triangle its own three positions, like a mesh that was exported without shared vertices.
+		mesh make_grid(u32 size, bool split)
+		{
+			using namespace DirectX;
+			const u32 row{ size + 1 };
+			utl::vector<math::v3> grid(row * row);
+			for (u32 z{ 0 }; z < row; ++z)
+				for (u32 x{ 0 }; x < row; ++x)
+				{
+					const f32 fx{ (f32)x }, fz{ (f32)z };
+					grid[z * row + x] = { fx, 0.25f * std::sin(fx * 0.7f) * std::cos(fz * 0.45f) + 0.05f * std::sin(fx * fz * 0.03f), fz };
+				}
+
+			mesh m{};
+			m.raw_indices.reserve(size * size * 6);
+			for (u32 z{ 0 }; z < size; ++z)
+				for (u32 x{ 0 }; x < size; ++x)
+				{
+					const u32 a{ z * row + x }, b{ a + 1 }, c{ a + row }, d{ c + 1 };
+					for (const u32 i : { a, c, b, b, c, d })
+					{
+						if (split)
+						{
+							m.raw_indices.emplace_back((u32)m.positions.size());
+							m.positions.emplace_back(grid[i]);
+						}
+						else
+						{
+							m.raw_indices.emplace_back(i);
+						}
+					}
+				}
+			if (!split) m.positions.swap(grid);
+
+			const u32 num_indices{ (u32)m.raw_indices.size() };
+			m.normals.resize(num_indices);
+			for (u32 i{ 0 }; i < num_indices; i += 3)
+			{
+				const XMVECTOR v0{ XMLoadFloat3(&m.positions[m.raw_indices[i]]) };
+				const XMVECTOR v1{ XMLoadFloat3(&m.positions[m.raw_indices[i + 1]]) };
+				const XMVECTOR v2{ XMLoadFloat3(&m.positions[m.raw_indices[i + 2]]) };
+				XMStoreFloat3(&m.normals[i], XMVector3Normalize(XMVector3Cross(v1 - v0, v2 - v0)));
+				m.normals[i + 1] = m.normals[i + 2] = m.normals[i];
+			}
+			return m;
+		}
+
+		// Same vertices and indices, positions and normals compared bit for bit
+		bool same_vertices(const mesh& a, const mesh& b)
+		{
+			if (a.vertices.size() != b.vertices.size() || a.indices.size() != b.indices.size()) return false;
+			if (memcmp(a.indices.data(), b.indices.data(), a.indices.size() * sizeof(u32)) != 0) return false;
+			for (u32 i{ 0 }; i < a.vertices.size(); ++i)
+			{
+				if (memcmp(&a.vertices[i].position, &b.vertices[i].position, sizeof(math::v3)) != 0 ||
+					memcmp(&a.vertices[i].normal, &b.vertices[i].normal, sizeof(math::v3)) != 0) return false;
+			}
+			return true;
+		}
+
+		template<typename F>
+		f32 time_ms(F&& f)
+		{
+			const auto start{ std::chrono::steady_clock::now() };
+			f();
+			return std::chrono::duration<f32, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+
+		// PSNR of src compressed to f, decoded with the engine's decoders, over the channels f keeps: red for BC4, red and green
+		// for BC5, the colors for BC1, whose alpha is only a threshold, and all four for BC3 and BC7. 99 dB when nothing was lost.
+		f32 compression_psnr(const block_compression::image& src, block_compression::format::type f, const u8 *const blocks)
+		{
+			using namespace block_compression;
+			const u32 channel_count{ f == format::bc4 ? 1u : f == format::bc5 ? 2u : f == format::bc1 ? 3u : 4u };
+			const u32 blocks_x{ (src.width + 3) >> 2 };
+			const u32 blocks_y{ (src.height + 3) >> 2 };
+			u64 squared_error{ 0 };
+			for (u32 block_y{ 0 }; block_y < blocks_y; ++block_y)
+				for (u32 block_x{ 0 }; block_x < blocks_x; ++block_x)
+				{
+					u8 texels[16][4];
+					decompress_block(blocks + (u64)block_y * row_pitch(f, src.width) + block_x * block_size(f), f, texels);
+					for (u32 i{ 0 }; i < 16; ++i)
+					{
+						const u32 x{ block_x * 4 + (i & 3) }, y{ block_y * 4 + (i >> 2) };
+						if (x >= src.width || y >= src.height) continue;
+						const u8 *const texel{ src.pixels + (u64)y * src.row_pitch + x * 4 };
+						for (u32 c{ 0 }; c < channel_count; ++c)
+						{
+							const s32 d{ (s32)texel[c] - (s32)texels[i][c] };
+							squared_error += (u64)(d * d);
+						}
+					}
+				}
+
+			if (!squared_error) return 99.f;
+			const f32 mse{ (f32)squared_error / ((f32)src.width * (f32)src.height * (f32)channel_count) };
+			return 10.f * std::log10(255.f * 255.f / mse);
+		}
+	} // anonymous namespace
 }
 
 EDITOR_INTERFACE void ShutDownContentTools()
 {
 	using namespace primal::tools;
 	ShutDownTextureTools();
-}
\ No newline at end of file
+}
+
+// Headless driver for the geometry pipeline, run as
+//		rundll32 ContentTools.dll,ProcessGeometry <file.fbx|file.obj> [report.csv]
+// Imports the file with the editor's default settings, runs process_scene and writes a row per mesh to the report
+// (<file>.csv by default) with its LOD, vertex cache statistics, simplification error and meshlet count. The last row says whether
+// the LOD chains passed check_lods.
+EDITOR_INTERFACE void CALLBACK ProcessGeometry(HWND, HINSTANCE, LPSTR cmd_line, int)
+{
+	using namespace primal::tools;
+	const char* arguments{ cmd_line ? cmd_line : "" };
+	const std::string file{ next_argument(arguments) };
+	std::string report_file{ next_argument(arguments) };
+	if (file.empty()) return;
+	if (report_file.empty()) report_file = file + ".csv";
+
+	scene_data data{};
+	data.settings = default_geometry_import_settings;
+	scene scene{};
+	progression progression{};
+
+	const std::string extension{ file.size() > 4 ? file.substr(file.size() - 4) : std::string{} };
+	const bool loaded{ _stricmp(extension.c_str(), ".obj") == 0 ? load_obj_scene(file.c_str(), scene) :
+		load_fbx_scene(file.c_str(), scene, data, &progression) };
+
+	std::ofstream report{ report_file, std::ios::out | std::ios::trunc };
+	if (!report) return;
+	if (!loaded)
+	{
+		report << "failed to load " << file << '\n';
+		return;
+	}
+
+	process_scene(scene, data.settings, &progression);
+
+	bool passed{ true };
+	report << "lod_group,mesh,lod_id,lod_threshold,lod_error,triangles,vertices,acmr_before,acmr_after,atvr_before,atvr_after,meshlets\n";
+	for (const auto& lod : scene.lod_groups)
+	{
+		for (const auto& m : lod.meshes)
+		{
+			report << lod.name << ',' << m.name << ',' << m.lod_id << ',' << m.lod_threshold << ',' << m.lod_error << ','
+				<< m.indices.size() / 3 << ',' << m.vertices.size() << ','
+				<< m.cache_before.acmr << ',' << m.cache_after.acmr << ',' << m.cache_before.atvr << ',' << m.cache_after.atvr << ',' << m.meshlets.size() << '\n';
+		}
+		passed &= check_lods(lod);
+	}
+	report << "lod_check," << (passed ? "passed" : "failed") << '\n';
+}
+
+// Headless check of the normal smoothing, run as
+//		rundll32 ContentTools.dll,CheckNormals [report.csv]
+// Smooths generated height fields with smooth_normals and with the smoothing it replaced, and writes a row per case to the
+// report (check_normals.csv by default):
+//		equivalence: without welding both give the same vertices and indices, at smoothing angles from 0 to 180 degrees
+//		weld: a grid split into separate triangles welds back to the vertex count of the shared grid
+//		benchmark: both on a 1M-triangle grid at the editor's default angle, smooth_normals with and without welding
+// The last row says whether all checks passed.
+EDITOR_INTERFACE void CALLBACK CheckNormals(HWND, HINSTANCE, LPSTR cmd_line, int)
+{
+	using namespace primal::tools;
+	const char* arguments{ cmd_line ? cmd_line : "" };
+	std::string report_file{ next_argument(arguments) };
+	if (report_file.empty()) report_file = "check_normals.csv";
+
+	std::ofstream report{ report_file, std::ios::out | std::ios::trunc };
+	if (!report) return;
+
+	constexpr u32 check_size{ 64 };
+	constexpr u32 benchmark_size{ 708 };		// 1,002,528 triangles
+	bool passed{ true };
+	report << "case,smoothing_angle,triangles,vertices,reference_vertices,milliseconds,reference_milliseconds,result\n";
+
+	constexpr f32 angles[]{ 0.f, 30.f, 60.f, 90.f, 178.f, 180.f };
+	for (const f32 angle : angles)
+	{
+		mesh reference{ make_grid(check_size, false) };
+		mesh m{ make_grid(check_size, false) };
+		const f32 reference_ms{ time_ms([&] { reference_smooth_normals(reference, angle); }) };
+		const f32 ms{ time_ms([&] { smooth_normals(m, angle, false); }) };
+		const bool same{ same_vertices(m, reference) };
+		passed &= same;
+		report << "equivalence," << angle << ',' << m.indices.size() / 3 << ',' << m.vertices.size() << ',' << reference.vertices.size() << ','
+			<< ms << ',' << reference_ms << ',' << (same ? "passed" : "failed") << '\n';
+	}
+
+	{
+		// Fully smoothed, every position of the shared grid ends up as one vertex
+		mesh reference{ make_grid(check_size, false) };
+		mesh m{ make_grid(check_size, true) };
+		const f32 reference_ms{ time_ms([&] { reference_smooth_normals(reference, 0.f); }) };
+		const f32 ms{ time_ms([&] { smooth_normals(m, 0.f, true); }) };
+		const bool welded{ m.vertices.size() == reference.vertices.size() };
+		passed &= welded;
+		report << "weld,0," << m.indices.size() / 3 << ',' << m.vertices.size() << ',' << reference.vertices.size() << ','
+			<< ms << ',' << reference_ms << ',' << (welded ? "passed" : "failed") << '\n';
+	}
+
+	{
+		const f32 angle{ default_geometry_import_settings.smoothing_angle };
+		mesh reference{ make_grid(benchmark_size, false) };
+		mesh m{ make_grid(benchmark_size, false) };
+		const f32 reference_ms{ time_ms([&] { reference_smooth_normals(reference, angle); }) };
+		const f32 ms{ time_ms([&] { smooth_normals(m, angle, false); }) };
+		const bool same{ same_vertices(m, reference) };
+		passed &= same;
+		report << "benchmark," << angle << ',' << m.indices.size() / 3 << ',' << m.vertices.size() << ',' << reference.vertices.size() << ','
+			<< ms << ',' << reference_ms << ',' << (same ? "passed" : "failed") << '\n';
+
+		const f32 weld_ms{ time_ms([&] { smooth_normals(m, angle, true); }) };
+		report << "benchmark_weld," << angle << ',' << m.indices.size() / 3 << ',' << m.vertices.size() << ',' << reference.vertices.size() << ','
+			<< weld_ms << ',' << reference_ms << ",timed\n";
+	}
+
+	report << "check," << (passed ? "passed" : "failed") << '\n';
+}
+
+// Headless check of the portable block compressor, run as
+//		rundll32 ContentTools.dll,CheckBlockCompression <image|directory> [report.csv]
+// Compresses the image, or every image in the directory (EngineTest\assets\images for example), to the format select_format
+// picks without BC7 and to BC7 at every quality. Writes a row per image and format to the report (block_compression.csv
+// by default) with the PSNR of the decoded texels and the throughput of compress. Each BC7 quality searches everything
+// the one below it does, so the last row says whether no image lost PSNR from one quality to the next.
+EDITOR_INTERFACE void CALLBACK CheckBlockCompression(HWND, HINSTANCE, LPSTR cmd_line, int)
+{
+	using namespace primal::tools;
+	using namespace primal::tools::block_compression;
+	namespace fs = std::filesystem;
+	const char* arguments{ cmd_line ? cmd_line : "" };
+	const std::string source{ next_argument(arguments) };
+	std::string report_file{ next_argument(arguments) };
+	if (source.empty()) return;
+	if (report_file.empty()) report_file = "block_compression.csv";
+
+	std::error_code error;
+	primal::utl::vector<std::string> files;
+	if (fs::is_directory(source, error))
+	{
+		for (const auto& entry : fs::directory_iterator{ source, error })
+		{
+			if (entry.is_regular_file(error)) files.emplace_back(entry.path().string());
+		}
+		std::sort(files.begin(), files.end());
+	}
+	else
+	{
+		files.emplace_back(source);
+	}
+
+	std::ofstream report{ report_file, std::ios::out | std::ios::trunc };
+	if (!report) return;
+
+	// For the texture importer's WIC decoders
+	const HRESULT hr{ CoInitializeEx(nullptr, COINIT_MULTITHREADED) };
+
+	constexpr const char* format_names[format::count]{ "bc1", "bc3", "bc4", "bc5", "bc7" };
+	constexpr const char* quality_names[bc7_quality::count]{ "fast", "normal", "best" };
+	bool passed{ true };
+	report << "image,width,height,format,bc7_quality,psnr,milliseconds,megapixels_per_second\n";
+	for (const std::string& file : files)
+	{
+		primal::utl::vector<u8> pixels;
+		u32 width{ 0 }, height{ 0 };
+		// Skips the files that aren't images
+		if (!load_rgba_image(file.c_str(), pixels, width, height)) continue;
+
+		const image src{ pixels.data(), width, height, width * 4 };
+		const std::string name{ fs::path{ file }.filename().string() };
+		auto run{ [&](format::type f, bc7_quality::level quality) {
+			primal::utl::vector<u8> blocks(slice_pitch(f, width, height));
+			const f32 ms{ time_ms([&] { compress(src, f, blocks.data(), quality); }) };
+			const f32 psnr{ compression_psnr(src, f, blocks.data()) };
+			report << name << ',' << width << ',' << height << ',' << format_names[f] << ',' << (f == format::bc7 ? quality_names[quality] : "")
+				<< ',' << psnr << ',' << ms << ',' << (f32)width * (f32)height / (std::max(ms, 1e-3f) * 1000.f) << '\n';
+			return psnr;
+		} };
+
+		bool is_normal_map;
+		run(select_format(src, false, is_normal_map), default_bc7_quality);
+		f32 previous_psnr{ 0.f };
+		for (u32 quality{ 0 }; quality < bc7_quality::count; ++quality)
+		{
+			const f32 psnr{ run(format::bc7, (bc7_quality::level)quality) };
+			passed &= psnr >= previous_psnr;
+			previous_psnr = psnr;
+		}
+	}
+
+	if (SUCCEEDED(hr)) CoUninitialize();
+	report << "check," << (passed ? "passed" : "failed") << '\n';
+}
+
+// Headless import pipeline, run as
+//		rundll32 ContentTools.dll,ImportAssets <file|directory> <cache directory> [report.csv]
+// Imports the OBJ, FBX and image files whose outputs in the cache directory are out of date (see import_pipeline::import_assets)
+// and writes a row per asset to the report (import.csv in the cache directory by default) with its status, import time
+// and number of outputs. The last row has the totals.
+EDITOR_INTERFACE void CALLBACK ImportAssets(HWND, HINSTANCE, LPSTR cmd_line, int)
+{
+	using namespace primal::tools;
+	using namespace primal::tools::import_pipeline;
+	const char* arguments{ cmd_line ? cmd_line : "" };
+	const std::string source{ next_argument(arguments) };
+	const std::string cache_directory{ next_argument(arguments) };
+	std::string report_file{ next_argument(arguments) };
+	if (source.empty() || cache_directory.empty()) return;
+	if (report_file.empty()) report_file = cache_directory + "\\import.csv";
+
+	const auto start{ std::chrono::steady_clock::now() };
+	const primal::utl::vector<import_result> results{ import_assets(source.c_str(), cache_directory.c_str()) };
+	const f32 milliseconds{ std::chrono::duration<f32, std::milli>(std::chrono::steady_clock::now() - start).count() };
+
+	std::ofstream report{ report_file, std::ios::out | std::ios::trunc };
+	if (!report) return;
+
+	constexpr const char* status_names[import_status::count]{ "imported", "up_to_date", "failed" };
+	u32 counts[import_status::count]{};
+	report << "asset,type,status,milliseconds,outputs\n";
+	for (const auto& result : results)
+	{
+		++counts[result.status];
+		report << result.path << ',' << result.type << ',' << status_names[result.status] << ',' << result.milliseconds << ',' << result.output_count << '\n';
+	}
+	report << "total,," << counts[import_status::imported] << " imported " << counts[import_status::up_to_date] << " up to date "
+		<< counts[import_status::failed] << " failed," << milliseconds << ",\n";
+}
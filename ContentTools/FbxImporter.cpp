@@ -353,21 +353,24 @@ namespace primal::tools
 		}
 	}
 
+	bool load_fbx_scene(const char* file, scene& scene, scene_data& data, progression *const progression)
+	{
+		// NOTE: anything that involves using the FBX SDK should be single-threaded
+		std::lock_guard lock{ fbx_mutex };
+		fbx_context fbx_context{ file, &scene, &data, progression };
+		if (fbx_context.is_valid())
+		{
+			fbx_context.get_scene();
+		}
+		return !scene.lod_groups.empty();
+	}
+
 	EDITOR_INTERFACE void ImportFbx(const char* file, scene_data* data, progression::progress_callback callback)
 	{
 		assert(file && data);
 		scene scene{};
 		progression progression{ callback };
-		// NOTE: anything that involves using the FBX SDK should be single-threaded
-		{
-			std::lock_guard lock{ fbx_mutex };
-			fbx_context fbx_context{ file, &scene, data, &progression };
-			if (fbx_context.is_valid())
-			{
-				fbx_context.get_scene();
-			}
-		}
-		if(scene.lod_groups.empty())
+		if (!load_fbx_scene(file, scene, *data, &progression))
 		{
 			// TODO: send fasilure log message to editor
 			return;
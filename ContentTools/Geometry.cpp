@@ -1,4 +1,8 @@
 #include "Geometry.h"
+#include "MeshSimplifier.h"
+#include <cfloat>
+#include <cmath>
+#include <execution>
 #include "../Engine/Utilities/IOStream.h"
 
 
@@ -35,7 +39,92 @@ namespace primal::tools
 			}
 		}
 
-		void process_normals(mesh& m, f32 smoothing_angle)
+		// Gives positions closer than vertex_welding::tolerance the same id. Ids are numbered in the order of the positions,
+		// a position takes the lowest id within the tolerance. Positions are hashed by grid cell. Cells are much larger than
+		// the tolerance, so most positions only look in their own cell and the neighbors of the faces they're close to are rarely searched.
+		u32 weld_positions(const utl::vector<v3>& positions, utl::vector<u32>& weld_ids)
+		{
+			const u32 num_positions{ (u32)positions.size() };
+			weld_ids.resize(num_positions);
+
+			XMVECTOR box_min{ XMLoadFloat3(&positions[0]) };
+			XMVECTOR box_max{ box_min };
+			for (const auto& p : positions)
+			{
+				box_min = XMVectorMin(box_min, XMLoadFloat3(&p));
+				box_max = XMVectorMax(box_max, XMLoadFloat3(&p));
+			}
+			const f32 diagonal{ XMVectorGetX(XMVector3Length(box_max - box_min)) };
+			const f32 tolerance{ diagonal > 0.f ? diagonal * vertex_welding::tolerance : 1.f };
+			const f32 tolerance_sq{ tolerance * tolerance };
+			constexpr f32 cell_scale{ 64.f };
+			const f32 cell_size{ cell_scale * tolerance };
+			v3 origin{};
+			XMStoreFloat3(&origin, box_min);
+
+			auto cell_key{ [](s64 x, s64 y, s64 z) {
+				constexpr u64 mask{ (1ull << 21) - 1 };
+				return ((u64)x & mask) | (((u64)y & mask) << 21) | (((u64)z & mask) << 42);
+			} };
+			auto cell_hash{ [](u64 key) { key ^= key >> 33; key *= 0xff51afd7ed558ccdull; key ^= key >> 33; return key; } };
+
+			// Open addressing, each slot holds the last position that started an id in that cell. Keys wrap after
+			// 2^21 cells per axis, so cells can share a slot, but positions are always compared before they're welded.
+			struct cell
+			{
+				u64							key{ u64_invalid_id };
+				u32							head{ u32_invalid_id };
+			};
+			u32 table_size{ 1 };
+			while (table_size < num_positions * 2) table_size <<= 1;
+			utl::vector<cell> cells(table_size);
+			utl::vector<u32> next(num_positions, u32_invalid_id);			// Earlier positions that started an id in the same slot
+
+			auto find_slot{ [&](u64 key) {
+				u32 slot{ (u32)cell_hash(key) & (table_size - 1) };
+				while (cells[slot].key != u64_invalid_id && cells[slot].key != key) slot = (slot + 1) & (table_size - 1);
+				return slot;
+			} };
+
+			// Neighbors across the faces that are closer than the tolerance are searched too
+			auto first_cell{ [](f32 coord, s64 c) { return coord - c < 1.f / cell_scale ? c - 1 : c; } };
+			auto last_cell{ [](f32 coord, s64 c) { return c + 1 - coord < 1.f / cell_scale ? c + 1 : c; } };
+
+			u32 num_ids{ 0 };
+			for (u32 i{ 0 }; i < num_positions; ++i)
+			{
+				const v3& p{ positions[i] };
+				const v3 f{ (p.x - origin.x) / cell_size, (p.y - origin.y) / cell_size, (p.z - origin.z) / cell_size };
+				const s64 cx{ (s64)std::floor(f.x) }, cy{ (s64)std::floor(f.y) }, cz{ (s64)std::floor(f.z) };
+				u32 id{ u32_invalid_id };
+				for (s64 z{ first_cell(f.z, cz) }; z <= last_cell(f.z, cz); ++z)
+					for (s64 y{ first_cell(f.y, cy) }; y <= last_cell(f.y, cy); ++y)
+						for (s64 x{ first_cell(f.x, cx) }; x <= last_cell(f.x, cx); ++x)
+						{
+							for (u32 j{ cells[find_slot(cell_key(x, y, z))].head }; j != u32_invalid_id; j = next[j])
+							{
+								const v3& q{ positions[j] };
+								const f32 dx{ p.x - q.x }, dy{ p.y - q.y }, dz{ p.z - q.z };
+								if (dx * dx + dy * dy + dz * dz <= tolerance_sq && weld_ids[j] < id) id = weld_ids[j];
+							}
+						}
+
+				if (id == u32_invalid_id)
+				{
+					id = num_ids++;
+					const u64 key{ cell_key(cx, cy, cz) };
+					cell& slot{ cells[find_slot(key)] };
+					slot.key = key;
+					next[i] = slot.head;
+					slot.head = i;
+				}
+				weld_ids[i] = id;
+			}
+
+			return num_ids;
+		}
+
+		void process_normals(mesh& m, f32 smoothing_angle, bool weld)
 		{
 			const f32 cos_alpha{ XMScalarCos(pi - smoothing_angle * pi / 180.f) };
 			const bool is_hard_edge{ XMScalarNearEqual(smoothing_angle, 180.f, epsilon) };
@@ -45,15 +134,36 @@ namespace primal::tools
 			assert(num_indices && num_vertices);
 
 			m.indices.resize(num_indices);
+			m.vertices.clear();
+			m.vertices.reserve(num_vertices);
 
-			utl::vector<utl::vector<u32>> idx_ref(num_vertices);
-			for (u32 i{ 0 }; i < num_indices; ++i) idx_ref[m.raw_indices[i]].emplace_back(i);
-			for (u32 i{ 0 }; i < num_vertices; ++i)
+			utl::vector<u32> weld_ids;
+			u32 num_ids{ num_vertices };
+			if (weld)
 			{
-				auto& refs{ idx_ref[i] };
-				u32 num_refs{ (u32)refs.size() };
-				for (u32 j{ 0 }; j < num_refs; ++j)
+				num_ids = weld_positions(m.positions, weld_ids);
+			}
+			auto weld_id{ [&](u32 position) { return weld ? weld_ids[position] : position; } };
+
+			// References to each welded position, in index order
+			utl::vector<u32> offsets(num_ids + 1, 0);
+			for (u32 i{ 0 }; i < num_indices; ++i) ++offsets[weld_id(m.raw_indices[i]) + 1];
+			for (u32 i{ 0 }; i < num_ids; ++i) offsets[i + 1] += offsets[i];
+			utl::vector<u32> refs(num_indices);
+			{
+				utl::vector<u32> fill(offsets.begin(), offsets.end() - 1);
+				for (u32 i{ 0 }; i < num_indices; ++i) refs[fill[weld_id(m.raw_indices[i])]++] = i;
+			}
+
+			// References that were merged into an earlier vertex are marked instead of erased
+			utl::vector<u8> merged(num_indices, 0);
+			for (u32 i{ 0 }; i < num_ids; ++i)
+			{
+				const u32 first{ offsets[i] };
+				const u32 last{ offsets[i + 1] };
+				for (u32 j{ first }; j < last; ++j)
 				{
+					if (merged[j]) continue;
 					m.indices[refs[j]] = (u32)m.vertices.size();
 					vertex& v{ m.vertices.emplace_back() };
 					v.position = m.positions[m.raw_indices[refs[j]]];
@@ -61,8 +171,9 @@ namespace primal::tools
 					XMVECTOR n1{ XMLoadFloat3(&m.normals[refs[j]]) };
 					if (!is_hard_edge)
 					{
-						for (u32 k{ j + 1 }; k < num_refs; ++k)
+						for (u32 k{ j + 1 }; k < last; ++k)
 						{
+							if (merged[k]) continue;
 							// this value represents the cosine of the angle between nromals
 							f32 cos_theta{ 0.f };
 							XMVECTOR n2{ XMLoadFloat3(&m.normals[refs[k]]) };
@@ -79,9 +190,7 @@ namespace primal::tools
 							{
 								n1 += n2;
 								m.indices[refs[k]] = m.indices[refs[j]];
-								refs.erase(refs.begin() + k);
-								--num_refs;
-								--k;
+								merged[k] = 1;
 							}
 						}
 					}
@@ -340,6 +449,35 @@ namespace primal::tools
 			return type;
 		}
 
+		// Reorders the triangles for the post-transform cache and for overdraw, then the vertices in the order
+		// the triangles fetch them
+		void optimize_mesh(mesh& m)
+		{
+			const u32 num_indices{ (u32)m.indices.size() };
+			m.cache_before = mesh_optimizer::analyze_vertex_cache(m.indices.data(), num_indices, (u32)m.vertices.size());
+
+			mesh_optimizer::optimize_vertex_cache(m.indices.data(), num_indices, (u32)m.vertices.size());
+			mesh_optimizer::optimize_overdraw(m.indices.data(), num_indices, (const u8*)&m.vertices[0].position, (u32)m.vertices.size(), sizeof(vertex));
+			mesh_optimizer::optimize_vertex_fetch(m.indices, m.vertices);
+
+			m.cache_after = mesh_optimizer::analyze_vertex_cache(m.indices.data(), num_indices, (u32)m.vertices.size());
+		}
+
+		void build_meshlets(mesh& m)
+		{
+			if (m.vertices.empty()) return;
+
+			meshlet_builder::build_meshlets(m.indices, (const u8*)&m.vertices[0].position, (const u8*)&m.vertices[0].normal,
+				(u32)m.vertices.size(), sizeof(vertex), m.meshlets);
+
+			if constexpr (mesh_optimizer::enabled)
+			{
+				// Meshlets moved the triangles, so the vertices are renumbered to their new order
+				mesh_optimizer::optimize_vertex_fetch(m.indices, m.vertices);
+				m.cache_after = mesh_optimizer::analyze_vertex_cache(m.indices.data(), (u32)m.indices.size(), (u32)m.vertices.size());
+			}
+		}
+
 		void process_vertices(mesh& m, const geometry_import_settings& settings)
 		{
 			assert((m.raw_indices.size() % 3) == 0);
@@ -348,7 +486,7 @@ namespace primal::tools
 				recalculate_normals(m);
 			}
 
-			process_normals(m, settings.smoothing_angle);
+			process_normals(m, settings.smoothing_angle, vertex_welding::enabled);
 
 			if (!m.uv_sets.empty())
 			{
@@ -356,7 +494,68 @@ namespace primal::tools
 			}
 			
 			m.elements_type = determine_elements_type(m);
-			pack_vertices(m);
+		}
+
+		// Appends simplified copies of the meshes of a group that has no LODs in the source, one LOD per level.
+		// Every LOD is simplified from LOD 0 and the chain ends at the first LOD that doesn't get small enough.
+		void generate_lods(lod_group& lod)
+		{
+			using namespace mesh_simplifier;
+			u32 previous_triangles{ 0 };
+			for (const auto& m : lod.meshes)
+			{
+				if (m.lod_id != 0 && m.lod_id != u32_invalid_id) return;
+				previous_triangles += (u32)m.indices.size() / 3;
+			}
+
+			const u32 base_count{ (u32)lod.meshes.size() };
+			f32 previous_threshold{ 0.f };
+
+			for (u32 level{ 1 }; level < max_lod_count; ++level)
+			{
+				utl::vector<mesh> level_meshes;
+				u32 level_triangles{ 0 };
+				f32 level_error{ 0.f };
+				const f32 ratio{ powf(lod_triangle_ratio, (f32)level) };
+
+				for (u32 i{ 0 }; i < base_count; ++i)
+				{
+					const mesh& base{ lod.meshes[i] };
+					mesh& m{ level_meshes.emplace_back() };
+					m.name = base.name + "_LOD" + std::to_string(level);
+					m.elements_type = base.elements_type;
+					m.lod_id = level;
+					m.vertices = base.vertices;
+					m.indices = base.indices;
+
+					const u32 target_index_count{ (u32)((f32)(base.indices.size() / 3) * ratio) * 3 };
+					const simplify_result result{ simplify(m.indices, m.vertices, target_index_count, max_lod_error) };
+					mesh_optimizer::optimize_vertex_fetch(m.indices, m.vertices);
+
+					m.lod_error = result.error * mesh_extent(base.vertices);
+					level_error = std::max(level_error, m.lod_error);
+					level_triangles += result.index_count / 3;
+				}
+
+				// Not worth a LOD when the error budget stopped the simplifier early
+				if (level_triangles < min_lod_triangles || (f32)level_triangles > (f32)previous_triangles * 0.75f) break;
+
+				// Thresholds have to increase from LOD to LOD
+				const f32 threshold{ std::max(lod_threshold(level_error), std::nextafter(previous_threshold, FLT_MAX)) };
+				for (auto& m : level_meshes)
+				{
+					m.lod_threshold = threshold;
+					lod.meshes.emplace_back(m);
+				}
+
+				previous_triangles = level_triangles;
+				previous_threshold = threshold;
+			}
+
+			if (lod.meshes.size() > base_count)
+			{
+				for (u32 i{ 0 }; i < base_count; ++i) lod.meshes[i].lod_id = 0;
+			}
 		}
 
 		u64 get_mesh_size(const mesh& m)
@@ -381,7 +580,9 @@ namespace primal::tools
 				sizeof(u32) +									// LOD threshold
 				position_buffer_size +							// room for vertex position
 				element_buffer_size +							// room for vertex element
-				index_buffer_size								// room for indices
+				index_buffer_size +								// room for indices
+				su32 +											// number of meshlets
+				sizeof(content::meshlet) * m.meshlets.size()	// room for meshlets
 			};
 			return size;
 		}
@@ -456,6 +657,9 @@ namespace primal::tools
 				data = (const u8*)indices.data();
 			}
 			blob.write(data, index_buffer_size);
+			// meshlets
+			blob.write((u32)m.meshlets.size());
+			blob.write((const u8*)m.meshlets.data(), sizeof(content::meshlet) * m.meshlets.size());
 		}
 
 		bool split_meshes_by_material(u32 material_idx, const mesh& m, mesh& submesh)
@@ -562,12 +766,37 @@ namespace primal::tools
 		assert(progression);
 		split_meshes_by_material(scene, progression);
 
-		for(auto& lod : scene.lod_groups)
+		for (auto& lod : scene.lod_groups)
+		{
+			// Meshes don't share data until the LODs are generated. The editor's callback is only called from this thread.
+			std::for_each(std::execution::par, lod.meshes.begin(), lod.meshes.end(), [&settings](mesh& m) { process_vertices(m, settings); });
+			progression->callback(progression->value() + (u32)lod.meshes.size(), progression->max_value());
+
+			if constexpr (mesh_simplifier::generate_lods)
+			{
+				generate_lods(lod);
+			}
+
 			for (auto& m : lod.meshes)
 			{
-				process_vertices(m, settings);
-				progression->callback(progression->value() + 1, progression->max_value());
+				if constexpr (mesh_optimizer::enabled)
+				{
+					optimize_mesh(m);
+				}
+
+				if constexpr (meshlet_builder::enabled)
+				{
+					build_meshlets(m);
+				}
+
+				pack_vertices(m);
 			}
+		}
+	}
+
+	void smooth_normals(mesh& m, f32 smoothing_angle, bool weld)
+	{
+		process_normals(m, smoothing_angle, weld);
 	}
 
 	void pack_data(const scene& scene, scene_data& data)
@@ -1,9 +1,19 @@
 #pragma once
 
 #include "ToolsCommon.h"
+#include "MeshOptimizer.h"
+#include "MeshletBuilder.h"
 
 namespace primal::tools {
 
+	// Welding joins vertices that share a position but are separate in the source, like the seams of a mesh exported per face.
+	// It changes the cooked vertices and indices of such meshes, so it's off unless a project asks for it.
+	namespace vertex_welding
+	{
+		constexpr bool enabled{ false };
+		constexpr f32 tolerance{ 1e-6f };				// Positions closer than this fraction of the mesh's bounding box diagonal share their normals
+	}
+
 	struct vertex
 	{
 		math::v4								tangent{};
@@ -140,6 +150,14 @@ namespace primal::tools {
 
 		f32										lod_threshold{ -1.f };
 		u32										lod_id{ u32_invalid_id };
+
+		// Post-transform cache efficiency of the index buffer before and after mesh_optimizer reordered it
+		mesh_optimizer::cache_statistics		cache_before{};
+		mesh_optimizer::cache_statistics		cache_after{};
+		// World space error of a LOD generated by mesh_simplifier, 0 for meshes from the source
+		f32										lod_error{ 0.f };
+		// Clusters of triangles for culling, each is a contiguous range of indices
+		utl::vector<content::meshlet>			meshlets;
 	};
 
 	struct lod_group
@@ -165,6 +183,9 @@ namespace primal::tools {
 		u8										coalesce_meshes;
 	};
 
+	// Settings the headless tools import with
+	constexpr geometry_import_settings default_geometry_import_settings{ 178.f, 0, 0, 0, 1, 1, 0 };
+
 	struct  scene_data
 	{
 		u8*										buffer;
@@ -173,6 +194,9 @@ namespace primal::tools {
 	};
 
 	void process_scene(scene& scene, const geometry_import_settings& settings, progression *const progression);
+	// The normal smoothing step of process_scene, for the headless checks: raw_indices, positions and a normal per index in,
+	// vertices and indices out. Positions are welded first when weld is set.
+	void smooth_normals(mesh& m, f32 smoothing_angle, bool weld);
 	void pack_data(const scene& scene, scene_data& data);
 	bool coalesce_meshes(const lod_group& lod, mesh& combined_mesh, progression *const progression);
 }
\ No newline at end of file
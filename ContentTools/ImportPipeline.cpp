@@ -0,0 +1,429 @@
+#include "ImportPipeline.h"
+#include "Geometry.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+namespace primal::tools
+{
+	extern bool load_fbx_scene(const char* file, scene& scene, scene_data& data, progression *const progression);
+	extern bool import_obj_model(const std::string& path, const std::string& file_package_path, const char* package_name, utl::vector<std::string>& outputs);
+	extern bool import_texture_file(const char* source, const char* output_file);
+}
+
+namespace primal::tools::import_pipeline
+{
+	namespace
+	{
+		namespace fs = std::filesystem;
+
+		struct asset_type
+		{
+			enum type : u32
+			{
+				obj = 0,
+				fbx,
+				texture,
+
+				count
+			};
+		};
+
+		constexpr const char* asset_type_names[asset_type::count]{ "obj", "fbx", "texture" };
+
+		struct asset
+		{
+			std::string							path;
+			std::string							name;			// File name and path hash, names the asset's record and outputs in the cache
+			std::string							stem;
+			asset_type::type					type;
+			u64									size;
+		};
+
+		// A source file as it was when the asset was imported
+		struct source_file
+		{
+			std::string							path;
+			u64									size;
+			s64									write_time;
+			u64									hash;
+		};
+
+		// Stored as text in <cache directory>\<asset name>.import
+		struct import_record
+		{
+			u32									version{ 0 };
+			u64									settings_hash{ 0 };
+			utl::vector<source_file>			sources;
+			utl::vector<std::string>			outputs;
+		};
+
+		// Hashes 8 bytes at a time, seed continues the hash of the bytes before these
+		u64 hash_bytes(const void *const data, u64 size, u64 seed)
+		{
+			constexpr u64 c1{ 0x87c37b91114253d5ull };
+			constexpr u64 c2{ 0x4cf5ad432745937full };
+			auto rotl{ [](u64 x, u32 r) { return (x << r) | (x >> (64 - r)); } };
+
+			const u8* bytes{ (const u8*)data };
+			u64 h{ seed ^ (size * c1) };
+			for (; size >= sizeof(u64); size -= sizeof(u64), bytes += sizeof(u64))
+			{
+				u64 k;
+				memcpy(&k, bytes, sizeof(u64));
+				h ^= rotl(k * c1, 31) * c2;
+				h = rotl(h, 27) * 5 + 0x52dce729;
+			}
+
+			u64 tail{ 0 };
+			memcpy(&tail, bytes, size);
+			h ^= rotl(tail * c1, 31) * c2;
+
+			h ^= h >> 33;
+			h *= 0xff51afd7ed558ccdull;
+			h ^= h >> 33;
+			h *= 0xc4ceb9fe1a85ec53ull;
+			h ^= h >> 33;
+			return h;
+		}
+
+		bool hash_file(const std::string& path, u64& hash)
+		{
+			std::ifstream file{ path, std::ios::in | std::ios::binary };
+			if (!file.is_open()) return false;
+
+			utl::vector<char> buffer(1 << 20);
+			hash = 0;
+			while (file)
+			{
+				file.read(buffer.data(), (std::streamsize)buffer.size());
+				const std::streamsize read{ file.gcount() };
+				if (read > 0) hash = hash_bytes(buffer.data(), (u64)read, hash);
+			}
+			return file.eof();
+		}
+
+		bool file_attributes(const std::string& path, u64& size, s64& write_time)
+		{
+			std::error_code error;
+			size = (u64)fs::file_size(path, error);
+			if (error) return false;
+			write_time = (s64)fs::last_write_time(path, error).time_since_epoch().count();
+			return !error;
+		}
+
+		std::string to_hex(u64 value)
+		{
+			char text[17];
+			sprintf_s(text, "%016llx", value);
+			return text;
+		}
+
+		// Textures are whatever DirectXTex loads in load_from_file
+		bool asset_type_from_extension(std::string extension, asset_type::type& type)
+		{
+			std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)tolower(c); });
+			if (extension == ".obj") type = asset_type::obj;
+			else if (extension == ".fbx") type = asset_type::fbx;
+			else if (extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".bmp" || extension == ".tga" ||
+				extension == ".tif" || extension == ".tiff" || extension == ".hdr" || extension == ".dds") type = asset_type::texture;
+			else return false;
+			return true;
+		}
+
+		utl::vector<asset> find_assets(const char* source)
+		{
+			utl::vector<asset> assets;
+			auto add_asset{ [&assets](const fs::path& path) {
+				asset a{};
+				if (!asset_type_from_extension(path.extension().string(), a.type)) return;
+
+				std::error_code error;
+				a.path = fs::absolute(path, error).string();
+				a.size = (u64)fs::file_size(path, error);
+				if (error) return;
+				a.stem = path.stem().string();
+				a.name = a.stem + "_" + to_hex(hash_bytes(a.path.data(), a.path.size(), 0));
+				assets.emplace_back(a);
+			} };
+
+			std::error_code error;
+			if (fs::is_directory(source, error))
+			{
+				// Increments that report errors instead of throwing, the tools are built without exceptions
+				for (fs::recursive_directory_iterator it{ source, error }, end; !error && it != end; it.increment(error))
+				{
+					if (it->is_regular_file(error)) add_asset(it->path());
+				}
+			}
+			else
+			{
+				add_asset(source);
+			}
+			return assets;
+		}
+
+		// An OBJ's materials are in the .mtl files that its mtllib lines name relative to the OBJ
+		utl::vector<std::string> obj_dependencies(const std::string& path)
+		{
+			utl::vector<std::string> dependencies;
+			std::ifstream file{ path };
+			const fs::path directory{ fs::path{ path }.parent_path() };
+			std::string line;
+			while (std::getline(file, line))
+			{
+				if (line.compare(0, 7, "mtllib ")) continue;
+				const size_t last{ line.find_last_not_of(" \t\r") };
+				if (last < 7) continue;
+				dependencies.emplace_back((directory / line.substr(7, last - 6)).string());
+			}
+			return dependencies;
+		}
+
+		u64 settings_hash(asset_type::type type)
+		{
+			u64 hash{ hash_bytes(&importer_version, sizeof(importer_version), type) };
+			if (type == asset_type::fbx)
+			{
+				hash = hash_bytes(&default_geometry_import_settings, sizeof(default_geometry_import_settings), hash);
+			}
+			return hash;
+		}
+
+		bool read_record(const std::string& file, import_record& record)
+		{
+			std::ifstream in{ file };
+			if (!in.is_open()) return false;
+
+			std::string tag;
+			while (in >> tag)
+			{
+				if (tag == "version")
+				{
+					in >> record.version;
+				}
+				else if (tag == "settings")
+				{
+					in >> std::hex >> record.settings_hash >> std::dec;
+				}
+				else if (tag == "source")
+				{
+					source_file source{};
+					in >> source.size >> source.write_time >> std::hex >> source.hash >> std::dec;
+					in.get();
+					std::getline(in, source.path);
+					record.sources.emplace_back(source);
+				}
+				else if (tag == "output")
+				{
+					std::string output;
+					in.get();
+					std::getline(in, output);
+					record.outputs.emplace_back(output);
+				}
+				else
+				{
+					return false;
+				}
+			}
+			return !in.bad();
+		}
+
+		bool write_record(const std::string& file, const import_record& record)
+		{
+			std::ofstream out{ file, std::ios::out | std::ios::trunc };
+			if (!out.is_open()) return false;
+
+			out << "version " << record.version << '\n';
+			out << "settings " << to_hex(record.settings_hash) << '\n';
+			for (const auto& source : record.sources)
+			{
+				out << "source " << source.size << ' ' << source.write_time << ' ' << to_hex(source.hash) << ' ' << source.path << '\n';
+			}
+			for (const auto& output : record.outputs)
+			{
+				out << "output " << output << '\n';
+			}
+			return out.good();
+		}
+
+		// Sources that were touched but didn't change keep the record valid. touched is set so their new write times
+		// are stored and they aren't hashed again.
+		bool is_up_to_date(import_record& record, u64 settings, bool& touched)
+		{
+			if (record.version != importer_version || record.settings_hash != settings || record.sources.empty()) return false;
+
+			for (auto& source : record.sources)
+			{
+				u64 size{ 0 };
+				s64 write_time{ 0 };
+				if (!file_attributes(source.path, size, write_time) || size != source.size) return false;
+				if (write_time == source.write_time) continue;
+
+				u64 hash{ 0 };
+				if (!hash_file(source.path, hash) || hash != source.hash) return false;
+				source.write_time = write_time;
+				touched = true;
+			}
+
+			for (const auto& output : record.outputs)
+			{
+				std::error_code error;
+				if (!fs::exists(output, error)) return false;
+			}
+			return true;
+		}
+
+		bool write_file(const std::string& file, const u8 *const data, u32 size)
+		{
+			std::ofstream out{ file, std::ios::out | std::ios::binary | std::ios::trunc };
+			if (!out.is_open()) return false;
+			out.write((const char*)data, size);
+			return out.good();
+		}
+
+		bool import_asset(const asset& a, const std::string& cache_directory, import_record& record)
+		{
+			// Sources are hashed before they're imported, so an edit during the import is noticed by the next one
+			utl::vector<std::string> sources{};
+			sources.emplace_back(a.path);
+			if (a.type == asset_type::obj)
+			{
+				for (const auto& dependency : obj_dependencies(a.path)) sources.emplace_back(dependency);
+			}
+
+			for (const auto& path : sources)
+			{
+				source_file source{};
+				source.path = path;
+				// Missing .mtl files are the importer's to report, they're recorded once they exist
+				if (!file_attributes(path, source.size, source.write_time) || !hash_file(path, source.hash))
+				{
+					if (path == a.path) return false;
+					continue;
+				}
+				record.sources.emplace_back(source);
+			}
+
+			const std::string output{ cache_directory + "\\" + a.name };
+			switch (a.type)
+			{
+			case asset_type::obj:
+			{
+				std::error_code error;
+				fs::create_directories(output, error);
+				return !error && import_obj_model(a.path, output, a.stem.c_str(), record.outputs);
+			}
+			case asset_type::fbx:
+			{
+				scene scene{};
+				scene_data data{};
+				data.settings = default_geometry_import_settings;
+				progression progression{};
+				if (!load_fbx_scene(a.path.c_str(), scene, data, &progression)) return false;
+
+				process_scene(scene, data.settings, &progression);
+				pack_data(scene, data);
+				const std::string file{ output + ".geometry" };
+				const bool written{ write_file(file, data.buffer, data.buffer_size) };
+				CoTaskMemFree(data.buffer);
+				if (written) record.outputs.emplace_back(file);
+				return written;
+			}
+			case asset_type::texture:
+			{
+				const std::string file{ output + ".texture" };
+				if (!import_texture_file(a.path.c_str(), file.c_str())) return false;
+				record.outputs.emplace_back(file);
+				return true;
+			}
+			default: assert(false);
+			}
+			return false;
+		}
+
+		// Runs job(i) for every i below count on a thread per hardware thread, the calling thread included.
+		// The workers initialize COM for the texture importer's WIC decoders.
+		template<typename job_function>
+		void run_jobs(u32 count, job_function&& job)
+		{
+			std::atomic<u32> next{ 0 };
+			auto worker{ [&next, &job, count]() {
+				const HRESULT hr{ CoInitializeEx(nullptr, COINIT_MULTITHREADED) };
+				for (u32 i{ next++ }; i < count; i = next++) job(i);
+				if (SUCCEEDED(hr)) CoUninitialize();
+			} };
+
+			const u32 thread_count{ std::min(std::max(std::thread::hardware_concurrency(), 1u), count) };
+			utl::vector<std::thread> threads;
+			threads.reserve(thread_count);
+			for (u32 i{ 1 }; i < thread_count; ++i) threads.emplace_back(worker);
+			worker();
+			for (auto& thread : threads) thread.join();
+		}
+	} // anonymous namespace
+
+	utl::vector<import_result> import_assets(const char* source, const char* cache_directory)
+	{
+		assert(source && cache_directory);
+		// Records keep absolute paths, so they stay valid from any working directory
+		std::error_code error;
+		const std::string cache{ fs::absolute(cache_directory, error).string() };
+		fs::create_directories(cache, error);
+
+		const utl::vector<asset> assets{ find_assets(source) };
+		const u32 asset_count{ (u32)assets.size() };
+		utl::vector<import_result> results(asset_count);
+		if (!asset_count) return results;
+
+		// Large assets first, so a big one doesn't start last and keep a single thread busy at the end
+		utl::vector<u32> order(asset_count);
+		for (u32 i{ 0 }; i < asset_count; ++i) order[i] = i;
+		std::sort(order.begin(), order.end(), [&assets](u32 a, u32 b) { return assets[a].size > assets[b].size; });
+
+		run_jobs(asset_count, [&](u32 job) {
+			const asset& a{ assets[order[job]] };
+			import_result& result{ results[order[job]] };
+			result.path = a.path;
+			result.type = asset_type_names[a.type];
+
+			const auto start{ std::chrono::steady_clock::now() };
+			const std::string record_file{ cache + "\\" + a.name + ".import" };
+			const u64 settings{ settings_hash(a.type) };
+
+			import_record record{};
+			bool touched{ false };
+			if (read_record(record_file, record) && is_up_to_date(record, settings, touched))
+			{
+				if (touched) write_record(record_file, record);
+				result.status = import_status::up_to_date;
+			}
+			else
+			{
+				// A record is only written after every output was, an interrupted import is redone
+				std::error_code remove_error;
+				fs::remove(record_file, remove_error);
+
+				record = {};
+				record.version = importer_version;
+				record.settings_hash = settings;
+				const bool imported{ import_asset(a, cache, record) && write_record(record_file, record) };
+				result.status = imported ? import_status::imported : import_status::failed;
+			}
+
+			result.output_count = (u32)record.outputs.size();
+			result.milliseconds = std::chrono::duration<f32, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			constexpr const char* status_names[import_status::count]{ "imported", "up to date", "failed" };
+			char message[512];
+			sprintf_s(message, "Import pipeline: %s %s, %.1f ms\n", a.path.c_str(), status_names[result.status], result.milliseconds);
+			OutputDebugStringA(message);
+		});
+
+		return results;
+	}
+}
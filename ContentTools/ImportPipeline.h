@@ -0,0 +1,38 @@
+#pragma once
+
+#include "ToolsCommon.h"
+
+namespace primal::tools::import_pipeline
+{
+	// Bump when an importer writes different outputs for the same sources, the outputs of older importers are imported again
+	constexpr u32 importer_version{ 1 };
+
+	struct import_status
+	{
+		enum status : u32
+		{
+			imported = 0,
+			up_to_date,
+			failed,
+
+			count
+		};
+	};
+
+	struct import_result
+	{
+		std::string								path;
+		const char*								type;
+		import_status::status					status;
+		f32										milliseconds;
+		u32										output_count;
+	};
+
+	// Imports the OBJ, FBX and image files at source, a file or a directory that is searched recursively, into cache_directory.
+	// Each asset has a record in the cache with the size, write time and hash of its sources (an OBJ's .mtl files included), the
+	// importer version and settings, and the files it wrote. Assets whose sources and settings match their record and whose outputs
+	// still exist are skipped. Sources whose size and write time are unchanged aren't read, so a re-import without changes only
+	// looks at file attributes. The other assets are imported on a thread per hardware thread, largest first.
+	// Returns a result per asset in the order they were found.
+	[[nodiscard]] utl::vector<import_result> import_assets(const char* source, const char* cache_directory);
+}
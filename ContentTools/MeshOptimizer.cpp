@@ -0,0 +1,303 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+
+namespace primal::tools::mesh_optimizer
+{
+	namespace
+	{
+		using namespace DirectX;
+
+		// Triangles that use each vertex, one entry per index so degenerate triangles are listed twice
+		struct vertex_adjacency
+		{
+			utl::vector<u32>					counts;
+			utl::vector<u32>					offsets;
+			utl::vector<u32>					triangles;
+		};
+
+		void build_adjacency(vertex_adjacency& adjacency, const u32* indices, u32 index_count, u32 vertex_count)
+		{
+			adjacency.counts.resize(vertex_count, 0);
+			adjacency.offsets.resize(vertex_count, 0);
+			adjacency.triangles.resize(index_count);
+
+			for (u32 i{ 0 }; i < index_count; ++i)
+			{
+				assert(indices[i] < vertex_count);
+				++adjacency.counts[indices[i]];
+			}
+
+			u32 offset{ 0 };
+			for (u32 i{ 0 }; i < vertex_count; ++i)
+			{
+				adjacency.offsets[i] = offset;
+				offset += adjacency.counts[i];
+			}
+
+			utl::vector<u32> fill{ adjacency.offsets };
+			for (u32 i{ 0 }; i < index_count; ++i)
+			{
+				adjacency.triangles[fill[indices[i]]++] = i / 3;
+			}
+		}
+
+		// Adds the vertices of a triangle to the simulated FIFO cache and returns how many of them missed.
+		// A vertex is cached while fewer than cache_size vertices were added after it, so the cache is
+		// flushed by advancing the timestamp by cache_size + 1.
+		u32 update_cache(const u32* triangle, utl::vector<u32>& timestamps, u32& timestamp)
+		{
+			u32 misses{ 0 };
+			for (u32 i{ 0 }; i < 3; ++i)
+			{
+				const u32 v{ triangle[i] };
+				if (timestamp - timestamps[v] > cache_size)
+				{
+					timestamps[v] = timestamp++;
+					++misses;
+				}
+			}
+			return misses;
+		}
+
+		struct tipsify_state
+		{
+			utl::vector<u32>					live;				// Triangles of each vertex that weren't emitted yet
+			utl::vector<u32>					timestamps;
+			utl::vector<u32>					dead_end;			// Vertices of the emitted triangles, most recent last
+			utl::vector<u32>					candidates;			// Vertices of the triangles emitted around the last fanning vertex
+			u32									dead_end_count{ 0 };
+			u32									timestamp{ cache_size + 1 };
+			u32									cursor{ 0 };		// Vertices before it have no live triangles
+		};
+
+		u32 next_fanning_vertex(tipsify_state& state, u32 vertex_count)
+		{
+			// Prefer the candidate that entered the cache first and still stays in it while its triangles are emitted,
+			// each of them adds at most two vertices to the cache
+			u32 best{ u32_invalid_id };
+			s32 best_priority{ -1 };
+			for (const u32 v : state.candidates)
+			{
+				if (!state.live[v]) continue;
+
+				const u32 age{ state.timestamp - state.timestamps[v] };
+				const s32 priority{ age + 2 * state.live[v] <= cache_size ? (s32)age : 0 };
+				if (priority > best_priority)
+				{
+					best = v;
+					best_priority = priority;
+				}
+			}
+			if (best != u32_invalid_id) return best;
+
+			// Dead end, continue with the most recently used vertex that has triangles left
+			while (state.dead_end_count)
+			{
+				const u32 v{ state.dead_end[--state.dead_end_count] };
+				if (state.live[v]) return v;
+			}
+
+			// Nothing recent is left, continue with the next vertex in input order
+			while (state.cursor < vertex_count)
+			{
+				if (state.live[state.cursor]) return state.cursor;
+				++state.cursor;
+			}
+
+			return u32_invalid_id;
+		}
+
+		struct cluster
+		{
+			u32									start;				// First triangle
+			u32									end;				// One past the last triangle
+			f32									sort_key;
+		};
+
+		// Hard boundaries start at the triangles that miss the cache with all three vertices, these are usually
+		// new patches of the mesh. The patches are split again where their running ACMR drops to overdraw_threshold
+		// times the ACMR of the whole patch, so the order inside each cluster costs at most that much.
+		void build_clusters(utl::vector<cluster>& clusters, const u32* indices, u32 triangle_count, u32 vertex_count)
+		{
+			utl::vector<u32> timestamps(vertex_count, 0);
+			u32 timestamp{ cache_size + 1 };
+
+			utl::vector<u32> hard_boundaries;
+			for (u32 t{ 0 }; t < triangle_count; ++t)
+			{
+				if (update_cache(&indices[t * 3], timestamps, timestamp) == 3 || t == 0)
+					hard_boundaries.emplace_back(t);
+			}
+
+			for (u32 i{ 0 }; i < hard_boundaries.size(); ++i)
+			{
+				const u32 start{ hard_boundaries[i] };
+				const u32 end{ i + 1 < hard_boundaries.size() ? hard_boundaries[i + 1] : triangle_count };
+
+				timestamp += cache_size + 1;
+				u32 patch_misses{ 0 };
+				for (u32 t{ start }; t < end; ++t) patch_misses += update_cache(&indices[t * 3], timestamps, timestamp);
+				const f32 threshold{ overdraw_threshold * (f32)patch_misses / (f32)(end - start) };
+
+				timestamp += cache_size + 1;
+				u32 cluster_start{ start };
+				u32 misses{ 0 };
+				for (u32 t{ start }; t < end; ++t)
+				{
+					misses += update_cache(&indices[t * 3], timestamps, timestamp);
+					if (t + 1 < end && (f32)misses / (f32)(t + 1 - cluster_start) <= threshold)
+					{
+						clusters.emplace_back(cluster{ cluster_start, t + 1, 0.f });
+						cluster_start = t + 1;
+						misses = 0;
+						timestamp += cache_size + 1;
+					}
+				}
+				clusters.emplace_back(cluster{ cluster_start, end, 0.f });
+			}
+		}
+	} // anonymous namespace
+
+	cache_statistics analyze_vertex_cache(const u32* indices, u32 index_count, u32 vertex_count)
+	{
+		assert((index_count % 3) == 0);
+		const u32 triangle_count{ index_count / 3 };
+		if (!triangle_count) return {};
+
+		utl::vector<u32> timestamps(vertex_count, 0);
+		utl::vector<u8> referenced(vertex_count, 0);
+		u32 timestamp{ cache_size + 1 };
+		u32 misses{ 0 };
+		u32 referenced_count{ 0 };
+
+		for (u32 t{ 0 }; t < triangle_count; ++t)
+		{
+			misses += update_cache(&indices[t * 3], timestamps, timestamp);
+			for (u32 i{ 0 }; i < 3; ++i)
+			{
+				const u32 v{ indices[t * 3 + i] };
+				referenced_count += referenced[v] ? 0 : 1;
+				referenced[v] = 1;
+			}
+		}
+
+		return { (f32)misses / (f32)triangle_count, (f32)misses / (f32)referenced_count };
+	}
+
+	void optimize_vertex_cache(u32* indices, u32 index_count, u32 vertex_count)
+	{
+		assert((index_count % 3) == 0);
+		if (!index_count) return;
+
+		const utl::vector<u32> source(indices, indices + index_count);
+		vertex_adjacency adjacency{};
+		build_adjacency(adjacency, source.data(), index_count, vertex_count);
+
+		tipsify_state state{};
+		state.live = adjacency.counts;
+		state.timestamps.resize(vertex_count, 0);
+		state.dead_end.resize(index_count);
+		utl::vector<u8> emitted(index_count / 3, 0);
+
+		u32 output{ 0 };
+		u32 fanning{ source[0] };
+		while (fanning != u32_invalid_id)
+		{
+			state.candidates.clear();
+
+			const u32 first{ adjacency.offsets[fanning] };
+			for (u32 i{ first }; i < first + adjacency.counts[fanning]; ++i)
+			{
+				const u32 t{ adjacency.triangles[i] };
+				if (emitted[t]) continue;
+				emitted[t] = 1;
+
+				for (u32 k{ 0 }; k < 3; ++k)
+				{
+					const u32 v{ source[t * 3 + k] };
+					indices[output++] = v;
+					state.dead_end[state.dead_end_count++] = v;
+					state.candidates.emplace_back(v);
+					--state.live[v];
+					if (state.timestamp - state.timestamps[v] > cache_size)
+						state.timestamps[v] = state.timestamp++;
+				}
+			}
+
+			fanning = next_fanning_vertex(state, vertex_count);
+		}
+		assert(output == index_count);
+	}
+
+	void optimize_overdraw(u32* indices, u32 index_count, const u8* positions, u32 vertex_count, u32 position_stride)
+	{
+		assert((index_count % 3) == 0 && positions);
+		const u32 triangle_count{ index_count / 3 };
+		if (!triangle_count) return;
+
+		utl::vector<cluster> clusters;
+		build_clusters(clusters, indices, triangle_count, vertex_count);
+		if (clusters.size() < 2) return;
+
+		auto position{ [positions, position_stride](u32 v) { return XMLoadFloat3((const math::v3*)(positions + (u64)v * position_stride)); } };
+
+		// Area weighted centroid of the mesh
+		XMVECTOR mesh_centroid{ XMVectorZero() };
+		f32 mesh_area{ 0.f };
+		for (u32 t{ 0 }; t < triangle_count; ++t)
+		{
+			const XMVECTOR v0{ position(indices[t * 3]) }, v1{ position(indices[t * 3 + 1]) }, v2{ position(indices[t * 3 + 2]) };
+			const f32 area{ XMVectorGetX(XMVector3Length(XMVector3Cross(v1 - v0, v2 - v0))) };
+			mesh_centroid += (v0 + v1 + v2) * area;
+			mesh_area += area;
+		}
+		if (mesh_area <= 0.f) return;
+		mesh_centroid /= mesh_area * 3.f;
+
+		// Clusters that face away from the center are in front of the others, the higher the key the earlier they're drawn
+		for (auto& c : clusters)
+		{
+			XMVECTOR centroid{ XMVectorZero() };
+			XMVECTOR normal{ XMVectorZero() };
+			f32 area{ 0.f };
+			for (u32 t{ c.start }; t < c.end; ++t)
+			{
+				const XMVECTOR v0{ position(indices[t * 3]) }, v1{ position(indices[t * 3 + 1]) }, v2{ position(indices[t * 3 + 2]) };
+				const XMVECTOR n{ XMVector3Cross(v1 - v0, v2 - v0) };
+				const f32 triangle_area{ XMVectorGetX(XMVector3Length(n)) };
+				centroid += (v0 + v1 + v2) * triangle_area;
+				normal += n;
+				area += triangle_area;
+			}
+			if (area <= 0.f) continue;
+
+			centroid /= area * 3.f;
+			c.sort_key = XMVectorGetX(XMVector3Dot(centroid - mesh_centroid, XMVector3Normalize(normal)));
+		}
+
+		std::stable_sort(clusters.begin(), clusters.end(), [](const cluster& a, const cluster& b) { return a.sort_key > b.sort_key; });
+
+		const utl::vector<u32> source(indices, indices + index_count);
+		u32 output{ 0 };
+		for (const auto& c : clusters)
+		{
+			for (u32 i{ c.start * 3 }; i < c.end * 3; ++i) indices[output++] = source[i];
+		}
+		assert(output == index_count);
+	}
+
+	u32 optimize_vertex_fetch_remap(u32* indices, u32 index_count, u32 vertex_count, utl::vector<u32>& remap)
+	{
+		remap.clear();
+		remap.resize(vertex_count, u32_invalid_id);
+
+		u32 next{ 0 };
+		for (u32 i{ 0 }; i < index_count; ++i)
+		{
+			u32& v{ remap[indices[i]] };
+			if (v == u32_invalid_id) v = next++;
+			indices[i] = v;
+		}
+		return next;
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "ToolsCommon.h"
+
+namespace primal::tools::mesh_optimizer
+{
+	constexpr bool enabled{ true };
+	constexpr u32 cache_size{ 16 };					// FIFO entries of the post-transform cache that's optimized for and simulated
+	constexpr f32 overdraw_threshold{ 1.05f };		// ACMR a cluster may lose to the overdraw order, 1 keeps the vertex cache order
+
+	// Post-transform cache efficiency of an index buffer, simulated with a FIFO cache of cache_size entries
+	struct cache_statistics
+	{
+		f32			acmr;			// Average cache miss ratio: vertex shader invocations per triangle, 0.5 is the ideal of a regular grid
+		f32			atvr;			// Average transformed vertex ratio: invocations per referenced vertex, 1 is the ideal
+	};
+
+	[[nodiscard]] cache_statistics analyze_vertex_cache(const u32* indices, u32 index_count, u32 vertex_count);
+
+	// Reorders the triangles so the vertices they share are still in the cache (Tipsify, Sander et al. 2007)
+	void optimize_vertex_cache(u32* indices, u32 index_count, u32 vertex_count);
+
+	// Keeps the vertex cache order inside clusters of triangles and draws the clusters that face away from
+	// the center of the mesh first, so they occlude the rest. Expects indices already optimized for the vertex cache.
+	// positions points to the first vertex position, position_stride is the size of a vertex.
+	void optimize_overdraw(u32* indices, u32 index_count, const u8* positions, u32 vertex_count, u32 position_stride);
+
+	// Renumbers the vertices in the order the indices first use them, so the vertex fetch reads memory linearly.
+	// remap gets the new index of every old vertex, u32_invalid_id for unused vertices. Returns the used vertex count.
+	u32 optimize_vertex_fetch_remap(u32* indices, u32 index_count, u32 vertex_count, utl::vector<u32>& remap);
+
+	// Moves the vertices to the order the indices were renumbered to and drops the unused ones
+	template<typename T>
+	void optimize_vertex_fetch(utl::vector<u32>& indices, utl::vector<T>& vertices)
+	{
+		utl::vector<u32> remap;
+		const u32 used_count{ optimize_vertex_fetch_remap(indices.data(), (u32)indices.size(), (u32)vertices.size(), remap) };
+
+		utl::vector<T> reordered(used_count);
+		for (u32 i{ 0 }; i < vertices.size(); ++i)
+		{
+			if (remap[i] != u32_invalid_id) reordered[remap[i]] = vertices[i];
+		}
+		vertices.swap(reordered);
+	}
+}
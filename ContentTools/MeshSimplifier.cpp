@@ -0,0 +1,533 @@
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <unordered_set>
+
+namespace primal::tools::mesh_simplifier
+{
+	namespace
+	{
+		using namespace DirectX;
+
+		enum vertex_kind : u8
+		{
+			manifold,			// Collapses anywhere
+			border,				// Open border, collapses along the border
+			seam,				// Two wedges with different attributes, collapses along the seam
+			locked,				// Corners and non-manifold vertices, never collapses
+		};
+
+		// Sum of squared distances to planes, each weighted by the area it stands for
+		struct quadric
+		{
+			f32									a00, a11, a22, a10, a20, a21;
+			f32									b0, b1, b2;
+			f32									c;
+			f32									weight;
+		};
+
+		// Normal and UV, scaled by their weight
+		constexpr u32 attribute_count{ 5 };
+
+		// Sum of squared differences between a value and the linear fields of an attribute over triangles,
+		// sum(w * (dot(g, p) + d - value)^2), for every attribute of a wedge
+		struct attribute_quadric
+		{
+			struct component
+			{
+				f32								a00, a11, a22, a10, a20, a21;	// sum(w * g * g^T)
+				f32								b0, b1, b2;						// sum(w * g * d)
+				f32								c;								// sum(w * d * d)
+				f32								g0, g1, g2;						// sum(w * g)
+				f32								d;								// sum(w * d)
+			};
+
+			component							components[attribute_count];
+			f32									weight;
+		};
+
+		struct collapse
+		{
+			u32									from;				// Wedge that is removed
+			u32									to;
+			u32									twin_from;			// Other wedge of a seam vertex, u32_invalid_id otherwise
+			u32									twin_to;
+			f32									error;				// Squared, relative to the mesh extent
+		};
+
+		// Directed edges of the current triangles, between vertices and between the positions they share
+		struct edge_sets
+		{
+			std::unordered_set<u64>				vertices;
+			std::unordered_set<u64>				positions;
+
+			[[nodiscard]] bool has_vertex_edge(u32 a, u32 b) const { return vertices.count(((u64)a << 32) | b) != 0; }
+			[[nodiscard]] bool has_position_edge(u32 a, u32 b) const { return positions.count(((u64)a << 32) | b) != 0; }
+		};
+
+		struct simplifier_context
+		{
+			utl::vector<math::v3>				positions;			// Scaled to a unit extent
+			utl::vector<u32>					position_ids;		// Lowest vertex index with the same position
+			utl::vector<u32>					next_wedge;			// Ring of the vertices with the same position
+			utl::vector<vertex_kind>			kinds;				// Valid for position ids
+			utl::vector<quadric>				quadrics;			// Valid for position ids
+			utl::vector<attribute_quadric>		attributes;			// Per wedge
+			edge_sets							edges;
+		};
+
+		void add_plane(quadric& q, XMVECTOR normal, f32 d, f32 weight)
+		{
+			XMFLOAT3 n;
+			XMStoreFloat3(&n, normal);
+			q.a00 += weight * n.x * n.x;
+			q.a11 += weight * n.y * n.y;
+			q.a22 += weight * n.z * n.z;
+			q.a10 += weight * n.y * n.x;
+			q.a20 += weight * n.z * n.x;
+			q.a21 += weight * n.z * n.y;
+			q.b0 += weight * n.x * d;
+			q.b1 += weight * n.y * d;
+			q.b2 += weight * n.z * d;
+			q.c += weight * d * d;
+			q.weight += weight;
+		}
+
+		void add_quadric(quadric& q, const quadric& o)
+		{
+			q.a00 += o.a00; q.a11 += o.a11; q.a22 += o.a22;
+			q.a10 += o.a10; q.a20 += o.a20; q.a21 += o.a21;
+			q.b0 += o.b0; q.b1 += o.b1; q.b2 += o.b2;
+			q.c += o.c;
+			q.weight += o.weight;
+		}
+
+		// Weighted mean of the squared distances of p to the planes of q
+		f32 evaluate(const quadric& q, const math::v3& p)
+		{
+			const f32 rx{ q.a00 * p.x + q.a10 * p.y + q.a20 * p.z };
+			const f32 ry{ q.a10 * p.x + q.a11 * p.y + q.a21 * p.z };
+			const f32 rz{ q.a20 * p.x + q.a21 * p.y + q.a22 * p.z };
+			const f32 r{ rx * p.x + ry * p.y + rz * p.z + 2.f * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z) + q.c };
+			return q.weight > 0.f ? fabsf(r) / q.weight : 0.f;
+		}
+
+		void get_attributes(const vertex& v, f32 (&values)[attribute_count])
+		{
+			values[0] = v.normal.x * normal_weight;
+			values[1] = v.normal.y * normal_weight;
+			values[2] = v.normal.z * normal_weight;
+			values[3] = v.uv.x * uv_weight;
+			values[4] = v.uv.y * uv_weight;
+		}
+
+		void add_attribute_quadric(attribute_quadric& q, const attribute_quadric& o)
+		{
+			for (u32 i{ 0 }; i < attribute_count; ++i)
+			{
+				attribute_quadric::component& c{ q.components[i] };
+				const attribute_quadric::component& oc{ o.components[i] };
+				c.a00 += oc.a00; c.a11 += oc.a11; c.a22 += oc.a22;
+				c.a10 += oc.a10; c.a20 += oc.a20; c.a21 += oc.a21;
+				c.b0 += oc.b0; c.b1 += oc.b1; c.b2 += oc.b2;
+				c.c += oc.c;
+				c.g0 += oc.g0; c.g1 += oc.g1; c.g2 += oc.g2;
+				c.d += oc.d;
+			}
+			q.weight += o.weight;
+		}
+
+		// Weighted mean of the squared differences between the attributes of v, moved to p, and the fields of q
+		f32 evaluate(const attribute_quadric& q, const math::v3& p, const vertex& v)
+		{
+			if (q.weight <= 0.f) return 0.f;
+
+			f32 values[attribute_count];
+			get_attributes(v, values);
+
+			f32 r{ 0.f };
+			for (u32 i{ 0 }; i < attribute_count; ++i)
+			{
+				const attribute_quadric::component& c{ q.components[i] };
+				const f32 rx{ c.a00 * p.x + c.a10 * p.y + c.a20 * p.z };
+				const f32 ry{ c.a10 * p.x + c.a11 * p.y + c.a21 * p.z };
+				const f32 rz{ c.a20 * p.x + c.a21 * p.y + c.a22 * p.z };
+				const f32 field{ c.g0 * p.x + c.g1 * p.y + c.g2 * p.z + c.d };
+				r += rx * p.x + ry * p.y + rz * p.z + 2.f * (c.b0 * p.x + c.b1 * p.y + c.b2 * p.z) + c.c -
+					2.f * values[i] * field + values[i] * values[i] * q.weight;
+			}
+			return fabsf(r) / q.weight;
+		}
+
+		void build_wedges(simplifier_context& ctx, const utl::vector<vertex>& vertices)
+		{
+			const u32 vertex_count{ (u32)vertices.size() };
+			utl::vector<u32> order(vertex_count);
+			for (u32 i{ 0 }; i < vertex_count; ++i) order[i] = i;
+
+			// Vertices with equal positions end up next to each other, the lowest index first
+			std::sort(order.begin(), order.end(), [&vertices](u32 a, u32 b)
+			{
+				const math::v3& pa{ vertices[a].position };
+				const math::v3& pb{ vertices[b].position };
+				if (pa.x != pb.x) return pa.x < pb.x;
+				if (pa.y != pb.y) return pa.y < pb.y;
+				if (pa.z != pb.z) return pa.z < pb.z;
+				return a < b;
+			});
+
+			ctx.position_ids.resize(vertex_count);
+			ctx.next_wedge.resize(vertex_count);
+
+			u32 first{ 0 };
+			for (u32 i{ 1 }; i <= vertex_count; ++i)
+			{
+				if (i < vertex_count && memcmp(&vertices[order[i]].position, &vertices[order[first]].position, sizeof(math::v3)) == 0) continue;
+
+				for (u32 j{ first }; j < i; ++j)
+				{
+					ctx.position_ids[order[j]] = order[first];
+					ctx.next_wedge[order[j]] = order[j + 1 < i ? j + 1 : first];
+				}
+				first = i;
+			}
+		}
+
+		void build_edges(simplifier_context& ctx, const u32* indices, u32 index_count)
+		{
+			ctx.edges.vertices.clear();
+			ctx.edges.positions.clear();
+			ctx.edges.vertices.reserve(index_count);
+			ctx.edges.positions.reserve(index_count);
+
+			for (u32 i{ 0 }; i < index_count; ++i)
+			{
+				const u32 a{ indices[i] };
+				const u32 b{ indices[i % 3 == 2 ? i - 2 : i + 1] };
+				ctx.edges.vertices.insert(((u64)a << 32) | b);
+				ctx.edges.positions.insert(((u64)ctx.position_ids[a] << 32) | ctx.position_ids[b]);
+			}
+		}
+
+		void classify_vertices(simplifier_context& ctx, const u32* indices, u32 index_count)
+		{
+			const u32 vertex_count{ (u32)ctx.position_ids.size() };
+			utl::vector<u32> open_out(vertex_count, 0), open_in(vertex_count, 0);
+			utl::vector<u32> border_out(vertex_count, 0), border_in(vertex_count, 0);
+
+			for (u32 i{ 0 }; i < index_count; ++i)
+			{
+				const u32 a{ indices[i] };
+				const u32 b{ indices[i % 3 == 2 ? i - 2 : i + 1] };
+				if (!ctx.edges.has_vertex_edge(b, a))
+				{
+					++open_out[a];
+					++open_in[b];
+				}
+
+				const u32 pa{ ctx.position_ids[a] }, pb{ ctx.position_ids[b] };
+				if (!ctx.edges.has_position_edge(pb, pa))
+				{
+					++border_out[pa];
+					++border_in[pb];
+				}
+			}
+
+			ctx.kinds.resize(vertex_count, locked);
+			for (u32 v{ 0 }; v < vertex_count; ++v)
+			{
+				if (ctx.position_ids[v] != v) continue;
+
+				const u32 wedge_count{ ctx.next_wedge[v] == v ? 1u : ctx.next_wedge[ctx.next_wedge[v]] == v ? 2u : 3u };
+				const bool has_border{ border_out[v] || border_in[v] };
+				vertex_kind kind{ locked };
+
+				if (wedge_count == 1)
+				{
+					if (!has_border) kind = manifold;
+					else if (border_out[v] == 1 && border_in[v] == 1) kind = border;
+				}
+				else if (wedge_count == 2 && !has_border)
+				{
+					const u32 w{ ctx.next_wedge[v] };
+					if (open_out[v] == 1 && open_in[v] == 1 && open_out[w] == 1 && open_in[w] == 1) kind = seam;
+				}
+
+				ctx.kinds[v] = kind;
+			}
+		}
+
+		// Every triangle adds its plane to the quadrics of its corners. Open borders and seams add a plane through the edge,
+		// perpendicular to the triangle, so collapses that move them away from where they are get expensive.
+		void build_quadrics(simplifier_context& ctx, const u32* indices, u32 index_count, const utl::vector<vertex>& vertices)
+		{
+			ctx.quadrics.resize(ctx.position_ids.size(), quadric{});
+			ctx.attributes.resize(ctx.position_ids.size(), attribute_quadric{});
+
+			for (u32 t{ 0 }; t < index_count; t += 3)
+			{
+				const XMVECTOR p0{ XMLoadFloat3(&ctx.positions[indices[t]]) };
+				const XMVECTOR p1{ XMLoadFloat3(&ctx.positions[indices[t + 1]]) };
+				const XMVECTOR p2{ XMLoadFloat3(&ctx.positions[indices[t + 2]]) };
+				const XMVECTOR cross{ XMVector3Cross(p1 - p0, p2 - p0) };
+				const f32 length{ XMVectorGetX(XMVector3Length(cross)) };
+				if (length <= 0.f) continue;
+
+				const XMVECTOR n{ cross / length };
+				const f32 d{ -XMVectorGetX(XMVector3Dot(n, p0)) };
+				const f32 area{ length * 0.5f };
+				for (u32 k{ 0 }; k < 3; ++k) add_plane(ctx.quadrics[ctx.position_ids[indices[t + k]]], n, d, area);
+
+				// Gradient of each attribute in the plane of the triangle, from the differences along its two edges
+				const XMVECTOR e1{ p1 - p0 }, e2{ p2 - p0 };
+				const f32 e11{ XMVectorGetX(XMVector3Dot(e1, e1)) }, e12{ XMVectorGetX(XMVector3Dot(e1, e2)) }, e22{ XMVectorGetX(XMVector3Dot(e2, e2)) };
+				const f32 det{ e11 * e22 - e12 * e12 };
+				if (det > 0.f)
+				{
+					f32 values[3][attribute_count];
+					for (u32 k{ 0 }; k < 3; ++k) get_attributes(vertices[indices[t + k]], values[k]);
+
+					attribute_quadric q{};
+					q.weight = area;
+					for (u32 i{ 0 }; i < attribute_count; ++i)
+					{
+						const f32 da1{ values[1][i] - values[0][i] }, da2{ values[2][i] - values[0][i] };
+						XMFLOAT3 g;
+						XMStoreFloat3(&g, e1 * ((da1 * e22 - da2 * e12) / det) + e2 * ((da2 * e11 - da1 * e12) / det));
+						const f32 gd{ values[0][i] - XMVectorGetX(XMVector3Dot(XMLoadFloat3(&g), p0)) };
+
+						attribute_quadric::component& c{ q.components[i] };
+						c.a00 = area * g.x * g.x; c.a11 = area * g.y * g.y; c.a22 = area * g.z * g.z;
+						c.a10 = area * g.y * g.x; c.a20 = area * g.z * g.x; c.a21 = area * g.z * g.y;
+						c.b0 = area * g.x * gd; c.b1 = area * g.y * gd; c.b2 = area * g.z * gd;
+						c.c = area * gd * gd;
+						c.g0 = area * g.x; c.g1 = area * g.y; c.g2 = area * g.z;
+						c.d = area * gd;
+					}
+					for (u32 k{ 0 }; k < 3; ++k) add_attribute_quadric(ctx.attributes[indices[t + k]], q);
+				}
+
+				for (u32 k{ 0 }; k < 3; ++k)
+				{
+					const u32 a{ indices[t + k] };
+					const u32 b{ indices[t + (k + 1) % 3] };
+					const u32 pa{ ctx.position_ids[a] }, pb{ ctx.position_ids[b] };
+					if (ctx.edges.has_vertex_edge(b, a) && ctx.edges.has_position_edge(pb, pa)) continue;
+
+					const XMVECTOR edge{ XMLoadFloat3(&ctx.positions[b]) - XMLoadFloat3(&ctx.positions[a]) };
+					const XMVECTOR edge_normal{ XMVector3Normalize(XMVector3Cross(edge, n)) };
+					const f32 edge_d{ -XMVectorGetX(XMVector3Dot(edge_normal, XMLoadFloat3(&ctx.positions[a]))) };
+					const f32 weight{ border_weight * XMVectorGetX(XMVector3LengthSq(edge)) };
+					add_plane(ctx.quadrics[pa], edge_normal, edge_d, weight);
+					add_plane(ctx.quadrics[pb], edge_normal, edge_d, weight);
+				}
+			}
+		}
+
+		bool can_collapse(const simplifier_context& ctx, u32 from, u32 to)
+		{
+			const u32 pa{ ctx.position_ids[from] }, pb{ ctx.position_ids[to] };
+			const vertex_kind target{ ctx.kinds[pb] };
+
+			switch (ctx.kinds[pa])
+			{
+			case manifold: return true;
+			case border: return (target == border || target == locked) &&
+				!(ctx.edges.has_position_edge(pa, pb) && ctx.edges.has_position_edge(pb, pa));
+			case seam: return (target == seam || target == locked) &&
+				!(ctx.edges.has_vertex_edge(from, to) && ctx.edges.has_vertex_edge(to, from));
+			default: return false;
+			}
+		}
+
+		// Wedge of to's position that the other wedge of a seam vertex collapses to: the one it shares an edge with
+		u32 find_twin(const simplifier_context& ctx, u32 twin_from, u32 to)
+		{
+			u32 w{ to };
+			do
+			{
+				if (ctx.edges.has_vertex_edge(twin_from, w) || ctx.edges.has_vertex_edge(w, twin_from)) return w;
+				w = ctx.next_wedge[w];
+			} while (w != to);
+
+			return u32_invalid_id;
+		}
+
+		// Rejects collapses that turn a remaining triangle around from by more than 75 degrees or fold it over
+		bool flips_triangles(const simplifier_context& ctx, const u32* indices, const utl::vector<u32>& offsets,
+			const utl::vector<u32>& triangles, u32 from, u32 to)
+		{
+			const u32 pb{ ctx.position_ids[to] };
+			for (u32 i{ offsets[from] }; i < offsets[from + 1]; ++i)
+			{
+				const u32* t{ &indices[triangles[i] * 3] };
+				if (ctx.position_ids[t[0]] == pb || ctx.position_ids[t[1]] == pb || ctx.position_ids[t[2]] == pb) continue;
+				if (t[0] != from && t[1] != from && t[2] != from) continue;
+
+				XMVECTOR p[3];
+				for (u32 k{ 0 }; k < 3; ++k) p[k] = XMLoadFloat3(&ctx.positions[t[k]]);
+				const XMVECTOR before{ XMVector3Cross(p[1] - p[0], p[2] - p[0]) };
+				for (u32 k{ 0 }; k < 3; ++k) if (t[k] == from) p[k] = XMLoadFloat3(&ctx.positions[to]);
+				const XMVECTOR after{ XMVector3Cross(p[1] - p[0], p[2] - p[0]) };
+
+				const f32 dot{ XMVectorGetX(XMVector3Dot(before, after)) };
+				if (dot <= 0.25f * XMVectorGetX(XMVector3Length(before)) * XMVectorGetX(XMVector3Length(after))) return true;
+			}
+			return false;
+		}
+	} // anonymous namespace
+
+	simplify_result simplify(utl::vector<u32>& indices, const utl::vector<vertex>& vertices, u32 target_index_count, f32 target_error)
+	{
+		assert((indices.size() % 3) == 0);
+		const u32 vertex_count{ (u32)vertices.size() };
+		u32 index_count{ (u32)indices.size() };
+		if (index_count <= target_index_count || !vertex_count) return { index_count, 0.f };
+
+		simplifier_context ctx{};
+		const f32 extent{ mesh_extent(vertices) };
+		const f32 scale{ extent > 0.f ? 1.f / extent : 0.f };
+		ctx.positions.resize(vertex_count);
+		for (u32 i{ 0 }; i < vertex_count; ++i)
+		{
+			const math::v3& p{ vertices[i].position };
+			ctx.positions[i] = { p.x * scale, p.y * scale, p.z * scale };
+		}
+
+		build_wedges(ctx, vertices);
+		build_edges(ctx, indices.data(), index_count);
+		classify_vertices(ctx, indices.data(), index_count);
+		build_quadrics(ctx, indices.data(), index_count, vertices);
+
+		const f32 error_limit{ target_error * target_error };
+		f32 result_error{ 0.f };
+		utl::vector<collapse> collapses;
+		utl::vector<u32> offsets(vertex_count + 1);
+		utl::vector<u32> triangles;
+		utl::vector<u8> touched(vertex_count);
+		utl::vector<u8> removed;
+
+		while (index_count > target_index_count)
+		{
+			// Triangles of every vertex
+			std::fill(offsets.begin(), offsets.end(), 0);
+			for (u32 i{ 0 }; i < index_count; ++i) ++offsets[indices[i] + 1];
+			for (u32 v{ 0 }; v < vertex_count; ++v) offsets[v + 1] += offsets[v];
+			triangles.resize(index_count);
+			{
+				utl::vector<u32> fill{ offsets };
+				for (u32 i{ 0 }; i < index_count; ++i) triangles[fill[indices[i]]++] = i / 3;
+			}
+
+			collapses.clear();
+			for (u32 i{ 0 }; i < index_count; ++i)
+			{
+				const u32 edge[2]{ indices[i], indices[i % 3 == 2 ? i - 2 : i + 1] };
+				for (u32 k{ 0 }; k < 2; ++k)
+				{
+					const u32 from{ edge[k] }, to{ edge[1 - k] };
+					const u32 pa{ ctx.position_ids[from] }, pb{ ctx.position_ids[to] };
+					if (pa == pb || !can_collapse(ctx, from, to)) continue;
+
+					collapse c{ from, to, u32_invalid_id, u32_invalid_id, 0.f };
+					const math::v3& p{ ctx.positions[to] };
+					c.error = evaluate(ctx.quadrics[pa], p) + evaluate(ctx.attributes[from], p, vertices[to]);
+					if (ctx.kinds[pa] == seam)
+					{
+						c.twin_from = ctx.next_wedge[from];
+						c.twin_to = find_twin(ctx, c.twin_from, to);
+						if (c.twin_to == u32_invalid_id) continue;
+						c.error += evaluate(ctx.attributes[c.twin_from], p, vertices[c.twin_to]);
+					}
+
+					if (c.error <= error_limit) collapses.emplace_back(c);
+				}
+			}
+			if (collapses.empty()) break;
+
+			std::sort(collapses.begin(), collapses.end(), [](const collapse& a, const collapse& b) { return a.error < b.error; });
+
+			// Vertices collapse once per pass and not onto a vertex that collapsed, so the errors computed above stay exact
+			std::fill(touched.begin(), touched.end(), (u8)0);
+			removed.clear();
+			removed.resize(index_count / 3, 0);
+			u32 remaining{ index_count };
+			u32 collapse_count{ 0 };
+
+			for (const collapse& c : collapses)
+			{
+				if (remaining <= target_index_count) break;
+
+				const u32 pa{ ctx.position_ids[c.from] }, pb{ ctx.position_ids[c.to] };
+				if (touched[pa] || touched[pb]) continue;
+				if (flips_triangles(ctx, indices.data(), offsets, triangles, c.from, c.to)) continue;
+				if (c.twin_from != u32_invalid_id && flips_triangles(ctx, indices.data(), offsets, triangles, c.twin_from, c.twin_to)) continue;
+
+				const u32 wedges[2][2]{ { c.from, c.to }, { c.twin_from, c.twin_to } };
+				for (const auto& w : wedges)
+				{
+					if (w[0] == u32_invalid_id) continue;
+					for (u32 i{ offsets[w[0]] }; i < offsets[w[0] + 1]; ++i)
+					{
+						const u32 t{ triangles[i] };
+						if (removed[t]) continue;
+
+						u32* triangle{ &indices[t * 3] };
+						for (u32 k{ 0 }; k < 3; ++k) if (triangle[k] == w[0]) triangle[k] = w[1];
+
+						const u32 p0{ ctx.position_ids[triangle[0]] }, p1{ ctx.position_ids[triangle[1]] }, p2{ ctx.position_ids[triangle[2]] };
+						if (p0 == p1 || p1 == p2 || p2 == p0)
+						{
+							removed[t] = 1;
+							remaining -= 3;
+						}
+					}
+				}
+
+				add_quadric(ctx.quadrics[pb], ctx.quadrics[pa]);
+				add_attribute_quadric(ctx.attributes[c.to], ctx.attributes[c.from]);
+				if (c.twin_from != u32_invalid_id) add_attribute_quadric(ctx.attributes[c.twin_to], ctx.attributes[c.twin_from]);
+				touched[pa] = 1;
+				touched[pb] = 1;
+				result_error = std::max(result_error, c.error);
+				++collapse_count;
+			}
+			if (!collapse_count) break;
+
+			u32 write{ 0 };
+			for (u32 t{ 0 }; t < index_count / 3; ++t)
+			{
+				if (removed[t]) continue;
+				for (u32 k{ 0 }; k < 3; ++k) indices[write++] = indices[t * 3 + k];
+			}
+			assert(write == remaining);
+			index_count = remaining;
+			build_edges(ctx, indices.data(), index_count);
+		}
+
+		indices.resize(index_count);
+		return { index_count, sqrtf(result_error) };
+	}
+
+	f32 mesh_extent(const utl::vector<vertex>& vertices)
+	{
+		if (vertices.empty()) return 0.f;
+
+		XMVECTOR min{ XMLoadFloat3(&vertices[0].position) };
+		XMVECTOR max{ min };
+		for (const auto& v : vertices)
+		{
+			const XMVECTOR p{ XMLoadFloat3(&v.position) };
+			min = XMVectorMin(min, p);
+			max = XMVectorMax(max, p);
+		}
+
+		XMFLOAT3 size;
+		XMStoreFloat3(&size, max - min);
+		return std::max(size.x, std::max(size.y, size.z));
+	}
+
+	f32 lod_threshold(f32 error)
+	{
+		return error * reference_height / (2.f * tanf(reference_fov_y * 0.5f) * max_pixel_error);
+	}
+}
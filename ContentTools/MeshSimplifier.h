@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Geometry.h"
+
+namespace primal::tools::mesh_simplifier
+{
+	constexpr bool generate_lods{ true };				// Groups without LODs in the source get a chain of simplified LODs
+	constexpr u32 max_lod_count{ 4 };					// Including the source LOD
+	constexpr f32 lod_triangle_ratio{ 0.5f };			// Triangles of each generated LOD relative to the previous one
+	constexpr f32 max_lod_error{ 0.02f };				// Relative to the mesh extent, the chain ends at a LOD that can't get within it
+	constexpr u32 min_lod_triangles{ 64 };				// The chain ends before a LOD with fewer triangles
+	constexpr f32 normal_weight{ 0.5f };				// Relative error per unit a normal differs from the normals interpolated around it
+	constexpr f32 uv_weight{ 1.f };						// Relative error per unit a UV differs from the UVs interpolated around it
+	constexpr f32 border_weight{ 10.f };				// Weight of the planes that keep open borders and UV seams in place
+
+	// A LOD is used from the camera distance at which its error projects to max_pixel_error on the reference view
+	constexpr f32 reference_fov_y{ 0.25f * math::pi };
+	constexpr f32 reference_height{ 1080.f };
+	constexpr f32 max_pixel_error{ 1.f };
+
+	struct simplify_result
+	{
+		u32			index_count;
+		f32			error;				// Relative to the mesh extent, the largest error of the collapses that were made
+	};
+
+	// Collapses edges in the order of the quadric error they add (Garland and Heckbert 1997) until indices has at most
+	// target_index_count indices or the next collapse would add more than target_error, relative to the mesh extent.
+	// Collapses keep the vertex they collapse to, so vertices aren't changed and the removed ones are just no longer referenced.
+	// The error includes how far normals and UVs get from the values the remaining triangles interpolate.
+	// Vertices on open borders and UV seams only collapse along the border or the seam, corners where they meet are kept.
+	simplify_result simplify(utl::vector<u32>& indices, const utl::vector<vertex>& vertices, u32 target_index_count, f32 target_error);
+
+	// Largest side of the bounding box of the vertices
+	[[nodiscard]] f32 mesh_extent(const utl::vector<vertex>& vertices);
+
+	// Camera distance at which error, in world units, projects to max_pixel_error on the reference view
+	[[nodiscard]] f32 lod_threshold(f32 error);
+}
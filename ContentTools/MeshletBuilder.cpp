@@ -0,0 +1,277 @@
+#include "MeshletBuilder.h"
+#include <algorithm>
+#include <cmath>
+
+namespace primal::tools::meshlet_builder
+{
+	namespace
+	{
+		using namespace DirectX;
+		using content::meshlet_max_vertices;
+		using content::meshlet_max_triangles;
+
+		// Triangles that use each vertex
+		struct vertex_adjacency
+		{
+			utl::vector<u32>					counts;
+			utl::vector<u32>					offsets;
+			utl::vector<u32>					triangles;
+		};
+
+		void build_adjacency(vertex_adjacency& adjacency, const u32* indices, u32 index_count, u32 vertex_count)
+		{
+			adjacency.counts.resize(vertex_count, 0);
+			adjacency.offsets.resize(vertex_count, 0);
+			adjacency.triangles.resize(index_count);
+
+			for (u32 i{ 0 }; i < index_count; ++i)
+			{
+				assert(indices[i] < vertex_count);
+				++adjacency.counts[indices[i]];
+			}
+
+			u32 offset{ 0 };
+			for (u32 i{ 0 }; i < vertex_count; ++i)
+			{
+				adjacency.offsets[i] = offset;
+				offset += adjacency.counts[i];
+			}
+
+			utl::vector<u32> fill{ adjacency.offsets };
+			for (u32 i{ 0 }; i < index_count; ++i)
+			{
+				adjacency.triangles[fill[indices[i]]++] = i / 3;
+			}
+		}
+
+		// Meshlet that is being grown
+		struct open_meshlet
+		{
+			utl::vector<u32>					vertices;
+			utl::vector<u32>					triangles;
+			XMVECTOR							box_min;
+			XMVECTOR							box_max;
+			XMVECTOR							normal_sum;
+		};
+
+		struct triangle_data
+		{
+			utl::vector<math::v3>				normals;		// Unit normal facing the viewer that sees the front, zero for degenerate triangles
+			utl::vector<math::v3>				box_min;
+			utl::vector<math::v3>				box_max;
+		};
+
+		u32 extra_vertices(const u32* triangle, const utl::vector<u32>& owner, u32 meshlet_index)
+		{
+			u32 extra{ 0 };
+			for (u32 k{ 0 }; k < 3; ++k)
+			{
+				extra += owner[triangle[k]] != meshlet_index ? 1 : 0;
+			}
+			// Degenerate triangles repeat a vertex
+			if (triangle[0] == triangle[1] || triangle[0] == triangle[2]) extra -= owner[triangle[0]] != meshlet_index ? 1 : 0;
+			if (triangle[1] == triangle[2]) extra -= owner[triangle[1]] != meshlet_index ? 1 : 0;
+			return extra;
+		}
+
+		f32 box_diagonal(XMVECTOR box_min, XMVECTOR box_max)
+		{
+			return XMVectorGetX(XMVector3Length(box_max - box_min));
+		}
+
+		// Lower is better. The number of added vertices comes first, distance and normal only decide between equal counts.
+		f32 triangle_score(const open_meshlet& m, const triangle_data& data, u32 t, u32 extra)
+		{
+			const XMVECTOR centroid{ (XMLoadFloat3(&data.box_min[t]) + XMLoadFloat3(&data.box_max[t])) * 0.5f };
+			const XMVECTOR center{ (m.box_min + m.box_max) * 0.5f };
+			const f32 diagonal{ std::max(box_diagonal(m.box_min, m.box_max), 1e-20f) };
+			const f32 distance{ std::min(XMVectorGetX(XMVector3Length(centroid - center)) / diagonal, 1.f) };
+
+			const XMVECTOR axis{ XMVector3Normalize(m.normal_sum) };
+			const f32 spread{ 0.5f * (1.f - XMVectorGetX(XMVector3Dot(XMLoadFloat3(&data.normals[t]), axis))) };
+
+			return (f32)extra + cone_weight * spread + (1.f - cone_weight) * distance;
+		}
+
+		content::meshlet close_meshlet(const open_meshlet& m, const triangle_data& data, const u32* indices,
+			const u8* positions, u32 stride, u32 first_index)
+		{
+			auto position{ [positions, stride](u32 v) { return XMLoadFloat3((const math::v3*)(positions + (u64)v * stride)); } };
+
+			content::meshlet result{};
+			result.first_index = first_index;
+			result.triangle_count = (u32)m.triangles.size();
+			result.vertex_count = (u32)m.vertices.size();
+
+			const XMVECTOR center{ (m.box_min + m.box_max) * 0.5f };
+			XMVECTOR radius_sq{ XMVectorZero() };
+			for (const u32 v : m.vertices)
+			{
+				radius_sq = XMVectorMax(radius_sq, XMVector3LengthSq(position(v) - center));
+			}
+			XMStoreFloat3(&result.center, center);
+			result.radius = XMVectorGetX(XMVectorSqrt(radius_sq));
+
+			// The cone can only cull when every triangle's normal is within 90 degrees of the axis
+			XMStoreFloat3(&result.cone_apex, center);
+			result.cone_axis = { 0.f, 0.f, 1.f };
+			result.cone_cutoff = 1.f;
+
+			const f32 axis_length{ XMVectorGetX(XMVector3Length(m.normal_sum)) };
+			if (axis_length < 1e-6f) return result;
+			const XMVECTOR axis{ m.normal_sum / axis_length };
+			XMStoreFloat3(&result.cone_axis, axis);
+
+			f32 min_cos{ 1.f };
+			for (const u32 t : m.triangles)
+			{
+				const XMVECTOR n{ XMLoadFloat3(&data.normals[t]) };
+				if (XMVector3Equal(n, XMVectorZero())) continue;
+				min_cos = std::min(min_cos, XMVectorGetX(XMVector3Dot(n, axis)));
+			}
+			if (min_cos <= 0.f) return result;
+
+			// Move the apex back along the axis until every triangle's plane is behind it
+			f32 max_t{ 0.f };
+			for (const u32 t : m.triangles)
+			{
+				const XMVECTOR n{ XMLoadFloat3(&data.normals[t]) };
+				if (XMVector3Equal(n, XMVectorZero())) continue;
+				const f32 dc{ XMVectorGetX(XMVector3Dot(center - position(indices[t * 3]), n)) };
+				const f32 dn{ XMVectorGetX(XMVector3Dot(axis, n)) };
+				max_t = std::max(max_t, dc / dn);
+			}
+			XMStoreFloat3(&result.cone_apex, center - axis * max_t);
+			result.cone_cutoff = std::sqrt(1.f - min_cos * min_cos);
+			return result;
+		}
+	} // anonymous namespace
+
+	void build_meshlets(utl::vector<u32>& indices, const u8* positions, const u8* normals, u32 vertex_count, u32 stride, utl::vector<content::meshlet>& meshlets)
+	{
+		assert((indices.size() % 3) == 0 && positions);
+		meshlets.clear();
+		const u32 index_count{ (u32)indices.size() };
+		const u32 triangle_count{ index_count / 3 };
+		if (!triangle_count) return;
+
+		auto position{ [positions, stride](u32 v) { return XMLoadFloat3((const math::v3*)(positions + (u64)v * stride)); } };
+
+		// Triangle normals follow the winding, the vertex normals decide which side of the winding is the front
+		triangle_data data{};
+		data.normals.resize(triangle_count);
+		data.box_min.resize(triangle_count);
+		data.box_max.resize(triangle_count);
+		f32 facing{ 0.f };
+		for (u32 t{ 0 }; t < triangle_count; ++t)
+		{
+			const u32* const triangle{ &indices[t * 3] };
+			const XMVECTOR v0{ position(triangle[0]) }, v1{ position(triangle[1]) }, v2{ position(triangle[2]) };
+			const XMVECTOR n{ XMVector3Cross(v1 - v0, v2 - v0) };
+			const f32 length{ XMVectorGetX(XMVector3Length(n)) };
+			XMStoreFloat3(&data.normals[t], length > 0.f ? n / length : XMVectorZero());
+			XMStoreFloat3(&data.box_min[t], XMVectorMin(XMVectorMin(v0, v1), v2));
+			XMStoreFloat3(&data.box_max[t], XMVectorMax(XMVectorMax(v0, v1), v2));
+
+			if (!normals) continue;
+			XMVECTOR vertex_normal{ XMVectorZero() };
+			for (u32 k{ 0 }; k < 3; ++k) vertex_normal += XMLoadFloat3((const math::v3*)(normals + (u64)triangle[k] * stride));
+			facing += XMVectorGetX(XMVector3Dot(n, vertex_normal));
+		}
+		if (facing < 0.f)
+		{
+			for (auto& n : data.normals) n = { -n.x, -n.y, -n.z };
+		}
+
+		vertex_adjacency adjacency{};
+		build_adjacency(adjacency, indices.data(), index_count, vertex_count);
+
+		utl::vector<u8> emitted(triangle_count, 0);
+		utl::vector<u32> owner(vertex_count, u32_invalid_id);		// Meshlet that last took the vertex
+		utl::vector<u32> output;
+		output.reserve(index_count);
+		u32 cursor{ 0 };											// Triangles before it are all in meshlets
+
+		open_meshlet m{};
+		auto add_triangle{ [&](u32 t) {
+			const u32 meshlet_index{ (u32)meshlets.size() };
+			const u32* const triangle{ &indices[t * 3] };
+			for (u32 k{ 0 }; k < 3; ++k)
+			{
+				const u32 v{ triangle[k] };
+				if (owner[v] != meshlet_index)
+				{
+					owner[v] = meshlet_index;
+					m.vertices.emplace_back(v);
+				}
+				output.emplace_back(v);
+			}
+			m.triangles.emplace_back(t);
+			emitted[t] = 1;
+
+			const XMVECTOR box_min{ XMLoadFloat3(&data.box_min[t]) }, box_max{ XMLoadFloat3(&data.box_max[t]) };
+			const bool first{ m.triangles.size() == 1 };
+			m.box_min = first ? box_min : XMVectorMin(m.box_min, box_min);
+			m.box_max = first ? box_max : XMVectorMax(m.box_max, box_max);
+			m.normal_sum = (first ? XMVectorZero() : m.normal_sum) + XMLoadFloat3(&data.normals[t]);
+		} };
+
+		while (true)
+		{
+			while (cursor < triangle_count && emitted[cursor]) ++cursor;
+			if (cursor == triangle_count) break;
+
+			const u32 meshlet_index{ (u32)meshlets.size() };
+			const u32 first_index{ (u32)output.size() };
+			m.vertices.clear();
+			m.triangles.clear();
+			add_triangle(cursor);
+
+			while (m.triangles.size() < meshlet_max_triangles)
+			{
+				u32 best{ u32_invalid_id };
+				f32 best_score{ 0.f };
+				for (const u32 v : m.vertices)
+				{
+					const u32 first{ adjacency.offsets[v] };
+					for (u32 i{ first }; i < first + adjacency.counts[v]; ++i)
+					{
+						const u32 t{ adjacency.triangles[i] };
+						if (emitted[t]) continue;
+
+						const u32 extra{ extra_vertices(&indices[t * 3], owner, meshlet_index) };
+						if (m.vertices.size() + extra > meshlet_max_vertices) continue;
+
+						const f32 score{ triangle_score(m, data, t, extra) };
+						if (best == u32_invalid_id || score < best_score)
+						{
+							best = t;
+							best_score = score;
+						}
+					}
+				}
+
+				// Nothing connected fits, continue with the next triangle in index order if it's close
+				if (best == u32_invalid_id)
+				{
+					while (cursor < triangle_count && emitted[cursor]) ++cursor;
+					if (cursor == triangle_count) break;
+					if (m.vertices.size() + extra_vertices(&indices[cursor * 3], owner, meshlet_index) > meshlet_max_vertices) break;
+
+					const f32 diagonal{ box_diagonal(m.box_min, m.box_max) };
+					const XMVECTOR grown_min{ XMVectorMin(m.box_min, XMLoadFloat3(&data.box_min[cursor])) };
+					const XMVECTOR grown_max{ XMVectorMax(m.box_max, XMLoadFloat3(&data.box_max[cursor])) };
+					if (box_diagonal(grown_min, grown_max) > max_jump_growth * diagonal) break;
+					best = cursor;
+				}
+
+				add_triangle(best);
+			}
+
+			meshlets.emplace_back(close_meshlet(m, data, indices.data(), positions, stride, first_index));
+		}
+
+		assert(output.size() == index_count);
+		indices.swap(output);
+	}
+}
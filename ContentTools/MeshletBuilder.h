@@ -0,0 +1,19 @@
+#pragma once
+
+#include "ToolsCommon.h"
+#include "Content/Meshlet.h"
+
+namespace primal::tools::meshlet_builder
+{
+	constexpr bool enabled{ true };
+	constexpr f32 cone_weight{ 0.5f };				// 0 grows meshlets by distance only, 1 by normal only. Narrower cones cull more backfaces.
+	constexpr f32 max_jump_growth{ 2.f };			// A meshlet continues with a triangle it doesn't share a vertex with only if its bounds grow at most this much
+
+	// Groups the triangles into meshlets of at most content::meshlet_max_vertices vertices and content::meshlet_max_triangles
+	// triangles and moves the triangles of each meshlet next to each other in indices. A meshlet grows over the triangles that
+	// share its vertices, preferring the ones that add the fewest vertices and stay close to its position and normal.
+	// Meshlets are started and continued in index order, so an index buffer optimized for the vertex cache and overdraw mostly keeps that order.
+	// positions and normals point to the first vertex's position and normal, stride is the vertex size.
+	// Normals only decide which side the triangles face, without them counter-clockwise triangles face the viewer.
+	void build_meshlets(utl::vector<u32>& indices, const u8* positions, const u8* normals, u32 vertex_count, u32 stride, utl::vector<content::meshlet>& meshlets);
+}
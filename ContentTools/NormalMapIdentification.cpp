@@ -32,7 +32,7 @@ namespace primal::tools
 
 			color operator*(f32 s)
 			{
-				r += s; g *= s; b *= s; a *= s;
+				r *= s; g *= s; b *= s; a *= s;
 				return *this;
 			}
 
@@ -63,13 +63,12 @@ namespace primal::tools
 			return (v.z < 0.f || v_length_sq < vector_length_sq_rejection_threshold) ? -1 : 1;
 		}
 
-		bool evaluate_image(const Image *const image, sampler sample)
+		bool evaluate_image(const u8 *const pixels, const size_t image_size, sampler sample)
 		{
 			constexpr u32 sample_count{ 4096 };
-			const size_t image_size{ image->slicePitch };
-			const size_t sample_interval{ std::max(image_size / sample_count, (size_t)4) };
+			// Samples have to start on a pixel, otherwise they read channels of two pixels
+			const size_t sample_interval{ std::max(image_size / sample_count, (size_t)4) & ~(size_t)3 };
 			const u32 min_sample_count{ std::max((u32)(image_size / sample_interval) >> 2, (u32)1) };
-			const u8 *const pixels{ image->pixels };
 
 			u32 accepted_samples{ 0 };
 			u32 rejected_samples{ 0 };
@@ -118,6 +117,12 @@ namespace primal::tools
 		const DXGI_FORMAT image_format{ image->format };
 		if (BitsPerPixel(image_format) != 32 || BitsPerColor(image_format) != 8) return false;
 
-		return evaluate_image(image, IsBGR(image_format) ? sample_pixel_bgr : sample_pixel_rgb);
+		return evaluate_image(image->pixels, image->slicePitch, IsBGR(image_format) ? sample_pixel_bgr : sample_pixel_rgb);
 	}
-}
\ No newline at end of file
+
+	// Same test for tightly packed 8-bit RGBA or BGRA pixels, used by the block compressor
+	bool is_normal_map(const u8 *const pixels, u64 size, bool is_bgr)
+	{
+		return pixels && size >= 4 && evaluate_image(pixels, (size_t)size, is_bgr ? sample_pixel_bgr : sample_pixel_rgb);
+	}
+}
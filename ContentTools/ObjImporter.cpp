@@ -1,4 +1,6 @@
 #include "ObjImporter.h"
+#include "Geometry.h"
+#include "MeshletBuilder.h"
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "Content/tiny_obj_loader.h"
@@ -10,6 +12,12 @@
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <execution>
+#include <limits>
+#include <thread>
 #include "../Engine/Utilities/IOStream.h"
 #include "TemplateShader/PBR_Template_Shader_v1.h"
 
@@ -41,14 +49,64 @@ namespace primal::tools
 			}
 		};
 
+		// The three indices of a face corner mixed into 64 bits with the MurmurHash3 finalizer
+		[[nodiscard]] u64 hash_indices(s32 v, s32 vt, s32 vn)
+		{
+			u64 h{ (((u64)(u32)v << 32) | (u32)vt) ^ ((u64)(u32)vn * 0x9e3779b97f4a7c15ull) };
+			h ^= h >> 33;
+			h *= 0xff51afd7ed558ccdull;
+			h ^= h >> 33;
+			h *= 0xc4ceb9fe1a85ec53ull;
+			h ^= h >> 33;
+			return h;
+		}
+
 		struct hash_idx
 		{
 			size_t operator()(const tinyobj::index_t& a) const
 			{
-				return ((a.vertex_index ^ a.texcoord_index << 1) >> 1) ^ (a.normal_index << 1);
+				return (size_t)hash_indices(a.vertex_index, a.texcoord_index, a.normal_index);
 			}
 		};
 
+		// Packs the vertices against the geometry's bounding box and narrows the indices to 16 bits when they fit.
+		// The extents are written after the vertices and are the quantization box the loader decodes them with.
+		void write_vertices_and_indices(std::fstream& outfile, geometry_config* g)
+		{
+			const content::quantization_box box{ content::make_quantization_box(g->min_extents, g->max_extents) };
+			utl::vector<content::packed_vertex> vertices(g->vertex_count);
+			for (u32 i{ 0 }; i < g->vertex_count; ++i)
+			{
+				const Vertex& v{ g->vertices[i] };
+				vertices[i] = content::pack_vertex(v.pos, { v.texCoord.x, v.texCoord.y }, v.normal, v.tangent, box);
+			}
+
+			u32 vertex_size{ sizeof(content::packed_vertex) };
+			outfile.write(reinterpret_cast<char*>(&vertex_size), sizeof(u32));
+			outfile.write(reinterpret_cast<char*>(&g->vertex_count), sizeof(u32));
+			outfile.write(reinterpret_cast<char*>(vertices.data()), vertices.size() * sizeof(content::packed_vertex));
+
+			u32 index_size{ g->vertex_count < content::max_u16_index_vertices ? (u32)sizeof(u16) : (u32)sizeof(u32) };
+			outfile.write(reinterpret_cast<char*>(&index_size), sizeof(u32));
+			outfile.write(reinterpret_cast<char*>(&g->index_count), sizeof(u32));
+			if (index_size == sizeof(u16))
+			{
+				utl::vector<u16> indices(g->index_count);
+				for (u32 i{ 0 }; i < g->index_count; ++i) indices[i] = (u16)g->indices[i];
+				outfile.write(reinterpret_cast<char*>(indices.data()), indices.size() * sizeof(u16));
+			}
+			else
+			{
+				outfile.write(reinterpret_cast<char*>(g->indices.data()), g->indices.size() * sizeof(u32));
+			}
+
+			char message[512];
+			sprintf_s(message, "Vertex packing: %s, %u vertices, %u indices, %llu -> %llu bytes\n", g->name, g->vertex_count, g->index_count,
+				(u64)g->vertex_count * sizeof(Vertex) + (u64)g->index_count * sizeof(u32),
+				(u64)g->vertex_count * vertex_size + (u64)g->index_count * index_size);
+			OutputDebugStringA(message);
+		}
+
 		bool write_kms_file(const char* file_package, const char* filename, u32 count, utl::vector<geometry_config>& out_geometry_darray)
 		{
 			std::fstream outfile;
@@ -60,7 +118,7 @@ namespace primal::tools
 
 			std::string fullpath = file_package_path.append("\\").append(filename).append(kms_ext);
 
-			outfile.open(fullpath.c_str(), std::ios::out | std::ios::app | std::ios::binary);
+			outfile.open(fullpath.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
 
 			if (!outfile.is_open()) return false;
 
@@ -72,21 +130,8 @@ namespace primal::tools
 			{
 				geometry_config* g = &out_geometry_darray[i];
 
-				// Vertices (size/count/array)
-				outfile.write(reinterpret_cast<char*>(&g->vertex_size), sizeof(u32));
-				outfile.write(reinterpret_cast<char*>(&g->vertex_count), sizeof(u32));
-				for (u32 x{ 0 }; x < g->vertex_count; ++x)
-				{
-					outfile.write(reinterpret_cast<char*>(&g->vertices[x]), sizeof(Vertex));
-				}
-
-				// Indices (size/count/array)
-				outfile.write(reinterpret_cast<char*>(&g->index_size), sizeof(u32));
-				outfile.write(reinterpret_cast<char*>(&g->index_count), sizeof(u32));
-				for (u32 y{ 0 }; y < g->index_count; ++y)
-				{
-					outfile.write(reinterpret_cast<char*>(&g->indices[y]), sizeof(u32));
-				}
+				// Vertices and indices (size/count/array)
+				write_vertices_and_indices(outfile, g);
 
 				// Name  
 				u32 g_name_length = (u32)strlen(g->name) + 1;
@@ -131,6 +176,15 @@ namespace primal::tools
 				outfile.write(reinterpret_cast<char*>(&g->max_extents), sizeof(math::v3));
 			}
 
+			// Meshlets (count/array) of each geometry, after all geometries so files without them still load
+			for (u32 i{ 0 }; i < count; ++i)
+			{
+				geometry_config* g = &out_geometry_darray[i];
+				u32 meshlet_count = (u32)g->meshlets.size();
+				outfile.write(reinterpret_cast<char*>(&meshlet_count), sizeof(u32));
+				outfile.write(reinterpret_cast<char*>(g->meshlets.data()), meshlet_count * sizeof(content::meshlet));
+			}
+
 			outfile.close();
 
 			return true;
@@ -147,7 +201,7 @@ namespace primal::tools
 
 			std::string fullpath = file_package_path.append("\\").append(filename).append(kms_ext);
 
-			outfile.open(fullpath.c_str(), std::ios::out | std::ios::app | std::ios::binary);
+			outfile.open(fullpath.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
 
 			if (!outfile.is_open()) return false;
 
@@ -160,21 +214,8 @@ namespace primal::tools
 			{
 				geometry_config* g = &out_geometry_darray;
 
-				// Vertices (size/count/array)
-				outfile.write(reinterpret_cast<char*>(&g->vertex_size), sizeof(u32));
-				outfile.write(reinterpret_cast<char*>(&g->vertex_count), sizeof(u32));
-				for (u32 x{ 0 }; x < g->vertex_count; ++x)
-				{
-					outfile.write(reinterpret_cast<char*>(&g->vertices[x]), sizeof(Vertex));
-				}
-
-				// Indices (size/count/array)
-				outfile.write(reinterpret_cast<char*>(&g->index_size), sizeof(u32));
-				outfile.write(reinterpret_cast<char*>(&g->index_count), sizeof(u32));
-				for (u32 y{ 0 }; y < g->index_count; ++y)
-				{
-					outfile.write(reinterpret_cast<char*>(&g->indices[y]), sizeof(u32));
-				}
+				// Vertices and indices (size/count/array)
+				write_vertices_and_indices(outfile, g);
 
 				// Name  
 				u32 g_name_length = (u32)strlen(g->name) + 1;
@@ -219,6 +260,11 @@ namespace primal::tools
 				outfile.write(reinterpret_cast<char*>(&g->max_extents), sizeof(math::v3));
 			}
 
+			// Meshlets (count/array), after the geometry so files without them still load
+			u32 meshlet_count = (u32)out_geometry_darray.meshlets.size();
+			outfile.write(reinterpret_cast<char*>(&meshlet_count), sizeof(u32));
+			outfile.write(reinterpret_cast<char*>(out_geometry_darray.meshlets.data()), meshlet_count * sizeof(content::meshlet));
+
 			outfile.close();
 
 			return true;
@@ -226,8 +272,9 @@ namespace primal::tools
 
 		void generate_bounding_box_and_center(geometry_config* geo)
 		{
-			geo->min_extents = math::v3{ 0, 0, 0 };
-			geo->max_extents = math::v3{ 0, 0, 0 };
+			// Tight around the vertices, the packed positions are quantized in this box
+			geo->min_extents = geo->vertex_count ? geo->vertices[0].pos : math::v3{ 0, 0, 0 };
+			geo->max_extents = geo->min_extents;
 
 			for (u32 i{ 0 }; i < geo->vertex_count; ++i)
 			{
@@ -262,82 +309,513 @@ namespace primal::tools
 			geo->center.z = (geo->min_extents.z + geo->max_extents.z) / 2.f;
 		}
 
+		// Reorders the indices into meshlets, call after the indices are final
+		void generate_meshlets(geometry_config* geo)
+		{
+			if (!meshlet_builder::enabled || geo->vertices.empty()) return;
+			meshlet_builder::build_meshlets(geo->indices, (const u8*)&geo->vertices[0].pos, (const u8*)&geo->vertices[0].normal,
+				geo->vertex_count, sizeof(Vertex), geo->meshlets);
+		}
+
+		// Every vertex of a triangle takes its tangent, later triangles overwrite the ones before them
 		void generate_tangents(geometry_config* geos)
 		{
 			assert(geos->index_count % 3 == 0);
 			using namespace DirectX;
 			for (u32 i{ 0 }; i < geos->index_count; i += 3)
 			{
-				u32 i0 = geos->indices[i];
-				u32 i1 = geos->indices[i + 1];
-				u32 i2 = geos->indices[i + 2];
-
-				math::v3 edge1{ geos->vertices[i1].pos.x - geos->vertices[i0].pos.x,
-					geos->vertices[i1].pos.y - geos->vertices[i0].pos.y,
-					geos->vertices[i1].pos.z - geos->vertices[i0].pos.z };
-				math::v3 edge2{ geos->vertices[i2].pos.x - geos->vertices[i0].pos.x,
-					geos->vertices[i2].pos.y - geos->vertices[i0].pos.y,
-					geos->vertices[i2].pos.z - geos->vertices[i0].pos.z };
-
-				f32 deltaU1 = geos->vertices[i1].texCoord.x - geos->vertices[i0].texCoord.x;
-				f32 deltaV1 = geos->vertices[i1].texCoord.y - geos->vertices[i0].texCoord.y;
-
-				f32 deltaU2 = geos->vertices[i2].texCoord.x - geos->vertices[i0].texCoord.x;
-				f32 deltaV2 = geos->vertices[i2].texCoord.y - geos->vertices[i0].texCoord.y;
-
-				f32 dividend = (deltaU1 * deltaV2 - deltaU2 * deltaV1);
-				f32 fc = 1.f / dividend;
-
-				math::v3 tangent{ fc * (deltaV2 * edge1.x - deltaV1 * edge2.x),
-					fc * (deltaV2 * edge1.y - deltaV1 * edge2.y),
-					fc * (deltaV2 * edge1.z - deltaV1 * edge2.z)};
-
-				XMVECTOR tang = XMLoadFloat3(&tangent);
-				tang = XMVector3Normalize(tang);
-				XMStoreFloat3(&tangent, tang);
-
-				f32 sx = deltaU1, sy = deltaU2;
-				f32 tx = deltaV1, ty = deltaV2;
-				f32 handedness = ((tx * sy - ty * sx) < 0.f) ? -1.f : 1.f;
-				math::v3 t4{ tangent.x * handedness, tangent.y * handedness, tangent.z * handedness };
-				geos->vertices[i0].tangent = t4;
-				geos->vertices[i1].tangent = t4;
-				geos->vertices[i2].tangent = t4;
+				Vertex& v0{ geos->vertices[geos->indices[i]] };
+				Vertex& v1{ geos->vertices[geos->indices[i + 1]] };
+				Vertex& v2{ geos->vertices[geos->indices[i + 2]] };
+
+				const XMVECTOR p0{ XMLoadFloat3(&v0.pos) };
+				const XMVECTOR edge1{ XMLoadFloat3(&v1.pos) - p0 };
+				const XMVECTOR edge2{ XMLoadFloat3(&v2.pos) - p0 };
+
+				// x and y are the u and v deltas of each edge
+				const XMVECTOR uv0{ XMLoadFloat3(&v0.texCoord) };
+				const XMVECTOR delta1{ XMLoadFloat3(&v1.texCoord) - uv0 };
+				const XMVECTOR delta2{ XMLoadFloat3(&v2.texCoord) - uv0 };
+
+				const XMVECTOR fc{ XMVectorReciprocal(XMVector2Cross(delta1, delta2)) };
+				XMVECTOR tangent{ (edge1 * XMVectorSplatY(delta2) - edge2 * XMVectorSplatY(delta1)) * fc };
+				tangent = XMVector3Normalize(tangent);
+
+				const XMVECTOR flip{ XMVectorLess(XMVector2Cross(delta2, delta1), XMVectorZero()) };
+				tangent = XMVectorSelect(tangent, XMVectorNegate(tangent), flip);
+
+				XMStoreFloat3(&v0.tangent, tangent);
+				XMStoreFloat3(&v1.tangent, tangent);
+				XMStoreFloat3(&v2.tangent, tangent);
 			}
 		}
 
-		bool generate_shader(const void* const data, const char* file_package)
+		// OBJ files are parsed in chunks of lines on their own threads. Faces can index the vertices before them relatively and
+		// quads are split along their shorter diagonal, so they're resolved in a second parallel pass once the vertex counts of
+		// every chunk are known. Numbers are read with the tinyobj parsers, so the values are the same as LoadObj's.
+		namespace obj
 		{
-			tinyobj::material_t material_data{ *(tinyobj::material_t*)data };
+			constexpr u64 min_chunk_size{ 1ull << 20 };
 
+			struct corner
 			{
-				std::string out_vertex_shader_name{ file_package };
-				out_vertex_shader_name.append("//").append("shaders");
-				if (_access(out_vertex_shader_name.c_str(), 0) == -1)
-					OutputDebugStringA(std::to_string(_mkdir(out_vertex_shader_name.c_str())).c_str());
-				out_vertex_shader_name.append("\\").append(material_data.name.c_str()).append(".vert");
-				std::ofstream vert_shader{ out_vertex_shader_name };
-				if (!vert_shader.is_open())
+				s32								v;
+				s32								vt;				// -1 without texture coordinates
+				s32								vn;				// -1 without normals
+			};
+
+			struct event_type
+			{
+				enum type : u32
 				{
-					OutputDebugStringA("Failed to open vertex shader to write!");
-					return false;
+					group = 0,
+					object,
+					material,
+				};
+			};
+
+			struct event
+			{
+				event_type::type				type;
+				u32								face;			// Faces of the chunk before the event, triangles once they're resolved
+				std::string						name;
+			};
+
+			struct chunk
+			{
+				char*							begin;
+				char*							end;
+				utl::vector<f32>				positions;
+				utl::vector<f32>				texcoords;
+				utl::vector<f32>				normals;
+				utl::vector<corner>				corners;		// face_sizes[i] for face i
+				utl::vector<u32>				face_sizes;
+				utl::vector<u32>				relative;		// corner * 3 + component of the indices that count back from the chunk's vertices
+				utl::vector<event>				events;
+				utl::vector<std::string>		material_libraries;
+				utl::vector<corner>				triangles;
+				u32								first_position;
+				u32								first_texcoord;
+				u32								first_normal;
+				u32								first_triangle;
+				u32								dropped_faces;
+			};
+
+			struct shape
+			{
+				std::string						name;
+				s32								material_id;	// Of its first face, like tinyobj's material_ids[0]
+				u32								first_triangle;
+				u32								triangle_count;
+			};
+
+			struct model
+			{
+				std::vector<f32>				positions;		// tinyobj's triangulation takes them
+				utl::vector<f32>				texcoords;
+				utl::vector<f32>				normals;
+				utl::vector<corner>				triangles;
+				utl::vector<shape>				shapes;
+				std::vector<tinyobj::material_t> materials;
+				u32								chunk_count;
+				u32								dropped_faces;
+			};
+
+			[[nodiscard]] constexpr bool is_space(char c) { return c == ' ' || c == '\t'; }
+			[[nodiscard]] constexpr bool is_new_line(char c) { return c == '\r' || c == '\n' || c == '\0'; }
+
+			// 1-based indices are absolute, negative ones count back from the vertices read so far, 0 is missing
+			void add_index(chunk& c, s32 index, u32 count, u32 component, s32& out)
+			{
+				if (index > 0)
+				{
+					out = index - 1;
+				}
+				else if (index < 0)
+				{
+					out = (s32)count + index;
+					c.relative.emplace_back((u32)c.corners.size() * 3 + component);
+				}
+				else
+				{
+					out = -1;
+				}
+			}
+
+			void parse_line(chunk& c, const char* token)
+			{
+				token += strspn(token, " \t");
+				if (token[0] == 'v' && is_space(token[1]))
+				{
+					token += 2;
+					for (u32 i{ 0 }; i < 3; ++i) c.positions.emplace_back(tinyobj::parseReal(&token));
+				}
+				else if (token[0] == 'v' && token[1] == 't' && is_space(token[2]))
+				{
+					token += 3;
+					for (u32 i{ 0 }; i < 2; ++i) c.texcoords.emplace_back(tinyobj::parseReal(&token));
+				}
+				else if (token[0] == 'v' && token[1] == 'n' && is_space(token[2]))
+				{
+					token += 3;
+					for (u32 i{ 0 }; i < 3; ++i) c.normals.emplace_back(tinyobj::parseReal(&token));
+				}
+				else if (token[0] == 'f' && is_space(token[1]))
+				{
+					token += 2;
+					token += strspn(token, " \t");
+					u32 size{ 0 };
+					while (!is_new_line(token[0]))
+					{
+						const tinyobj::vertex_index_t index{ tinyobj::parseRawTriple(&token) };
+						corner v;
+						add_index(c, index.v_idx, (u32)c.positions.size() / 3, 0, v.v);
+						add_index(c, index.vt_idx, (u32)c.texcoords.size() / 2, 1, v.vt);
+						add_index(c, index.vn_idx, (u32)c.normals.size() / 3, 2, v.vn);
+						c.corners.emplace_back(v);
+						token += strspn(token, " \t\r");
+						++size;
+					}
+					c.face_sizes.emplace_back(size);
+				}
+				else if (!strncmp(token, "usemtl", 6) && is_space(token[6]))
+				{
+					token += 6;
+					c.events.emplace_back(event{ event_type::material, (u32)c.face_sizes.size(), tinyobj::parseString(&token) });
+				}
+				else if (!strncmp(token, "mtllib", 6) && is_space(token[6]))
+				{
+					token += 7;
+					c.material_libraries.emplace_back(tinyobj::parseString(&token));
+				}
+				else if (token[0] == 'g' && is_space(token[1]))
+				{
+					// Several group names are joined like tinyobj does
+					std::string name;
+					for (token += 2 + strspn(token + 2, " \t"); !is_new_line(token[0]); token += strspn(token, " \t\r"))
+					{
+						if (!name.empty()) name.append(" ");
+						name.append(tinyobj::parseString(&token));
+					}
+					c.events.emplace_back(event{ event_type::group, (u32)c.face_sizes.size(), name });
+				}
+				else if (token[0] == 'o' && is_space(token[1]))
+				{
+					c.events.emplace_back(event{ event_type::object, (u32)c.face_sizes.size(), std::string{ token + 2 } });
+				}
+			}
+
+			void parse_chunk(chunk& c)
+			{
+				for (char* line{ c.begin }; line < c.end;)
+				{
+					char* line_end{ (char*)memchr(line, '\n', c.end - line) };
+					if (!line_end) line_end = c.end;
+					*line_end = '\0';
+					if (line_end > line && line_end[-1] == '\r') line_end[-1] = '\0';
+					parse_line(c, line);
+					line = line_end + 1;
 				}
-				vert_shader << PBR_Template_Vertex_Shader;
-				vert_shader.close();
 			}
 
+			// Makes the relative indices absolute and splits the faces into triangles. Faces with less than 3 corners or
+			// indices past the vertices are dropped.
+			void resolve_chunk(chunk& c, const model& m)
+			{
+				const s32 first[3]{ (s32)c.first_position, (s32)c.first_texcoord, (s32)c.first_normal };
+				for (const u32 r : c.relative)
+				{
+					s32* const indices{ &c.corners[r / 3].v };
+					indices[r % 3] += first[r % 3];
+				}
+
+				const s32 position_count{ (s32)(m.positions.size() / 3) };
+				const s32 texcoord_count{ (s32)(m.texcoords.size() / 2) };
+				const s32 normal_count{ (s32)(m.normals.size() / 3) };
+				auto valid{ [&](const corner& v) {
+					return v.v >= 0 && v.v < position_count && v.vt >= -1 && v.vt < texcoord_count && v.vn >= -1 && v.vn < normal_count;
+				} };
+				auto distance_sq{ [&m](const corner& a, const corner& b) {
+					const f32* const pa{ &m.positions[3 * a.v] };
+					const f32* const pb{ &m.positions[3 * b.v] };
+					const f32 x{ pb[0] - pa[0] }, y{ pb[1] - pa[1] }, z{ pb[2] - pa[2] };
+					return x * x + y * y + z * z;
+				} };
+
+				c.triangles.reserve(c.corners.size());
+				u32 next_event{ 0 };
+				u32 first_corner{ 0 };
+				const u32 face_count{ (u32)c.face_sizes.size() };
+				for (u32 f{ 0 }; f <= face_count; ++f)
+				{
+					for (; next_event < c.events.size() && c.events[next_event].face == f; ++next_event)
+					{
+						c.events[next_event].face = (u32)c.triangles.size() / 3;
+					}
+					if (f == face_count) break;
+
+					const u32 size{ c.face_sizes[f] };
+					const corner* const v{ &c.corners[first_corner] };
+					first_corner += size;
+
+					bool face_valid{ size >= 3 };
+					for (u32 i{ 0 }; i < size && face_valid; ++i) face_valid = valid(v[i]);
+					if (!face_valid)
+					{
+						++c.dropped_faces;
+						continue;
+					}
+
+					if (size == 3)
+					{
+						for (u32 i{ 0 }; i < 3; ++i) c.triangles.emplace_back(v[i]);
+					}
+					else if (size == 4)
+					{
+						const u32 split[2][6]{ { 0, 1, 3, 1, 2, 3 }, { 0, 1, 2, 0, 2, 3 } };
+						for (const u32 i : split[distance_sq(v[0], v[2]) < distance_sq(v[1], v[3])]) c.triangles.emplace_back(v[i]);
+					}
+					else
+					{
+						// Larger polygons are rare, they go through tinyobj's ear clipping
+						tinyobj::PrimGroup polygon;
+						tinyobj::face_t& face{ polygon.faceGroup.emplace_back() };
+						for (u32 i{ 0 }; i < size; ++i)
+						{
+							tinyobj::vertex_index_t index{ v[i].v };
+							index.vt_idx = v[i].vt;
+							index.vn_idx = v[i].vn;
+							face.vertex_indices.emplace_back(index);
+						}
+						tinyobj::shape_t triangulated;
+						tinyobj::exportGroupsToShape(&triangulated, polygon, {}, -1, {}, true, m.positions, nullptr);
+						for (const auto& index : triangulated.mesh.indices)
+						{
+							c.triangles.emplace_back(corner{ index.vertex_index, index.texcoord_index, index.normal_index });
+						}
+					}
+				}
+			}
+
+			// Shapes start at each group or object like in tinyobj, the ones without faces are skipped
+			void build_shapes(model& m, const utl::vector<chunk>& chunks, const std::map<std::string, int>& material_map)
+			{
+				shape current{ {}, -1, 0, 0 };
+				s32 material_id{ -1 };
+				auto close_shape{ [&m, &current](u32 triangle) {
+					current.triangle_count = triangle - current.first_triangle;
+					if (current.triangle_count) m.shapes.emplace_back(current);
+				} };
+
+				for (const auto& c : chunks)
+				{
+					for (const auto& e : c.events)
+					{
+						const u32 triangle{ c.first_triangle + e.face };
+						if (e.type == event_type::material)
+						{
+							const auto material{ material_map.find(e.name) };
+							material_id = material == material_map.end() ? -1 : material->second;
+							if (triangle == current.first_triangle) current.material_id = material_id;
+						}
+						else
+						{
+							close_shape(triangle);
+							current = shape{ e.name, material_id, triangle, 0 };
+						}
+					}
+				}
+				close_shape((u32)m.triangles.size() / 3);
+			}
+
+			bool load(const std::string& path, const std::string& base_path, model& m, std::string& warn)
+			{
+				utl::vector<char> data;
+				{
+					std::ifstream file{ path, std::ios::in | std::ios::binary | std::ios::ate };
+					if (!file.is_open()) return false;
+					const u64 size{ (u64)file.tellg() };
+					file.seekg(0);
+					// One more for the last line's terminator
+					data.resize(size + 1);
+					file.read(data.data(), size);
+					data[size] = '\0';
+					if (!file) return false;
+				}
+
+				const u64 size{ data.size() - 1 };
+				const u32 chunk_count{ (u32)std::clamp<u64>(size / min_chunk_size, 1, std::max(std::thread::hardware_concurrency(), 1u)) };
+				utl::vector<chunk> chunks(chunk_count);
+				char* const begin{ data.data() };
+				char* const end{ begin + size };
+				for (u32 i{ 0 }; i < chunk_count; ++i)
+				{
+					chunks[i].begin = i ? chunks[i - 1].end : begin;
+					char* split{ std::max(begin + size * (i + 1) / chunk_count, chunks[i].begin) };
+					if (split < end)
+					{
+						char* const line_end{ (char*)memchr(split, '\n', end - split) };
+						split = line_end ? line_end + 1 : end;
+					}
+					chunks[i].end = i + 1 == chunk_count ? end : split;
+				}
+
+				std::for_each(std::execution::par, chunks.begin(), chunks.end(), [](chunk& c) { parse_chunk(c); });
+
+				u32 position_count{ 0 }, texcoord_count{ 0 }, normal_count{ 0 };
+				for (auto& c : chunks)
+				{
+					c.first_position = position_count;
+					c.first_texcoord = texcoord_count;
+					c.first_normal = normal_count;
+					position_count += (u32)c.positions.size() / 3;
+					texcoord_count += (u32)c.texcoords.size() / 2;
+					normal_count += (u32)c.normals.size() / 3;
+				}
+				m.positions.resize(position_count * 3);
+				m.texcoords.resize(texcoord_count * 2);
+				m.normals.resize(normal_count * 3);
+
+				std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&m](const chunk& c) {
+					if (!c.positions.empty()) memcpy(&m.positions[c.first_position * 3], c.positions.data(), c.positions.size() * sizeof(f32));
+					if (!c.texcoords.empty()) memcpy(&m.texcoords[c.first_texcoord * 2], c.texcoords.data(), c.texcoords.size() * sizeof(f32));
+					if (!c.normals.empty()) memcpy(&m.normals[c.first_normal * 3], c.normals.data(), c.normals.size() * sizeof(f32));
+				});
+
+				std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&m](chunk& c) { resolve_chunk(c, m); });
+
+				u32 triangle_count{ 0 };
+				m.dropped_faces = 0;
+				for (auto& c : chunks)
+				{
+					c.first_triangle = triangle_count;
+					triangle_count += (u32)c.triangles.size() / 3;
+					m.dropped_faces += c.dropped_faces;
+				}
+				m.triangles.resize((u64)triangle_count * 3);
+				std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&m](const chunk& c) {
+					if (!c.triangles.empty()) memcpy(&m.triangles[(u64)c.first_triangle * 3], c.triangles.data(), c.triangles.size() * sizeof(corner));
+				});
+
+				// Every library is read once, in the order the file names them
+				std::string mtl_base_path{ base_path };
+				if (!mtl_base_path.empty() && mtl_base_path.back() != '\\' && mtl_base_path.back() != '/') mtl_base_path.append("\\");
+				tinyobj::MaterialFileReader material_reader{ mtl_base_path };
+				std::map<std::string, int> material_map;
+				utl::vector<std::string> libraries;
+				for (const auto& c : chunks)
+				{
+					for (const auto& library : c.material_libraries)
+					{
+						if (std::find(libraries.begin(), libraries.end(), library) != libraries.end()) continue;
+						libraries.emplace_back(library);
+						std::string err;
+						material_reader(library, &m.materials, &material_map, &warn, &err);
+						warn.append(err);
+					}
+				}
+
+				build_shapes(m, chunks, material_map);
+				m.chunk_count = chunk_count;
+				return true;
+			}
+
+			// Open addressing over a material's corners. Slots are empty until they get a vertex.
+			struct corner_slot
+			{
+				corner							key;
+				u32								vertex{ u32_invalid_id };
+			};
+
+			// Vertices are numbered in the order their corners first appear in the shapes, the bounds grow as they're added
+			void build_geometry(const model& m, const utl::vector<u32>& shape_ids, geometry_config& g)
+			{
+				using namespace DirectX;
+				u32 corner_count{ 0 };
+				for (const u32 id : shape_ids) corner_count += m.shapes[id].triangle_count * 3;
+
+				u32 table_size{ 1 };
+				while (table_size < corner_count * 2) table_size <<= 1;
+				utl::vector<corner_slot> table(table_size);
+				g.vertices.reserve(corner_count);
+				g.indices.reserve(corner_count);
+
+				XMVECTOR box_min{ XMVectorReplicate(std::numeric_limits<f32>::max()) };
+				XMVECTOR box_max{ XMVectorNegate(box_min) };
+				for (const u32 id : shape_ids)
+				{
+					const shape& s{ m.shapes[id] };
+					const corner* const corners{ &m.triangles[(u64)s.first_triangle * 3] };
+					for (u32 i{ 0 }; i < s.triangle_count * 3; ++i)
+					{
+						const corner& c{ corners[i] };
+						u32 slot{ (u32)hash_indices(c.v, c.vt, c.vn) & (table_size - 1) };
+						while (table[slot].vertex != u32_invalid_id &&
+							(table[slot].key.v != c.v || table[slot].key.vt != c.vt || table[slot].key.vn != c.vn))
+						{
+							slot = (slot + 1) & (table_size - 1);
+						}
+
+						if (table[slot].vertex == u32_invalid_id)
+						{
+							table[slot] = { c, (u32)g.vertices.size() };
+							Vertex& v{ g.vertices.emplace_back() };
+							v.pos = { m.positions[3 * c.v + 0], m.positions[3 * c.v + 1], m.positions[3 * c.v + 2] };
+							v.color = { 1.f, 1.f, 1.f };
+							v.texCoord = c.vt < 0 ? math::v3{ 0.f, 0.f, 0.f } : math::v3{ m.texcoords[2 * c.vt + 0], 1.f - m.texcoords[2 * c.vt + 1], 0.f };
+							v.normal = c.vn < 0 ? math::v3{ 0.f, 0.f, 0.f } : math::v3{ m.normals[3 * c.vn + 0], m.normals[3 * c.vn + 1], m.normals[3 * c.vn + 2] };
+							v.tangent = { 0.f, 0.f, 0.f };
+
+							const XMVECTOR p{ XMLoadFloat3(&v.pos) };
+							box_min = XMVectorMin(box_min, p);
+							box_max = XMVectorMax(box_max, p);
+						}
+
+						g.indices.emplace_back(table[slot].vertex);
+					}
+				}
+
+				g.vertex_size = sizeof(Vertex);
+				g.vertex_count = (u32)g.vertices.size();
+				g.index_size = sizeof(u32);
+				g.index_count = (u32)g.indices.size();
+				if (!g.vertex_count) box_min = box_max = XMVectorZero();
+				XMStoreFloat3(&g.min_extents, box_min);
+				XMStoreFloat3(&g.max_extents, box_max);
+				XMStoreFloat3(&g.center, (box_min + box_max) * 0.5f);
+			}
+		}
+
+		// Leaves the file alone when it already has this content, so shaders that didn't change keep their timestamps
+		bool write_if_changed(const std::string& file, const std::string& content)
+		{
+			{
+				std::ifstream existing{ file, std::ios::in | std::ios::binary };
+				if (existing.is_open())
+				{
+					const std::string old_content{ std::istreambuf_iterator<char>{ existing }, std::istreambuf_iterator<char>{} };
+					if (old_content == content) return true;
+				}
+			}
+
+			std::ofstream out{ file, std::ios::out | std::ios::binary | std::ios::trunc };
+			if (!out.is_open()) return false;
+			out << content;
+			return out.good();
+		}
+
+		bool generate_shader(const void* const data, const char* file_package, utl::vector<std::string>* outputs = nullptr)
+		{
+			tinyobj::material_t material_data{ *(tinyobj::material_t*)data };
+
+			// Every material shares Engine/Graphics/Vulkan/Shaders/material.vert, and the fragment shader includes the
+			// Common.h next to it, compileShaders.py puts that folder on the include path
 			{
 				std::string out_fragment_shader_name{ file_package };
 				out_fragment_shader_name.append("//").append("shaders");
 				if (_access(out_fragment_shader_name.c_str(), 0) == -1)
 					OutputDebugStringA(std::to_string(_mkdir(out_fragment_shader_name.c_str())).c_str());
 				out_fragment_shader_name.append("\\").append(material_data.name.c_str()).append(".frag");
-				std::ofstream fragment_shader{ out_fragment_shader_name };
-				if (!fragment_shader.is_open())
-				{
-					OutputDebugStringA("Failed to open fragment shader to write!");
-					return false;
-				}
 
 				std::string fragment_template_string{ PBR_Template_Fragment_Shader };
 
@@ -482,56 +960,23 @@ namespace primal::tools
 					}
 				}
 
-				fragment_shader << fragment_template_string;
-				fragment_shader.close();
+				if (!write_if_changed(out_fragment_shader_name, fragment_template_string))
+				{
+					OutputDebugStringA("Failed to open fragment shader to write!");
+					return false;
+				}
+				if (outputs) outputs->emplace_back(out_fragment_shader_name);
 			}
 			return true;
 		}
-
-		void copy_shader_header(const char* file_package)
-		{
-			std::string common_src{ "C:/Users/zy/Desktop/PrimalMerge/PrimalEngine/Engine/Graphics/Vulkan/Shaders/Common.h" };
-			std::string common_dst{ file_package };
-			common_dst.append("\\").append("shaders\\").append("Common.h");
-
-			std::ifstream src(common_src, std::ios::binary);
-			std::ofstream dst(common_dst, std::ios::binary);
-
-			dst << src.rdbuf();
-
-			std::string shadertype_src{ "C:/Users/zy/Desktop/PrimalMerge/PrimalEngine/Engine/Graphics/Vulkan/Shaders/CommonTypes.glsli" };
-			std::string shadertype_dst{ file_package };
-			shadertype_dst.append("\\").append("shaders\\").append("CommonTypes.glsli");
-
-			std::ifstream shadertypesrc(shadertype_src, std::ios::binary);
-			std::ofstream shadertypedst(shadertype_dst, std::ios::binary);
-
-			shadertypedst << shadertypesrc.rdbuf();
-
-			std::string shaderfunction_src{ "C:/Users/zy/Desktop/PrimalMerge/PrimalEngine/Engine/Graphics/Vulkan/Shaders/CommonFunction.glsli" };
-			std::string shaderfunction_dst{ file_package };
-			shaderfunction_dst.append("\\").append("shaders\\").append("CommonFunction.glsli");
-
-			std::ifstream shaderfunctionsrc(shaderfunction_src, std::ios::binary);
-			std::ofstream shaderfunctiondst(shaderfunction_dst, std::ios::binary);
-
-			shaderfunctiondst << shaderfunctionsrc.rdbuf();
-
-			std::string shaderconstant_src{ "C:/Users/zy/Desktop/PrimalMerge/PrimalEngine/Engine/Graphics/Vulkan/Shaders/CommonConstant.glsli" };
-			std::string shaderconstant_dst{ file_package };
-			shaderconstant_dst.append("\\").append("shaders\\").append("CommonConstant.glsli");
-
-			std::ifstream shaderconstantsrc(shaderconstant_src, std::ios::binary);
-			std::ofstream shaderconstantdst(shaderconstant_dst, std::ios::binary);
-
-			shaderconstantdst << shaderconstantsrc.rdbuf();
-		}
 	} // anonymous namespace
 
-	bool load_obj_model(std::string path, const char* out_ksm_file_package)
+	// Imports an OBJ file into file_package_path, one .kms file per material named <package_name>_<material id>, and the
+	// material fragment shaders into its shaders folder. The files it writes are added to outputs.
+	bool import_obj_model(const std::string& path, const std::string& file_package_path, const char* package_name, utl::vector<std::string>& outputs)
 	{
-		size_t pos = path.rfind("/", path.length());
-		std::string base_file_path{ path.substr(0, pos) };
+		const size_t pos{ path.find_last_of("/\\") };
+		std::string base_file_path{ pos == std::string::npos ? std::string{} : path.substr(0, pos) };
 		// size_t last{ path.find_last_of("/\\") };
 		// size_t ext_string{ path.find_last_of(".") };
 		//std::string filename;
@@ -542,141 +987,103 @@ namespace primal::tools
 		//	filename = filename.substr(0, ext_string);
 		//}
 
-		std::string file_package_path{ out_model_path + std::string{ out_ksm_file_package } };
 		if (_access(file_package_path.c_str(), 0) == -1)
 			OutputDebugStringA(std::to_string(_mkdir(file_package_path.c_str())).c_str());
 
-		tinyobj::attrib_t attrib;
-		std::vector<tinyobj::shape_t> shapes;
-		std::vector<tinyobj::material_t> materials;
-		std::string warn, err;
-
-		utl::vector<Vertex>	globalvertices;
-		utl::vector<geometry_config> out_geometry_darray;
-
-		if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.c_str(), base_file_path.c_str()))
+		const auto start{ std::chrono::steady_clock::now() };
+		obj::model model;
+		std::string warn;
+		if (!obj::load(path, base_file_path, model, warn))
 		{
-			throw std::runtime_error(warn + err);
+			OutputDebugStringA(("Failed to read " + path + "\n").c_str());
+			return false;
 		}
+		if (!warn.empty()) OutputDebugStringA(warn.c_str());
+		const auto parsed{ std::chrono::steady_clock::now() };
 
-		for (auto material : materials)
+		for (auto material : model.materials)
 		{
-			if (!generate_shader(static_cast<void*>(&material), file_package_path.c_str()))
+			if (!generate_shader(static_cast<void*>(&material), file_package_path.c_str(), &outputs))
 			{
 				OutputDebugStringA("Failed to write shader");
 			}
 		}
 
-		copy_shader_header(file_package_path.c_str());
-
-		std::unordered_map<tinyobj::index_t, size_t, hash_idx, equal_idx> uniqueVertices;
-		std::map<u32, geometry_config>						geo_per_material_id;
-		std::map<u32, utl::vector<Vertex>>					vertices;
-		std::map<u32, utl::vector<u32>>						indices;
-
-		globalvertices.clear();
-		vertices.clear();
-		indices.clear();
-
-		for (const auto& shape : shapes)
+		// A shape goes to the material of its first face, shapes without one use the first material like load_obj_scene.
+		// Materials are independent from here on.
+		struct material_job
 		{
-			out_geometry_darray.clear();
-			u32 material_id = shape.mesh.material_ids[0];
-			for (const auto& index : shape.mesh.indices)
+			u32									material_id;
+			utl::vector<u32>					shape_ids;
+			std::string							filename;
+			bool								written;
+		};
+		utl::vector<material_job> jobs;
+		for (u32 i{ 0 }; i < model.shapes.size(); ++i)
+		{
+			const u32 material_id{ (u32)std::max(model.shapes[i].material_id, 0) };
+			material_job* job{ nullptr };
+			for (auto& j : jobs) if (j.material_id == material_id) job = &j;
+			if (!job)
 			{
-				Vertex vertex;
-				vertex.pos = math::v3{
-					attrib.vertices[3 * index.vertex_index + 0],
-					attrib.vertices[3 * index.vertex_index + 1],
-					attrib.vertices[3 * index.vertex_index + 2]
-				};
-
-				vertex.color = math::v3{ 1.0f, 1.0f, 1.0f };
-
-				vertex.texCoord = math::v3{
-					attrib.texcoords[2 * index.texcoord_index + 0],
-					1.0f - attrib.texcoords[2 * index.texcoord_index + 1], // 1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-					0.0f
-				};
-
-				vertex.normal = math::v3{
-					attrib.normals[3 * index.normal_index + 0],
-					attrib.normals[3 * index.normal_index + 1],
-					attrib.normals[3 * index.normal_index + 2]
-				};
-
-				if (uniqueVertices.count(index) == 0)
-				{
-					//uniqueVertices[index] = (u32)globalvertices.size();
-					//globalvertices.emplace_back(vertex);
-					uniqueVertices[index] = (u32)vertices[material_id].size();
-					vertices[material_id].emplace_back(vertex);
-				}
-
-				indices[material_id].emplace_back((u32)uniqueVertices[index]);
+				std::string filename{ package_name };
+				filename.append("_").append(std::to_string(material_id));
+				job = &jobs.emplace_back(material_job{ material_id, {}, filename, false });
 			}
+			job->shape_ids.emplace_back(i);
+		}
+		std::sort(jobs.begin(), jobs.end(), [](const material_job& a, const material_job& b) { return a.material_id < b.material_id; });
 
-			geometry_config g;
-			g.vertex_size = sizeof(Vertex);
-			g.vertex_count = (u32)vertices[material_id].size();
-			//g.vertices.swap(vertices[material_id]);
-			g.index_size = sizeof(u32);
-			g.index_count = (u32)indices[material_id].size();
-			//g.indices.swap(indices[material_id]);
-			memcpy_s(g.name, 256, shape.name.c_str(), 256);
-			memcpy_s(g.material_name, 256, materials[material_id].name.c_str(), 256);
-			if (!materials[material_id].ambient_texname.empty())
-			{
-				g.ambient_map = materials[material_id].ambient_texname;
-				g.ambient_map.replace(g.ambient_map.find("textures"), 8, "images");
-			}
-			if (!materials[material_id].diffuse_texname.empty())
-			{
-				g.diffuse_map = materials[material_id].diffuse_texname;
-				g.diffuse_map.replace(g.diffuse_map.find("textures"), 8, "images");
-			}
-			if (!materials[material_id].specular_texname.empty())
-			{
-				g.specular_map = materials[material_id].specular_texname;
-				g.specular_map.replace(g.specular_map.find("textures"), 8, "images");
-			}
-			if (!materials[material_id].alpha_texname.empty())
-			{
-				g.alpha_map = materials[material_id].alpha_texname;
-				g.alpha_map.replace(g.alpha_map.find("textures"), 8, "images");
-			}
-			if (!materials[material_id].bump_texname.empty())
+		std::for_each(std::execution::par, jobs.begin(), jobs.end(), [&](material_job& job) {
+			geometry_config g{};
+			obj::build_geometry(model, job.shape_ids, g);
+
+			// Named after the material's last shape
+			strncpy_s(g.name, model.shapes[job.shape_ids.back()].name.c_str(), _TRUNCATE);
+			if (job.material_id < model.materials.size())
 			{
-				g.normal_map = materials[material_id].bump_texname;
-				g.normal_map.replace(g.normal_map.find("textures"), 8, "images");
+				const tinyobj::material_t& material{ model.materials[job.material_id] };
+				strncpy_s(g.material_name, material.name.c_str(), _TRUNCATE);
+				auto texture_path{ [](const std::string& texture) {
+					std::string image_path{ texture };
+					const size_t pos{ image_path.find("textures") };
+					if (pos != std::string::npos) image_path.replace(pos, 8, "images");
+					return image_path;
+				} };
+				g.ambient_map = texture_path(material.ambient_texname);
+				g.diffuse_map = texture_path(material.diffuse_texname);
+				g.specular_map = texture_path(material.specular_texname);
+				g.alpha_map = texture_path(material.alpha_texname);
+				g.normal_map = texture_path(material.bump_texname);
 			}
-			//generate_bounding_box_and_center(&g);
-			//generate_tangents(&g);
-			
-			geo_per_material_id[material_id] = g;
-			//out_geometry_darray.emplace_back(g);
-			//write_kms_file(file_package_path.c_str(), g.name, (u32)out_geometry_darray.size(), out_geometry_darray);
-			//g.clear();
-		}
 
-		for (std::map<u32, geometry_config>::iterator iter = geo_per_material_id.begin(); iter != geo_per_material_id.end(); ++iter)
-		{
-			std::string filename{ out_ksm_file_package };
-			filename.append("_").append(std::to_string(iter->first));
+			generate_tangents(&g);
+			generate_meshlets(&g);
 
-			u32 material_id = iter->first;
+			job.written = write_kms_file(file_package_path.c_str(), job.filename.c_str(), g);
+		});
 
-			geometry_config g{geo_per_material_id[material_id]};
-			g.vertices = vertices[material_id];
-			g.indices = indices[material_id];
+		bool written{ true };
+		for (const auto& job : jobs)
+		{
+			written &= job.written;
+			if (job.written) outputs.emplace_back(file_package_path + "\\" + job.filename + kms_ext);
+		}
 
-			generate_bounding_box_and_center(&g);
-			generate_tangents(&g);
+		char message[512];
+		sprintf_s(message, "OBJ import: %s, %u triangles in %u shapes, %u chunks parsed in %.1f ms, %u materials built in %.1f ms, %u faces dropped\n",
+			path.c_str(), (u32)model.triangles.size() / 3, (u32)model.shapes.size(), model.chunk_count,
+			std::chrono::duration<f32, std::milli>(parsed - start).count(), (u32)jobs.size(),
+			std::chrono::duration<f32, std::milli>(std::chrono::steady_clock::now() - parsed).count(), model.dropped_faces);
+		OutputDebugStringA(message);
 
-			write_kms_file(file_package_path.c_str(), filename.c_str(), g);
-		}
+		return written;
+	}
 
-		return true;
+	bool load_obj_model(std::string path, const char* out_ksm_file_package)
+	{
+		utl::vector<std::string> outputs;
+		return import_obj_model(path, out_model_path + std::string{ out_ksm_file_package }, out_ksm_file_package, outputs);
 	}
 
 	bool load_single_obj_model(std::string path, const char* out_ksm_file_package)
@@ -795,6 +1202,7 @@ namespace primal::tools
 
 			generate_bounding_box_and_center(&g);
 			generate_tangents(&g);
+			generate_meshlets(&g);
 
 			write_kms_file(file_package_path.c_str(), filename.c_str(), g);
 		}
@@ -802,6 +1210,81 @@ namespace primal::tools
 		return true;
 	}
 
+	// Loads an OBJ file for process_scene, one LOD group per shape. Positions are shared within a shape,
+	// normals and UVs are per face corner like the FBX importer reads them.
+	bool load_obj_scene(const char* file, scene& scene)
+	{
+		const std::string path{ file };
+		const size_t separator{ path.find_last_of("/\\") };
+		const std::string base_path{ separator == std::string::npos ? std::string{} : path.substr(0, separator) };
+
+		tinyobj::attrib_t attrib;
+		std::vector<tinyobj::shape_t> shapes;
+		std::vector<tinyobj::material_t> materials;
+		std::string warn, err;
+		if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, file, base_path.c_str())) return false;
+
+		scene.name = path.substr(separator == std::string::npos ? 0 : separator + 1);
+		for (const auto& shape : shapes)
+		{
+			if (shape.mesh.indices.empty()) continue;
+
+			bool has_normals{ !attrib.normals.empty() };
+			bool has_uvs{ !attrib.texcoords.empty() };
+			for (const auto& index : shape.mesh.indices)
+			{
+				has_normals &= index.normal_index >= 0;
+				has_uvs &= index.texcoord_index >= 0;
+			}
+
+			lod_group lod{};
+			lod.name = shape.name;
+			mesh& m{ lod.meshes.emplace_back() };
+			m.name = shape.name;
+			m.lod_id = 0;
+			m.uv_sets.resize(has_uvs ? 1 : 0);
+
+			utl::vector<u32> position_ref(attrib.vertices.size() / 3, u32_invalid_id);
+			for (const auto& index : shape.mesh.indices)
+			{
+				u32& ref{ position_ref[index.vertex_index] };
+				if (ref == u32_invalid_id)
+				{
+					ref = (u32)m.positions.size();
+					m.positions.emplace_back(attrib.vertices[3 * index.vertex_index + 0], attrib.vertices[3 * index.vertex_index + 1],
+						attrib.vertices[3 * index.vertex_index + 2]);
+				}
+				m.raw_indices.emplace_back(ref);
+
+				if (has_normals)
+				{
+					m.normals.emplace_back(attrib.normals[3 * index.normal_index + 0], attrib.normals[3 * index.normal_index + 1],
+						attrib.normals[3 * index.normal_index + 2]);
+				}
+
+				if (has_uvs)
+				{
+					m.uv_sets[0].emplace_back(attrib.texcoords[2 * index.texcoord_index + 0], 1.f - attrib.texcoords[2 * index.texcoord_index + 1]);
+				}
+			}
+
+			// Faces are triangulated by the loader
+			for (const s32 material_id : shape.mesh.material_ids)
+			{
+				const u32 mtl_index{ (u32)std::max(material_id, 0) };
+				m.material_indices.emplace_back(mtl_index);
+				if (std::find(m.material_used.begin(), m.material_used.end(), mtl_index) == m.material_used.end())
+				{
+					m.material_used.emplace_back(mtl_index);
+				}
+			}
+
+			scene.lod_groups.emplace_back(lod);
+		}
+
+		return !scene.lod_groups.empty();
+	}
+
 	EDITOR_INTERFACE void ImportObj(const char* file, const char* kms_name)
 	{
 		assert(file);
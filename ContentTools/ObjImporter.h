@@ -1,9 +1,12 @@
 #pragma once
 
 #include "ToolsCommon.h"
+#include "Content/Meshlet.h"
+#include "Content/PackedVertex.h"
 
 namespace primal::tools
 {
+    // Vertex as it's imported and processed. The .kms files store it as content::packed_vertex.
     struct Vertex
     {
         math::v3 pos;
@@ -43,6 +46,7 @@ namespace primal::tools
         std::string             specular_map;
         std::string             alpha_map;
         std::string             normal_map;
+        utl::vector<content::meshlet>   meshlets;
 
         void clear()
         {
@@ -62,6 +66,7 @@ namespace primal::tools
             this->specular_map.clear();
             this->alpha_map.clear();
             this->normal_map.clear();
+            this->meshlets.clear();
         }
     };
 
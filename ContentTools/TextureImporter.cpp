@@ -1,6 +1,8 @@
 #include "ToolsCommon.h"
+#include "BlockCompression.h"
 #include "Content/ContentToEngine.h"
 #include "Utilities/IOStream.h"
+#include <fstream>
 #include <DirectXTex.h>
 #include <dxgi1_6.h>
 
@@ -49,7 +51,7 @@ namespace primal::tools
 			u32								source_count;		// number of file paths
 			u32								dimension;
 			u32								mip_levels;
-			u32								alpha_threshold;
+			f32								alpha_threshold;	// The editor marshals a float
 			u32								prefer_bc7;
 			u32								output_format;
 			u32								compress;
@@ -527,6 +529,56 @@ namespace primal::tools
 			return false;
 		}
 
+		bool to_block_compression_format(DXGI_FORMAT format, block_compression::format::type& bc_format)
+		{
+			switch (format)
+			{
+			case DXGI_FORMAT_BC1_UNORM: case DXGI_FORMAT_BC1_UNORM_SRGB: bc_format = block_compression::format::bc1; return true;
+			case DXGI_FORMAT_BC3_UNORM: case DXGI_FORMAT_BC3_UNORM_SRGB: bc_format = block_compression::format::bc3; return true;
+			case DXGI_FORMAT_BC4_UNORM: bc_format = block_compression::format::bc4; return true;
+			case DXGI_FORMAT_BC5_UNORM: bc_format = block_compression::format::bc5; return true;
+			case DXGI_FORMAT_BC7_UNORM: case DXGI_FORMAT_BC7_UNORM_SRGB: bc_format = block_compression::format::bc7; return true;
+			}
+
+			return false;
+		}
+
+		// Compresses every image of scratch with the portable block compressor. The texels are compressed as stored,
+		// so sRGB images are converted to 8-bit sRGB and linear ones to 8-bit UNORM first.
+		[[nodiscard]] HRESULT compress_on_cpu(const ScratchImage& scratch, DXGI_FORMAT output_format, block_compression::format::type bc_format,
+			f32 alpha_threshold, ScratchImage& bc_scratch)
+		{
+			const DXGI_FORMAT rgba_format{ IsSRGB(output_format) ? DXGI_FORMAT_R8G8B8A8_UNORM_SRGB : DXGI_FORMAT_R8G8B8A8_UNORM };
+			ScratchImage rgba_scratch;
+			const ScratchImage* source{ &scratch };
+			HRESULT hr{ S_OK };
+			if (scratch.GetMetadata().format != rgba_format)
+			{
+				hr = Convert(scratch.GetImages(), scratch.GetImageCount(), scratch.GetMetadata(), rgba_format,
+					TEX_FILTER_DEFAULT, TEX_THRESHOLD_DEFAULT, rgba_scratch);
+				if (FAILED(hr)) return hr;
+				source = &rgba_scratch;
+			}
+
+			TexMetadata metadata{ source->GetMetadata() };
+			metadata.format = output_format;
+			hr = bc_scratch.Initialize(metadata);
+			if (FAILED(hr)) return hr;
+
+			assert(source->GetImageCount() == bc_scratch.GetImageCount());
+			const u8 threshold{ (u8)math::clamp(alpha_threshold * 255.f + .5f, 0.f, 255.f) };
+			for (u32 i{ 0 }; i < source->GetImageCount(); ++i)
+			{
+				const Image& src{ source->GetImages()[i] };
+				const Image& dst{ bc_scratch.GetImages()[i] };
+				assert(dst.rowPitch == block_compression::row_pitch(bc_format, (u32)src.width));
+				block_compression::compress({ src.pixels, (u32)src.width, (u32)src.height, (u32)src.rowPitch }, bc_format, dst.pixels,
+					block_compression::default_bc7_quality, threshold);
+			}
+
+			return S_OK;
+		}
+
 		[[nodiscard]] ScratchImage compress_image(texture_data *const data, ScratchImage& scratch)
 		{
 			assert(data && data->import_settings.compress && scratch.GetImages());
@@ -560,6 +612,10 @@ namespace primal::tools
 					if (wait) std::this_thread::sleep_for(std::chrono::microseconds(200));
 				}
 			}
+			else if (block_compression::format::type bc_format; to_block_compression_format(output_format, bc_format))
+			{
+				hr = compress_on_cpu(scratch, output_format, bc_format, data->import_settings.alpha_threshold, bc_scratch);
+			}
 			else
 			{
 				hr = Compress(scratch.GetImages(), scratch.GetImageCount(), scratch.GetMetadata(),
@@ -720,4 +776,66 @@ namespace primal::tools
 			texture_info_from_metadata(scratch.GetMetadata(), data->info);
 		}
 	}
-}
\ No newline at end of file
+	// Imports a single 2D image with the editor's default settings and writes it to output_file as a content::texture_file_header
+	// followed by the subresources as copy_subresources packs them, which the Vulkan renderer loads. Used by the headless import
+	// pipeline, the calling thread must have initialized COM.
+	bool import_texture_file(const char* source, const char* output_file)
+	{
+		assert(source && output_file);
+		texture_data data{};
+		texture_import_settings& settings{ data.import_settings };
+		settings.sources = const_cast<char*>(source);
+		settings.source_count = 1;
+		settings.dimension = texture_dimension::texture_2d;
+		settings.mip_levels = 0;
+		settings.alpha_threshold = 0.5f;
+		settings.prefer_bc7 = 1;
+		settings.output_format = DXGI_FORMAT_UNKNOWN;
+		settings.compress = 1;
+
+		Import(&data);
+
+		bool succeeded{ !data.info.import_error && data.subresource_data };
+		if (succeeded)
+		{
+			std::ofstream file{ output_file, std::ios::out | std::ios::binary | std::ios::trunc };
+			const texture_info& info{ data.info };
+			const content::texture_file_header header{ info.width, info.height, info.array_size, info.flags, info.mip_levels, info.format, data.subresource_size };
+			file.write((const char*)&header, sizeof(header));
+			file.write((const char*)data.subresource_data, data.subresource_size);
+			succeeded = file.good();
+		}
+
+		CoTaskMemFree(data.subresource_data);
+		CoTaskMemFree(data.icon);
+		return succeeded;
+	}
+
+	// Loads the first image of a file as 8-bit RGBA texels, rows width * 4 bytes apart. sRGB images keep their sRGB values,
+	// like compress_on_cpu compresses them. Used by the block compression check, the calling thread must have initialized COM.
+	bool load_rgba_image(const char* file_name, utl::vector<u8>& pixels, u32& width, u32& height)
+	{
+		assert(file_name);
+		texture_data data{};
+		const ScratchImage scratch{ load_from_file(&data, file_name) };
+		const Image* image{ scratch.GetImage(0, 0, 0) };
+		if (data.info.import_error || !image) return false;
+
+		const DXGI_FORMAT rgba_format{ IsSRGB(image->format) ? DXGI_FORMAT_R8G8B8A8_UNORM_SRGB : DXGI_FORMAT_R8G8B8A8_UNORM };
+		ScratchImage rgba_scratch;
+		if (image->format != rgba_format)
+		{
+			if (FAILED(Convert(*image, rgba_format, TEX_FILTER_DEFAULT, TEX_THRESHOLD_DEFAULT, rgba_scratch))) return false;
+			image = rgba_scratch.GetImage(0, 0, 0);
+		}
+
+		width = (u32)image->width;
+		height = (u32)image->height;
+		pixels.resize((u64)width * height * 4);
+		for (u32 y{ 0 }; y < height; ++y)
+		{
+			memcpy(&pixels[(u64)y * width * 4], image->pixels + (u64)y * image->rowPitch, (u64)width * 4);
+		}
+		return true;
+	}
+}
@@ -12,9 +12,23 @@ namespace primal::transform {
 		utl::vector<math::v3>		orientations;
 		utl::vector<math::v3>		scales;
 		utl::vector<u8>				has_transform;
+		utl::vector<u8>				static_flags;
 		utl::vector<u8>				changes_from_previous_frame;
+		// ids of entities that have a non-zero entry in changes_from_previous_frame, in the order they changed.
+		utl::vector<game_entity::entity_id>	changed_entity_ids;
+		u32							changed_entity_ids_epoch{ 0 };
 		u8							read_write_flag;
 
+		void mark_changed(game_entity::entity_id id, u8 flags)
+		{
+			const u32 index{ id::index(id) };
+			if (!changes_from_previous_frame[index])
+			{
+				changed_entity_ids.emplace_back(id);
+			}
+			changes_from_previous_frame[index] |= flags;
+		}
+
 		void calculate_transform_matrices(id::id_type index)
 		{
 			assert(rotations.size() >= index);
@@ -53,7 +67,7 @@ namespace primal::transform {
 			rotations[index] = rotation_quaternion;
 			orientations[index] = calculate_orientation(rotation_quaternion);
 			has_transform[index] = 0;
-			changes_from_previous_frame[index] |= component_flags::rotation;
+			mark_changed(game_entity::entity_id{ id }, component_flags::rotation);
 		}
 
 		void set_orientation(transform_id id, const math::v3&)
@@ -66,7 +80,7 @@ namespace primal::transform {
 			const u32 index{ id::index(id) };
 			positions[index] = position;
 			has_transform[index] = 0;
-			changes_from_previous_frame[index] |= component_flags::position;
+			mark_changed(game_entity::entity_id{ id }, component_flags::position);
 		}
 
 		void set_scale(transform_id id, const math::v3& scale)
@@ -74,7 +88,7 @@ namespace primal::transform {
 			const u32 index{ id::index(id) };
 			scales[index] = scale;
 			has_transform[index] = 0;
-			changes_from_previous_frame[index] |= component_flags::scale;
+			mark_changed(game_entity::entity_id{ id }, component_flags::scale);
 		}
 
 	} // anonymous namespace
@@ -93,7 +107,8 @@ namespace primal::transform {
 			positions[entity_index] = math::v3{ info.position };
 			scales[entity_index] = math::v3{ info.scale };
 			has_transform[entity_index] = 0;
-			changes_from_previous_frame[entity_index] = (u8)component_flags::all;
+			static_flags[entity_index] = info.is_static ? 1 : 0;
+			changes_from_previous_frame[entity_index] = 0;
 		}
 		else
 		{
@@ -103,11 +118,14 @@ namespace primal::transform {
 			rotations.emplace_back(info.rotation);
 			scales.emplace_back(info.scale);
 			has_transform.emplace_back((u8)0);
+			static_flags.emplace_back((u8)(info.is_static ? 1 : 0));
 			to_world.emplace_back();
 			inv_world.emplace_back();
-			changes_from_previous_frame.emplace_back((u8)component_flags::all);
+			changes_from_previous_frame.emplace_back((u8)0);
 		}
 
+		mark_changed(entity.get_id(), (u8)component_flags::all);
+
 		// NOTE: each entity has a transform component. Therefore, id's for transform components
 		//		 are exactly the same as entity ids.
 		return component{ transform_id{ entity.get_id() } };
@@ -144,6 +162,14 @@ namespace primal::transform {
 		}
 	}
 
+	const game_entity::entity_id *const get_changed_entity_ids(u32& count, u32& epoch)
+	{
+		read_write_flag = 1;
+		count = (u32)changed_entity_ids.size();
+		epoch = changed_entity_ids_epoch;
+		return changed_entity_ids.data();
+	}
+
 	void update(const component_cache *const cache, u32 count)
 	{
 		assert(cache && count);
@@ -153,6 +179,8 @@ namespace primal::transform {
 		if (read_write_flag)
 		{
 			memset(changes_from_previous_frame.data(), 0, changes_from_previous_frame.size());
+			changed_entity_ids.clear();
+			++changed_entity_ids_epoch;
 			read_write_flag = 0;
 		}
 
@@ -206,4 +234,10 @@ namespace primal::transform {
 		assert(is_valid());
 		return scales[id::index(_id)];
 	}
+
+	bool component::is_static() const
+	{
+		assert(is_valid());
+		return static_flags[id::index(_id)] != 0;
+	}
 }
\ No newline at end of file
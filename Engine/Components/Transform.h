@@ -8,6 +8,8 @@ namespace primal::transform {
 		f32 position[3]{};
 		f32 rotation[4]{};
 		f32 scale[3]{1.f, 1.f, 1.f};
+		// Static transforms aren't expected to change after creation, renderers may cache what depends on them
+		bool is_static{ false };
 	};
 
 	struct component_flags
@@ -37,5 +39,9 @@ namespace primal::transform {
 	void remove(component c);
 	void get_transform_matrices(const game_entity::entity_id id, math::m4x4& world, math::m4x4& inverse_world);
 	void get_updated_components_flags(const game_entity::entity_id *const ids, u32 count, u8 *const flags);
+	// Returns the ids of all entities whose transform changed since the last call to update().
+	// 'epoch' is incremented every time the list is cleared, so a caller can remember how far
+	// it has read and only look at new entries.
+	const game_entity::entity_id *const get_changed_entity_ids(u32& count, u32& epoch);
 	void update(const component_cache *const cache, u32 count);
 }
\ No newline at end of file
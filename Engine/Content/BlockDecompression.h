@@ -0,0 +1,294 @@
+#pragma once
+// Only the primitive types, ContentTools shares these tables and decoders with its portable block compressor
+#include "Common/PrimitiveTypes.h"
+#include <cstring>
+
+namespace primal::content
+{
+	// Decoders for the block compressed formats ContentTools writes, used where the GPU can't sample them. Each decodes one
+	// block to 16 RGBA texels in row order, with the values the GPU would sample: BC4 to red and BC5 to red and green, with
+	// opaque alpha. BC6H isn't decoded, HDR textures need the hardware formats.
+	namespace detail
+	{
+		// BC7 two-subset partitions, bit i is the subset of texel i
+		constexpr u16 bc7_partitions2[64]{
+			0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80, 0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+			0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce, 0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+			0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a, 0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+			0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c, 0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22,
+		};
+
+		// BC7 three-subset partitions, bits 2i and 2i+1 are the subset of texel i
+		constexpr u32 bc7_partitions3[64]{
+			0xaa685050, 0x6a5a5040, 0x5a5a4200, 0x5450a0a8, 0xa5a50000, 0xa0a05050, 0x5555a0a0, 0x5a5a5050,
+			0xaa550000, 0xaa555500, 0xaaaa5500, 0x90909090, 0x94949494, 0xa4a4a4a4, 0xa9a59450, 0x2a0a4250,
+			0xa5945040, 0x0a425054, 0xa5a5a500, 0x55a0a0a0, 0xa8a85454, 0x6a6a4040, 0xa4a45000, 0x1a1a0500,
+			0x0050a4a4, 0xaaa59090, 0x14696914, 0x69691400, 0xa08585a0, 0xaa821414, 0x50a4a450, 0x6a5a0200,
+			0xa9a58000, 0x5090a0a8, 0xa8a09050, 0x24242424, 0x00aa5500, 0x24924924, 0x24499224, 0x50a50a50,
+			0x500aa550, 0xaaaa4444, 0x66660000, 0xa5a0a5a0, 0x50a050a0, 0x69286928, 0x44aaaa44, 0x66666600,
+			0xaa444444, 0x54a854a8, 0x95809580, 0x96969600, 0xa85454a8, 0x80959580, 0xaa141414, 0x96960000,
+			0xaaaa1414, 0xa05050a0, 0xa0a5a5a0, 0x96000000, 0x40804080, 0xa9a8a9a8, 0xaaaaaa44, 0x2a4a5254,
+		};
+
+		// Texels whose index has an implicit 0 top bit, besides texel 0: the second subset's of two-subset partitions,
+		// and the second and third subsets' of three-subset partitions
+		constexpr u8 bc7_anchors2[64]{
+			15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+			15,  2,  8,  2,  2,  8,  8, 15,  2,  8,  2,  2,  8,  8,  2,  2,
+			15, 15,  6,  8,  2,  8, 15, 15,  2,  8,  2,  2,  2, 15, 15,  6,
+			 6,  2,  6,  8, 15, 15,  2,  2, 15, 15, 15, 15, 15,  2,  2, 15,
+		};
+
+		constexpr u8 bc7_anchors3_second[64]{
+			 3,  3, 15, 15,  8,  3, 15, 15,  8,  8,  6,  6,  6,  5,  3,  3,
+			 3,  3,  8, 15,  3,  3,  6, 10,  5,  8,  8,  6,  8,  5, 15, 15,
+			 8, 15,  3,  5,  6, 10,  8, 15, 15,  3, 15,  5, 15, 15, 15, 15,
+			 3, 15,  5,  5,  5,  8,  5, 10,  5, 10,  8, 13, 15, 12,  3,  3,
+		};
+
+		constexpr u8 bc7_anchors3_third[64]{
+			15,  8,  8,  3, 15, 15,  3,  8, 15, 15, 15, 15, 15, 15, 15,  8,
+			15,  8, 15,  3, 15,  8, 15,  8,  3, 15,  6, 10, 15, 15, 10,  8,
+			15,  3, 15, 10, 10,  8,  9, 10,  6, 15,  8, 15,  3,  6,  6,  8,
+			15,  3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,  3, 15, 15,  8,
+		};
+
+		constexpr u32 bc7_weights2[4]{ 0, 21, 43, 64 };
+		constexpr u32 bc7_weights3[8]{ 0, 9, 18, 27, 37, 46, 55, 64 };
+		constexpr u32 bc7_weights4[16]{ 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+		[[nodiscard]] constexpr const u32* bc7_weights(u32 index_bits)
+		{
+			return index_bits == 2 ? bc7_weights2 : index_bits == 3 ? bc7_weights3 : bc7_weights4;
+		}
+
+		[[nodiscard]] constexpr u32 bc7_interpolate(u32 a, u32 b, u32 weight)
+		{
+			return ((64 - weight) * a + weight * b + 32) >> 6;
+		}
+
+		[[nodiscard]] constexpr u32 bc7_subset(u32 subsets, u32 partition, u32 texel)
+		{
+			return subsets == 1 ? 0 : subsets == 2 ? (bc7_partitions2[partition] >> texel) & 1 : (bc7_partitions3[partition] >> (texel * 2)) & 3;
+		}
+
+		[[nodiscard]] constexpr bool bc7_is_anchor(u32 subsets, u32 partition, u32 texel)
+		{
+			return texel == 0 ||
+				(subsets == 2 && texel == bc7_anchors2[partition]) ||
+				(subsets == 3 && (texel == bc7_anchors3_second[partition] || texel == bc7_anchors3_third[partition]));
+		}
+
+		struct bc7_mode_info
+		{
+			u32								subsets;
+			u32								partition_bits;
+			u32								rotation_bits;
+			u32								index_selection_bits;
+			u32								color_bits;
+			u32								alpha_bits;
+			u32								pbits;				// 0: none, 1: one per subset, 2: one per endpoint
+			u32								index_bits;
+			u32								secondary_index_bits;
+		};
+
+		constexpr bc7_mode_info bc7_modes[8]{
+			{ 3, 4, 0, 0, 4, 0, 2, 3, 0 },
+			{ 2, 6, 0, 0, 6, 0, 1, 3, 0 },
+			{ 3, 6, 0, 0, 5, 0, 0, 2, 0 },
+			{ 2, 6, 0, 0, 7, 0, 2, 2, 0 },
+			{ 1, 0, 2, 1, 5, 6, 0, 2, 3 },
+			{ 1, 0, 2, 0, 7, 8, 0, 2, 2 },
+			{ 1, 0, 0, 0, 7, 7, 2, 4, 0 },
+			{ 2, 6, 0, 0, 5, 5, 2, 2, 0 },
+		};
+
+		struct bit_reader
+		{
+			const u8*						data;
+			u32								position{ 0 };
+
+			[[nodiscard]] u32 read(u32 bits)
+			{
+				u32 value{ 0 };
+				for (u32 i{ 0 }; i < bits; ++i, ++position)
+				{
+					value |= (u32)((data[position >> 3] >> (position & 7)) & 1) << i;
+				}
+				return value;
+			}
+		};
+
+		// Quantized endpoint channel, with its p-bit when the mode has them, to 8 bits by repeating the top bits
+		[[nodiscard]] constexpr u32 unquantize(u32 value, u32 bits)
+		{
+			value <<= 8 - bits;
+			return value | (value >> bits);
+		}
+
+		inline void bc1_palette(u16 c0, u16 c1, bool four_colors, u8 (&palette)[4][4])
+		{
+			auto expand{ [](u16 c, u8 (&rgba)[4]) {
+				rgba[0] = (u8)unquantize((c >> 11) & 31, 5);
+				rgba[1] = (u8)unquantize((c >> 5) & 63, 6);
+				rgba[2] = (u8)unquantize(c & 31, 5);
+				rgba[3] = 255;
+			} };
+			expand(c0, palette[0]);
+			expand(c1, palette[1]);
+			for (u32 c{ 0 }; c < 3; ++c)
+			{
+				const u32 a{ palette[0][c] }, b{ palette[1][c] };
+				palette[2][c] = (u8)(four_colors ? (2 * a + b + 1) / 3 : (a + b + 1) / 2);
+				palette[3][c] = (u8)(four_colors ? (a + 2 * b + 1) / 3 : 0);
+			}
+			palette[2][3] = 255;
+			palette[3][3] = four_colors ? 255 : 0;
+		}
+
+		inline void decode_color_block(const u8 *const block, bool four_colors_only, u8 (&texels)[16][4])
+		{
+			u16 c0, c1;
+			u32 indices;
+			memcpy(&c0, block, sizeof(u16));
+			memcpy(&c1, block + 2, sizeof(u16));
+			memcpy(&indices, block + 4, sizeof(u32));
+
+			u8 palette[4][4];
+			bc1_palette(c0, c1, four_colors_only || c0 > c1, palette);
+			for (u32 i{ 0 }; i < 16; ++i) memcpy(texels[i], palette[(indices >> (i * 2)) & 3], 4);
+		}
+
+		inline void decode_alpha_block(const u8 *const block, u32 channel, u8 (&texels)[16][4])
+		{
+			const u32 e0{ block[0] }, e1{ block[1] };
+			u32 palette[8]{ e0, e1 };
+			if (e0 > e1)
+			{
+				for (u32 k{ 1 }; k < 7; ++k) palette[k + 1] = ((7 - k) * e0 + k * e1 + 3) / 7;
+			}
+			else
+			{
+				for (u32 k{ 1 }; k < 5; ++k) palette[k + 1] = ((5 - k) * e0 + k * e1 + 2) / 5;
+				palette[6] = 0;
+				palette[7] = 255;
+			}
+
+			u64 indices{ 0 };
+			for (u32 i{ 0 }; i < 6; ++i) indices |= (u64)block[2 + i] << (i * 8);
+			for (u32 i{ 0 }; i < 16; ++i) texels[i][channel] = (u8)palette[(indices >> (i * 3)) & 7];
+		}
+	}
+
+	inline void decode_bc1(const u8 *const block, u8 (&texels)[16][4])
+	{
+		detail::decode_color_block(block, false, texels);
+	}
+
+	inline void decode_bc3(const u8 *const block, u8 (&texels)[16][4])
+	{
+		detail::decode_color_block(block + 8, true, texels);
+		detail::decode_alpha_block(block, 3, texels);
+	}
+
+	inline void decode_bc4(const u8 *const block, u8 (&texels)[16][4])
+	{
+		detail::decode_alpha_block(block, 0, texels);
+		for (u32 i{ 0 }; i < 16; ++i)
+		{
+			texels[i][1] = texels[i][2] = 0;
+			texels[i][3] = 255;
+		}
+	}
+
+	inline void decode_bc5(const u8 *const block, u8 (&texels)[16][4])
+	{
+		detail::decode_alpha_block(block, 0, texels);
+		detail::decode_alpha_block(block + 8, 1, texels);
+		for (u32 i{ 0 }; i < 16; ++i)
+		{
+			texels[i][2] = 0;
+			texels[i][3] = 255;
+		}
+	}
+
+	// Every mode. Reserved blocks (mode bits all 0) decode to transparent black as the spec asks.
+	inline void decode_bc7(const u8 *const block, u8 (&texels)[16][4])
+	{
+		using namespace detail;
+		bit_reader reader{ block };
+		u32 mode{ 0 };
+		while (mode < 8 && !reader.read(1)) ++mode;
+		if (mode == 8)
+		{
+			memset(texels, 0, sizeof(texels));
+			return;
+		}
+
+		const bc7_mode_info& info{ bc7_modes[mode] };
+		const u32 partition{ reader.read(info.partition_bits) };
+		const u32 rotation{ reader.read(info.rotation_bits) };
+		const u32 index_selection{ reader.read(info.index_selection_bits) };
+
+		u32 endpoints[3][2][4]{};
+		for (u32 c{ 0 }; c < 4; ++c)
+		{
+			const u32 bits{ c < 3 ? info.color_bits : info.alpha_bits };
+			for (u32 s{ 0 }; s < info.subsets; ++s)
+				for (u32 e{ 0 }; e < 2; ++e) endpoints[s][e][c] = reader.read(bits);
+		}
+
+		for (u32 s{ 0 }; s < info.subsets; ++s)
+		{
+			u32 pbits[2]{};
+			if (info.pbits == 1) pbits[0] = pbits[1] = reader.read(1);
+			else if (info.pbits == 2)
+			{
+				pbits[0] = reader.read(1);
+				pbits[1] = reader.read(1);
+			}
+
+			for (u32 e{ 0 }; e < 2; ++e)
+			{
+				for (u32 c{ 0 }; c < 4; ++c)
+				{
+					const u32 bits{ c < 3 ? info.color_bits : info.alpha_bits };
+					u32& value{ endpoints[s][e][c] };
+					if (!bits) value = 255;
+					else if (info.pbits) value = unquantize((value << 1) | pbits[e], bits + 1);
+					else value = unquantize(value, bits);
+				}
+			}
+		}
+
+		u32 indices[16], secondary_indices[16]{};
+		for (u32 i{ 0 }; i < 16; ++i)
+		{
+			indices[i] = reader.read(info.index_bits - (bc7_is_anchor(info.subsets, partition, i) ? 1 : 0));
+		}
+		if (info.secondary_index_bits)
+		{
+			for (u32 i{ 0 }; i < 16; ++i) secondary_indices[i] = reader.read(info.secondary_index_bits - (i ? 0 : 1));
+		}
+
+		// Mode 4 can swap which index set the color and the alpha use
+		const u32 *const color_weights{ bc7_weights(index_selection ? info.secondary_index_bits : info.index_bits) };
+		const u32 *const alpha_weights{ bc7_weights(info.secondary_index_bits && !index_selection ? info.secondary_index_bits : info.index_bits) };
+		for (u32 i{ 0 }; i < 16; ++i)
+		{
+			const u32 (&e)[2][4]{ endpoints[bc7_subset(info.subsets, partition, i)] };
+			const u32 color_index{ index_selection ? secondary_indices[i] : indices[i] };
+			const u32 alpha_index{ info.secondary_index_bits && !index_selection ? secondary_indices[i] : indices[i] };
+			for (u32 c{ 0 }; c < 3; ++c) texels[i][c] = (u8)bc7_interpolate(e[0][c], e[1][c], color_weights[color_index]);
+			texels[i][3] = (u8)bc7_interpolate(e[0][3], e[1][3], alpha_weights[alpha_index]);
+
+			// Modes 4 and 5 can store a color channel in alpha, which has more precision
+			if (rotation)
+			{
+				const u8 swapped{ texels[i][rotation - 1] };
+				texels[i][rotation - 1] = texels[i][3];
+				texels[i][3] = swapped;
+			}
+		}
+	}
+}
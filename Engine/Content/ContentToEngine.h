@@ -33,6 +33,21 @@ namespace primal::content
 		};
 	};
 
+	// Header of the .texture files written by ContentTools' import pipeline. subresource_size bytes of subresources follow it, each
+	// one is its width, height, row pitch and slice pitch as u32 and then its texels. The mip levels of each array slice follow each
+	// other, largest first. format is a DXGI_FORMAT value.
+	struct texture_file_header
+	{
+		u32								width;
+		u32								height;
+		u32								array_size;
+		u32								flags;				// texture_flags
+		u32								mip_levels;
+		u32								format;
+		u32								subresource_size;
+	};
+	static_assert(sizeof(texture_file_header) == 7 * sizeof(u32));
+
 	typedef struct compiled_shader
 	{
 		static constexpr u32 hash_length{ 16 };
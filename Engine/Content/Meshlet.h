@@ -0,0 +1,26 @@
+#pragma once
+#include "CommonHeaders.h"
+
+namespace primal::content
+{
+	constexpr u32 meshlet_max_vertices{ 64 };
+	constexpr u32 meshlet_max_triangles{ 124 };
+
+	// A cluster of up to meshlet_max_triangles triangles that is culled as a whole. Its triangles are a contiguous
+	// range of the mesh's index buffer, so the meshlets that survive culling are drawn as ranges of that buffer.
+	// Written by ContentTools, bounds are in model space.
+	struct meshlet
+	{
+		math::v3						center;				// Bounding sphere
+		f32								radius;
+		// Normal cone: every triangle faces away from a viewer at p if dot(normalize(cone_apex - p), cone_axis) >= cone_cutoff.
+		// cone_cutoff is 1 when the normals spread too far for that to happen.
+		math::v3						cone_apex;
+		math::v3						cone_axis;
+		f32								cone_cutoff;
+		u32								first_index;
+		u32								triangle_count;
+		u32								vertex_count;		// Distinct vertices of the triangles
+	};
+	static_assert(sizeof(meshlet) == 14 * sizeof(u32));
+}
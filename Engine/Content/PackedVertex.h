@@ -0,0 +1,100 @@
+#pragma once
+#include "CommonHeaders.h"
+#include <DirectXPackedVector.h>
+#include <cmath>
+
+namespace primal::content
+{
+	// Vertex of the Vulkan geometry path, 20 bytes where the float layout takes 60. Written by ContentTools,
+	// read by the vertex shaders as R16G16B16A16_UNORM, R16G16_SFLOAT, R16G16_SNORM and R16G16_SNORM.
+	struct packed_vertex
+	{
+		u16								position[4];		// xyz: UNORM in the mesh's quantization box, w: always 1
+		u16								uv[2];				// Half floats
+		s16								normal[2];			// Octahedral
+		s16								tangent[2];			// Octahedral, the importer already folds the UV handedness into the direction
+	};
+	static_assert(sizeof(packed_vertex) == 20);
+
+	// Positions decode to min + unorm * scale. Meshes are quantized against their own bounding box, so the
+	// 16 bits cover the mesh evenly whatever its size and placement.
+	struct quantization_box
+	{
+		math::v3						min;
+		math::v3						scale;
+	};
+
+	// Meshes with fewer vertices are drawn with 16-bit indices
+	constexpr u32 max_u16_index_vertices{ 1 << 16 };
+
+	[[nodiscard]] inline quantization_box make_quantization_box(const math::v3& min, const math::v3& max)
+	{
+		// Flat meshes still need a scale that isn't 0
+		auto extent{ [](f32 a, f32 b) { return b > a ? b - a : 1.f; } };
+		return { min, { extent(min.x, max.x), extent(min.y, max.y), extent(min.z, max.z) } };
+	}
+
+	namespace detail
+	{
+		[[nodiscard]] inline s16 pack_snorm16(f32 f)
+		{
+			return (s16)std::lround(math::clamp(f, -1.f, 1.f) * 32767.f);
+		}
+
+		// Unit vector to the octahedron folded onto the z = 0 square (Meyer et al. 2010)
+		inline void pack_octahedral(const math::v3& v, s16 (&out)[2])
+		{
+			const f32 l1{ std::abs(v.x) + std::abs(v.y) + std::abs(v.z) };
+			if (l1 <= 0.f)
+			{
+				out[0] = out[1] = 0;
+				return;
+			}
+
+			f32 x{ v.x / l1 }, y{ v.y / l1 };
+			if (v.z < 0.f)
+			{
+				const f32 fx{ (1.f - std::abs(y)) * (x >= 0.f ? 1.f : -1.f) };
+				const f32 fy{ (1.f - std::abs(x)) * (y >= 0.f ? 1.f : -1.f) };
+				x = fx;
+				y = fy;
+			}
+			out[0] = pack_snorm16(x);
+			out[1] = pack_snorm16(y);
+		}
+	}
+
+	inline void pack_position(packed_vertex& v, const math::v3& position, const quantization_box& box)
+	{
+		auto unorm{ [](f32 p, f32 min, f32 scale) { return (u16)math::pack_unit_float<16>(math::clamp((p - min) / scale, 0.f, 1.f)); } };
+		v.position[0] = unorm(position.x, box.min.x, box.scale.x);
+		v.position[1] = unorm(position.y, box.min.y, box.scale.y);
+		v.position[2] = unorm(position.z, box.min.z, box.scale.z);
+		v.position[3] = u16_invalid_id;
+	}
+
+	[[nodiscard]] inline packed_vertex pack_vertex(const math::v3& position, const math::v2& uv, const math::v3& normal,
+		const math::v3& tangent, const quantization_box& box)
+	{
+		packed_vertex v{};
+		pack_position(v, position, box);
+		v.uv[0] = DirectX::PackedVector::XMConvertFloatToHalf(uv.x);
+		v.uv[1] = DirectX::PackedVector::XMConvertFloatToHalf(uv.y);
+		detail::pack_octahedral(normal, v.normal);
+		detail::pack_octahedral(tangent, v.tangent);
+		return v;
+	}
+
+	[[nodiscard]] inline math::v3 unpack_position(const packed_vertex& v, const quantization_box& box)
+	{
+		constexpr f32 inv_max{ 1.f / 65535.f };
+		return { box.min.x + v.position[0] * inv_max * box.scale.x,
+				 box.min.y + v.position[1] * inv_max * box.scale.y,
+				 box.min.z + v.position[2] * inv_max * box.scale.z };
+	}
+
+	[[nodiscard]] inline math::v2 unpack_uv(const packed_vertex& v)
+	{
+		return { DirectX::PackedVector::XMConvertHalfToFloat(v.uv[0]), DirectX::PackedVector::XMConvertHalfToFloat(v.uv[1]) };
+	}
+}
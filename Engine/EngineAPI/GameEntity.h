@@ -24,6 +24,7 @@ namespace primal {
 			[[nodiscard]] math::v3 orientation() const { return transform().orientation(); }
 			[[nodiscard]] math::v3 position() const { return transform().position(); }
 			[[nodiscard]] math::v3 scale() const { return transform().scale(); }
+			[[nodiscard]] bool is_static() const { return transform().is_static(); }
 		private:
 			entity_id _id;
 		};
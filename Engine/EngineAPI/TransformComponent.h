@@ -18,6 +18,7 @@ namespace primal::transform {
 		math::v3 orientation() const;
 		math::v3 position() const;
 		math::v3 scale() const;
+		bool is_static() const;
 	private:
 		transform_id _id;
 	};
@@ -25,7 +25,9 @@ namespace primal::graphics::d3d12
 		pi.light.create_light_set = light::create_light_set;
 		pi.light.remove_light_set = light::remove_light_set;
 		pi.light.create = light::create;
+		pi.light.create_many = light::create;
 		pi.light.remove = light::remove;
+		pi.light.remove_many = light::remove;
 		pi.light.set_parameter = light::set_parameter;
 		pi.light.get_parameter = light::get_parameter;
 
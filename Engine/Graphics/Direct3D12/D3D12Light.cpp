@@ -987,12 +987,30 @@ namespace primal::graphics::d3d12::light
 		return light_sets[info.light_set_key].add(info);
 	}
 
+	void create(const light_init_info *const infos, u32 count, graphics::light *const lights)
+	{
+		assert(infos && lights);
+		for (u32 i{ 0 }; i < count; ++i)
+		{
+			lights[i] = create(infos[i]);
+		}
+	}
+
 	void remove(light_id id, u64 light_set_key)
 	{
 		assert(light_sets.count(light_set_key));
 		light_sets[light_set_key].remove(id);
 	}
 
+	void remove(const light_id *const ids, u32 count, u64 light_set_key)
+	{
+		assert(ids);
+		for (u32 i{ 0 }; i < count; ++i)
+		{
+			remove(ids[i], light_set_key);
+		}
+	}
+
 	void set_parameter(light_id id, u64 light_set_key, light_parameter::parameter parameter, const void *const data, u32 data_size)
 	{
 		assert(data && data_size);
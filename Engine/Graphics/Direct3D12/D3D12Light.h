@@ -14,7 +14,9 @@ namespace primal::graphics::d3d12::light
 	void create_light_set(u64 light_set_key);
 	void remove_light_set(u64 light_set_key);
 	graphics::light create(light_init_info info);
+	void create(const light_init_info *const infos, u32 count, graphics::light *const lights);
 	void remove(light_id id, u64 light_set_key);
+	void remove(const light_id *const ids, u32 count, u64 light_set_key);
 	void set_parameter(light_id id, u64 light_set_key, light_parameter::parameter parameter, const void *const data, u32 data_size);
 	void get_parameter(light_id id, u64 light_set_key, light_parameter::parameter parameter, void *const data, u32 data_size);
 
@@ -24,7 +24,9 @@ namespace primal::graphics {
 			void(*create_light_set)(u64);
 			void(*remove_light_set)(u64);
 			light(*create)(light_init_info);
+			void(*create_many)(const light_init_info *const, u32, light *const);
 			void(*remove)(light_id, u64);
+			void(*remove_many)(const light_id *const, u32, u64);
 			void(*set_parameter)(light_id, u64, light_parameter::parameter, const void *const, u32);
 			void(*get_parameter)(light_id, u64, light_parameter::parameter, void *const, u32);
 		} light;
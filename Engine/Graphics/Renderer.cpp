@@ -2,6 +2,7 @@
 #include "GraphicsPlatformInterface.h"
 #include "Direct3D12//D3D12Interface.h"
 #include "Vulkan/VulkanInterface.h"
+#include "Vulkan/VulkanHeadless.h"
 
 namespace primal::graphics
 {
@@ -53,6 +54,23 @@ namespace primal::graphics
 		if(gfx.platform != (graphics_platform) - 1) gfx.shutdown();
 	}
 
+	bool configure_headless(s32 argc, char** argv)
+	{
+		return vulkan::headless::configure_from_command_line(argc, argv);
+	}
+
+	bool is_headless()
+	{
+		return vulkan::headless::is_enabled();
+	}
+
+	bool is_headless_finished(s32& exit_code)
+	{
+		if (!vulkan::headless::is_enabled() || !vulkan::headless::is_finished()) return false;
+		exit_code = vulkan::headless::get_result().passed ? 0 : 1;
+		return true;
+	}
+
 	const char* get_engine_shaders_path()
 	{
 		return engine_shader_paths[(u32)gfx.platform];
@@ -113,11 +131,23 @@ namespace primal::graphics
 		return gfx.light.create(info);
 	}
 
+	void create_lights(const light_init_info *const infos, u32 count, light *const lights)
+	{
+		assert(infos && lights);
+		gfx.light.create_many(infos, count, lights);
+	}
+
 	void remove_light(light_id id, u64 light_set_key)
 	{
 		gfx.light.remove(id, light_set_key);
 	}
 
+	void remove_lights(const light_id *const ids, u32 count, u64 light_set_key)
+	{
+		assert(ids);
+		gfx.light.remove_many(ids, count, light_set_key);
+	}
+
 	void light::is_enabled(bool is_enabled) const
 	{
 		assert(is_valid());
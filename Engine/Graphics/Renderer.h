@@ -261,6 +261,14 @@ namespace primal::graphics
 	bool initialize(graphics_platform platform);
 	void shutdown();
 
+	// Scripted offscreen runs of the Vulkan renderer, see Vulkan/VulkanHeadless.h for the switches. Reads -headless and its
+	// switches from the command line, call it before initialize(). Returns true when the run is headless, its surfaces
+	// then render offscreen and the window passed to create_surface() is ignored.
+	bool configure_headless(s32 argc, char** argv);
+	bool is_headless();
+	// The headless run rendered all its frames. exit_code is 0 when it passed, 1 when it didn't.
+	bool is_headless_finished(s32& exit_code);
+
 	// Get the location of compiled engine shaders relative to the executable's path.
 	// The part is for the grphics API that's currently in use.
 	const char* get_engine_shaders_path();
@@ -276,7 +284,11 @@ namespace primal::graphics
 	void remove_light_set(u64 light_set_key);
 
 	light create_light(light_init_info info);
+	// Create count lights of the same light set at once, lights receives them in the order of infos
+	void create_lights(const light_init_info *const infos, u32 count, light *const lights);
 	void remove_light(light_id id, u64 light_set_key);
+	// Remove count lights of the same light set at once
+	void remove_lights(const light_id *const ids, u32 count, u64 light_set_key);
 
 	camera create_camera(camera_init_info info);
 	void remove_camera(camera_id id);
@@ -14,6 +14,13 @@ layout(set = 0, binding = 2) buffer InFrustum
 	Frustum Frustums[];
 } inFrustum;
 
+layout(set = 0, binding = 3) uniform ShadowCascadeBlock
+{
+	ShadowCascadeData data;
+} shadowCascades;
+
+layout(set = 0, binding = 4) uniform sampler2DArray shadowMap;
+
 layout(set = 1, binding = 2) buffer LightGrid
 {
 	uvec2 grids[];
@@ -55,6 +62,40 @@ bool query(vec2 z, vec2 uv, int width, int height)
 	return z.y < depths && z.x > depths;
 }
 
+// Returns 1.0 for fully lit, 0.0 for fully shadowed by the directional light
+float CascadeShadow(vec3 worldPos, float viewDepth)
+{
+	if(viewDepth >= shadowCascades.data.SplitDepths[SHADOW_CASCADE_COUNT - 1]) return 1.0;
+
+	uint cascade = SHADOW_CASCADE_COUNT - 1;
+	for(uint i = 0; i < SHADOW_CASCADE_COUNT; ++i)
+	{
+		if(viewDepth < shadowCascades.data.SplitDepths[i])
+		{
+			cascade = i;
+			break;
+		}
+	}
+
+	vec4 coord = shadowCascades.data.ViewProjection[cascade] * vec4(worldPos, 1.0);
+	coord.xyz /= coord.w;
+	vec2 uv = coord.xy * 0.5 + 0.5;
+
+	// 3x3 PCF
+	float texel = 1.0 / float(textureSize(shadowMap, 0).x);
+	float lit = 0.0;
+	for(int x = -1; x <= 1; ++x)
+	{
+		for(int y = -1; y <= 1; ++y)
+		{
+			float depth = texture(shadowMap, vec3(uv + vec2(x, y) * texel, float(cascade))).r;
+			lit += coord.z <= depth ? 1.0 : 0.0;
+		}
+	}
+
+	return lit / 9.0;
+}
+
 Result RayMarching(Ray r, int width, int height)
 {
 	Result result;
@@ -177,32 +218,33 @@ void main()
 	if(is_reflect == 0.0)
 	{
 		uint i = 0;
-		//for(i = 0; i < light_Nums.light_num; i++)
-		//{
-		//	vec3 lightPos = normalize(directionalLight.param[i].Direction - vec3(0.0)) * 5.0;
-		//	
-		//	vec3 L = normalize(lightPos - fragPos);
-		//	vec3 H = normalize(V + L);
-		//	float distance = distance(lightPos, fragPos); // length(lightPos - fragPos);
-		//	float attenuation = max(dot(directionalLight.param[i].Direction, normal), 0.0); //1.0 / (distance * distance);
-		//	vec3 radiance = directionalLight.param[i].Color * attenuation * directionalLight.param[i].Intensity * 5.0;
-		//	
-		//	float NDF = DistributionGGX(normal, H, roughness);
-		//	float G = GeometrySmith(normal, V, L, roughness);
-		//	vec3 F = fresnelSchlick(clamp(dot(H, V), 0.0, 1.0), F0);
-		//	
-		//	vec3 nominator = NDF * G * F;
-		//	float denominator = 4.0 * max(dot(normal, V), 0.0) * max(dot(normal, L), 0.0);
-		//	vec3 specular_1 = nominator / max(denominator, 0.001);
-		//	
-		//	vec3 kS = F;
-		//	vec3 kD = vec3(1.0) - kS;
-		//	kD *= (1.0 - 0.35);
-		//	
-		//	float NdotL = max(dot(normal, L), 0.0);
-		//	
-		//	color += (kD * albedo.xyz / PI + specular_1) * radiance * NdotL;
-		//}
+		float viewDepth = dot(fragPos - uboBlock.ubo.CameraPositon, normalize(uboBlock.ubo.CameraDirection));
+		// Directional lights. The first one is the light the shadow cascades were rendered for.
+		for(i = 0; i < light_Nums.light_num; i++)
+		{
+			DirectionalLightParameters light = directionalLight.param[i];
+			vec3 N = normalize(normal);
+			vec3 L = normalize(-light.Direction);
+			vec3 H = normalize(V + L);
+			vec3 radiance = light.Color * light.Intensity;
+
+			float NDF = DistributionGGX(N, H, roughness);
+			float G = GeometrySmith(N, V, L, roughness);
+			vec3 F = fresnelSchlick(clamp(dot(H, V), 0.0, 1.0), F0);
+
+			vec3 nominator = NDF * G * F;
+			float denominator = 4.0 * max(dot(N, V), 0.0) * max(dot(N, L), 0.0);
+			vec3 specular_1 = nominator / max(denominator, 0.001);
+
+			vec3 kS = F;
+			vec3 kD = vec3(1.0) - kS;
+			kD *= (1.0 - 0.35);
+
+			float NdotL = max(dot(N, L), 0.0);
+			float shadow = i == 0 ? CascadeShadow(fragPos, viewDepth) : 1.0;
+
+			color += (kD * albedo.xyz / PI + specular_1) * radiance * NdotL * shadow;
+		}
 
 		uint lightStartIndex = inLightGrid.grids[gridIndex].x;
 		uint lightCount = inLightGrid.grids[gridIndex].y;
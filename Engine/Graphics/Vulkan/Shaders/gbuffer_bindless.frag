@@ -0,0 +1,77 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+#include "Common.h"
+
+// Pixel shader of the GPU-driven geometry path. Every material is drawn with it, the material
+// is looked up in the bindless material buffer and its maps in the bindless texture array.
+// Data Transfer Object written by gbuffer_indirect.vert, same block as the material shaders
+layout (location = 0) in struct dto
+{
+	vec3 position;
+	vec2 tex_coord;
+	vec3 normal;
+	vec3 view_position;
+	vec3 frag_position;
+	vec3 cameraDir;
+	vec4 color;
+	vec3 tangent;
+	float near;
+	float far;
+	float mid;
+	float isReflect;
+} in_dto;
+layout (location = 12) flat in uint inMaterialID;
+
+layout (location = 0) out vec4 outPosition;
+layout (location = 1) out vec4 outNormal;
+layout (location = 2) out vec4 outAlbedo;
+layout (location = 3) out vec4 outSpecular;
+
+layout (set = 0, binding = 0) readonly buffer Materials
+{
+	MaterialData materials[];
+} inMaterials;
+
+layout (set = 0, binding = 1) uniform sampler2D textures[];
+
+const uint InvalidIndex = 0xFFFFFFFF;
+
+// Same as the PBR template fragment shader
+float linearDepth(float depth)
+{
+	float z = depth * 2.0f - 1.0f;
+	return (2.0f * in_dto.near * in_dto.far) / (in_dto.far + in_dto.near - z * (in_dto.far - in_dto.near));
+}
+
+// Writes the G-buffer exactly like the material fragment shaders (PBR_Template_Shader_v1.h), composition.frag reads:
+// world position with the linear depth in w, normal mapped normal with mid / 100 in w,
+// diffuse color times the diffuse map, specular map with the reflection flag in w.
+void main()
+{
+	MaterialData material = inMaterials.materials[inMaterialID];
+
+	vec3 normal = in_dto.normal;
+	if (material.NormalIndex != InvalidIndex)
+	{
+		vec3 tangent = in_dto.tangent;
+		tangent = (tangent - dot(tangent, normal) * normal);
+		vec3 bitangent = cross(in_dto.normal, in_dto.tangent);
+		mat3 TBN = mat3(tangent, bitangent, normal);
+		// Update the normal to use a sample from the normal map.
+		vec3 localNormal = 2.0 * texture(textures[nonuniformEXT(material.NormalIndex)], in_dto.tex_coord).rgb - 1.0;
+		normal = normalize(TBN * localNormal);
+	}
+
+	vec4 albedo = in_dto.color * vec4(material.DiffuseColor, 1.0);
+	if (material.DiffuseIndex != InvalidIndex)
+		albedo *= texture(textures[nonuniformEXT(material.DiffuseIndex)], in_dto.tex_coord);
+
+	vec3 specular = vec3(0.0);
+	if (material.SpecularIndex != InvalidIndex)
+		specular = texture(textures[nonuniformEXT(material.SpecularIndex)], in_dto.tex_coord).rgb;
+
+	outPosition = vec4(in_dto.frag_position, linearDepth(gl_FragCoord.z));
+	outNormal = vec4(normal, in_dto.mid / 100);
+	outAlbedo = albedo;
+	outSpecular = vec4(specular, in_dto.isReflect);
+}
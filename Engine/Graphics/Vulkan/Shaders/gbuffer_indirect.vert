@@ -0,0 +1,69 @@
+#version 450
+precision highp float;
+#include "Common.h"
+
+// Vertex shader of the GPU-driven geometry path. Writes the same dto block as material.vert, but the
+// model matrix comes from the instance buffer instead of a per-instance uniform buffer.
+// content::packed_vertex
+layout (location = 0) in vec4 inPackedPos;
+layout (location = 2) in vec2 inUV;
+layout (location = 3) in vec2 inPackedNormal;
+layout (location = 4) in vec2 inPackedTangent;
+
+// Set 0 is the bindless material set, see gbuffer_bindless.frag
+layout (set = 1, binding = 0) readonly buffer Instances
+{
+	IndirectInstanceData instances[];
+} inInstances;
+
+layout (set = 1, binding = 1) uniform GlobalShaderDataBlock
+{
+	GlobalShaderData global_ubo;
+} global_ubo_block;
+
+// Data Transfer Object, locations 0 to 11
+layout (location = 0) out struct dto
+{
+	vec3 position;
+	vec2 tex_coord;
+	vec3 normal;
+	vec3 view_position;
+	vec3 frag_position;
+	vec3 cameraDir;
+	vec4 color;
+	vec3 tangent;
+	float near;
+	float far;
+	float mid;
+	float isReflect;
+} out_dto;
+
+// Only the bindless path needs the material as an exact index, right after the dto block
+layout (location = 12) flat out uint outMaterialID;
+
+void main()
+{
+	IndirectInstanceData instance = inInstances.instances[gl_InstanceIndex];
+	mat4 model = instance.Model;
+	vec4 inPos = DequantizePosition(inPackedPos, instance.PositionMin.xyz, instance.PositionScale.xyz);
+	vec3 inNormal = DecodeOctahedral(inPackedNormal);
+	vec3 inTangent = DecodeOctahedral(inPackedTangent);
+
+	out_dto.tex_coord = inUV;
+	out_dto.color = vec4(1.0);
+	// Fragment position in world space.
+	out_dto.frag_position = vec3(model * inPos);
+	mat3 m3_model = transpose(inverse(mat3(global_ubo_block.global_ubo.View * model)));
+	out_dto.normal = normalize(m3_model * inNormal);
+	out_dto.tangent = normalize(m3_model * inTangent);
+	out_dto.view_position = global_ubo_block.global_ubo.CameraPositon;
+	out_dto.cameraDir = global_ubo_block.global_ubo.CameraDirection;
+	gl_Position = global_ubo_block.global_ubo.Projection * global_ubo_block.global_ubo.View * model * inPos;
+	out_dto.position = vec3(model * inPos);
+	out_dto.near = global_ubo_block.global_ubo.NearPlane;
+	out_dto.far = global_ubo_block.global_ubo.FarPlane;
+	out_dto.mid = float(instance.MaterialID);
+	out_dto.isReflect = float(instance.IsReflect);
+
+	outMaterialID = instance.MaterialID;
+}
@@ -1,11 +1,14 @@
 #version 450
 precision highp float;
-#include "Common.h" 
-layout(location = 0) in vec4 inPos;
-layout(location = 1) in vec3 inColor;
+#include "Common.h"
+
+// Vertex shader of every material. Only the fragment shaders are generated per material by the OBJ importer
+// (ContentTools/TemplateShader/PBR_Template_Shader_v1.h), they all read the dto block written here.
+// content::packed_vertex
+layout(location = 0) in vec4 inPackedPos;
 layout(location = 2) in vec2 inUV;
-layout(location = 3) in vec3 inNormal;
-layout(location = 4) in vec3 inTangent;
+layout(location = 3) in vec2 inPackedNormal;
+layout(location = 4) in vec2 inPackedTangent;
 layout(set = 0, binding = 0) uniform GlobalShaderDataBlock
 {
     GlobalShaderData global_ubo;
@@ -16,6 +19,8 @@ layout(set = 0, binding = 1) uniform Model
     mat4 model; // 64 bytes
     int mid;
     int isReflect; 
+    vec4 positionMin; // Dequantizes inPackedPos
+    vec4 positionScale;
 } model;
 layout(location = 0) out struct dto
 {
@@ -34,8 +39,11 @@ layout(location = 0) out struct dto
 } out_dto;
 void main()
 {// Make sure to assign the shader id.
+    vec4 inPos = DequantizePosition(inPackedPos, model.positionMin.xyz, model.positionScale.xyz);
+    vec3 inNormal = DecodeOctahedral(inPackedNormal);
+    vec3 inTangent = DecodeOctahedral(inPackedTangent);
     out_dto.tex_coord = inUV;
-    out_dto.color = vec4(inColor, 1.0); 
+    out_dto.color = vec4(1.0); 
     // Fragment position in world space.
     out_dto.frag_position = vec3(model.model * inPos);
     // Copy the normal over.
@@ -50,4 +58,4 @@ void main()
     out_dto.far = global_ubo_block.global_ubo.FarPlane;
     out_dto.mid = float(model.mid);
     out_dto.isReflect = float(model.isReflect);
-}
\ No newline at end of file
+}
@@ -0,0 +1,28 @@
+#version 450
+
+layout(location = 0) in vec4 inPackedPos;		// UNORM in the model's quantization box
+
+layout(set = 0, binding = 1) uniform Model
+{
+    mat4 model;
+    int mid;
+    int isReflect;
+    vec4 positionMin;
+    vec4 positionScale;
+} model;
+
+layout(push_constant) uniform Cascade
+{
+    mat4 viewProjection;
+} cascade;
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
+
+void main()
+{
+	vec4 pos = vec4(model.positionMin.xyz + inPackedPos.xyz * model.positionScale.xyz, 1.0);
+	gl_Position = cascade.viewProjection * model.model * pos;
+}
@@ -0,0 +1,275 @@
+#include "VulkanBindless.h"
+#include "VulkanCore.h"
+#include "VulkanHelpers.h"
+#include "VulkanData.h"
+#include "VulkanContent.h"
+#include "Shaders/ShaderTypes.h"
+
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+
+namespace primal::graphics::vulkan::bindless
+{
+	namespace
+	{
+		id::id_type										descriptor_pool_id{ id::invalid_id };
+		id::id_type										set_layout_id{ id::invalid_id };
+		id::id_type										set_id{ id::invalid_id };
+		id::id_type										material_buffer_id{ id::invalid_id };
+		u32												texture_capacity{ 0 };
+
+		std::unordered_map<id::id_type, u32>			texture_slots;			// texture id -> slot in the texture array
+		utl::vector<u32>								free_texture_slots;
+		u32												next_texture_slot{ 0 };
+		utl::vector<glsl::MaterialData>					material_data;
+		bool											materials_dirty{ false };
+		std::mutex										bindless_mutex;
+
+		// Keep the array inside what the device allows for update-after-bind samplers in a single stage and set
+		u32 query_texture_capacity()
+		{
+			VkPhysicalDeviceVulkan12Properties vulkan12_properties{};
+			vulkan12_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+			vulkan12_properties.pNext = nullptr;
+			VkPhysicalDeviceProperties2 properties{};
+			properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+			properties.pNext = &vulkan12_properties;
+			vkGetPhysicalDeviceProperties2(core::physical_device(), &properties);
+
+			return std::min({ max_textures,
+				vulkan12_properties.maxPerStageDescriptorUpdateAfterBindSamplers,
+				vulkan12_properties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+				vulkan12_properties.maxDescriptorSetUpdateAfterBindSamplers,
+				vulkan12_properties.maxDescriptorSetUpdateAfterBindSampledImages });
+		}
+
+		glsl::MaterialData empty_material()
+		{
+			return { invalid_index, invalid_index, invalid_index, 0, { 1.f, 1.f, 1.f }, 0.f };
+		}
+
+		// Takes a free slot and writes the image into it, bindless_mutex has to be held
+		u32 write_texture_slot(const VkDescriptorImageInfo& imageInfo)
+		{
+			u32 slot{ invalid_index };
+			if (!free_texture_slots.empty())
+			{
+				slot = free_texture_slots.back();
+				free_texture_slots.resize(free_texture_slots.size() - 1);
+			}
+			else if (next_texture_slot < texture_capacity)
+			{
+				slot = next_texture_slot++;
+			}
+			else
+			{
+				MESSAGE("Bindless texture array is full");
+				return invalid_index;
+			}
+
+			VkDescriptorSet set{ data::get_data<VkDescriptorSet>(set_id) };
+			VkWriteDescriptorSet descriptorWrite{ descriptor::setWriteDescriptorSet(VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, set, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &imageInfo) };
+			descriptorWrite.dstArrayElement = slot;
+			vkUpdateDescriptorSets(core::logical_device(), 1, &descriptorWrite, 0, nullptr);
+			return slot;
+		}
+	} // anonymous namespace
+
+	bool initialize()
+	{
+		if (!core::descriptor_indexing_supported())
+		{
+			MESSAGE("Descriptor indexing is not supported, bindless materials are disabled");
+			return true;
+		}
+
+		texture_capacity = query_texture_capacity();
+
+		std::vector<VkDescriptorPoolSize> poolSize = {
+			Engine_Descriptor_Pool_Size(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1),
+			Engine_Descriptor_Pool_Size(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, texture_capacity)
+		};
+
+		VkDescriptorPoolCreateInfo poolInfo;
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.pNext = VK_NULL_HANDLE;
+		poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+		poolInfo.poolSizeCount = static_cast<u32>(poolSize.size());
+		poolInfo.pPoolSizes = poolSize.data();
+		poolInfo.maxSets = 1;
+		descriptor_pool_id = data::create_data(data::engine_vulkan_data::vulkan_descriptor_pool, static_cast<void*>(&poolInfo), 0);
+
+		{
+			// Textures are written while frames using other slots are in flight, and most slots are never written
+			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings{
+				descriptor::descriptorSetLayoutBinding(0, VK_SHADER_STAGE_FRAGMENT_BIT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER),
+				descriptor::descriptorSetLayoutBinding(1, VK_SHADER_STAGE_FRAGMENT_BIT, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, nullptr, texture_capacity),
+			};
+			const VkDescriptorBindingFlags bindingFlags[2]{
+				0,
+				VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT |
+				VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT,
+			};
+			VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO };
+			bindingFlagsInfo.pNext = nullptr;
+			bindingFlagsInfo.bindingCount = 2;
+			bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+			VkDescriptorSetLayoutCreateInfo descriptorLayout = descriptor::descriptorSetLayoutCreate(setLayoutBindings);
+			descriptorLayout.pNext = &bindingFlagsInfo;
+			descriptorLayout.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+			set_layout_id = data::create_data(data::engine_vulkan_data::vulkan_descriptor_set_layout, static_cast<void*>(&descriptorLayout), 0);
+		}
+
+		VkDescriptorSetVariableDescriptorCountAllocateInfo variableCountInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO };
+		variableCountInfo.pNext = nullptr;
+		variableCountInfo.descriptorSetCount = 1;
+		variableCountInfo.pDescriptorCounts = &texture_capacity;
+
+		VkDescriptorSetAllocateInfo allocInfo;
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.pNext = &variableCountInfo;
+		allocInfo.descriptorPool = data::get_data<VkDescriptorPool>(descriptor_pool_id);
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &data::get_data<VkDescriptorSetLayout>(set_layout_id);
+		set_id = data::create_data(data::engine_vulkan_data::vulkan_descriptor_sets, static_cast<void*>(&allocInfo), 0);
+
+		material_data.resize(max_materials, empty_material());
+		auto flags = data::vulkan_buffer::static_storage_buffer;
+		material_buffer_id = data::create_data(data::engine_vulkan_data::vulkan_buffer, (void*)(&flags), (u32)(sizeof(glsl::MaterialData) * max_materials));
+		data::get_data<data::vulkan_buffer>(material_buffer_id).update((void*)(material_data.data()), sizeof(glsl::MaterialData) * max_materials);
+
+		VkDescriptorSet set{ data::get_data<VkDescriptorSet>(set_id) };
+		VkDescriptorBufferInfo bufferInfo;
+		bufferInfo.buffer = data::get_data<data::vulkan_buffer>(material_buffer_id).cpu_address;
+		bufferInfo.offset = 0;
+		bufferInfo.range = data::get_data<data::vulkan_buffer>(material_buffer_id).size;
+		VkWriteDescriptorSet descriptorWrite{ descriptor::setWriteDescriptorSet(VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, set, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfo) };
+		vkUpdateDescriptorSets(core::logical_device(), 1, &descriptorWrite, 0, nullptr);
+
+		return true;
+	}
+
+	void shutdown()
+	{
+		if (!is_supported()) return;
+
+		data::remove_data(data::engine_vulkan_data::vulkan_buffer, material_buffer_id);
+		data::remove_data(data::engine_vulkan_data::vulkan_descriptor_sets, set_id);
+		data::remove_data(data::engine_vulkan_data::vulkan_descriptor_set_layout, set_layout_id);
+		data::remove_data(data::engine_vulkan_data::vulkan_descriptor_pool, descriptor_pool_id);
+		material_buffer_id = id::invalid_id;
+		set_id = id::invalid_id;
+		set_layout_id = id::invalid_id;
+		descriptor_pool_id = id::invalid_id;
+
+		texture_slots.clear();
+		free_texture_slots.clear();
+		next_texture_slot = 0;
+		material_data.clear();
+		materials_dirty = false;
+	}
+
+	u32 texture_index(id::id_type texture_id)
+	{
+		assert(is_supported() && id::is_valid(texture_id));
+		std::lock_guard lock{ bindless_mutex };
+
+		auto it = texture_slots.find(texture_id);
+		if (it != texture_slots.end()) return it->second;
+
+		const u32 slot{ write_texture_slot(textures::get_texture(texture_id).get_descriptor_info()) };
+		if (slot != invalid_index) texture_slots[texture_id] = slot;
+		return slot;
+	}
+
+	void remove_texture(id::id_type texture_id)
+	{
+		std::lock_guard lock{ bindless_mutex };
+		auto it = texture_slots.find(texture_id);
+		if (it == texture_slots.end()) return;
+
+		// The stale descriptor stays in the slot, it's partially bound and nothing indexes it until it's reused
+		free_texture_slots.emplace_back(it->second);
+		texture_slots.erase(it);
+	}
+
+	void replace_texture(id::id_type texture_id, const VkDescriptorImageInfo& image_info)
+	{
+		assert(is_supported() && id::is_valid(texture_id));
+		std::lock_guard lock{ bindless_mutex };
+
+		// The slot in use may be read by frames in flight and can't be written, UPDATE_UNUSED_WHILE_PENDING only covers the others
+		const u32 slot{ write_texture_slot(image_info) };
+		if (slot == invalid_index) return;
+
+		auto it = texture_slots.find(texture_id);
+		if (it != texture_slots.end())
+		{
+			const u32 previous{ it->second };
+			for (auto& material : material_data)
+			{
+				if (material.DiffuseIndex == previous) material.DiffuseIndex = slot;
+				if (material.SpecularIndex == previous) material.SpecularIndex = slot;
+				if (material.NormalIndex == previous) material.NormalIndex = slot;
+			}
+			materials_dirty = true;
+			core::deferred_release([previous]() {
+				std::lock_guard lock{ bindless_mutex };
+				free_texture_slots.emplace_back(previous);
+			});
+		}
+		texture_slots[texture_id] = slot;
+	}
+
+	void update_material(id::id_type material_id)
+	{
+		assert(is_supported());
+		if (material_id >= max_materials)
+		{
+			MESSAGE("Material id exceeds the bindless material buffer");
+			return;
+		}
+
+		// Maps are expected in the order the content loader adds them: diffuse, specular, normal
+		const materials::vulkan_material& material{ materials::get_material(material_id) };
+		const utl::vector<id::id_type> texture_ids{ material.getTextureIDS() };
+		glsl::MaterialData data{ empty_material() };
+		u32* const indices[3]{ &data.DiffuseIndex, &data.SpecularIndex, &data.NormalIndex };
+		for (u32 i{ 0 }; i < texture_ids.size() && i < _countof(indices); ++i)
+		{
+			*indices[i] = texture_index(texture_ids[i]);
+		}
+		data.TextureCount = (u32)texture_ids.size();
+		data.DiffuseColor = material.getDiffuseColor();
+
+		std::lock_guard lock{ bindless_mutex };
+		material_data[material_id] = data;
+		materials_dirty = true;
+	}
+
+	void flush_materials()
+	{
+		std::lock_guard lock{ bindless_mutex };
+		if (!materials_dirty) return;
+
+		data::get_data<data::vulkan_buffer>(material_buffer_id).update((void*)(material_data.data()), sizeof(glsl::MaterialData) * material_data.size());
+		materials_dirty = false;
+	}
+
+	bool is_supported()
+	{
+		return id::is_valid(set_id);
+	}
+
+	id::id_type descriptor_set_layout_id()
+	{
+		return set_layout_id;
+	}
+
+	id::id_type descriptor_set_id()
+	{
+		return set_id;
+	}
+}
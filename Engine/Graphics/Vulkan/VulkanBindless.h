@@ -0,0 +1,32 @@
+#pragma once
+#include "VulkanCommonHeaders.h"
+
+// One descriptor set shared by every draw of the GPU-driven path: a material storage buffer and a
+// descriptor-indexed array of all material textures. Shaders reach a texture through
+// Materials[instance.MaterialID].*Index, so nothing is bound per draw or allocated per instance.
+namespace primal::graphics::vulkan::bindless
+{
+	constexpr u32 max_textures{ 4096 };				// Upper bound of the texture array, clamped to the device limits
+	constexpr u32 max_materials{ 1024 };			// Material ids index the material buffer directly
+	constexpr u32 invalid_index{ u32_invalid_id };	// Texture slot of a material without that map
+
+	bool initialize();
+	void shutdown();
+
+	// Slot of the texture in the bindless array, the texture is written into the array on first use
+	u32 texture_index(id::id_type texture_id);
+	// Free the slot of a texture that's being destroyed. No-op for textures never used by a material.
+	void remove_texture(id::id_type texture_id);
+	// Sample the texture through image_info from now on. It goes to a new slot, frames in flight keep indexing the old one,
+	// which is reused once they're done. The materials using the texture pick up the slot with the next flush_materials().
+	void replace_texture(id::id_type texture_id, const VkDescriptorImageInfo& image_info);
+
+	// Refresh the material buffer entry of material_id from its texture list
+	void update_material(id::id_type material_id);
+	// Upload the material entries changed since the last call
+	void flush_materials();
+
+	bool is_supported();
+	id::id_type descriptor_set_layout_id();
+	id::id_type descriptor_set_id();
+}
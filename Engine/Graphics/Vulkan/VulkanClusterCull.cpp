@@ -0,0 +1,233 @@
+#include "VulkanClusterCull.h"
+#include "VulkanCore.h"
+#include "VulkanData.h"
+#include "VulkanContent.h"
+#include "VulkanCamera.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace primal::graphics::vulkan::clusters
+{
+	namespace
+	{
+		using cull_clock = std::chrono::high_resolution_clock;
+
+		// A slot's buffer is rewritten once the frame that drew from it is done, which the frame fences guarantee
+		// after frame_buffer_count newer frames
+		constexpr u32 slot_count{ frame_buffer_count + 1 };
+		constexpr u32 command_stride{ sizeof(VkDrawIndexedIndirectCommand) };
+
+		// Commands of an instance in the frame's buffer, count is u32_invalid_id when it wasn't culled
+		struct draw_range
+		{
+			u32					first;
+			u32					count;
+		};
+
+		struct frame_slot
+		{
+			id::id_type			buffer_id{ id::invalid_id };
+			u32					capacity{ 0 };			// Commands the buffer holds
+		};
+
+		frame_slot									slots[slot_count];
+		u32											current_slot{ 0 };
+		bool										active{ false };			// draw() uses the ranges of this frame
+		utl::vector<draw_range>						ranges;						// Indexed by instance id
+		utl::vector<VkDrawIndexedIndirectCommand>	commands;
+		cull_stats									stats{};
+
+		void release_buffer(frame_slot& slot)
+		{
+			if (!id::is_valid(slot.buffer_id)) return;
+			const id::id_type buffer_id{ slot.buffer_id };
+			core::deferred_release([buffer_id]() { data::remove_data(data::engine_vulkan_data::vulkan_buffer, buffer_id); });
+			slot.buffer_id = id::invalid_id;
+			slot.capacity = 0;
+		}
+
+		void upload(frame_slot& slot)
+		{
+			if (commands.empty()) return;
+			if (slot.capacity < commands.size())
+			{
+				// The old buffer may still be read by a frame in flight
+				release_buffer(slot);
+				slot.capacity = std::max((u32)commands.size(), slot.capacity * 2);
+				auto flags = data::vulkan_buffer::indirect_buffer;
+				slot.buffer_id = data::create_data(data::engine_vulkan_data::vulkan_buffer, (void*)(&flags), slot.capacity * command_stride);
+			}
+			data::get_data<data::vulkan_buffer>(slot.buffer_id).update((void*)commands.data(), (u32)commands.size() * command_stride);
+		}
+	} // anonymous namespace
+
+	cull_view make_view(camera_id id)
+	{
+		using namespace DirectX;
+		const camera::vulkan_camera& c{ camera::get(id) };
+		// Same planes as the GPU-driven path: they come from the columns of the row-vector view-projection, depth is [0, 1]
+		const XMMATRIX vp{ XMMatrixTranspose(c.view_projection()) };
+		const XMVECTOR planes[6]{
+			vp.r[3] + vp.r[0],		// left
+			vp.r[3] - vp.r[0],		// right
+			vp.r[3] + vp.r[1],		// bottom
+			vp.r[3] - vp.r[1],		// top
+			vp.r[2],				// near
+			vp.r[3] - vp.r[2],		// far
+		};
+
+		cull_view view{};
+		for (u32 i{ 0 }; i < 6; ++i)
+		{
+			XMStoreFloat4(&view.frustum_planes[i], XMPlaneNormalize(planes[i]));
+		}
+		XMStoreFloat3(&view.position, c.position());
+		view.max_distance = max_draw_distance > 0.f ? max_draw_distance : c.far_z();
+		return view;
+	}
+
+	void cull(const utl::vector<content::meshlet>& meshlets, const math::m4x4& world, const cull_view& view,
+		utl::vector<VkDrawIndexedIndirectCommand>& commands, cull_stats& stats)
+	{
+		using namespace DirectX;
+		const XMMATRIX m{ XMLoadFloat4x4(&world) };
+		const f32 sx{ XMVectorGetX(XMVector3Length(m.r[0])) };
+		const f32 sy{ XMVectorGetX(XMVector3Length(m.r[1])) };
+		const f32 sz{ XMVectorGetX(XMVector3Length(m.r[2])) };
+		const f32 scale{ std::max(std::max(sx, sy), sz) };
+		// Cone angles only survive the transform when it scales every axis the same
+		const bool use_cones{ std::abs(sx - sy) <= 1e-3f * scale && std::abs(sx - sz) <= 1e-3f * scale };
+		const XMVECTOR camera_position{ XMLoadFloat3(&view.position) };
+
+		bool merge{ false };		// The last command ends right before the next meshlet
+		for (const auto& meshlet : meshlets)
+		{
+			stats.triangle_count += meshlet.triangle_count;
+			const XMVECTOR center{ XMVector3TransformCoord(XMLoadFloat3(&meshlet.center), m) };
+			const f32 radius{ meshlet.radius * scale };
+
+			bool visible{ true };
+			for (u32 i{ 0 }; i < 6 && visible; ++i)
+			{
+				visible = XMVectorGetX(XMPlaneDotCoord(XMLoadFloat4(&view.frustum_planes[i]), center)) >= -radius;
+			}
+			if (!visible)
+			{
+				++stats.frustum_culled;
+				merge = false;
+				continue;
+			}
+
+			if (XMVectorGetX(XMVector3Length(center - camera_position)) - radius > view.max_distance)
+			{
+				++stats.distance_culled;
+				merge = false;
+				continue;
+			}
+
+			if (use_cones && meshlet.cone_cutoff < 1.f)
+			{
+				const XMVECTOR apex{ XMVector3TransformCoord(XMLoadFloat3(&meshlet.cone_apex), m) };
+				const XMVECTOR axis{ XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&meshlet.cone_axis), m)) };
+				if (XMVectorGetX(XMVector3Dot(XMVector3Normalize(apex - camera_position), axis)) >= meshlet.cone_cutoff)
+				{
+					++stats.backface_culled;
+					merge = false;
+					continue;
+				}
+			}
+
+			++stats.visible_meshlet_count;
+			stats.visible_triangle_count += meshlet.triangle_count;
+			const u32 index_count{ meshlet.triangle_count * 3 };
+			if (merge && commands.back().firstIndex + commands.back().indexCount == meshlet.first_index)
+			{
+				commands.back().indexCount += index_count;
+			}
+			else
+			{
+				commands.emplace_back(VkDrawIndexedIndirectCommand{ index_count, 1, meshlet.first_index, 0, 0 });
+			}
+			merge = true;
+		}
+		stats.meshlet_count += (u32)meshlets.size();
+	}
+
+	void update(const frame_info& info, scene::vulkan_scene& scene)
+	{
+		if constexpr (!enabled) return;
+
+		const auto start{ cull_clock::now() };
+		current_slot = (current_slot + 1) % slot_count;
+		stats = {};
+		commands.clear();
+		for (auto& range : ranges) range = { 0, u32_invalid_id };
+
+		const cull_view view{ make_view(info.camera_id) };
+		for (const id::id_type instance_id : scene.getInstanceIDs())
+		{
+			const auto& instance{ scene::get_instance(instance_id) };
+			const auto& meshlets{ instance.getModel().getMeshlets() };
+			if (meshlets.empty()) continue;
+
+			if (ranges.size() <= instance_id) ranges.resize(instance_id + 1, draw_range{ 0, u32_invalid_id });
+			const u32 first{ (u32)commands.size() };
+			cull(meshlets, instance.getModelMatrix(), view, commands, stats);
+			ranges[instance_id] = { first, (u32)commands.size() - first };
+			++stats.instance_count;
+		}
+
+		stats.command_count = (u32)commands.size();
+		upload(slots[current_slot]);
+		active = true;
+		stats.cull_ms = std::chrono::duration<f32, std::milli>(cull_clock::now() - start).count();
+	}
+
+	void skip_frame()
+	{
+		active = false;
+		stats = {};
+	}
+
+	bool draw(VkCommandBuffer cmd_buffer, id::id_type instance_id)
+	{
+		if constexpr (!enabled) return false;
+		if (!active || instance_id >= ranges.size()) return false;
+
+		const draw_range& range{ ranges[instance_id] };
+		if (range.count == u32_invalid_id) return false;
+		if (!range.count) return true;		// Every meshlet was culled
+
+		const VkBuffer buffer{ data::get_data<data::vulkan_buffer>(slots[current_slot].buffer_id).cpu_address };
+		const VkDeviceSize offset{ (VkDeviceSize)range.first * command_stride };
+		if (core::multi_draw_indirect_supported())
+		{
+			vkCmdDrawIndexedIndirect(cmd_buffer, buffer, offset, range.count, command_stride);
+		}
+		else
+		{
+			// Without multiDrawIndirect drawCount has to be 0 or 1
+			for (u32 i{ 0 }; i < range.count; ++i)
+			{
+				vkCmdDrawIndexedIndirect(cmd_buffer, buffer, offset + (VkDeviceSize)i * command_stride, 1, command_stride);
+			}
+		}
+		return true;
+	}
+
+	const cull_stats& get_stats()
+	{
+		return stats;
+	}
+
+	void shutdown()
+	{
+		for (auto& slot : slots) release_buffer(slot);
+		ranges.clear();
+		commands.clear();
+		active = false;
+		stats = {};
+	}
+}
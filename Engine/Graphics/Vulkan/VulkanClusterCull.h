@@ -0,0 +1,63 @@
+#pragma once
+#include "VulkanCommonHeaders.h"
+
+namespace primal::graphics::vulkan
+{
+	namespace scene
+	{
+		class vulkan_scene;
+	}
+}
+
+// Meshlet culling of the per-instance geometry path. Every frame the meshlets of each instance are tested against
+// the camera frustum, their normal cone and the draw distance on the CPU, and the ones left are written as indexed
+// indirect commands. Adjacent meshlets that both survive are merged into one command.
+// The GPU-driven path culls whole instances instead, nothing is culled here while it draws the scene.
+namespace primal::graphics::vulkan::clusters
+{
+	constexpr bool enabled{ true };
+	constexpr f32 max_draw_distance{ 0.f };			// Meshlets farther from the camera are culled, 0 uses the camera's far plane
+
+	// World space view the meshlets are culled against
+	struct cull_view
+	{
+		math::v4			frustum_planes[6];		// Normalized, xyz: inward normal, w: distance
+		math::v3			position;
+		f32					max_distance;
+	};
+
+	// Counts of the last culled frame
+	struct cull_stats
+	{
+		u32					instance_count;			// Instances with meshlets
+		u32					meshlet_count;
+		u32					visible_meshlet_count;
+		u32					frustum_culled;
+		u32					backface_culled;
+		u32					distance_culled;
+		u32					command_count;			// Indirect commands after merging adjacent meshlets
+		u64					triangle_count;
+		u64					visible_triangle_count;
+		f32					cull_ms;
+	};
+
+	[[nodiscard]] cull_view make_view(camera_id id);
+
+	// Append the commands of the meshlets of a model with the world matrix that pass the view. Commands draw from the model's index buffer.
+	void cull(const utl::vector<content::meshlet>& meshlets, const math::m4x4& world, const cull_view& view,
+		utl::vector<VkDrawIndexedIndirectCommand>& commands, cull_stats& stats);
+
+	// Cull the meshlets of every instance of the scene and upload the commands for this frame's draws
+	void update(const frame_info& info, scene::vulkan_scene& scene);
+
+	// Nothing is culled this frame, draw() leaves every instance to be drawn whole
+	void skip_frame();
+
+	// Record the commands of the instance's visible meshlets, its model's buffers have to be bound.
+	// False when the instance wasn't culled this frame and has to be drawn whole.
+	bool draw(VkCommandBuffer cmd_buffer, id::id_type instance_id);
+
+	[[nodiscard]] const cull_stats& get_stats();
+
+	void shutdown();
+}
@@ -4,6 +4,8 @@
 
 #include "CommonHeaders.h"
 #include "Graphics/Renderer.h"
+#include "Content/Meshlet.h"
+#include "Content/PackedVertex.h"
 
 #ifdef _WIN32
 #define VK_USE_PLATFORM_WIN32_KHR
@@ -40,7 +42,7 @@ struct vulkan_image
 
 struct vulkan_texture : vulkan_image
 {
-    VkSampler       sampler;
+    VkSampler       sampler{ VK_NULL_HANDLE };  // From the sampler cache, released with the texture
     VkFormat        format;
 };
 
@@ -92,6 +94,7 @@ struct vulkan_fence
 };
 
 // Own param
+// Vertex of .kms files written before ContentTools packed them, load_kms_file packs these on load
 struct Vertex
 {
     math::v3 pos;
@@ -114,11 +117,15 @@ struct geometry_config
 {
     u32						vertex_size;
     u32						vertex_count;
-    utl::vector<Vertex>		vertices;
+    utl::vector<content::packed_vertex>	vertices;
+    content::quantization_box			position_box;
 
-    u32						index_size;
+    u32						index_size;			// In the file, 16-bit indices are kept in indices16 and 32-bit ones in indices
     u32						index_count;
     utl::vector<u32>		indices;
+    utl::vector<u16>		indices16;
+
+    [[nodiscard]] u32 index(u32 i) const { return index_size == sizeof(u16) ? indices16[i] : indices[i]; }
 
     math::v3				center;
     math::v3				min_extents;
@@ -131,6 +138,9 @@ struct geometry_config
     char                    specular_map[256];
     char                    alpha_map[256];
     char                    normal_map[256];
+
+    // Empty for .kms files written before ContentTools built meshlets
+    utl::vector<content::meshlet>   meshlets;
 };
 
 struct InstanceData
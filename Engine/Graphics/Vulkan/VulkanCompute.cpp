@@ -15,8 +15,6 @@ namespace primal::graphics::vulkan::compute
 {
 	namespace
 	{
-		VkCommandPool					_compute_pool;
-
 		class vulkan_base_compute_pass
 		{
 		public:
@@ -95,25 +93,17 @@ namespace primal::graphics::vulkan::compute
 
 				assert(!_input_buffers.empty() || !_input_images.empty() || !_output_buffers.empty() || !_output_images.empty() || id::is_valid(_shader_id));
 
-				get_graphics_queue();
-
-				create_semaphore_and_fence();
-
 				createPoolAndLayout();
 
 				create_pipeline();
 
-				create_command_buffer();
-
 				create_descriptor_set();
 			}
 
 			virtual void shutdown()
 			{
+				// NOTE: the surface waits for the device before it shuts compute down
 				using namespace data;
-				vkQueueWaitIdle(_compute_queue);
-
-				free_cmd_buffer(core::logical_device(), _compute_pool, _cmd_buffer);
 
 				for (auto id : _descriptor_set_ids)
 				{
@@ -128,11 +118,6 @@ namespace primal::graphics::vulkan::compute
 
 				remove_data(engine_vulkan_data::vulkan_pipeline_layout, _pipeline_layout_id);
 
-				vkDestroySemaphore(core::logical_device(), _signal_semaphore, nullptr);
-				vkDestroySemaphore(core::logical_device(), _wait_semaphore, nullptr);
-				
-				vkDestroyFence(core::logical_device(), _fence.fence, nullptr);
-
 				_input_buffers.clear();
 				_input_images.clear();
 				_output_buffers.clear();
@@ -143,27 +128,25 @@ namespace primal::graphics::vulkan::compute
 
 			virtual void rebuild_pipeline(id::id_type shader_id)
 			{
-				vkQueueWaitIdle(_compute_queue);
-
-				data::remove_data(data::engine_vulkan_data::vulkan_pipeline, _pipeline_id);
+				// Frames in flight may still use the old pipeline
+				core::deferred_release([pipeline_id{ _pipeline_id }]() { data::remove_data(data::engine_vulkan_data::vulkan_pipeline, pipeline_id); });
 
 				_shader_id = shader_id;
 
 				create_pipeline();
 			}
 
-			virtual void run(u32 dispatch_x, u32 dispatch_y, u32 dispatch_z)
+			virtual void record(VkCommandBuffer cmd_buffer, u32 dispatch_x, u32 dispatch_y, u32 dispatch_z)
 			{
-				runRenderpass(dispatch_x, dispatch_y, dispatch_z);
-			}
+				auto pipeline = data::get_data<VkPipeline>(_pipeline_id);
+				auto pipelineLayout = data::get_data<VkPipelineLayout>(_pipeline_layout_id);
+				auto set = data::get_data<VkDescriptorSet>(_descriptor_set_ids.font());
+				vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+				vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &set, 0, 0);
 
-			virtual void submit(u32 wait_num, VkSemaphore* pWait)
-			{
-				compute_submit(wait_num, pWait);
+				vkCmdDispatch(cmd_buffer, dispatch_x, dispatch_y, dispatch_z);
 			}
 
-			[[nodiscard]] constexpr VkSemaphore const signal_semaphore() const { return _signal_semaphore; }
-
 		protected:
 			[[nodiscard]] utl::vector<id::id_type> const get_descriptor_sets() const { return _descriptor_set_ids; }
 			[[nodiscard]] constexpr id::id_type const get_descriptor_pool() const { return _descriptor_pool_id; }
@@ -182,11 +165,6 @@ namespace primal::graphics::vulkan::compute
 			id::id_type										_pipeline_layout_id;
 			id::id_type										_pipeline_id;
 			utl::vector<id::id_type>						_descriptor_set_ids;
-			vulkan_cmd_buffer								_cmd_buffer;
-			VkSemaphore										_signal_semaphore;
-			VkSemaphore										_wait_semaphore;
-			VkQueue											_compute_queue;
-			vulkan_fence									_fence;
 
 		private:
 
@@ -378,73 +356,6 @@ namespace primal::graphics::vulkan::compute
 
 				_pipeline_id = data::create_data(data::engine_vulkan_data::vulkan_pipeline, static_cast<void*>(&info), 1);
 			}
-
-			virtual void create_command_buffer()
-			{
-				if (_cmd_buffer.cmd_buffer)
-				{
-					vkFreeCommandBuffers(core::logical_device(), _compute_pool, 1, &_cmd_buffer.cmd_buffer);
-
-					_cmd_buffer.cmd_buffer = nullptr;
-					_cmd_buffer.cmd_state = vulkan_cmd_buffer::CMD_NOT_ALLOCATED;
-				}
-				_cmd_buffer = allocate_cmd_buffer(core::logical_device(), _compute_pool, true);
-			}
-
-			virtual void runRenderpass(u32 dispatch_x, u32 dispatch_y, u32 dispatch_z)
-			{
-				_cmd_buffer.cmd_buffer = beginSingleCommand(core::logical_device(), _compute_pool);
-				_cmd_buffer.cmd_state = vulkan_cmd_buffer::CMD_IN_RENDER_PASS;
-				auto pipeline = data::get_data<VkPipeline>(_pipeline_id);
-				auto pipelineLayout = data::get_data<VkPipelineLayout>(_pipeline_layout_id);
-				auto set = data::get_data<VkDescriptorSet>(_descriptor_set_ids.font());
-				vkCmdBindPipeline(_cmd_buffer.cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
-				vkCmdBindDescriptorSets(_cmd_buffer.cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &set, 0, 0);
-
-				vkCmdDispatch(_cmd_buffer.cmd_buffer, dispatch_x, dispatch_y, dispatch_z);
-
-				vkEndCommandBuffer(_cmd_buffer.cmd_buffer);
-			}
-
-			virtual void compute_submit(u32 wait_num, VkSemaphore* pWait)
-			{
-				VkSubmitInfo submitInfo;
-				submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-				submitInfo.pNext = nullptr;
-				submitInfo.commandBufferCount = 1;
-				submitInfo.pCommandBuffers = &_cmd_buffer.cmd_buffer;
-				submitInfo.waitSemaphoreCount = wait_num;
-				submitInfo.pWaitSemaphores = pWait;
-				submitInfo.signalSemaphoreCount = 1;
-				submitInfo.pSignalSemaphores = &_signal_semaphore;
-				VkPipelineStageFlags flags[4]{ VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT ,VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT };
-				submitInfo.pWaitDstStageMask = flags;
-				VkResult result{ VK_SUCCESS };
-				VkCall(result = vkQueueSubmit(_compute_queue, 1, &submitInfo, nullptr), "Failed to submit compute queue...");
-			}
-
-			void create_semaphore_and_fence()
-			{
-				VkResult result{ VK_SUCCESS };
-				VkSemaphoreCreateInfo sInfo;
-				sInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-				sInfo.pNext = nullptr;
-				sInfo.flags = 0;
-				VkCall(result = vkCreateSemaphore(core::logical_device(), &sInfo, nullptr, &_signal_semaphore), "Failed to create compute signal semaphore...");
-				VkCall(result = vkCreateSemaphore(core::logical_device(), &sInfo, nullptr, &_wait_semaphore), "Failed to create compute wait semaphore...");
-
-				_fence.signaled = true;
-
-				VkFenceCreateInfo f_info{ VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
-				f_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;	// this ensures the fence starts signaled as open
-
-				VkCall(result = vkCreateFence(core::logical_device(), &f_info, nullptr, &_fence.fence), "Failed to create fence");
-			}
-
-			void get_graphics_queue()
-			{
-				vkGetDeviceQueue(core::logical_device(), core::compute_family_queue_index(), 0, &_compute_queue);
-			}
 		};
 
 		class frustum_pass : public vulkan_base_compute_pass
@@ -461,11 +372,13 @@ namespace primal::graphics::vulkan::compute
 			{
 				vulkan_base_compute_pass::shutdown();
 				is_rendered = false;
-				is_submited = false;
 			}
 
-			virtual void run(u32 dispatch_x = 0, u32 dispatch_y = 0, u32 dispatch_z = 0) override
+			// The frustums only depend on the tile grid, they're built in the first frame and kept
+			void record(VkCommandBuffer cmd_buffer)
 			{
+				if (is_rendered) return;
+
 				const u32 tile_size{ 16 };
 				const math::u32v2 tile_count
 				{
@@ -476,30 +389,14 @@ namespace primal::graphics::vulkan::compute
 				u32 NumThreadGroupX = (u32)math::align_size_up<tile_size>(tile_count.x) / tile_size;
 				u32 NumThreadGroupY = (u32)math::align_size_up<tile_size>(tile_count.y) / tile_size;
 
-				if (!is_rendered)
-				{
-					vulkan_base_compute_pass::run(NumThreadGroupX, NumThreadGroupY, 1);
-					is_rendered = !is_rendered;
-				}
+				vulkan_base_compute_pass::record(cmd_buffer, NumThreadGroupX, NumThreadGroupY, 1);
+				is_rendered = true;
 			}
 
-			virtual void submit(u32 wait_num, VkSemaphore* pWait) override
-			{
-				if (!is_submited)
-				{
-					vulkan_base_compute_pass::submit(wait_num, pWait);
-					is_submited = !is_submited;
-				}
-			}
-
-			[[nodiscard]] constexpr VkSemaphore const get_signal_semaphore() const { return vulkan_base_compute_pass::signal_semaphore(); }
 			[[nodiscard]] constexpr bool const Is_Rendered() const { return is_rendered; }
 
 		private:
 			bool							is_rendered{ false };
-			bool							is_submited{ false };
-
-		private:
 		};
 
 		class culling_light_pass
@@ -514,10 +411,8 @@ namespace primal::graphics::vulkan::compute
 
 			void shutdown()
 			{
+				// NOTE: the surface waits for the device before it shuts compute down
 				using namespace data;
-				vkQueueWaitIdle(_compute_queue);
-
-				free_cmd_buffer(core::logical_device(), _compute_pool, _cmd_buffer);
 
 				for (auto id : _descriptor_set_ids)
 				{
@@ -532,22 +427,15 @@ namespace primal::graphics::vulkan::compute
 
 				remove_data(engine_vulkan_data::vulkan_pipeline_layout, _pipeline_layout_id);
 
-				vkDestroySemaphore(core::logical_device(), _signal_semaphore, nullptr);
-				vkDestroySemaphore(core::logical_device(), _wait_semaphore, nullptr);
-
-				vkDestroyFence(core::logical_device(), _fence.fence, nullptr);
-
 				_input_buffers.clear();
 				_input_images.clear();
 				_output_buffers.clear();
 				_output_images.clear();
 				_shader_id = id::invalid_id;
 				_set_count = 0;
-				is_rendered = false;
-				is_submited = false;
 			}
 
-			void run(u32 dispatch_x = 0, u32 dispatch_y = 0, u32 dispatch_z = 0)
+			void record(VkCommandBuffer cmd_buffer, VkBuffer light_index_counter)
 			{
 				const u32 tile_size{ 16 };
 				const math::u32v2 tile_count
@@ -556,31 +444,17 @@ namespace primal::graphics::vulkan::compute
 					(u32)math::align_size_up<tile_size>(900) / tile_size,
 				};
 
-				u32 NumThreadGroupX = tile_count.x;
-				u32 NumThreadGroupY = tile_count.y;
-
-				if (!is_rendered)
-				{
-					is_rendered = !is_rendered;
-					return;
-				}
+				// The light list is appended to through the counter, it starts from zero every frame
+				vkCmdFillBuffer(cmd_buffer, light_index_counter, 0, VK_WHOLE_SIZE, 0);
+				VkMemoryBarrier barrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+				barrier.pNext = nullptr;
+				barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+				vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
 
-				runRenderpass(NumThreadGroupX, NumThreadGroupY, 1);
+				runRenderpass(cmd_buffer, tile_count.x, tile_count.y, 1);
 			}
 
-			void submit(u32 wait_num, VkSemaphore* pWait)
-			{
-				if (!is_submited)
-				{
-					is_submited = !is_submited;
-					return;
-				}
-				compute_submit(wait_num, pWait);
-			}
-
-			[[nodiscard]] constexpr VkSemaphore const get_singal_semaphore() const { return _signal_semaphore; }
-			[[nodiscard]] constexpr bool const Is_Rendered() const { return is_rendered; }
-
 		public:
 			enum data_io : u32
 			{
@@ -657,24 +531,17 @@ namespace primal::graphics::vulkan::compute
 
 				assert(!_input_buffers.empty() || !_input_images.empty() || !_output_buffers.empty() || !_output_images.empty() || id::is_valid(_shader_id));
 
-				get_graphics_queue();
-
-				create_semaphore_and_fence();
-
 				createPoolAndLayout();
 
 				create_pipeline();
 
-				create_command_buffer();
-
 				create_descriptor_set();
 			}
 
 			void rebuild_pipeline(id::id_type shader_id)
 			{
-				vkQueueWaitIdle(_compute_queue);
-
-				data::remove_data(data::engine_vulkan_data::vulkan_pipeline, _pipeline_id);
+				// Frames in flight may still use the old pipeline
+				core::deferred_release([pipeline_id{ _pipeline_id }]() { data::remove_data(data::engine_vulkan_data::vulkan_pipeline, pipeline_id); });
 
 				_shader_id = shader_id;
 
@@ -682,8 +549,6 @@ namespace primal::graphics::vulkan::compute
 			}
 
 
-			[[nodiscard]] constexpr VkSemaphore const signal_semaphore() const { return _signal_semaphore; }
-
 		protected:
 			[[nodiscard]] utl::vector<id::id_type> const get_descriptor_sets() const { return _descriptor_set_ids; }
 			[[nodiscard]] constexpr id::id_type const get_descriptor_pool() const { return _descriptor_pool_id; }
@@ -703,14 +568,6 @@ namespace primal::graphics::vulkan::compute
 			id::id_type										_pipeline_layout_id;
 			id::id_type										_pipeline_id;
 			utl::vector<id::id_type>						_descriptor_set_ids;
-			vulkan_cmd_buffer								_cmd_buffer;
-			VkSemaphore										_signal_semaphore;
-			VkSemaphore										_wait_semaphore;
-			VkQueue											_compute_queue;
-			vulkan_fence									_fence;
-
-			bool											is_submited{ false };
-			bool											is_rendered{ false };
 
 		private:
 
@@ -917,26 +774,12 @@ namespace primal::graphics::vulkan::compute
 				_pipeline_id = data::create_data(data::engine_vulkan_data::vulkan_pipeline, static_cast<void*>(&info), 1);
 			}
 
-			void create_command_buffer()
+			void runRenderpass(VkCommandBuffer cmd_buffer, u32 dispatch_x, u32 dispatch_y, u32 dispatch_z)
 			{
-				if (_cmd_buffer.cmd_buffer)
-				{
-					vkFreeCommandBuffers(core::logical_device(), _compute_pool, 1, &_cmd_buffer.cmd_buffer);
-
-					_cmd_buffer.cmd_buffer = nullptr;
-					_cmd_buffer.cmd_state = vulkan_cmd_buffer::CMD_NOT_ALLOCATED;
-				}
-				_cmd_buffer = allocate_cmd_buffer(core::logical_device(), _compute_pool, true);
-			}
-
-			void runRenderpass(u32 dispatch_x, u32 dispatch_y, u32 dispatch_z)
-			{
-				_cmd_buffer.cmd_buffer = beginSingleCommand(core::logical_device(), _compute_pool);
-				_cmd_buffer.cmd_state = vulkan_cmd_buffer::CMD_IN_RENDER_PASS;
 				auto pipeline = data::get_data<VkPipeline>(_pipeline_id);
 				auto pipelineLayout = data::get_data<VkPipelineLayout>(_pipeline_layout_id);
 				auto set = data::get_data<VkDescriptorSet>(_descriptor_set_ids.font());
-				vkCmdBindDescriptorSets(_cmd_buffer.cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &set, 0, 0);
+				vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &set, 0, 0);
 
 				VkWriteDescriptorSet write;
 				VkDescriptorBufferInfo lightBuffer;
@@ -952,7 +795,7 @@ namespace primal::graphics::vulkan::compute
 				write.dstArrayElement = 0;
 				write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 				write.pBufferInfo = &lightBuffer;
-				vkCmdPushDescriptorSetKHR(_cmd_buffer.cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 1, 1, &write);
+				vkCmdPushDescriptorSetKHR(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 1, 1, &write);
 
 				VkWriteDescriptorSet write1;
 				VkDescriptorBufferInfo lightgridBuffer;
@@ -968,7 +811,7 @@ namespace primal::graphics::vulkan::compute
 				write1.dstArrayElement = 0;
 				write1.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 				write1.pBufferInfo = &lightgridBuffer;
-				vkCmdPushDescriptorSetKHR(_cmd_buffer.cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 1, 1, &write1);
+				vkCmdPushDescriptorSetKHR(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 1, 1, &write1);
 
 				VkWriteDescriptorSet write2;
 				VkDescriptorBufferInfo lightIndexBuffer;
@@ -984,7 +827,7 @@ namespace primal::graphics::vulkan::compute
 				write2.dstArrayElement = 0;
 				write2.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 				write2.pBufferInfo = &lightIndexBuffer;
-				vkCmdPushDescriptorSetKHR(_cmd_buffer.cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 1, 1, &write2);
+				vkCmdPushDescriptorSetKHR(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 1, 1, &write2);
 
 				VkWriteDescriptorSet write3;
 				VkDescriptorBufferInfo boundingSpheresBuffer;
@@ -1000,69 +843,14 @@ namespace primal::graphics::vulkan::compute
 				write3.dstArrayElement = 0;
 				write3.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 				write3.pBufferInfo = &boundingSpheresBuffer;
-				vkCmdPushDescriptorSetKHR(_cmd_buffer.cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 1, 1, &write3);
-
-				vkCmdBindPipeline(_cmd_buffer.cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
-
-				vkCmdDispatch(_cmd_buffer.cmd_buffer, dispatch_x, dispatch_y, dispatch_z);
-
-				vkEndCommandBuffer(_cmd_buffer.cmd_buffer);
-			}
-
-			void compute_submit(u32 wait_num, VkSemaphore* pWait)
-			{
-				VkSubmitInfo submitInfo;
-				submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-				submitInfo.pNext = nullptr;
-				submitInfo.commandBufferCount = 1;
-				submitInfo.pCommandBuffers = &_cmd_buffer.cmd_buffer;
-				submitInfo.waitSemaphoreCount = wait_num;
-				submitInfo.pWaitSemaphores = pWait;
-				submitInfo.signalSemaphoreCount = 1;
-				submitInfo.pSignalSemaphores = &_signal_semaphore;
-				VkPipelineStageFlags flags[4]{ VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT ,VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT };
-				submitInfo.pWaitDstStageMask = flags;
-				VkResult result{ VK_SUCCESS };
-				VkCall(result = vkQueueSubmit(_compute_queue, 1, &submitInfo, nullptr), "Failed to submit compute queue...");
-			}
-
-			void create_semaphore_and_fence()
-			{
-				VkResult result{ VK_SUCCESS };
-				VkSemaphoreCreateInfo sInfo;
-				sInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-				sInfo.pNext = nullptr;
-				sInfo.flags = 0;
-				VkCall(result = vkCreateSemaphore(core::logical_device(), &sInfo, nullptr, &_signal_semaphore), "Failed to create compute signal semaphore...");
-				VkCall(result = vkCreateSemaphore(core::logical_device(), &sInfo, nullptr, &_wait_semaphore), "Failed to create compute wait semaphore...");
-
-				_fence.signaled = true;
+				vkCmdPushDescriptorSetKHR(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 1, 1, &write3);
 
-				VkFenceCreateInfo f_info{ VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
-				f_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;	// this ensures the fence starts signaled as open
+				vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
 
-				VkCall(result = vkCreateFence(core::logical_device(), &f_info, nullptr, &_fence.fence), "Failed to create fence");
-			}
-
-			void get_graphics_queue()
-			{
-				vkGetDeviceQueue(core::logical_device(), core::compute_family_queue_index(), 0, &_compute_queue);
+				vkCmdDispatch(cmd_buffer, dispatch_x, dispatch_y, dispatch_z);
 			}
 		};
 
-		bool create_command_pool_and_semaphore()
-		{
-			VkCommandPoolCreateInfo poolInfo;
-			poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-			poolInfo.pNext = nullptr;
-			poolInfo.queueFamilyIndex = core::compute_family_queue_index();
-			poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-			VkResult result{ VK_SUCCESS };
-			VkCall(result = vkCreateCommandPool(core::logical_device(), &poolInfo, nullptr, &_compute_pool), "Failed to create compute command pool...");
-
-			return true;
-		}
-
 		//vulkan_compute					_frustums_compute;
 		id::id_type						_storage_in_id{ id::invalid_id };
 		id::id_type						_storage_out_id{ id::invalid_id };
@@ -1073,16 +861,28 @@ namespace primal::graphics::vulkan::compute
 		id::id_type						_storage_in_light_info{ id::invalid_id }; // compute::culling_info_buffer_id()
 		id::id_type						_storage_in_light_count{ id::invalid_id };
 		id::id_type						_stroage_light_count{ id::invalid_id };
-		id::id_type						_storage_out_light_grid[frame_buffer_count]{ id::invalid_id, id::invalid_id, id::invalid_id };
-		id::id_type						_storage_out_light_list[frame_buffer_count]{ id::invalid_id, id::invalid_id, id::invalid_id };
+		// The render graph orders every frame's light culling after the previous frame's composition,
+		// so one grid and list serve all frames in flight
+		id::id_type						_storage_out_light_grid{ id::invalid_id };
+		id::id_type						_storage_out_light_list{ id::invalid_id };
 	} // anonymous namespace
 
-	void initialize(vulkan_geometry_pass* gpass)
+	void create_buffers()
 	{
-		create_command_pool_and_semaphore();
 		auto flags = data::vulkan_buffer::static_storage_buffer;
 		_storage_in_id = data::create_data(data::engine_vulkan_data::vulkan_buffer, (void*)(&flags), sizeof(glsl::GlobalShaderData));
 		_storage_out_id = data::create_data(data::engine_vulkan_data::vulkan_buffer, (void*)(&flags), sizeof(math::v4) * 4 * 5700);
+		_storage_in_light_count = data::create_data(data::engine_vulkan_data::vulkan_buffer, (void*)(&flags), sizeof(u32));
+		_storage_out_light_grid = data::create_data(data::engine_vulkan_data::vulkan_buffer, (void*)(&flags), (u32)math::align_size_up<sizeof(math::v4)>(sizeof(math::u32v2) * 5700));
+		_storage_out_light_list = data::create_data(data::engine_vulkan_data::vulkan_buffer, (void*)(&flags), (u32)math::align_size_up<sizeof(math::v4)>(sizeof(u32) * 5700 * 256));
+
+		// Cleared on the GPU at the start of light culling
+		auto counter_flags = data::vulkan_buffer::per_frame_update_storage_buffer;
+		_stroage_light_count = data::create_data(data::engine_vulkan_data::vulkan_buffer, (void*)(&counter_flags), sizeof(u32));
+	}
+
+	void initialize(vulkan_geometry_pass* gpass)
+	{
 		//utl::vector<id::id_type> local_buffer_ids;
 		//local_buffer_ids.emplace_back(_storage_in_id);
 		//local_buffer_ids.emplace_back(_storage_out_id);
@@ -1105,15 +905,6 @@ namespace primal::graphics::vulkan::compute
 			compute_shader_id);
 		_frustum_pass.initialize();
 
-		_storage_in_light_count = data::create_data(data::engine_vulkan_data::vulkan_buffer, (void*)(&flags), sizeof(u32));
-		_stroage_light_count = data::create_data(data::engine_vulkan_data::vulkan_buffer, (void*)(&flags), sizeof(u32));
-		_storage_out_light_grid[0] = data::create_data(data::engine_vulkan_data::vulkan_buffer, (void*)(&flags), (u32)math::align_size_up<sizeof(math::v4)>(sizeof(math::u32v2) * 5700));
-		_storage_out_light_grid[1] = data::create_data(data::engine_vulkan_data::vulkan_buffer, (void*)(&flags), (u32)math::align_size_up<sizeof(math::v4)>(sizeof(math::u32v2) * 5700));
-		_storage_out_light_grid[2] = data::create_data(data::engine_vulkan_data::vulkan_buffer, (void*)(&flags), (u32)math::align_size_up<sizeof(math::v4)>(sizeof(math::u32v2) * 5700));
-		_storage_out_light_list[0] = data::create_data(data::engine_vulkan_data::vulkan_buffer, (void*)(&flags), (u32)math::align_size_up<sizeof(math::v4)>(sizeof(u32) * 5700 * 256));
-		_storage_out_light_list[1] = data::create_data(data::engine_vulkan_data::vulkan_buffer, (void*)(&flags), (u32)math::align_size_up<sizeof(math::v4)>(sizeof(u32) * 5700 * 256));
-		_storage_out_light_list[2] = data::create_data(data::engine_vulkan_data::vulkan_buffer, (void*)(&flags), (u32)math::align_size_up<sizeof(math::v4)>(sizeof(u32) * 5700 * 256));
-
 		id::id_type culling_light_shader_id = shaders::add("C:/Users/zy/Desktop/PrimalMerge/PrimalEngine/Engine/Graphics/Vulkan/Shaders/spv/culling_light.comp.spv", shader_type::compute);
 
 		_cull_light_pass.add_resource(
@@ -1167,41 +958,16 @@ namespace primal::graphics::vulkan::compute
 		_frustum_pass.shutdown();
 
 		_cull_light_pass.shutdown();
-
-		vkDestroyCommandPool(core::logical_device(), _compute_pool, nullptr);
 	}
 
-	VkSemaphore get_compute_signal_semaphore()
+	void record_frustums(vulkan_cmd_buffer& cmd_buffer)
 	{
-		return _frustum_pass.get_signal_semaphore();
+		_frustum_pass.record(cmd_buffer.cmd_buffer);
 	}
 
-	VkSemaphore get_culling_signal_semaphore()
+	void record_light_culling(vulkan_cmd_buffer& cmd_buffer)
 	{
-		return _cull_light_pass.get_singal_semaphore();
-	}
-
-	void frustum_run()
-	{
-		_frustum_pass.run();
-	}
-
-	void frustum_submit()
-	{
-		_frustum_pass.submit(0, nullptr);
-	}
-
-	void culling_light_run()
-	{
-		u32 clear_value{ 0 };
-		data::get_data<data::vulkan_buffer>(_stroage_light_count).update(&clear_value, sizeof(u32));
-		_cull_light_pass.run();
-	}
-
-	void culling_light_submit(u32 wait_nums, VkSemaphore* pWait)
-	{
-
-		_cull_light_pass.submit(wait_nums, pWait);
+		_cull_light_pass.record(cmd_buffer.cmd_buffer, data::get_data<data::vulkan_buffer>(_stroage_light_count).cpu_address);
 	}
 
 	void run(const void* const data, u32 size)
@@ -1226,12 +992,17 @@ namespace primal::graphics::vulkan::compute
 
 	id::id_type culling_light_grid()
 	{
-		return _storage_out_light_grid[core::get_frame_index()];
+		return _storage_out_light_grid;
 	}
 
 	id::id_type culling_light_list()
 	{
-		return _storage_out_light_list[core::get_frame_index()];
+		return _storage_out_light_list;
+	}
+
+	id::id_type culling_light_index_counter()
+	{
+		return _stroage_light_count;
 	}
 
 	bool is_rendered()
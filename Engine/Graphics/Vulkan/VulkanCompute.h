@@ -24,23 +24,22 @@ namespace primal::graphics::vulkan::compute
 		};
 	};
 
+	// The buffers are imported by the geometry pass's render graph, they exist before it's built
+	void create_buffers();
 	void initialize(vulkan_geometry_pass* gpass);
 	void shutdown();
 	void run(const void* const data, u32 size);
-	void frustum_run();
-	void frustum_submit();
 
-	void culling_light_run();
-	void culling_light_submit(u32 wait_nums, VkSemaphore* pWait);
-
-	VkSemaphore get_compute_signal_semaphore();
-	VkSemaphore get_culling_signal_semaphore();
+	// Recorded by the render graph on the async compute queue, it places the barriers around them
+	void record_frustums(vulkan_cmd_buffer& cmd_buffer);
+	void record_light_culling(vulkan_cmd_buffer& cmd_buffer);
 
 	id::id_type get_input_buffer_id();
 	id::id_type get_output_buffer_id();
 	id::id_type culling_light_grid();
 	id::id_type culling_light_list();
 	id::id_type culling_in_light_count_id();
+	id::id_type culling_light_index_counter();
 
 	bool is_rendered();
 }
\ No newline at end of file
@@ -3,19 +3,29 @@
 #include "VulkanResources.h"
 #include "VulkanCore.h"
 #include "VulkanTexture.h"
+#include "VulkanSampler.h"
+#include "VulkanPipelineCompiler.h"
 #include "Components/Transform.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "Content/stb_image.h"
+#include "Content/BlockDecompression.h"
+#include "Content/ContentToEngine.h"
 #include "Utilities/FreeList.h"
+#include <fstream>
 #include <iostream>
 #include <unordered_map>
 #include <array>
+#include <atomic>
+#include <string>
 
 #include "VulkanData.h"
 #include "VulkanLight.h"
 #include "Shaders/ShaderTypes.h"
 #include "Utilities/IOStream.h"
 #include "VulkanCompute.h"
+#include "VulkanBindless.h"
+#include "VulkanClusterCull.h"
+#include "VulkanTextureStreaming.h"
 #include "Shaders/ShaderTypes.h"
 
 namespace primal::graphics::vulkan
@@ -38,8 +48,65 @@ namespace primal::graphics::vulkan
 			utl::free_list<textures::vulkan_texture_2d>			textures;
 
 			std::mutex											texture_mutex;
+			std::atomic<bool>									mipmaps_enabled{ true };	// Read by the loader threads
+
+			struct texture_subresource
+			{
+				u32												width;
+				u32												height;
+				u32												row_pitch;
+				u32												slice_pitch;
+				const u8*										texels;
+			};
+
+			using block_decoder = void(*)(const u8 *const, u8 (&)[16][4]);
+
+			block_decoder get_block_decoder(VkFormat format)
+			{
+				switch (format)
+				{
+				case VK_FORMAT_BC1_RGBA_UNORM_BLOCK: case VK_FORMAT_BC1_RGBA_SRGB_BLOCK: return content::decode_bc1;
+				case VK_FORMAT_BC3_UNORM_BLOCK: case VK_FORMAT_BC3_SRGB_BLOCK: return content::decode_bc3;
+				case VK_FORMAT_BC4_UNORM_BLOCK: return content::decode_bc4;
+				case VK_FORMAT_BC5_UNORM_BLOCK: return content::decode_bc5;
+				case VK_FORMAT_BC7_UNORM_BLOCK: case VK_FORMAT_BC7_SRGB_BLOCK: return content::decode_bc7;
+				}
+
+				return nullptr;
+			}
+
+			// Decodes a block compressed subresource to tightly packed RGBA8 rows
+			void transcode_subresource(const texture_subresource& subresource, block_decoder decode, u8 *const rgba)
+			{
+				const u32 block_rows{ (subresource.height + 3) >> 2 };
+				const u32 block_size{ subresource.row_pitch / ((subresource.width + 3) >> 2) };
+				for (u32 block_y{ 0 }; block_y < block_rows; ++block_y)
+				{
+					const u8* block{ subresource.texels + (u64)block_y * subresource.row_pitch };
+					for (u32 block_x{ 0 }; block_x * 4 < subresource.width; ++block_x, block += block_size)
+					{
+						u8 texels[16][4];
+						decode(block, texels);
+						for (u32 i{ 0 }; i < 16; ++i)
+						{
+							const u32 x{ block_x * 4 + (i & 3) }, y{ block_y * 4 + (i >> 2) };
+							if (x < subresource.width && y < subresource.height) memcpy(&rgba[((u64)y * subresource.width + x) * 4], texels[i], 4);
+						}
+					}
+				}
+			}
 		} // anonymous namespace
 
+		void set_generate_mipmaps(bool generate)
+		{
+			mipmaps_enabled = generate;
+		}
+
+		bool generate_mipmaps()
+		{
+			return mipmaps_enabled;
+		}
+
 		vulkan_texture_2d::vulkan_texture_2d(std::string path)
 		{
 			loadTexture(path);
@@ -67,12 +134,12 @@ namespace primal::graphics::vulkan
 			view_info.image = _texture.image;
 			VkCall(result = vkCreateImageView(core::logical_device(), &view_info, nullptr, &_texture.view), "Failed to create image view...");
 
-			VkCall(result = vkCreateSampler(core::logical_device(), &sampler_info, nullptr, &_texture.sampler), "Failed to create sampler...");
+			_texture.sampler = samplers::acquire(sampler_info);
 		}
 
 		vulkan_texture_2d::~vulkan_texture_2d()
 		{
-			vkDestroySampler(core::logical_device(), _texture.sampler, nullptr);
+			samplers::release(_texture.sampler);
 			destroy_image(core::logical_device(), &_texture);
 		}
 
@@ -85,6 +152,11 @@ namespace primal::graphics::vulkan
 			{
 				pixels = stbi_load(path.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
 			}
+			else if (GetFileExt(path) == "texture")
+			{
+				load_texture_file(path);
+				return;
+			}
 			else if (GetFileExt(path) == "tga")
 			{
 				FILE *f = stbi__fopen(path.c_str(), "rb");
@@ -100,35 +172,10 @@ namespace primal::graphics::vulkan
 				return;
 			}
 			
-			VkDeviceSize imageSize = 0;
-			VkFormat imageFormat = VK_FORMAT_UNDEFINED;
-
-			switch (texChannels)
-			{
-			case 1:
-			{
-				imageSize = texWidth * texHeight;
-				imageFormat = VK_FORMAT_R8_SRGB;
-			}	break;
-			case 2:
-			{
-				imageSize = texWidth * texHeight * 2;
-				imageFormat = VK_FORMAT_R8G8_SRGB;
-			}	break;
-			case 3:
-			{
-				imageSize = texWidth * texHeight * 4;
-				imageFormat = VK_FORMAT_R8G8B8A8_SRGB;
-			}	break;
-			case 4:
-			{
-				imageSize = texWidth * texHeight * 4;
-				imageFormat = VK_FORMAT_R8G8B8A8_SRGB;
-			}	break;
-			default:
-				throw std::runtime_error("The texture do not support...");
-				break;
-			}
+			// Both loaders are asked for 4 channels whatever the file has, so 1 and 2 channel images are expanded too
+			if (texChannels < 1 || texChannels > 4) throw std::runtime_error("The texture do not support...");
+			const VkDeviceSize imageSize{ (VkDeviceSize)texWidth * texHeight * 4 };
+			const VkFormat imageFormat{ VK_FORMAT_R8G8B8A8_SRGB };
 
 			if (!pixels) throw std::runtime_error("Failed to load texture data...");
 
@@ -146,56 +193,133 @@ namespace primal::graphics::vulkan
 
 			stbi_image_free(pixels);
 
+			// Without linear blits of the format the texture keeps its top level only
+			const u32 mipLevels{ generate_mipmaps() && supportsMipmapBlit(core::physical_device(), imageFormat) ? mipLevelCount(texWidth, texHeight) : 1 };
+
 			image_init_info image_info{};
 			image_info.image_type = VK_IMAGE_TYPE_2D;
 			image_info.width = texWidth;
 			image_info.height = texHeight;
+			image_info.mipmap = mipLevels;
 			image_info.format = imageFormat;
 			image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
-			image_info.usage_flags = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+			image_info.usage_flags = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 			image_info.memory_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
 			image_info.create_view = true;
 			image_info.view_aspect_flags = VK_IMAGE_ASPECT_COLOR_BIT;
 
 			create_image(core::logical_device(), &image_info, _texture);
-			transitionImageLayout(core::logical_device(), core::graphics_family_queue_index(), core::get_current_command_pool(), _texture.image, imageFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+			transitionImageLayout(core::logical_device(), core::graphics_family_queue_index(), core::get_current_command_pool(), _texture.image, imageFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);
 			copyBufferToImage(core::logical_device(), core::graphics_family_queue_index(), core::get_current_command_pool(), stagingBuffer, _texture.image, static_cast<u32>(texWidth), static_cast<u32>(texHeight));
-			transitionImageLayout(core::logical_device(), core::graphics_family_queue_index(), core::get_current_command_pool(), _texture.image, imageFormat, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			if (mipLevels > 1)
+				generateMipmaps(core::logical_device(), core::graphics_family_queue_index(), core::get_current_command_pool(), _texture.image, static_cast<u32>(texWidth), static_cast<u32>(texHeight), mipLevels);
+			else
+				transitionImageLayout(core::logical_device(), core::graphics_family_queue_index(), core::get_current_command_pool(), _texture.image, imageFormat, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
 			vkDestroyBuffer(core::logical_device(), stagingBuffer, nullptr);
 			vkFreeMemory(core::logical_device(), stagingMemory, nullptr);
 
-			VkPhysicalDeviceProperties properties;
-			vkGetPhysicalDeviceProperties(core::physical_device(), &properties);
-
-			VkSamplerCreateInfo samplerInfo;
-			samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-			samplerInfo.pNext = nullptr;
-			samplerInfo.flags = /*VK_SAMPLER_CREATE_SUBSAMPLED_BIT_EXT | */VK_SAMPLER_CREATE_SUBSAMPLED_COARSE_RECONSTRUCTION_BIT_EXT;
-			samplerInfo.magFilter = VK_FILTER_LINEAR;
-			samplerInfo.minFilter = VK_FILTER_LINEAR;
-			samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-			samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-			samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-			samplerInfo.mipLodBias = 0.0f;
-			samplerInfo.minLod = 0.0f;
-			samplerInfo.maxLod = 0.0f;
-			samplerInfo.anisotropyEnable = VK_TRUE;
-			samplerInfo.maxAnisotropy = properties.limits.maxSamplerAnisotropy;
-			samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
-			samplerInfo.unnormalizedCoordinates = VK_FALSE;
-			samplerInfo.compareEnable = VK_FALSE;
-			samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
-			samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+			// Nearly every texture samples the same way, they all share one sampler
+			_texture.sampler = samplers::acquire(samplers::texture_info());
+		}
 
-			VkResult result{ VK_SUCCESS };
-			VkCall(result = vkCreateSampler(core::logical_device(), &samplerInfo, nullptr, &_texture.sampler), "Failed to create texture sampler...");
+		void vulkan_texture_2d::load_texture_file(const std::string& path)
+		{
+			std::ifstream file{ path, std::ios::in | std::ios::binary };
+			content::texture_file_header header{};
+			if (!file.read((char*)&header, sizeof(header)) || !header.subresource_size) throw std::runtime_error("Failed to load texture data...");
+			std::unique_ptr<u8[]> data{ std::make_unique<u8[]>(header.subresource_size) };
+			if (!file.read((char*)data.get(), header.subresource_size)) throw std::runtime_error("Failed to load texture data...");
+
+			// vulkan_texture_2d only has one layer
+			constexpr u32 not_2d{ content::texture_flags::is_cube_map | content::texture_flags::is_volume_map };
+			const VkFormat file_format{ formatFromDxgi(header.format) };
+			if (header.array_size != 1 || (header.flags & not_2d) || !header.mip_levels || file_format == VK_FORMAT_UNDEFINED)
+				throw std::runtime_error("The texture do not support...");
+
+			utl::vector<texture_subresource> subresources;
+			utl::blob_stream_reader blob{ data.get() };
+			for (u32 i{ 0 }; i < header.mip_levels; ++i)
+			{
+				if (blob.offset() + sizeof(u32) * 4 > header.subresource_size) throw std::runtime_error("Failed to load texture data...");
+				texture_subresource subresource{};
+				subresource.width = blob.read<u32>();
+				subresource.height = blob.read<u32>();
+				subresource.row_pitch = blob.read<u32>();
+				subresource.slice_pitch = blob.read<u32>();
+				subresource.texels = blob.position();
+				if (blob.offset() + subresource.slice_pitch > header.subresource_size) throw std::runtime_error("Failed to load texture data...");
+				blob.skip(subresource.slice_pitch);
+				subresources.emplace_back(subresource);
+			}
+
+			// Without BC support the blocks are decoded here, at 4 to 8 times the memory
+			const bool supported{ supportsSampledFormat(core::physical_device(), file_format) };
+			const block_decoder decoder{ supported ? nullptr : get_block_decoder(file_format) };
+			if (!supported && !decoder) throw std::runtime_error("The texture do not support...");
+			const VkFormat imageFormat{ !decoder ? file_format :
+				(header.flags & content::texture_flags::is_srgb) ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM };
+
+			// The mips above the small ones are streamed, the streamer uploads file texels only
+			_base_mip = decoder ? 0 : texture_streaming::first_resident_mip(header.width, header.height, (u32)subresources.size());
+			const u32 level_count{ (u32)subresources.size() - _base_mip };
+
+			// Buffer offsets have to be multiples of the texel block size, 16 covers every format
+			utl::vector<VkBufferImageCopy> regions;
+			VkDeviceSize imageSize{ 0 };
+			for (u32 i{ _base_mip }; i < subresources.size(); ++i)
+			{
+				VkBufferImageCopy region{};
+				region.bufferOffset = imageSize;
+				region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i - _base_mip, 0, 1 };
+				region.imageExtent = { subresources[i].width, subresources[i].height, 1 };
+				regions.emplace_back(region);
+				imageSize += math::align_size_up<16>(decoder ? (VkDeviceSize)subresources[i].width * subresources[i].height * 4 : subresources[i].slice_pitch);
+			}
+
+			_texture.format = imageFormat;
+
+			VkBuffer stagingBuffer;
+			VkDeviceMemory stagingMemory;
+			createBuffer(core::logical_device(), imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingMemory);
+
+			void* mapped;
+			vkMapMemory(core::logical_device(), stagingMemory, 0, imageSize, 0, &mapped);
+			for (u32 i{ _base_mip }; i < subresources.size(); ++i)
+			{
+				u8 *const destination{ (u8*)mapped + regions[i - _base_mip].bufferOffset };
+				if (decoder) transcode_subresource(subresources[i], decoder, destination);
+				else memcpy(destination, subresources[i].texels, subresources[i].slice_pitch);
+			}
+			vkUnmapMemory(core::logical_device(), stagingMemory);
+
+			image_init_info image_info{};
+			image_info.image_type = VK_IMAGE_TYPE_2D;
+			image_info.width = subresources[_base_mip].width;
+			image_info.height = subresources[_base_mip].height;
+			image_info.mipmap = level_count;
+			image_info.format = imageFormat;
+			image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+			image_info.usage_flags = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+			image_info.memory_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+			image_info.create_view = true;
+			image_info.view_aspect_flags = VK_IMAGE_ASPECT_COLOR_BIT;
+
+			create_image(core::logical_device(), &image_info, _texture);
+			copyBufferToImageRegions(core::logical_device(), core::graphics_family_queue_index(), core::get_current_command_pool(), stagingBuffer, _texture.image,
+				regions.data(), (u32)regions.size(), level_count);
+
+			vkDestroyBuffer(core::logical_device(), stagingBuffer, nullptr);
+			vkFreeMemory(core::logical_device(), stagingMemory, nullptr);
+
+			_texture.sampler = samplers::acquire(samplers::texture_info());
 		}
 
 		void vulkan_texture_2d::create_sampler(VkSamplerCreateInfo info)
 		{
-			VkResult result{ VK_SUCCESS };
-			VkCall(result = vkCreateSampler(core::logical_device(), &info, nullptr, &_texture.sampler), "Failed to create sampler ....");
+			const VkSampler previous{ _texture.sampler };
+			_texture.sampler = samplers::acquire(info);
+			samplers::release(previous);
 		}
 
 		/// <summary>
@@ -205,7 +329,10 @@ namespace primal::graphics::vulkan
 		/// <returns></returns>
 		id::id_type add(std::string path)
 		{
-			return textures.add(path);
+			const id::id_type id{ textures.add(path) };
+			// Textures loaded without their top mips get them from the streamer
+			texture_streaming::add(id, path, textures[id].base_mip());
+			return id;
 		}
 
 		id::id_type add(vulkan_texture tex)
@@ -231,6 +358,8 @@ namespace primal::graphics::vulkan
 		/// <param name="id"></param>
 		void remove(id::id_type id)
 		{
+			texture_streaming::remove(id);
+			bindless::remove_texture(id);
 			std::lock_guard lock{ texture_mutex };
 			assert(id::is_valid(id));
 			textures.remove(id);
@@ -344,36 +473,161 @@ namespace primal::graphics::vulkan
 		namespace 
 		{
 			utl::free_list<vulkan_model>							_models;
+
+			struct shared_pipeline
+			{
+				id::id_type											pipeline_id;	// invalid_id while compiling or when the compile failed
+				id::id_type											request;		// Compile request until the pipeline is taken over
+				u32													ref_count;
+			};
+			std::unordered_map<id::id_type, shared_pipeline>		material_pipelines;		// material id -> pipeline of its instances
+			id::id_type												fallback_material{ id::invalid_id };
+			id::id_type												fallback_pipeline_id{ id::invalid_id };	// Drawn in place of pipelines still compiling
+			u32														pending_pipelines{ 0 };
+			u32														pipeline_version{ 0 };		// Bumped whenever compiled pipelines are taken over
+			geometry_memory											memory{};
+
+			// The reference goes now so new instances don't pick up a dying pipeline, the pipeline itself once frames are done with it
+			void release_pipeline(id::id_type material_id)
+			{
+				auto it = material_pipelines.find(material_id);
+				assert(it != material_pipelines.end() && it->second.ref_count);
+				if (it == material_pipelines.end() || --it->second.ref_count) return;
+
+				const id::id_type pipeline_id{ it->second.pipeline_id };
+				if (id::is_valid(pipeline_id))
+				{
+					core::deferred_release([pipeline_id]() { data::remove_data(data::engine_vulkan_data::vulkan_pipeline, pipeline_id); });
+				}
+				else if (id::is_valid(it->second.request))
+				{
+					pipelines::cancel(it->second.request);
+					--pending_pipelines;
+				}
+				material_pipelines.erase(it);
+			}
+
+			// Sums the triangle areas of the geometry in model space and in UV space, their ratio is how far the texture stretches
+			void add_triangle_areas(const geometry_config& geo, double& position_area, double& uv_area)
+			{
+				using namespace DirectX;
+				for (u32 i{ 0 }; i + 2 < geo.index_count; i += 3)
+				{
+					const u32 index[3]{ geo.index(i), geo.index(i + 1), geo.index(i + 2) };
+					if (index[0] >= geo.vertex_count || index[1] >= geo.vertex_count || index[2] >= geo.vertex_count) continue;
+					const content::packed_vertex* v[3]{ &geo.vertices[index[0]], &geo.vertices[index[1]], &geo.vertices[index[2]] };
+
+					math::v3 p[3];
+					math::v2 uv[3];
+					for (u32 k{ 0 }; k < 3; ++k)
+					{
+						p[k] = content::unpack_position(*v[k], geo.position_box);
+						uv[k] = content::unpack_uv(*v[k]);
+					}
+					const XMVECTOR p0{ XMLoadFloat3(&p[0]) };
+					position_area += 0.5 * XMVectorGetX(XMVector3Length(XMVector3Cross(XMLoadFloat3(&p[1]) - p0, XMLoadFloat3(&p[2]) - p0)));
+					uv_area += 0.5 * std::abs((double)(uv[1].x - uv[0].x) * (uv[2].y - uv[0].y) - (double)(uv[2].x - uv[0].x) * (uv[1].y - uv[0].y));
+				}
+			}
 		} // anonymous namespace
 	
 		vulkan_model::vulkan_model(const void* const data)
 		{
 			utl::vector<geometry_config>* geos{ (utl::vector<geometry_config>*)data };
 
+			// Geometries are quantized against their own boxes, the model's buffer needs one box for all of them
+			if (!geos->empty()) _position_box = (*geos)[0].position_box;
+			if (geos->size() > 1)
+			{
+				using namespace DirectX;
+				XMVECTOR box_min{ XMLoadFloat3(&_position_box.min) };
+				XMVECTOR box_max{ box_min + XMLoadFloat3(&_position_box.scale) };
+				for (const auto& geo : *geos)
+				{
+					box_min = XMVectorMin(box_min, XMLoadFloat3(&geo.position_box.min));
+					box_max = XMVectorMax(box_max, XMLoadFloat3(&geo.position_box.min) + XMLoadFloat3(&geo.position_box.scale));
+				}
+				math::v3 min, max;
+				XMStoreFloat3(&min, box_min);
+				XMStoreFloat3(&max, box_max);
+				_position_box = content::make_quantization_box(min, max);
+			}
+
+			// Most models fit 16-bit indices, the .kms file's 16-bit indices then go to the index buffer as they are
+			u64 vertex_count{ 0 };
+			for (const auto& geo : *geos) vertex_count += geo.vertex_count;
+			_index_type = vertex_count < content::max_u16_index_vertices ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+
+			bool has_meshlets{ true };
+			double position_area{ 0.0 }, uv_area{ 0.0 };
 			for (u32 i{ 0 }; i < geos->size(); ++i)
 			{
-				for (u32 j{ 0 }; j < (*geos)[i].vertex_count; ++j)
+				const geometry_config& geo{ (*geos)[i] };
+				const u32 index_base{ (u32)getIndicesCount() };
+				add_triangle_areas(geo, position_area, uv_area);
+				const bool requantize{ memcmp(&geo.position_box, &_position_box, sizeof(content::quantization_box)) != 0 };
+				for (u32 j{ 0 }; j < geo.vertex_count; ++j)
 				{
-					_vertices.emplace_back((*geos)[i].vertices[j]);
+					content::packed_vertex v{ geo.vertices[j] };
+					if (requantize) content::pack_position(v, content::unpack_position(v, geo.position_box), _position_box);
+					_vertices.emplace_back(v);
 				}
-				for (u32 k{ 0 }; k < (*geos)[i].index_count; ++k)
+				if (_index_type == VK_INDEX_TYPE_UINT16 && geo.index_size == sizeof(u16))
 				{
-					_indices.emplace_back((*geos)[i].indices[k]);
+					_indices16.resize(index_base + geo.index_count);
+					memcpy(_indices16.data() + index_base, geo.indices16.data(), geo.index_count * sizeof(u16));
 				}
+				else
+				{
+					for (u32 k{ 0 }; k < geo.index_count; ++k)
+					{
+						if (_index_type == VK_INDEX_TYPE_UINT16) _indices16.emplace_back((u16)geo.index(k));
+						else _indices.emplace_back(geo.index(k));
+					}
+				}
+
+				// Meshlets must cover the geometry's triangles exactly, otherwise the model is drawn whole
+				u32 triangle_count{ 0 };
+				for (const auto& m : geo.meshlets)
+				{
+					if ((u64)m.first_index + (u64)m.triangle_count * 3 > geo.index_count) { has_meshlets = false; break; }
+					triangle_count += m.triangle_count;
+					_meshlets.emplace_back(m);
+					_meshlets.back().first_index += index_base;
+				}
+				has_meshlets = has_meshlets && (u64)triangle_count * 3 == geo.index_count;
 			}
+			if (!has_meshlets) _meshlets.clear();
+			if (uv_area > 0.0) _uv_scale = (f32)std::sqrt(position_area / uv_area);
 
+			calculate_bounding_sphere();
 			create_vertex_buffer();
 			create_index_buffer();
 		}
 
 		vulkan_model::~vulkan_model()
 		{
-			if (_vertices.data() == nullptr && _indices.data() == nullptr) return;
-			data::remove_data(data::engine_vulkan_data::vulkan_buffer, _vertexBuffer_id);
-			data::remove_data(data::engine_vulkan_data::vulkan_buffer, _indexBuffer_id);
+			if (_vertices.data() == nullptr && _indices.data() == nullptr && _indices16.data() == nullptr) return;
+			if (id::is_valid(_vertexBuffer_id) && id::is_valid(_indexBuffer_id))
+			{
+				const id::id_type vertex_buffer_id{ _vertexBuffer_id };
+				const id::id_type index_buffer_id{ _indexBuffer_id };
+				core::deferred_release([vertex_buffer_id, index_buffer_id]() {
+					data::remove_data(data::engine_vulkan_data::vulkan_buffer, vertex_buffer_id);
+					data::remove_data(data::engine_vulkan_data::vulkan_buffer, index_buffer_id);
+				});
+				memory.vertex_bytes -= sizeof(content::packed_vertex) * _vertices.size();
+				memory.index_bytes -= (_index_type == VK_INDEX_TYPE_UINT16 ? sizeof(u16) : sizeof(u32)) * getIndicesCount();
+				memory.float_vertex_bytes -= sizeof(Vertex) * _vertices.size();
+				memory.u32_index_bytes -= sizeof(u32) * getIndicesCount();
+				_vertexBuffer_id = id::invalid_id;
+				_indexBuffer_id = id::invalid_id;
+			}
 
 			_vertices.clear();
 			_indices.clear();
+			_indices16.clear();
+			_meshlets.clear();
 		}
 
 		void vulkan_model::create_model_buffer()
@@ -382,9 +636,40 @@ namespace primal::graphics::vulkan
 			create_index_buffer();
 		}
 
+		void vulkan_model::calculate_bounding_sphere()
+		{
+			if (_vertices.empty()) return;
+
+			using namespace DirectX;
+			// The sphere holds the positions as the shaders decode them
+			utl::vector<math::v3> positions(_vertices.size());
+			for (u32 i{ 0 }; i < _vertices.size(); ++i)
+			{
+				positions[i] = content::unpack_position(_vertices[i], _position_box);
+			}
+
+			XMVECTOR min_pos{ XMLoadFloat3(&positions[0]) };
+			XMVECTOR max_pos{ min_pos };
+			for (const auto& v : positions)
+			{
+				const XMVECTOR p{ XMLoadFloat3(&v) };
+				min_pos = XMVectorMin(min_pos, p);
+				max_pos = XMVectorMax(max_pos, p);
+			}
+
+			const XMVECTOR center{ (min_pos + max_pos) * 0.5f };
+			XMVECTOR radius_sq{ XMVectorZero() };
+			for (const auto& v : positions)
+			{
+				radius_sq = XMVectorMax(radius_sq, XMVector3LengthSq(XMLoadFloat3(&v) - center));
+			}
+
+			XMStoreFloat4(&_bounding_sphere, XMVectorSetW(center, XMVectorGetX(XMVectorSqrt(radius_sq))));
+		}
+
 		void vulkan_model::create_vertex_buffer()
 		{
-			VkDeviceSize bufferSize = sizeof(Vertex) * _vertices.size();
+			VkDeviceSize bufferSize = sizeof(content::packed_vertex) * _vertices.size();
 
 			auto flags = data::vulkan_buffer::static_vertex_buffer;
 
@@ -393,18 +678,24 @@ namespace primal::graphics::vulkan
 			data::get_data<data::vulkan_buffer>(_vertexBuffer_id).update((void*)(_vertices.data()), bufferSize);
 
 			data::get_data<data::vulkan_buffer>(_vertexBuffer_id).convert_to_local_device_buffer();
+			memory.vertex_bytes += bufferSize;
+			memory.float_vertex_bytes += sizeof(Vertex) * _vertices.size();
 		}
 
 		void vulkan_model::create_index_buffer() {
-			VkDeviceSize bufferSize = sizeof(u32) * _indices.size();
+			// 16-bit indices halve the index buffer and the index fetch of most meshes
+			const void* const indices{ _index_type == VK_INDEX_TYPE_UINT16 ? (const void*)_indices16.data() : (const void*)_indices.data() };
+			VkDeviceSize bufferSize = (_index_type == VK_INDEX_TYPE_UINT16 ? sizeof(u16) : sizeof(u32)) * getIndicesCount();
 
 			auto flags = data::vulkan_buffer::static_index_buffer;
 
 			_indexBuffer_id = data::create_data(data::engine_vulkan_data::vulkan_buffer, (void*)(&flags), bufferSize);
 
-			data::get_data<data::vulkan_buffer>(_indexBuffer_id).update((void*)(_indices.data()), bufferSize);
+			data::get_data<data::vulkan_buffer>(_indexBuffer_id).update(indices, bufferSize);
 
 			data::get_data<data::vulkan_buffer>(_indexBuffer_id).convert_to_local_device_buffer();
+			memory.index_bytes += bufferSize;
+			memory.u32_index_bytes += sizeof(u32) * getIndicesCount();
 		}
 
 		void vulkan_instance_model::create_instance_buffer()
@@ -413,54 +704,91 @@ namespace primal::graphics::vulkan
 			_modelMatrx_id = data::create_data(data::engine_vulkan_data::vulkan_buffer, (void*)(&flags), sizeof(model_data));
 		}
 
+		void vulkan_instance_model::update_world_sphere()
+		{
+			using namespace DirectX;
+			const math::v4 sphere{ _model.getBoundingSphere() };
+			const XMMATRIX world{ XMLoadFloat4x4(&_modelData.model_matrix) };
+			const XMVECTOR center{ XMVector3TransformCoord(XMVectorSet(sphere.x, sphere.y, sphere.z, 1.f), world) };
+			// Scale the radius by the largest axis scale so the sphere stays conservative
+			const f32 scale{ std::sqrt(std::max(std::max(XMVectorGetX(XMVector3LengthSq(world.r[0])), XMVectorGetX(XMVector3LengthSq(world.r[1]))), XMVectorGetX(XMVector3LengthSq(world.r[2])))) };
+			XMStoreFloat4(&_world_sphere, XMVectorSetW(center, sphere.w * scale));
+		}
+
+		void vulkan_instance_model::set_model_matrix(game_entity::entity entity)
+		{
+			math::v3 scale = entity.scale();
+			math::v4 rotation = entity.rotation();
+			math::v3 transform = entity.position();
+			DirectX::XMMATRIX modelMatrix = DirectX::XMMatrixAffineTransformation(
+				DirectX::XMLoadFloat3(&scale),
+				{ 0.f, 0.f, 0.f, 1.f },
+				DirectX::XMLoadFloat4(&rotation),
+				DirectX::XMLoadFloat3(&transform));
+			DirectX::XMStoreFloat4x4(&_modelData.model_matrix, modelMatrix);
+			update_world_sphere();
+		}
+
+		void vulkan_instance_model::set_position_box()
+		{
+			const content::quantization_box& box{ _model.getPositionBox() };
+			_modelData.position_min = { box.min.x, box.min.y, box.min.z, 0.f };
+			_modelData.position_scale = { box.scale.x, box.scale.y, box.scale.z, 0.f };
+		}
+
 		void vulkan_instance_model::update_model_data(bool isReflect)
 		{
 			_modelData.is_reflect = isReflect;
 			data::get_data<data::vulkan_buffer>(_modelMatrx_id).update((void*)(&_modelData), sizeof(model_data));
 
-			data::get_data<data::vulkan_buffer>(_modelMatrx_id).convert_to_local_device_buffer();
+			// Movable instances keep their uniform block host visible, update_transform() rewrites it
+			if (_is_static) data::get_data<data::vulkan_buffer>(_modelMatrx_id).convert_to_local_device_buffer();
+		}
+
+		void vulkan_instance_model::update_transform()
+		{
+			set_model_matrix(game_entity::entity{ _id });
+			if (!_is_static) data::get_data<data::vulkan_buffer>(_modelMatrx_id).update((void*)(&_modelData), sizeof(model_data));
 		}
 
 		vulkan_instance_model::vulkan_instance_model(id::id_type model_id) : _model{ get_model(model_id)}
 		{
 			_model.create_model_buffer();
+			_world_sphere = _model.getBoundingSphere();
+			set_position_box();
 			create_instance_buffer();
 		}
 
-		vulkan_instance_model::vulkan_instance_model(game_entity::entity entity, id::id_type model_id) : _model{ get_model(model_id) }, _id{ entity.get_id() }
+		vulkan_instance_model::vulkan_instance_model(game_entity::entity entity, id::id_type model_id) : _model{ get_model(model_id) }, _id{ entity.get_id() }, _is_static{ entity.is_static() }
 		{
 			_model.create_model_buffer();
-			math::v3 scale = entity.scale();
-			math::v4 rotation = entity.rotation();
-			math::v3 transform = entity.position();
-			DirectX::XMMATRIX modelMatrix = DirectX::XMMatrixAffineTransformation(
-				DirectX::XMLoadFloat3(&scale),
-				{ 0.f, 0.f, 0.f, 1.f },
-				DirectX::XMLoadFloat4(&rotation),
-				DirectX::XMLoadFloat3(&transform));
-			DirectX::XMStoreFloat4x4(&_modelData.model_matrix, modelMatrix);
+			set_model_matrix(entity);
 			_modelData.is_reflect = 0;
+			set_position_box();
 			create_instance_buffer();
 		}
 
 		vulkan_instance_model::~vulkan_instance_model()
 		{
-			vkDeviceWaitIdle(core::logical_device());
-
-			data::remove_data(data::engine_vulkan_data::vulkan_pipeline, _pipeline_id);
-			data::remove_data(data::engine_vulkan_data::vulkan_descriptor_sets, _descriptorSet_id);
-
-			for (auto texture_id : materials::get_material(_material_id).getTextureIDS())
-			{
-				//textures::get_texture(texture_id).~vulkan_texture_2d();
-				textures::remove(texture_id);
-				//materials::get_material(_material_id).remove_texture(texture_id);
-			}
-
-			data::remove_data(data::engine_vulkan_data::vulkan_buffer, _modelMatrx_id);
+			// Frames in flight may still draw this instance, its GPU objects go once they're done. _model queues its own buffers.
+			if (id::is_valid(_pipeline_material)) release_pipeline(_pipeline_material);
+
+			utl::vector<id::id_type> texture_ids;
+			if (id::is_valid(_material_id)) texture_ids = materials::get_material(_material_id).getTextureIDS();
+			const id::id_type descriptor_set_id{ _descriptorSet_id };
+			const id::id_type model_matrix_id{ _modelMatrx_id };
+			core::deferred_release([descriptor_set_id, model_matrix_id, texture_ids]() {
+				data::remove_data(data::engine_vulkan_data::vulkan_descriptor_sets, descriptor_set_id);
+				for (auto texture_id : texture_ids)
+				{
+					//textures::get_texture(texture_id).~vulkan_texture_2d();
+					textures::remove(texture_id);
+					//materials::get_material(_material_id).remove_texture(texture_id);
+				}
+				data::remove_data(data::engine_vulkan_data::vulkan_buffer, model_matrix_id);
+			});
 
 			game_entity::remove(_id);
-			_model.~vulkan_model();
 		}
 
 		void vulkan_instance_model::createDescriptorSet(VkDescriptorPool pool, VkDescriptorSetLayout layout)
@@ -482,8 +810,7 @@ namespace primal::graphics::vulkan
 			auto vertexBuffer = data::get_data<data::vulkan_buffer>(_model.getVertexBuffer());
 			auto indexBuffer = data::get_data<data::vulkan_buffer>(_model.getIndexBuffer());
 			vkCmdBindVertexBuffers(cmd_buffer.cmd_buffer, 0, 1, &vertexBuffer.cpu_address, offset);
-			vkCmdBindIndexBuffer(cmd_buffer.cmd_buffer, indexBuffer.cpu_address, 0, VK_INDEX_TYPE_UINT32);	// !!!! NOTE: If indices is sizeof(u16), use VK_INDEX_TYPE_UINT16 !!!
-																											// !!!! NOTE: If indices is sizeof(u32), use VK_INDEX_TYPE_UINT32 !!!
+			vkCmdBindIndexBuffer(cmd_buffer.cmd_buffer, indexBuffer.cpu_address, 0, _model.getIndexType());
 		}
 
 		void vulkan_instance_model::draw(vulkan_cmd_buffer cmd_buffer)
@@ -493,6 +820,17 @@ namespace primal::graphics::vulkan
 
 		void vulkan_instance_model::createPipeline(VkPipelineLayout pipelineLayou, VkRenderPass render_pass)
 		{
+			if (id::is_valid(_pipeline_material)) release_pipeline(_pipeline_material);
+			_pipeline_material = _material_id;
+
+			auto shared = material_pipelines.find(_material_id);
+			if (shared != material_pipelines.end())
+			{
+				++shared->second.ref_count;
+				_pipeline_id = shared->second.pipeline_id;
+				return;
+			}
+
 			VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = descriptor::pipelineInputAssemblyStateCreate(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
 			VkPipelineViewportStateCreateInfo viewportState = descriptor::pipelineViewportStateCreate(1, 1);
 			VkPipelineRasterizationStateCreateInfo rasterizationState = descriptor::pipelineRasterizationStateCreate(VK_POLYGON_MODE_FILL, VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE);
@@ -547,8 +885,69 @@ namespace primal::graphics::vulkan
 			pipelineCI.basePipelineHandle = VK_NULL_HANDLE;
 			pipelineCI.basePipelineIndex = -1;
 
-			_pipeline_id = data::create_data(data::engine_vulkan_data::vulkan_pipeline, static_cast<void*>(&pipelineCI), 0);
+			// The first material is built right away and held on to, it stands in for every pipeline that is still compiling
+			if (!id::is_valid(fallback_pipeline_id))
+			{
+				_pipeline_id = data::create_data(data::engine_vulkan_data::vulkan_pipeline, static_cast<void*>(&pipelineCI), 0);
+				material_pipelines[_material_id] = { _pipeline_id, id::invalid_id, 2 };
+				fallback_material = _material_id;
+				fallback_pipeline_id = _pipeline_id;
+				return;
+			}
 
+			_pipeline_id = id::invalid_id;
+			material_pipelines[_material_id] = { id::invalid_id, pipelines::compile(pipelineCI), 1 };
+			++pending_pipelines;
+		}
+
+		void vulkan_instance_model::resolvePipeline()
+		{
+			if (id::is_valid(_pipeline_id) || !id::is_valid(_pipeline_material)) return;
+			auto shared = material_pipelines.find(_pipeline_material);
+			if (shared != material_pipelines.end()) _pipeline_id = shared->second.pipeline_id;
+		}
+
+		id::id_type const vulkan_instance_model::getDrawPipelineID() const
+		{
+			if (id::is_valid(_pipeline_id)) return _pipeline_id;
+			return pipelines::draw_fallback ? fallback_pipeline_id : id::invalid_id;
+		}
+
+		u32 update_pipelines()
+		{
+			if (!pending_pipelines) return pipeline_version;
+
+			for (auto& [material_id, shared] : material_pipelines)
+			{
+				if (!id::is_valid(shared.request)) continue;
+
+				const pipelines::status state{ pipelines::get_status(shared.request) };
+				if (state == pipelines::status::pending) continue;
+
+				if (state == pipelines::status::ready)
+				{
+					const VkPipeline pipeline{ pipelines::take(shared.request) };
+					shared.pipeline_id = data::create_data(data::engine_vulkan_data::vulkan_pipeline, static_cast<const void*>(&pipeline), 2);
+					++pipeline_version;
+				}
+				else
+				{
+					// Its instances keep drawing with the fallback
+					pipelines::cancel(shared.request);
+					MESSAGE(("Pipeline of material " + std::to_string(material_id) + " failed to compile").c_str());
+				}
+				shared.request = id::invalid_id;
+				--pending_pipelines;
+			}
+			return pipeline_version;
+		}
+
+		void release_fallback_pipeline()
+		{
+			if (!id::is_valid(fallback_material)) return;
+			release_pipeline(fallback_material);
+			fallback_material = id::invalid_id;
+			fallback_pipeline_id = id::invalid_id;
 		}
 
 		id::id_type add(const void* const data)
@@ -565,6 +964,11 @@ namespace primal::graphics::vulkan
 		{
 			return _models[id];
 		}
+
+		const geometry_memory& get_geometry_memory()
+		{
+			return memory;
+		}
 	} // primai::graphics::vulkan::submesh
 
 	namespace scene
@@ -572,30 +976,84 @@ namespace primal::graphics::vulkan
 		namespace
 		{
 			utl::free_list<submesh::vulkan_instance_model>		instance_models;
+
+			struct bound_state
+			{
+				VkPipeline											pipeline{ VK_NULL_HANDLE };
+				VkDescriptorSet										descriptor_set{ VK_NULL_HANDLE };
+				VkBuffer											vertex_buffer{ VK_NULL_HANDLE };
+				VkBuffer											index_buffer{ VK_NULL_HANDLE };
+			};
+
+			bound_state get_bound_state(const submesh::vulkan_instance_model& instance)
+			{
+				const id::id_type pipeline_id{ instance.getDrawPipelineID() };
+				return { id::is_valid(pipeline_id) ? data::get_data<VkPipeline>(pipeline_id) : VK_NULL_HANDLE,
+					data::get_data<VkDescriptorSet>(instance.getDescriptorSet()),
+					data::get_data<data::vulkan_buffer>(instance.getModel().getVertexBuffer()).cpu_address,
+					data::get_data<data::vulkan_buffer>(instance.getModel().getIndexBuffer()).cpu_address };
+			}
+		}
+
+		void instance_change_log::add(instance_change change)
+		{
+			if (_read)
+			{
+				_changes.clear();
+				++_epoch;
+				_read = false;
+			}
+			_changes.emplace_back(change);
+		}
+
+		const instance_change* const instance_change_log::read(u32& count, u32& epoch)
+		{
+			_read = true;
+			count = (u32)_changes.size();
+			epoch = _epoch;
+			return _changes.data();
 		}
 
 		vulkan_scene::~vulkan_scene()
 		{
-			for (auto instance : _instance_ids)
+			while (!_instance_ids.empty())
 			{
-				remove_model_instance(instance);
+				remove_model_instance(_instance_ids.back());
 			}
+			submesh::release_fallback_pipeline();
 		}
 
 		id::id_type vulkan_scene::add_model_instance(game_entity::entity entity, id::id_type model_id)
 		{
 			auto instance_id = instance_models.add(entity, model_id);
 			_instance_ids.emplace_back(instance_id);
+			const u32 entity_index{ id::index(entity.get_id()) };
+			if (entity_index >= _entity_instances.size()) _entity_instances.resize(entity_index + 1, id::invalid_id);
+			_entity_instances[entity_index] = instance_id;
+			if (instance_models[instance_id].is_static()) ++_static_version;
+			// Not logged, an instance is only drawn by the GPU-driven pass once it has a material
 			return instance_id;
 		}
 
+		// The GPU-driven pass frees the instance's slot from the removed log instead of diffing the whole scene.
+		// The instance's GPU objects are released once the frames in flight are done.
 		void vulkan_scene::remove_model_instance(id::id_type id)
 		{
-			//_instance_models.erase(id);
-			//_instance_ids.erase(id);
-			instance_models[id].~vulkan_instance_model();
+			if (instance_models[id].is_static()) ++_static_version;
+			const id::id_type entity_id{ instance_models[id].getEntityID() };
+			_removed_instances.add(instance_change{ id, entity_id });
+			if (id::is_valid(entity_id) && _entity_instances[id::index(entity_id)] == id) _entity_instances[id::index(entity_id)] = id::invalid_id;
+
+			for (u32 i{ 0 }; i < _instance_ids.size(); ++i)
+			{
+				if (_instance_ids[i] != id) continue;
+				_instance_ids.erase(i);
+				break;
+			}
+			instance_models.remove(id);
 		}
 
+
 		void vulkan_scene::add_camera(camera_init_info info)
 		{
 			_camera_ids.emplace_back(graphics::create_camera(info).get_id());
@@ -611,13 +1069,46 @@ namespace primal::graphics::vulkan
 		void vulkan_scene::add_material(id::id_type model_id, id::id_type material_id, bool isReflect)
 		{
 			instance_models[model_id].add_material(material_id);
+			// Materials loaded after the scene is set up are compiled in the background, the instance draws with the fallback meanwhile
+			if (_pipeline_render_pass) instance_models[model_id].createPipeline(_pipeline_layout, _pipeline_render_pass);
 
 			instance_models[model_id].update_model_data(isReflect);
+			_changed_instances.add(instance_change{ model_id, instance_models[model_id].getEntityID() });
 		}
 
 		void vulkan_scene::remove_material(id::id_type model_id)
 		{
 			instance_models[model_id].remove_material();
+			_changed_instances.add(instance_change{ model_id, instance_models[model_id].getEntityID() });
+		}
+
+		void vulkan_scene::updateTransforms()
+		{
+			u32 count{ 0 };
+			u32 epoch{ 0 };
+			const game_entity::entity_id* const ids{ transform::get_changed_entity_ids(count, epoch) };
+
+			// Only the entries added since the last call
+			const u32 first{ epoch == _transform_epoch ? _transform_cursor : 0 };
+			_transform_epoch = epoch;
+			_transform_cursor = count;
+
+			for (u32 i{ first }; i < count; ++i)
+			{
+				const u32 entity_index{ id::index(ids[i]) };
+				if (entity_index >= _entity_instances.size()) continue;
+				const id::id_type instance_id{ _entity_instances[entity_index] };
+				if (!id::is_valid(instance_id)) continue;
+
+				submesh::vulkan_instance_model& instance{ instance_models[instance_id] };
+				// Skip changes of an older entity that used the same slot
+				if ((id::id_type)instance.getEntityID() != (id::id_type)ids[i]) continue;
+
+				instance.update_transform();
+				// A static instance that moves anyway invalidates the cached shadow depth
+				if (instance.is_static()) ++_static_version;
+				_changed_instances.add(instance_change{ instance_id, instance.getEntityID() });
+			}
 		}
 
 		void vulkan_scene::createUniformBuffer() {
@@ -670,12 +1161,25 @@ namespace primal::graphics::vulkan
 
 		void vulkan_scene::createPipeline(VkRenderPass render_pass, VkPipelineLayout layout)
 		{
+			_pipeline_render_pass = render_pass;
+			_pipeline_layout = layout;
 			for (auto& instance : _instance_ids)
 			{
 				instance_models[instance].createPipeline(layout, render_pass);
 			}
 		}
 
+		void vulkan_scene::updatePipelines()
+		{
+			const u32 version{ submesh::update_pipelines() };
+			if (version == _pipeline_version) return;
+			_pipeline_version = version;
+			for (auto& instance : _instance_ids)
+			{
+				instance_models[instance].resolvePipeline();
+			}
+		}
+
 		void vulkan_scene::updateView(frame_info info)
 		{
 			glsl::GlobalShaderData data;
@@ -690,6 +1194,9 @@ namespace primal::graphics::vulkan
 			DirectX::XMStoreFloat3(&data.CameraDirection, graphics::vulkan::camera::get(info.camera_id).direction());
 			data.NearPlane = graphics::vulkan::camera::get(info.camera_id).near_z();
 			data.FarPlane = graphics::vulkan::camera::get(info.camera_id).far_z();
+			_view_position = data.CameraPositon;
+			_view_direction = data.CameraDirection;
+			_far_plane = data.FarPlane;
 			data.ViewHeight = 900;
 			data.ViewWidth = 1600;
 			data.DeltaTime = info.average_frame_time;
@@ -703,18 +1210,56 @@ namespace primal::graphics::vulkan
 
 		void vulkan_scene::flushBuffer(vulkan_cmd_buffer cmd_buffer, VkPipelineLayout layout)
 		{
-			
-			for (auto& instance : _instance_ids)
+			recording::bind_counts binds{};
+			record_draws(cmd_buffer, layout, _instance_ids.data(), (u32)_instance_ids.size(), binds);
+		}
+
+		void record_draws(vulkan_cmd_buffer cmd_buffer, VkPipelineLayout layout, const id::id_type* const instance_ids, u32 count, recording::bind_counts& binds)
+		{
+			bound_state bound{};
+			for (u32 i{ 0 }; i < count; ++i)
 			{
-				auto descriptorSet = data::get_data<VkDescriptorSet>(instance_models[instance].getDescriptorSet());
-				auto pipeline = data::get_data<VkPipeline>(instance_models[instance].getPipelineID());
+				const id::id_type instance{ instance_ids[i] };
+				const bound_state state{ get_bound_state(instance_models[instance]) };
+				if (!state.pipeline) continue;		// Still compiling and no fallback to draw with
+
+				// Every geometry pipeline uses the same layout, so the bound set survives a pipeline change
+				if (state.pipeline != bound.pipeline)
+				{
+					vkCmdBindPipeline(cmd_buffer.cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, state.pipeline);
+					++binds.pipeline;
+				}
+				if (state.descriptor_set != bound.descriptor_set)
+				{
+					vkCmdBindDescriptorSets(cmd_buffer.cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &state.descriptor_set, 0, nullptr);
+					++binds.descriptor_set;
+				}
+				if (state.vertex_buffer != bound.vertex_buffer || state.index_buffer != bound.index_buffer)
+				{
+					instance_models[instance].flushBuffer(cmd_buffer);
+					++binds.vertex_buffer;
+				}
+				bound = state;
 
-				vkCmdBindDescriptorSets(cmd_buffer.cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &descriptorSet, 0, nullptr);
+				// Only the meshlets that survived culling, or the whole mesh when the instance wasn't culled
+				if (!clusters::draw(cmd_buffer.cmd_buffer, instance)) instance_models[instance].draw(cmd_buffer);
+			}
+		}
 
-				vkCmdBindPipeline(cmd_buffer.cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-				instance_models[instance].flushBuffer(cmd_buffer);
-				instance_models[instance].draw(cmd_buffer);
+		recording::bind_counts count_binds(const id::id_type* const instance_ids, u32 count)
+		{
+			recording::bind_counts binds{};
+			bound_state bound{};
+			for (u32 i{ 0 }; i < count; ++i)
+			{
+				const bound_state state{ get_bound_state(instance_models[instance_ids[i]]) };
+				if (!state.pipeline) continue;
+				binds.pipeline += state.pipeline != bound.pipeline;
+				binds.descriptor_set += state.descriptor_set != bound.descriptor_set;
+				binds.vertex_buffer += state.vertex_buffer != bound.vertex_buffer || state.index_buffer != bound.index_buffer;
+				bound = state;
 			}
+			return binds;
 		}
 		
 		submesh::vulkan_instance_model& get_instance(id::id_type id)
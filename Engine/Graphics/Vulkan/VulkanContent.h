@@ -4,6 +4,7 @@
 #include "Graphics/Renderer.h"
 #include "VulkanCamera.h"
 #include "VulkanGBuffer.h"
+#include "VulkanDrawRecorder.h"
 #include "Components/Entity.h"
 
 #include <map>
@@ -31,6 +32,9 @@ namespace primal::graphics::vulkan
 
 			~vulkan_texture_2d();
 
+			// stb_image loads .jpg, .png and .tga files as RGBA8 and generates their mips. .texture files from ContentTools keep
+			// their format and mips, block compressed ones are decoded to RGBA8 when the GPU can't sample them. Those the GPU
+			// samples as they are start at texture_streaming::first_resident_mip, the streamer reads the others when they're needed.
 			void loadTexture(std::string path);
 
 			void create_sampler(VkSamplerCreateInfo);
@@ -39,10 +43,22 @@ namespace primal::graphics::vulkan
 
 			[[nodiscard]] VkDescriptorImageInfo get_descriptor_info() { return { _texture.sampler, _texture.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL }; }
 
+			// Mip of the file the image's first level is, 0 unless the texture streams
+			[[nodiscard]] constexpr u32 base_mip() const { return _base_mip; }
+
 		private:
+			void load_texture_file(const std::string& path);
+
 			vulkan_texture								_texture;
+			u32											_base_mip{ 0 };
 		};
 
+		// Loaded textures get a full mip chain, blitted down from the top level, unless this is turned off. Off samples
+		// the full resolution texture at any distance, compare headless runs with and without -nomips to see the
+		// bandwidth it saves. Only textures loaded afterwards are affected.
+		void set_generate_mipmaps(bool generate);
+		[[nodiscard]] bool generate_mipmaps();
+
 		id::id_type add(std::string path);
 
 		id::id_type add(vulkan_texture);
@@ -101,6 +117,9 @@ namespace primal::graphics::vulkan
 			[[nodiscard]] utl::vector<id::id_type> getTextureIDS() const { return _texture_ids; }
 			[[nodiscard]] constexpr u32 getTextureCount() const { return _texture_count; }
 			[[nodiscard]] id::id_type getShaderIDS(shader_type::type type) const { return _shader_ids.at(type); }
+			// ! Diffuse color the material's own fragment shader bakes in, the bindless path reads it from the material buffer
+			constexpr void setDiffuseColor(const math::v3& color) { _diffuse_color = color; }
+			[[nodiscard]] constexpr const math::v3& getDiffuseColor() const { return _diffuse_color; }
 
 		protected:
 
@@ -108,6 +127,7 @@ namespace primal::graphics::vulkan
 			material_type::type											_type;
 			u32															_texture_count;
 			utl::vector<id::id_type>									_texture_ids;
+			math::v3													_diffuse_color{ 1.f, 1.f, 1.f };
 			std::map<shader_type::type, id::id_type>					_shader_ids{ {shader_type::vertex, id::invalid_id}, {shader_type::hull, id::invalid_id},
 																					 {shader_type::domain, id::invalid_id}, {shader_type::geometry, id::invalid_id},
 																					 {shader_type::pixel, id::invalid_id}, {shader_type::compute, id::invalid_id}, 
@@ -134,15 +154,37 @@ namespace primal::graphics::vulkan
 			// ! Readonly function -> Two Buffers of Model are both readonly after load model
 			[[nodiscard]] constexpr id::id_type const getVertexBuffer() const { return _vertexBuffer_id; }
 			[[nodiscard]] constexpr id::id_type const getIndexBuffer() const { return _indexBuffer_id; }
-			[[nodiscard]] constexpr u64 const getIndicesCount() const { return _indices.size(); }
+			[[nodiscard]] constexpr u64 const getIndicesCount() const { return _index_type == VK_INDEX_TYPE_UINT16 ? _indices16.size() : _indices.size(); }
+			// ! Model space bounding sphere, xyz: center, w: radius
+			[[nodiscard]] constexpr math::v4 const getBoundingSphere() const { return _bounding_sphere; }
+			// ! CPU copies of the geometry, used to pack models into the shared GPU-driven buffers
+			[[nodiscard]] const utl::vector<content::packed_vertex>& getVertices() const { return _vertices; }
+			// ! Only the one of the two that matches getIndexType() holds the indices
+			[[nodiscard]] const utl::vector<u32>& getIndices() const { return _indices; }
+			[[nodiscard]] const utl::vector<u16>& getIndices16() const { return _indices16; }
+			// ! Box the packed positions decode in, all geometries of the model share it
+			[[nodiscard]] constexpr const content::quantization_box& getPositionBox() const { return _position_box; }
+			// ! 16-bit indices when the model has fewer than content::max_u16_index_vertices vertices
+			[[nodiscard]] constexpr VkIndexType getIndexType() const { return _index_type; }
+			// ! Meshlets of all geometries, their index ranges are in the model's index buffer. Empty when any geometry has none.
+			[[nodiscard]] const utl::vector<content::meshlet>& getMeshlets() const { return _meshlets; }
+			// ! Model space units one UV unit spans on average, 0 when the model has no UV mapping. Texture streaming's texel density.
+			[[nodiscard]] constexpr f32 const getUVScale() const { return _uv_scale; }
 
 		private:
-			utl::vector<Vertex>			_vertices;
+			utl::vector<content::packed_vertex>	_vertices;
 			utl::vector<u32>			_indices;
-			id::id_type					_vertexBuffer_id;
-			id::id_type					_indexBuffer_id;
+			utl::vector<u16>			_indices16;
+			utl::vector<content::meshlet>	_meshlets;
+			content::quantization_box	_position_box{ {}, { 1.f, 1.f, 1.f } };
+			VkIndexType					_index_type{ VK_INDEX_TYPE_UINT32 };
+			id::id_type					_vertexBuffer_id{ id::invalid_id };
+			id::id_type					_indexBuffer_id{ id::invalid_id };
+			math::v4					_bounding_sphere{};
+			f32							_uv_scale{ 0.f };
 			void create_vertex_buffer();
 			void create_index_buffer();
+			void calculate_bounding_sphere();
 		};
 
 		/// <summary>
@@ -181,42 +223,68 @@ namespace primal::graphics::vulkan
 				} 
 			}
 
+			// ! Instances with the same material share one pipeline, all of them are drawn with the same layout and render pass.
+			// ! The first material's pipeline is created right away, the others are compiled in the background.
 			void createPipeline(VkPipelineLayout pipelineLayout, VkRenderPass render_pass);
+			// ! Pick up the shared pipeline once its compile is done
+			void resolvePipeline();
 
 			/// <summary>
 			//  ! add a material to a instance model
 			/// </summary>
 			/// <param name="id">material ID</param>
-			void add_material(id::id_type id) { _material_id = id; _modelData.material_id = id; }
+			void add_material(id::id_type id) { _material_id = id; _modelData.material_id = id; _shaderStages.clear(); }
 			void remove_material() { _material_id = id::invalid_id; }
 			void update_model_data(bool isReflect);
+			// ! Take over the entity's changed transform: model matrix, world bounding sphere and the model uniform block
+			void update_transform();
+			// ! Instances of static entities are cached in the shadow cascades, movable ones are drawn every frame
+			[[nodiscard]] constexpr bool const is_static() const { return _is_static; }
+			// ! World space bounding sphere, xyz: center, w: radius
+			[[nodiscard]] constexpr math::v4 const getWorldBoundingSphere() const { return _world_sphere; }
+			[[nodiscard]] constexpr const math::m4x4& getModelMatrix() const { return _modelData.model_matrix; }
+			[[nodiscard]] constexpr bool const is_reflect() const { return _modelData.is_reflect != 0; }
+			[[nodiscard]] constexpr const vulkan_model& getModel() const { return _model; }
 			[[nodiscard]] constexpr id::id_type const getMaterialID() const { return _material_id; }
 			[[nodiscard]] constexpr id::id_type const getEntityID() const { return _id; }
 			[[nodiscard]] constexpr id::id_type const getPipelineID() const { return _pipeline_id; }
+			// ! Pipeline to draw with: the own one, the fallback while it compiles, or invalid_id when the draw is skipped
+			[[nodiscard]] id::id_type const getDrawPipelineID() const;
 			[[nodiscard]] constexpr id::id_type const getDescriptorSet() const { return _descriptorSet_id; }
 			[[nodiscard]] constexpr id::id_type const getLightDescriptorSet() const { return _light_descriptorSet_id; }
 			[[nodiscard]] constexpr id::id_type const getModelMatrixID() const { return _modelMatrx_id; }
 
 		private:
 
+			// Model uniform block of the material vertex shaders, std140
 			struct model_data
 			{
 				math::m4x4											model_matrix;
 				u32													material_id;
 				u32													is_reflect;
+				u32													_pad[2];
+				math::v4											position_min;		// Dequantizes the model's packed positions, w unused
+				math::v4											position_scale;
 			};
+			static_assert(sizeof(model_data) <= 128, "Only 128 bytes of uniform data are guaranteed");
 
 			game_entity::entity_id									_id;
 			vulkan_model											_model;
-			id::id_type												_material_id;
+			id::id_type												_material_id{ id::invalid_id };
 			utl::vector<VkPipelineShaderStageCreateInfo>			_shaderStages;
-			id::id_type												_pipeline_id;
+			id::id_type												_pipeline_id{ id::invalid_id };
+			id::id_type												_pipeline_material{ id::invalid_id };	// Material whose shared pipeline this instance holds a reference on
 			id::id_type												_descriptorSet_id;
 			id::id_type												_light_descriptorSet_id;
 			model_data												_modelData;
 			id::id_type												_modelMatrx_id;
+			math::v4												_world_sphere{};
+			bool													_is_static{ false };
 
 			void create_instance_buffer();
+			void set_model_matrix(game_entity::entity entity);
+			void set_position_box();
+			void update_world_sphere();
 		};
 
 		// TODO: complete the parameter
@@ -224,10 +292,45 @@ namespace primal::graphics::vulkan
 		id::id_type add(const void* const data);
 		void remove(id::id_type id);
 		vulkan_model get_model(id::id_type id);
+
+		// Vertex and index buffers of the models and instances that are loaded
+		struct geometry_memory
+		{
+			u64			vertex_bytes;
+			u64			index_bytes;
+			u64			float_vertex_bytes;		// The same buffers with float vertices and 32-bit indices
+			u64			u32_index_bytes;
+		};
+		[[nodiscard]] const geometry_memory& get_geometry_memory();
+		// ! Take over the pipelines finished compiling since the last call. The returned version changes whenever any were.
+		u32 update_pipelines();
+		// ! Drop the reference that keeps the fallback pipeline alive, once no instance is left to draw with it
+		void release_fallback_pipeline();
 	}
 
 	namespace scene
 	{
+		// Instance ids are recycled, the entity tells which instance an id referred to
+		struct instance_change
+		{
+			id::id_type											instance_id;
+			id::id_type											entity_id;
+		};
+
+		// Instances changed since the log was last read, the log is cleared by the first add after a read.
+		// The epoch changes with every clear, so a reader can keep a cursor into the log and resume from it.
+		class instance_change_log
+		{
+		public:
+			void add(instance_change change);
+			[[nodiscard]] const instance_change* const read(u32& count, u32& epoch);
+
+		private:
+			utl::vector<instance_change>						_changes;
+			u32													_epoch{ 0 };
+			bool												_read{ false };
+		};
+
 		class vulkan_scene
 		{
 		public:
@@ -241,18 +344,33 @@ namespace primal::graphics::vulkan
 			void remove_camera(id::id_type id);
 			void add_material(id::id_type model_id, id::id_type material_id, bool isReflect);
 			void remove_material(id::id_type model_id);
+			// ! Called every frame before anything reads the instances, applies the entity transforms changed since the last call
+			void updateTransforms();
 
 			void createUniformBuffer();
 			void createDescriptorSets(VkDescriptorPool pool, VkDescriptorSetLayout layout);
 			void createDeferDescriptorSets(VkDescriptorPool pool, VkDescriptorSetLayout layout);
 			void createPipeline(VkRenderPass render_pass, VkPipelineLayout layout);
+			// ! Called every frame before drawing, instances whose pipeline finished compiling switch to it
+			void updatePipelines();
 			void createDeferPipeline(VkRenderPass render_pass, VkPipelineLayout layout);
 
 			void updateView(frame_info info);
 			void flushBuffer(vulkan_cmd_buffer cmd_buffer, VkPipelineLayout layout);
 
 			[[nodiscard]] utl::vector<id::id_type> getInstance() { return _instance_ids; }
+			[[nodiscard]] const utl::vector<id::id_type>& getInstanceIDs() const { return _instance_ids; }
 			[[nodiscard]] constexpr id::id_type const getUboID() const { return _ubo_id;  }
+			// ! Changes whenever a static instance is added, removed or moved, used to invalidate cached shadow cascades
+			[[nodiscard]] constexpr u32 const getStaticVersion() const { return _static_version; }
+			// ! Instances removed since the last read, see instance_change_log
+			[[nodiscard]] const instance_change* const getRemovedInstances(u32& count, u32& epoch) { return _removed_instances.read(count, epoch); }
+			// ! Instances whose material was added or removed or whose transform changed since the last read, used to patch the GPU-driven draw data
+			[[nodiscard]] const instance_change* const getChangedInstances(u32& count, u32& epoch) { return _changed_instances.read(count, epoch); }
+			// ! Camera of the last updateView, used to sort draws front to back
+			[[nodiscard]] constexpr const math::v3& getViewPosition() const { return _view_position; }
+			[[nodiscard]] constexpr const math::v3& getViewDirection() const { return _view_direction; }
+			[[nodiscard]] constexpr f32 const getFarPlane() const { return _far_plane; }
 
 		private:
 			utl::vector<id::id_type>							_instance_ids;
@@ -260,8 +378,25 @@ namespace primal::graphics::vulkan
 			id::id_type											_ubo_id;
 			id::id_type											_pipeline_id;
 			id::id_type											_descriptor_set_id;
+			u32													_static_version{ 0 };
+			utl::vector<id::id_type>							_entity_instances;		// Instance of each entity, by entity index
+			u32													_transform_epoch{ u32_invalid_id };	// Position in the changed transforms list, see transform::get_changed_entity_ids
+			u32													_transform_cursor{ 0 };
+			instance_change_log									_removed_instances;
+			instance_change_log									_changed_instances;
+			math::v3											_view_position{};
+			math::v3											_view_direction{ 0.f, 0.f, 1.f };
+			f32													_far_plane{ 1.f };
+			VkRenderPass										_pipeline_render_pass{ VK_NULL_HANDLE };	// Set by createPipeline, materials added later compile against it
+			VkPipelineLayout									_pipeline_layout{ VK_NULL_HANDLE };
+			u32													_pipeline_version{ 0 };
 		};
 
 		submesh::vulkan_instance_model& get_instance(id::id_type);
+		// ! Bind and draw each instance, binds matching what's already bound are skipped and binds counts the ones recorded.
+		// ! Only reads scene data, so several threads may record into their own command buffers.
+		void record_draws(vulkan_cmd_buffer cmd_buffer, VkPipelineLayout layout, const id::id_type* const instance_ids, u32 count, recording::bind_counts& binds);
+		// ! Binds record_draws would record for instance_ids in this order
+		recording::bind_counts count_binds(const id::id_type* const instance_ids, u32 count);
 	}
 }
\ No newline at end of file
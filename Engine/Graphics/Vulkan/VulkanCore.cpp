@@ -10,6 +10,7 @@
 #include "VulkanResources.h"
 #include "VulkanHelpers.h"
 #include <set>
+#include <mutex>
 
 // Own header file
 #include <array>
@@ -17,12 +18,59 @@
 #include <string>
 #include "VulkanLight.h"
 #include "VulkanCompute.h"
+#include "VulkanHeadless.h"
+#include "VulkanSampler.h"
+#include "VulkanShader.h"
+#include "VulkanPipelineCompiler.h"
+#include "VulkanProfiler.h"
+#include "VulkanClusterCull.h"
+#include "VulkanTextureStreaming.h"
+#include "TaskScheduler/TaskScheduler.h"
 
 
 namespace primal::graphics::vulkan::core
 {
 namespace
 {
+struct deferred_resource
+{
+    u64                     frame;          // Last frame that may use the resource
+    std::function<void()>   release;
+};
+
+std::vector<deferred_resource>  deferred_releases;          // NOTE: std::vector, std::function can't be moved with realloc
+u64                             submitted_frames{ 0 };      // Frames handed to the GPU, the one being recorded is submitted_frames + 1
+u64                             completed_frames{ 0 };      // Every frame up to this one has finished on the GPU
+std::mutex                      deferred_release_mutex{};
+
+void
+process_deferred_release(u64 completed_frame)
+{
+    std::vector<deferred_resource> ready;
+    {
+        std::lock_guard lock{ deferred_release_mutex };
+        completed_frames = std::max(completed_frames, completed_frame);
+
+        // Resources are queued in frame order, so the ones that are ready are at the front
+        auto last{ deferred_releases.begin() };
+        while (last != deferred_releases.end() && last->frame <= completed_frames) ++last;
+        if (last == deferred_releases.begin()) return;
+
+        ready.assign(std::make_move_iterator(deferred_releases.begin()), std::make_move_iterator(last));
+        deferred_releases.erase(deferred_releases.begin(), last);
+    }
+
+    // NOTE: run outside the lock, a release may queue more releases
+    for (auto& resource : ready) resource.release();
+}
+
+u64
+frame_submitted()
+{
+    std::lock_guard lock{ deferred_release_mutex };
+    return ++submitted_frames;
+}
+
 class vulkan_command
 {
 public:
@@ -31,7 +79,6 @@ public:
     explicit vulkan_command(VkDevice device, u32 queue_family_idx, u32 swapchain_image_count)
     {
         VkResult result{ VK_SUCCESS };
-        utl::vector<VkCommandBuffer> cmd_buffers;
         _swapchain_image_count = swapchain_image_count;
 
         // Command pool
@@ -53,14 +100,15 @@ public:
         /*vkGetDeviceQueue(core::logical_device(), core::compute_family_queue_index(), 0, &_compute_queue);
         MESSAGE("Found compute queue");*/
 
-        // Command buffers
-        create_command_buffers(device, queue_family_idx);
-        
+        // NOTE: frames are recorded into the command buffers of the geometry pass's render graph, the pool is
+        //       left for uploads
+
         // Semaphores & Fences
         {
             _image_available.resize(frame_buffer_count);
             _render_finished.resize(frame_buffer_count);
             _draw_fences.resize(frame_buffer_count);
+            _submitted_frames.resize(frame_buffer_count, 0);
             VkSemaphoreCreateInfo s_info{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
 
             // NOTE: fences here are created in an already signaled state, which indicates to Vulkan API that the frame
@@ -133,54 +181,19 @@ public:
             return false;
         }
 
+        // The composition pass is the last submit of a frame and waits on the passes before it
+        process_deferred_release(_submitted_frames[frame]);
+
         // Get next swapchain image
         if (!surface->next_image_index(_image_available[frame], nullptr, std::numeric_limits<u64>::max()))
             return false;
 
-        // Begin recording commands
-        vulkan_cmd_buffer& cmd_buffer{ _cmd_buffers[frame] };
-        reset_cmd_buffer(cmd_buffer);
-        begin_cmd_buffer(cmd_buffer, true, false, false);
-
-        //surface->getGeometryPass().runRenderpass(cmd_buffer, surface);
-
-        VkViewport viewport{};
-        viewport.x = 0.0f;
-        viewport.y = (f32)surface->height();
-        viewport.width = (f32)surface->width();
-        viewport.height = (f32)surface->height() * -1.f;
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
-
-        VkRect2D scissor{};
-        scissor.offset.x = 0;
-        scissor.offset.y = 0;
-        scissor.extent.width = surface->width();
-        scissor.extent.height = surface->height();
-
-        vkCmdSetViewport(cmd_buffer.cmd_buffer, 0, 1, &viewport);
-        vkCmdSetScissor(cmd_buffer.cmd_buffer, 0, 1, &scissor);
-
-        surface->set_renderpass_render_area({ 0, 0, surface->width(), surface->height() });
-        surface->set_renderpass_depth(1.0f);
-        surface->set_renderpass_stencil(0);
-        surface->set_renderpass_clear_color({ 0.0f, 0.0f, 0.0f, 0.0f });
-
-        renderpass::begin_renderpass(cmd_buffer.cmd_buffer, cmd_buffer.cmd_state, surface->renderpass(), surface->current_framebuffer());
-
         return true;
     }
 
     bool end_frame(vulkan_surface* surface, frame_info frame_info)
     {
         u32 frame{ surface->current_frame() };
-        vulkan_cmd_buffer& cmd_buffer{ _cmd_buffers[frame] };
-
-        //compute::outputImageData();
-        surface->getFinalPass().render(cmd_buffer);
-
-        renderpass::end_renderpass(cmd_buffer.cmd_buffer, cmd_buffer.cmd_state, surface->renderpass());
-        end_cmd_buffer(cmd_buffer);
 
         // Make sure the previous frame is not using this image
         if (_fences_in_flight[frame] != VK_NULL_HANDLE)
@@ -192,32 +205,18 @@ public:
         // Reset the femce for use in next frame
         reset_fence(core::logical_device(), _draw_fences[frame]);
 
-        // Compute Pass Submit
-        // compute::submit();
-
-        // use compute semaphore
-        VkSemaphore graphicsWaitSemaphores[]{ compute::get_compute_signal_semaphore(),
-            _image_available[frame], surface->getGeometryPass().get_signal_semaphore() };
-        VkSemaphore graphicsWaitSemaphores2[]{ _image_available[frame], compute::get_culling_signal_semaphore()};
-        VkSemaphore graphicsSignalSemaphores[]{ _render_finished[frame] };
-
-        VkSubmitInfo info{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
-        info.commandBufferCount = 1;
-        info.pCommandBuffers = &cmd_buffer.cmd_buffer;
-        info.signalSemaphoreCount = 1; // 1
-        info.pSignalSemaphores = &_render_finished[frame]; // &_render_finished[frame]
-        info.waitSemaphoreCount = _is_first_frame ? 3 : 2; // 1
-        info.pWaitSemaphores = _is_first_frame ? graphicsWaitSemaphores : graphicsWaitSemaphores2; // &_image_available[frame]
-        VkPipelineStageFlags flags[4]{ VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT ,VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT };
-        info.pWaitDstStageMask = flags;
-
-        VkResult result{ VK_SUCCESS };
-        VkCall(result = vkQueueSubmit(_graphics_queue, 1, &info, _draw_fences[frame].fence), "Failed to submit queue...");
-        if (result != VK_SUCCESS) return false;
-
-        _is_first_frame = false;
+        // Composition is the graph's last submit, only it waits for the swapchain image
+        const VkPipelineStageFlags wait_stage{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+        render_graph::frame_sync sync{};
+        sync.wait_count = 1;
+        sync.wait_semaphores = &_image_available[frame];
+        sync.wait_stages = &wait_stage;
+        sync.signal_count = 1;
+        sync.signal_semaphores = &_render_finished[frame];
+        sync.fence = _draw_fences[frame].fence;
+        surface->getGeometryPass().submit(surface, sync);
 
-        update_cmd_buffer_submitted(cmd_buffer);
+        _submitted_frames[frame] = frame_submitted();
 
         surface->present(_image_available[frame], _render_finished[frame], nullptr, _presentation_queue);
 
@@ -235,30 +234,12 @@ public:
             destroy_fence(core::logical_device(), _draw_fences[i]);
         }
         free(_fences_in_flight);
-        for (u32 i{ 0 }; i < _swapchain_image_count; ++i)
-        {
-            free_cmd_buffer(core::logical_device(), _cmd_pool, _cmd_buffers[i]);
-        }
         vkDestroyCommandPool(core::logical_device(), _cmd_pool, nullptr);
     }
 
     [[nodiscard]] constexpr VkCommandPool const command_pool() const { return _cmd_pool; }
 
 private:
-    void create_command_buffers(VkDevice device, u32 queue_family_idx)
-    {
-        _cmd_buffers.resize(_swapchain_image_count);
-
-        for (u32 i{ 0 }; i < _swapchain_image_count; ++i)
-        {
-            if (_cmd_buffers[i].cmd_buffer)
-                free_cmd_buffer(device, _cmd_pool, _cmd_buffers[i]);
-
-            // TODO: hardcoded to true for now... 
-            _cmd_buffers[i] = allocate_cmd_buffer(device, _cmd_pool, true);
-        }
-    }
-
     bool create_fence(VkDevice device, bool signaled, vulkan_fence& fence)
     {
         fence.signaled = signaled;
@@ -329,14 +310,12 @@ private:
     VkCommandPool					_cmd_pool{ nullptr };
     VkQueue							_graphics_queue{ nullptr };
     VkQueue							_presentation_queue{ nullptr };
-    utl::vector<vulkan_cmd_buffer>	_cmd_buffers;
     utl::vector<vulkan_fence>		_draw_fences;
+    utl::vector<u64>				_submitted_frames;		// Frame number last submitted with each draw fence
     vulkan_fence**					_fences_in_flight;
     utl::vector<VkSemaphore>		_image_available;
     utl::vector<VkSemaphore>		_render_finished;
     u32								_swapchain_image_count{ 0 };
-    
-    bool                            _is_first_frame{ true };
 };
 
 // Indices (locations) of Queue Families (if they exist at all)
@@ -361,8 +340,14 @@ using surface_collection = utl::free_list<vulkan_surface>;
 
 //const utl::vector<const char*>	device_extensions{ 1, VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 const std::vector<const char*>  device_extensions{ VK_KHR_SWAPCHAIN_EXTENSION_NAME, VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME, "VK_KHR_maintenance4" };
+const std::vector<const char*>  headless_device_extensions{ VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME, "VK_KHR_maintenance4" };
 VkInstance						instance{ nullptr };
 VkFormat						device_depth_format{ VK_FORMAT_UNDEFINED };
+bool							device_draw_indirect_count{ false };
+bool							device_multi_draw_indirect{ false };
+bool							device_descriptor_indexing{ false };
+bool							device_host_query_reset{ false };
+bool							device_texture_compression_bc{ false };
 vulkan_command					gfx_command;
 VkDebugUtilsMessengerEXT		debug_messenger{ 0 };
 surface_collection				surfaces;
@@ -432,9 +417,13 @@ get_queue_families(VkPhysicalDevice device, VkSurfaceKHR surface)
             queue_family_indices.graphics_family = i;		// If queue family is valid, then get index
         }
 
-        // Check if queue family supports presentation
+        // Check if queue family supports presentation. Without a surface (headless) nothing is presented,
+        // the graphics queue stands in for the presentation queue.
         VkBool32 presentation_support{ false };
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentation_support);
+        if (surface)
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentation_support);
+        else
+            presentation_support = (queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
         // Check if queue is presentation type (can be both graphics and presentation)
         if (queue_family.queueCount > 0 && presentation_support)
             queue_family_indices.presentation_family = i;
@@ -472,7 +461,7 @@ check_device_extension_support(VkPhysicalDevice device)
     vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, extensions.data());
 
     // Check if given extensions are in the list of available extensions
-    for (const auto& device_ext : device_extensions)
+    for (const auto& device_ext : headless::is_enabled() ? headless_device_extensions : device_extensions)
     {
         bool has_ext = false;
         for (const auto& extension : extensions)
@@ -497,8 +486,8 @@ check_device_suitable(VkPhysicalDevice device, VkSurfaceKHR surface)
 
     bool extensions_supported{ check_device_extension_support(device) };
 
-    bool swapchain_valid{ false };
-    if (extensions_supported)
+    bool swapchain_valid{ !surface };
+    if (extensions_supported && surface)
     {
         swapchain_details swapchain_details = get_swapchain_details(device, surface);
         swapchain_valid = !swapchain_details.formats.empty() && !swapchain_details.presentation_modes.empty();
@@ -579,8 +568,9 @@ create_logical_device()
     VkDeviceCreateInfo info{ VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO };
     info.queueCreateInfoCount = (u32)infos.size();		// number of queue create infos
     info.pQueueCreateInfos = infos.data();				// List of queue create infos so device can create required queues
-    info.enabledExtensionCount = (u32)device_extensions.size();	// NUmber of enabled logical device extensions
-    info.ppEnabledExtensionNames = device_extensions.data();		// List of enabled logical device extensions
+    const std::vector<const char*>& extensions{ headless::is_enabled() ? headless_device_extensions : device_extensions };
+    info.enabledExtensionCount = (u32)extensions.size();		// NUmber of enabled logical device extensions
+    info.ppEnabledExtensionNames = extensions.data();			// List of enabled logical device extensions
 
     // Physical device features --- Maintenance4 Features KHR
     VkPhysicalDeviceMaintenance4FeaturesKHR maintenance4_features{};
@@ -588,6 +578,12 @@ create_logical_device()
     maintenance4_features.pNext = nullptr;
     // maintenance4_features.maintenance4 = VK_TRUE;
 
+    // Physical device features --- Vulkan 1.2, only drawIndirectCount and descriptor indexing are enabled for GPU-driven drawing
+    VkPhysicalDeviceVulkan12Features vulkan12_features{};
+    vulkan12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan12_features.pNext = nullptr;
+    maintenance4_features.pNext = &vulkan12_features;
+
     // Physical device features the logical device will be using
     // VkPhysicalDeviceFeatures device_features{};
     // device_features.samplerAnisotropy = VK_TRUE;
@@ -597,6 +593,33 @@ create_logical_device()
     vkGetPhysicalDeviceFeatures2(device_group.physical_device, &device_features);
 
     device_features.features.samplerAnisotropy = VK_TRUE;
+    // Cooked BCn textures are sampled as they are, without it they're decoded to RGBA8 on load
+    device_texture_compression_bc = device_features.features.textureCompressionBC;
+    device_features.features.textureCompressionBC = device_texture_compression_bc ? VK_TRUE : VK_FALSE;
+    if (!device_texture_compression_bc) MESSAGE("textureCompressionBC isn't supported, BCn textures are decoded to RGBA8 on load");
+
+    device_draw_indirect_count = vulkan12_features.drawIndirectCount && device_features.features.multiDrawIndirect;
+    device_multi_draw_indirect = device_features.features.multiDrawIndirect;
+    // Bindless materials: a partially bound, update-after-bind, runtime sized texture array indexed per fragment
+    device_descriptor_indexing = vulkan12_features.runtimeDescriptorArray && vulkan12_features.descriptorBindingPartiallyBound &&
+        vulkan12_features.descriptorBindingVariableDescriptorCount && vulkan12_features.descriptorBindingSampledImageUpdateAfterBind &&
+        vulkan12_features.descriptorBindingUpdateUnusedWhilePending && vulkan12_features.shaderSampledImageArrayNonUniformIndexing;
+    // The GPU profiler resets its queries from the CPU once it has read them
+    device_host_query_reset = vulkan12_features.hostQueryReset;
+    const VkBool32 draw_indirect_count{ vulkan12_features.drawIndirectCount };
+    vulkan12_features = {};
+    vulkan12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan12_features.drawIndirectCount = draw_indirect_count;
+    vulkan12_features.hostQueryReset = device_host_query_reset;
+    if (device_descriptor_indexing)
+    {
+        vulkan12_features.runtimeDescriptorArray = VK_TRUE;
+        vulkan12_features.descriptorBindingPartiallyBound = VK_TRUE;
+        vulkan12_features.descriptorBindingVariableDescriptorCount = VK_TRUE;
+        vulkan12_features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        vulkan12_features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+        vulkan12_features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    }
 
     // set Maintenance4 Features KHR in VkDeviceCreateInfo::pNext to enable Maintenance4
     info.pNext = &maintenance4_features;
@@ -655,15 +678,19 @@ initialize()
     app_info.apiVersion = VK_API_VERSION_1_3;					// Version of Vulkan API
 
     // List of instance extensions we need to have available
-    utl::vector<const char*> instance_ext{ 1, VK_KHR_SURFACE_EXTENSION_NAME };
+    utl::vector<const char*> instance_ext{};
 
     // Add appropriate OS specific surface extension to the list.
-    // For now, only Windows and Linux XLib are supported.
+    // For now, only Windows and Linux XLib are supported. Headless rendering doesn't need a surface.
+    if (!headless::is_enabled())
+    {
+        instance_ext.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
 #ifdef _WIN32
-    instance_ext.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
+        instance_ext.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
 #elif __linux__
-    instance_ext.push_back(VK_KHR_XLIB_SURFACE_EXTENSION_NAME);
+        instance_ext.push_back(VK_KHR_XLIB_SURFACE_EXTENSION_NAME);
 #endif // _WIN32
+    }
 
     // If validation enabled, add extension to report debug info
     if (enable_validation_layers)
@@ -722,10 +749,13 @@ initialize()
         MESSAGE("Vulkan validation layer created");
     }
 
-    GET_INSTANCE_PROC_ADDR(instance, GetPhysicalDeviceSurfaceSupportKHR);
-    GET_INSTANCE_PROC_ADDR(instance, GetPhysicalDeviceSurfaceCapabilitiesKHR);
-    GET_INSTANCE_PROC_ADDR(instance, GetPhysicalDeviceSurfaceFormatsKHR);
-    GET_INSTANCE_PROC_ADDR(instance, GetPhysicalDeviceSurfacePresentModesKHR);
+    if (!headless::is_enabled())
+    {
+        GET_INSTANCE_PROC_ADDR(instance, GetPhysicalDeviceSurfaceSupportKHR);
+        GET_INSTANCE_PROC_ADDR(instance, GetPhysicalDeviceSurfaceCapabilitiesKHR);
+        GET_INSTANCE_PROC_ADDR(instance, GetPhysicalDeviceSurfaceFormatsKHR);
+        GET_INSTANCE_PROC_ADDR(instance, GetPhysicalDeviceSurfacePresentModesKHR);
+    }
 
     MESSAGE("Vulkan initialized successfully");
 
@@ -735,7 +765,13 @@ initialize()
 void
 shutdown()
 {
+    flush_deferred_release();
     gfx_command.release();
+    pipelines::shutdown();
+    profiler::shutdown();
+    clusters::shutdown();
+    samplers::shutdown();
+    shaders::shutdown();
     vkDestroyDevice(device_group.logical_device, nullptr);
 
     if (enable_validation_layers)
@@ -856,12 +892,39 @@ find_memory_index(u32 type, u32 flags)
     return -1;
 }
 
+void
+deferred_release(std::function<void()> release)
+{
+    std::lock_guard lock{ deferred_release_mutex };
+    deferred_releases.emplace_back(deferred_resource{ submitted_frames + 1, std::move(release) });
+}
+
+void
+flush_deferred_release()
+{
+    u64 frame{ 0 };
+    {
+        std::lock_guard lock{ deferred_release_mutex };
+        frame = submitted_frames + 1;
+    }
+    process_deferred_release(frame);
+}
+
 u32 get_frame_index()
 {
     // Now has only one surface
     return surfaces[0].current_frame();
 }
 
+enki::TaskScheduler&
+task_scheduler()
+{
+    static enki::TaskScheduler scheduler;
+    static std::once_flag started;
+    std::call_once(started, [] { scheduler.Initialize(); });
+    return scheduler;
+}
+
 u32
 graphics_family_queue_index()
 {
@@ -908,10 +971,41 @@ depth_format()
     return device_depth_format;
 }
 
+bool
+draw_indirect_count_supported()
+{
+    return device_draw_indirect_count;
+}
+
+bool
+multi_draw_indirect_supported()
+{
+    return device_multi_draw_indirect;
+}
+
+bool
+descriptor_indexing_supported()
+{
+    return device_descriptor_indexing;
+}
+
+bool
+host_query_reset_supported()
+{
+    return device_host_query_reset;
+}
+
+bool
+texture_compression_bc_supported()
+{
+    return device_texture_compression_bc;
+}
+
 surface
 create_surface(platform::window window)
 {
-    surface_id id{ surfaces.add(window) };
+    // The window is ignored when rendering headless
+    surface_id id{ headless::is_enabled() ? surfaces.add(headless::get_config()) : surfaces.add(window) };
     surfaces[id].create(instance);
     return surface{ id };
 }
@@ -943,32 +1037,49 @@ surface_height(surface_id id)
 void
 render_surface(surface_id id, frame_info info)
 {
+    // A headless run moves the camera along its path and stops after its last frame
+    const bool headless{ surfaces[id].is_headless() };
+    if (headless && !headless::begin_frame(info)) return;
+    profiler::begin_frame();
+
     // update each frame data
     light::update_light_buffers(info);
+    // Move the instances whose entity moved, before the shadows, culling and draws read them
+    surfaces[id].getScene().updateTransforms();
+    // Switch instances to the pipelines that finished compiling in the background
+    surfaces[id].getScene().updatePipelines();
     surfaces[id].getScene().updateView(info);
+    // Fit shadow cascades and cull their casters, they're recorded with the geometry pass
+    surfaces[id].getShadowPass().update(info, surfaces[id].getScene());
+    // Pack instances for GPU-driven drawing and extract the culling frustum
+    surfaces[id].getIndirectPass().update(info, surfaces[id].getScene());
+    // Cull meshlets for the per-instance draws, the GPU-driven path culls whole instances on its own.
+    // Only the GPU-driven path samples streamed mips, its visible instances decide the ones to stream.
+    if (surfaces[id].getIndirectPass().is_ready())
+    {
+        clusters::skip_frame();
+        texture_streaming::add_view(id, info, surfaces[id].height(), surfaces[id].getScene());
+    }
+    else
+    {
+        clusters::update(info, surfaces[id].getScene());
+    }
 
-    // frustum pass -- run once
-    compute::frustum_run();
-    compute::frustum_submit();
-
-    // Geometry pass
-    // geometry_run(&surfaces[id]);
-    // geometry_submit();
-    surfaces[id].getGeometryPass().run(&surfaces[id]);
-    surfaces[id].getGeometryPass().submit(&surfaces[id]);
-
-    // Culling pass
-    compute::culling_light_run();
-    VkSemaphore wait_signal_one = surfaces[id].getGeometryPass().get_signal_semaphore();
-    compute::culling_light_submit(1, &wait_signal_one);
-
+    bool culling_matched{ true };
     if (gfx_command.begin_frame(&surfaces[id], info))
     {
-        //
-        // ....
-        //
-
+        // Shadows, instance culling, the G-buffer, tile frustums, light culling and composition make up one render
+        // graph, it places every barrier and semaphore between them
+        surfaces[id].getGeometryPass().run(&surfaces[id]);
         gfx_command.end_frame(&surfaces[id], info);
+
+        if (indirect::is_verifying_culling() && !surfaces[id].getIndirectPass().verify())
+        {
+            MESSAGE("GPU instance culling doesn't match the CPU reference");
+            culling_matched = false;
+        }
     }
+
+    if (headless) headless::end_frame(surfaces[id].getShadowPass(), culling_matched);
 }
 }
\ No newline at end of file
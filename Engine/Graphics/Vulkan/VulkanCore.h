@@ -3,6 +3,9 @@
 #pragma once
 
 #include "VulkanCommonHeaders.h"
+#include <functional>
+
+namespace enki { class TaskScheduler; }
 
 namespace primal::graphics::vulkan::core
 {
@@ -18,11 +21,23 @@ bool detect_subgroup(VkPhysicalDevice physical_device);
 s32 find_memory_index(u32 type, u32 flags);
 
 u32 get_frame_index();
+// Run release once the GPU is done with every frame that may still use the resource: the frames in flight and
+// the one being recorded. Queued releases run on the render thread after a frame fence wait, never wait for the device.
+void deferred_release(std::function<void()> release);
+// Run every queued release now. Only call with the device idle.
+void flush_deferred_release();
+// Shared by the draw recorder and the pipeline compiler, one thread per hardware thread. Started on first use.
+enki::TaskScheduler& task_scheduler();
 u32 graphics_family_queue_index();
 u32 presentation_family_queue_index();
 u32 compute_family_queue_index();
 u32 transfer_family_queue_index();
 VkFormat depth_format();
+bool draw_indirect_count_supported();
+bool multi_draw_indirect_supported();
+bool descriptor_indexing_supported();
+bool host_query_reset_supported();
+bool texture_compression_bc_supported();
 VkPhysicalDevice physical_device();
 VkDevice logical_device();
 VkInstance get_instance();
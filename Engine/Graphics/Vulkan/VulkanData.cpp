@@ -4,6 +4,7 @@
 
 #include "VulkanCore.h"
 #include "VulkanHelpers.h"
+#include "VulkanPipelineCompiler.h"
 
 #include <type_traits>
 
@@ -193,6 +194,7 @@ namespace primal::graphics::vulkan::data
 		// --------------------------------------------- VULKAN PIPELINE ------------------------------------------------------------------------- //
 		utl::free_list<VkPipeline> pipeline_list;
 
+		// size selects what data is: 0 graphics create info, 1 compute create info, 2 a VkPipeline created elsewhere
 		id::id_type create_pipeline(const void* const data, [[maybe_unused]] u32 size = 0)
 		{
 			VkPipeline pipeline;
@@ -200,12 +202,17 @@ namespace primal::graphics::vulkan::data
 			if (size == 0)
 			{
 				VkGraphicsPipelineCreateInfo info{ *(VkGraphicsPipelineCreateInfo*)data };
-				VkCall(result = vkCreateGraphicsPipelines(core::logical_device(), nullptr, 1, &info, nullptr, &pipeline), "Failed to create graphics pipeline...");
+				VkCall(result = vkCreateGraphicsPipelines(core::logical_device(), pipelines::cache(), 1, &info, nullptr, &pipeline), "Failed to create graphics pipeline...");
 			}
 			else if (size == 1)
 			{
 				VkComputePipelineCreateInfo info{ *(VkComputePipelineCreateInfo*)data };
-				VkCall(result = vkCreateComputePipelines(core::logical_device(), nullptr, 1, &info, nullptr, &pipeline), "Failed to create compute pipeline...");
+				VkCall(result = vkCreateComputePipelines(core::logical_device(), pipelines::cache(), 1, &info, nullptr, &pipeline), "Failed to create compute pipeline...");
+			}
+			else
+			{
+				assert(size == 2);
+				pipeline = *(const VkPipeline*)data;
 			}
 			return pipeline_list.add(pipeline);
 		}
@@ -304,6 +311,8 @@ namespace primal::graphics::vulkan::data
 			break;
 		case primal::graphics::vulkan::data::vulkan_buffer::per_frame_update_storage_buffer:				this->flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 			break;
+		case primal::graphics::vulkan::data::vulkan_buffer::indirect_buffer:								this->flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+			break;
 		}
 
 		createBuffer(core::logical_device(), size <= 0 ? 1 : size, this->flags, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, this->cpu_address, this->cpu_memory);
@@ -319,6 +328,7 @@ namespace primal::graphics::vulkan::data
 		case primal::graphics::vulkan::data::vulkan_buffer::static_uniform_buffer:
 		case primal::graphics::vulkan::data::vulkan_buffer::static_storage_buffer:
 		case primal::graphics::vulkan::data::vulkan_buffer::per_frame_update_storage_buffer:
+		case primal::graphics::vulkan::data::vulkan_buffer::indirect_buffer:
 			break;
 		case primal::graphics::vulkan::data::vulkan_buffer::per_frame_update_uniform_buffer:
 		{
@@ -339,6 +349,7 @@ namespace primal::graphics::vulkan::data
 		case primal::graphics::vulkan::data::vulkan_buffer::static_uniform_buffer:
 		case primal::graphics::vulkan::data::vulkan_buffer::static_storage_buffer:
 		case primal::graphics::vulkan::data::vulkan_buffer::per_frame_update_storage_buffer:
+		case primal::graphics::vulkan::data::vulkan_buffer::indirect_buffer:
 		{
 			//this->data = (void*)malloc(size);
 
@@ -380,6 +391,8 @@ namespace primal::graphics::vulkan::data
 			break;
 		case primal::graphics::vulkan::data::vulkan_buffer::per_frame_update_storage_buffer:				flag = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
 			break;
+		case primal::graphics::vulkan::data::vulkan_buffer::indirect_buffer:								flag = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+			break;
 		}
 
 		assert(flag != VK_BUFFER_USAGE_FLAG_BITS_MAX_ENUM);
@@ -16,6 +16,7 @@ namespace primal::graphics::vulkan::data
 			per_frame_update_uniform_buffer,
 			static_storage_buffer,
 			per_frame_update_storage_buffer,
+			indirect_buffer,					// Written by compute, read by vkCmdDraw*Indirect*, stays host visible for readback
 
 			count
 		};
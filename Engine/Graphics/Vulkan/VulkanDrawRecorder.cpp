@@ -0,0 +1,316 @@
+#include "VulkanDrawRecorder.h"
+#include "VulkanCore.h"
+#include "VulkanCommandBuffer.h"
+#include "VulkanContent.h"
+#include "TaskScheduler/TaskScheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string>
+
+namespace primal::graphics::vulkan
+{
+	namespace
+	{
+		using record_clock = std::chrono::high_resolution_clock;
+
+		f32 elapsed_ms(record_clock::time_point start)
+		{
+			return std::chrono::duration<f32, std::milli>(record_clock::now() - start).count();
+		}
+
+		u32 chunk_count(u32 draw_count)
+		{
+			return (draw_count + recording::draws_per_chunk - 1) / recording::draws_per_chunk;
+		}
+
+		void add_binds(recording::bind_counts& total, const recording::bind_counts& binds)
+		{
+			total.pipeline += binds.pipeline;
+			total.descriptor_set += binds.descriptor_set;
+			total.vertex_buffer += binds.vertex_buffer;
+		}
+
+		// The scheduler also runs the pipeline compiles at low priority, the render thread only helps with the recording
+		void run_and_wait(enki::TaskSet& task)
+		{
+			enki::TaskScheduler& scheduler{ core::task_scheduler() };
+			scheduler.AddTaskSetToPipe(&task);
+			scheduler.WaitforTask(&task, enki::TASK_PRIORITY_HIGH);
+		}
+
+		// Run func(block) for blocks [0, block_count), on the scheduler when there's more than one
+		template<typename F>
+		void for_each_block(u32 block_count, F&& func)
+		{
+			if (block_count == 1)
+			{
+				func(0u);
+				return;
+			}
+
+			enki::TaskSet task{ block_count, [&](enki::TaskSetPartition range, u32) {
+				for (u32 block{ range.start }; block < range.end; ++block) func(block);
+			} };
+			run_and_wait(task);
+		}
+	} // anonymous namespace
+
+	void vulkan_draw_recorder::setup()
+	{
+		_thread_count = core::task_scheduler().GetNumTaskThreads();
+
+		VkCommandPoolCreateInfo info{ VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+		info.pNext = nullptr;
+		info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		info.queueFamilyIndex = core::graphics_family_queue_index();
+
+		_pools.resize(frame_buffer_count * _thread_count);
+		for (auto& p : _pools)
+		{
+			VkResult result{ VK_SUCCESS };
+			VkCall(result = vkCreateCommandPool(core::logical_device(), &info, nullptr, &p.pool), "Failed to create secondary command pool...");
+		}
+	}
+
+	void vulkan_draw_recorder::release()
+	{
+		for (auto& p : _pools)
+		{
+			// Destroying the pool frees its command buffers
+			vkDestroyCommandPool(core::logical_device(), p.pool, nullptr);
+		}
+		_pools.clear();
+		_chunk_buffers.clear();
+		_chunk_binds.clear();
+	}
+
+	const utl::vector<id::id_type>& vulkan_draw_recorder::sort_draws(scene::vulkan_scene& current_scene)
+	{
+		const auto start{ record_clock::now() };
+		const utl::vector<id::id_type>& instance_ids{ current_scene.getInstanceIDs() };
+		const u32 count{ (u32)instance_ids.size() };
+
+		for (u32 i{ 0 }; i < 2; ++i)
+		{
+			_keys[i].resize(count);
+			_sorted_ids[i].resize(count);
+		}
+
+		using namespace DirectX;
+		const XMVECTOR view_position{ XMLoadFloat3(&current_scene.getViewPosition()) };
+		const XMVECTOR view_direction{ XMLoadFloat3(&current_scene.getViewDirection()) };
+		const f32 inv_far{ 1.f / current_scene.getFarPlane() };
+
+		for (u32 i{ 0 }; i < count; ++i)
+		{
+			const submesh::vulkan_instance_model& instance{ scene::get_instance(instance_ids[i]) };
+			const math::v4 sphere{ instance.getWorldBoundingSphere() };
+			const f32 depth{ XMVectorGetX(XMVector3Dot(XMVectorSubtract(XMLoadFloat4(&sphere), view_position), view_direction)) };
+
+			_keys[0][i] = recording::make_sort_key(recording::opaque_pass, instance.getDrawPipelineID(), instance.getMaterialID(),
+				instance.getModel().getVertexBuffer(), depth * inv_far);
+			_sorted_ids[0][i] = instance_ids[i];
+		}
+
+		radix_sort(count);
+
+		_bind_stats.draw_count = count;
+		_bind_stats.unsorted = scene::count_binds(instance_ids.data(), count);
+		_bind_stats.sort_ms = elapsed_ms(start);
+		return _sorted_ids[_sorted];
+	}
+
+	// LSD radix sort of _keys[0] carrying _sorted_ids[0] along, one byte per pass. Each pass splits the keys into
+	// blocks: blocks count their digits in parallel, a serial prefix sum over (digit, block) turns the counts into
+	// write offsets, then blocks scatter in parallel. Since blocks are in key order the sort stays stable.
+	void vulkan_draw_recorder::radix_sort(u32 count)
+	{
+		_sorted = 0;
+		if (count < 2) return;
+
+		constexpr u32 radix{ 256 };
+		const u32 block_count{ count < recording::radix_parallel_threshold ? 1 : std::max(1u, std::min(_thread_count, count / recording::draws_per_chunk)) };
+		const u32 block_size{ (count + block_count - 1) / block_count };
+		_histograms.resize(block_count * radix);
+
+		for (u32 shift{ 0 }; shift < 64; shift += 8)
+		{
+			const u64* const src_keys{ _keys[_sorted].data() };
+			const id::id_type* const src_ids{ _sorted_ids[_sorted].data() };
+			u64* const dst_keys{ _keys[_sorted ^ 1].data() };
+			id::id_type* const dst_ids{ _sorted_ids[_sorted ^ 1].data() };
+			u32* const histograms{ _histograms.data() };
+
+			for_each_block(block_count, [&](u32 block) {
+				u32* const histogram{ histograms + block * radix };
+				memset(histogram, 0, radix * sizeof(u32));
+				const u32 end{ std::min(count, (block + 1) * block_size) };
+				for (u32 i{ block * block_size }; i < end; ++i) ++histogram[(src_keys[i] >> shift) & (radix - 1)];
+			});
+
+			// All keys share this digit, the pass wouldn't move anything
+			bool skip{ false };
+			for (u32 digit{ 0 }; digit < radix && !skip; ++digit)
+			{
+				u32 digit_count{ 0 };
+				for (u32 block{ 0 }; block < block_count; ++block) digit_count += histograms[block * radix + digit];
+				skip = digit_count == count;
+			}
+			if (skip) continue;
+
+			u32 offset{ 0 };
+			for (u32 digit{ 0 }; digit < radix; ++digit)
+			{
+				for (u32 block{ 0 }; block < block_count; ++block)
+				{
+					const u32 digit_count{ histograms[block * radix + digit] };
+					histograms[block * radix + digit] = offset;
+					offset += digit_count;
+				}
+			}
+
+			for_each_block(block_count, [&](u32 block) {
+				u32* const offsets{ histograms + block * radix };
+				const u32 end{ std::min(count, (block + 1) * block_size) };
+				for (u32 i{ block * block_size }; i < end; ++i)
+				{
+					const u32 index{ offsets[(src_keys[i] >> shift) & (radix - 1)]++ };
+					dst_keys[index] = src_keys[i];
+					dst_ids[index] = src_ids[i];
+				}
+			});
+
+			_sorted ^= 1;
+		}
+	}
+
+	void vulkan_draw_recorder::record_inline(vulkan_cmd_buffer primary, VkPipelineLayout layout, const utl::vector<id::id_type>& instance_ids)
+	{
+		_bind_stats.sorted = {};
+		scene::record_draws(primary, layout, instance_ids.data(), (u32)instance_ids.size(), _bind_stats.sorted);
+		log_bind_stats();
+	}
+
+	void vulkan_draw_recorder::reset_pools(u32 frame)
+	{
+		for (u32 i{ 0 }; i < _thread_count; ++i)
+		{
+			thread_pool& p{ get_pool(frame, i) };
+			if (!p.used) continue;
+			vkResetCommandPool(core::logical_device(), p.pool, 0);
+			p.used = 0;
+		}
+	}
+
+	void vulkan_draw_recorder::record_chunks(u32 frame, const VkCommandBufferInheritanceInfo& inheritance, const VkViewport& viewport,
+		const VkRect2D& scissor, VkPipelineLayout layout, const id::id_type* const instance_ids, u32 draw_count)
+	{
+		const u32 chunks{ chunk_count(draw_count) };
+		_chunk_buffers.resize(chunks);
+		_chunk_binds.resize(chunks);
+
+		// Chunks are handed out in ranges, a thread records its chunks one after another into buffers of its own pool
+		enki::TaskSet task{ chunks, [&](enki::TaskSetPartition range, u32 thread) {
+			thread_pool& p{ get_pool(frame, thread) };
+			for (u32 chunk{ range.start }; chunk < range.end; ++chunk)
+			{
+				if (p.used == p.buffers.size())
+					p.buffers.emplace_back(allocate_cmd_buffer(core::logical_device(), p.pool, false));
+				vulkan_cmd_buffer& cmd_buffer{ p.buffers[p.used++] };
+
+				VkCommandBufferBeginInfo info{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+				info.pNext = nullptr;
+				info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+				info.pInheritanceInfo = &inheritance;
+				VkResult result{ VK_SUCCESS };
+				VkCall(result = vkBeginCommandBuffer(cmd_buffer.cmd_buffer, &info), "Failed to begin secondary command buffer...");
+				cmd_buffer.cmd_state = vulkan_cmd_buffer::CMD_RECORDING;
+
+				vkCmdSetViewport(cmd_buffer.cmd_buffer, 0, 1, &viewport);
+				vkCmdSetScissor(cmd_buffer.cmd_buffer, 0, 1, &scissor);
+
+				const u32 first{ chunk * recording::draws_per_chunk };
+				const u32 count{ std::min(recording::draws_per_chunk, draw_count - first) };
+				_chunk_binds[chunk] = {};
+				scene::record_draws(cmd_buffer, layout, instance_ids + first, count, _chunk_binds[chunk]);
+
+				end_cmd_buffer(cmd_buffer);
+				_chunk_buffers[chunk] = cmd_buffer.cmd_buffer;
+			}
+		} };
+
+		run_and_wait(task);
+	}
+
+	void vulkan_draw_recorder::record(vulkan_cmd_buffer primary, u32 frame, const VkCommandBufferInheritanceInfo& inheritance, const VkViewport& viewport,
+		const VkRect2D& scissor, VkPipelineLayout layout, const utl::vector<id::id_type>& instance_ids)
+	{
+		assert(frame < frame_buffer_count);
+		const auto start{ record_clock::now() };
+
+		// The frame's fence has been waited on, so its secondaries are no longer in use
+		reset_pools(frame);
+		record_chunks(frame, inheritance, viewport, scissor, layout, instance_ids.data(), (u32)instance_ids.size());
+		vkCmdExecuteCommands(primary.cmd_buffer, (u32)_chunk_buffers.size(), _chunk_buffers.data());
+
+		_stats.draw_count = (u32)instance_ids.size();
+		_stats.chunk_count = (u32)_chunk_buffers.size();
+		_stats.thread_count = _thread_count;
+		_stats.record_ms = elapsed_ms(start);
+
+		_bind_stats.sorted = {};
+		for (const auto& binds : _chunk_binds) add_binds(_bind_stats.sorted, binds);
+		log_bind_stats();
+	}
+
+	// Once per scene change rather than every frame, the counts only move when the draw list does
+	void vulkan_draw_recorder::log_bind_stats()
+	{
+		if (_bind_stats.draw_count == _logged_draw_count) return;
+		_logged_draw_count = _bind_stats.draw_count;
+
+		const auto binds_to_string = [](const recording::bind_counts& binds) {
+			return std::to_string(binds.pipeline) + " pipeline, " + std::to_string(binds.descriptor_set) + " descriptor set, " +
+				std::to_string(binds.vertex_buffer) + " vertex buffer";
+		};
+		MESSAGE(("Draw sorting: " + std::to_string(_bind_stats.draw_count) + " draws, unsorted " + binds_to_string(_bind_stats.unsorted) +
+			" binds, sorted " + binds_to_string(_bind_stats.sorted) + " binds, sort " + std::to_string(_bind_stats.sort_ms) + " ms").c_str());
+	}
+
+	utl::vector<recording::record_stats> vulkan_draw_recorder::benchmark(u32 frame, const VkCommandBufferInheritanceInfo& inheritance, const VkViewport& viewport,
+		const VkRect2D& scissor, VkPipelineLayout layout, const utl::vector<id::id_type>& instance_ids, u32 draw_count)
+	{
+		utl::vector<recording::record_stats> results;
+		assert(frame < frame_buffer_count);
+		if (instance_ids.empty() || _pools.empty()) return results;
+
+		utl::vector<id::id_type> draws(draw_count);
+		for (u32 i{ 0 }; i < draw_count; ++i)
+		{
+			draws[i] = instance_ids[i % instance_ids.size()];
+		}
+
+		// Fewer threads than pools is fine, thread numbers stay below the count the pools were made for
+		for (u32 threads{ 1 }; ; threads = std::min(threads * 2, _thread_count))
+		{
+			// Waits for the compiles in flight before restarting the threads
+			core::task_scheduler().Initialize(threads);
+
+			reset_pools(frame);
+			const auto start{ record_clock::now() };
+			record_chunks(frame, inheritance, viewport, scissor, layout, draws.data(), draw_count);
+			results.emplace_back(recording::record_stats{ draw_count, (u32)_chunk_buffers.size(), threads, elapsed_ms(start) });
+
+			MESSAGE(("Secondary recording: " + std::to_string(draw_count) + " draws, " + std::to_string(threads) + " threads, " +
+				std::to_string(results.back().record_ms) + " ms").c_str());
+
+			if (threads == _thread_count) break;
+		}
+
+		reset_pools(frame);
+		core::task_scheduler().Initialize(_thread_count);
+		return results;
+	}
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include "VulkanCommonHeaders.h"
+
+namespace primal::graphics::vulkan
+{
+	namespace scene { class vulkan_scene; }
+
+	namespace recording
+	{
+		constexpr u32 draws_per_chunk{ 256 };				// Draws recorded into one secondary command buffer
+		constexpr u32 parallel_threshold{ 512 };			// Below this the geometry pass records inline on the render thread
+		constexpr bool run_benchmark{ false };				// Time recording of benchmark_draw_count draws for 1..N threads after the scene is set up
+		constexpr u32 benchmark_draw_count{ 16384 };
+
+		struct record_stats
+		{
+			u32			draw_count;
+			u32			chunk_count;		// Secondary command buffers executed by the primary
+			u32			thread_count;		// Worker threads available to the scheduler, the render thread included
+			f32			record_ms;			// Wall time from splitting the draw list to the last secondary ending
+		};
+
+		// Sort key of a draw, most significant field first. Draws sorted by key group by pass, then pipeline,
+		// then material and mesh, and within a mesh go front to back.
+		constexpr u32 key_depth_bits{ 20 };
+		constexpr u32 key_mesh_bits{ 16 };
+		constexpr u32 key_material_bits{ 12 };
+		constexpr u32 key_pipeline_bits{ 14 };
+		constexpr u32 key_pass_bits{ 2 };
+		static_assert(key_depth_bits + key_mesh_bits + key_material_bits + key_pipeline_bits + key_pass_bits == 64);
+
+		constexpr u32 opaque_pass{ 0 };
+		constexpr u32 radix_parallel_threshold{ 4096 };	// Fewer keys than this are sorted on the calling thread
+
+		// Ids are truncated to their field, which only costs sort quality when ids outgrow it.
+		// depth is the view depth divided by the far plane, values outside [0, 1] are clamped.
+		constexpr u64 make_sort_key(u32 pass, id::id_type pipeline, id::id_type material, id::id_type mesh, f32 depth)
+		{
+			constexpr u64 depth_max{ (u64{ 1 } << key_depth_bits) - 1 };
+			const f32 d{ depth < 0.f ? 0.f : (depth > 1.f ? 1.f : depth) };
+			u64 key{ pass & ((u64{ 1 } << key_pass_bits) - 1) };
+			key = (key << key_pipeline_bits) | (pipeline & ((u64{ 1 } << key_pipeline_bits) - 1));
+			key = (key << key_material_bits) | (material & ((u64{ 1 } << key_material_bits) - 1));
+			key = (key << key_mesh_bits) | (mesh & ((u64{ 1 } << key_mesh_bits) - 1));
+			key = (key << key_depth_bits) | (u64)(d * (f32)depth_max);
+			return key;
+		}
+
+		struct bind_counts
+		{
+			u32			pipeline;
+			u32			descriptor_set;
+			u32			vertex_buffer;		// Vertex and index buffer of a mesh are bound together
+		};
+
+		struct bind_stats
+		{
+			u32			draw_count;			// Before sorting every draw bound all three
+			bind_counts	unsorted;			// Binds needed in scene order with redundant binds skipped
+			bind_counts	sorted;				// Binds actually recorded, per secondary the state starts unbound
+			f32			sort_ms;
+		};
+	}
+
+	// Records the per-instance draws of the geometry pass on the task scheduler's threads. Each thread owns one
+	// command pool per frame in flight, the draw list is split into chunks of recording::draws_per_chunk and every
+	// chunk goes into its own secondary command buffer, executed by the primary in chunk order.
+	class vulkan_draw_recorder
+	{
+	public:
+		vulkan_draw_recorder() = default;
+
+		DISABLE_COPY_AND_MOVE(vulkan_draw_recorder);
+
+		~vulkan_draw_recorder() = default;
+
+		void setup();
+
+		void release();
+
+		// Record instance_ids into secondary command buffers and execute them from primary. The primary must be inside
+		// a render pass begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS. Dynamic state isn't inherited, so
+		// viewport and scissor are set again in every secondary.
+		void record(vulkan_cmd_buffer primary, u32 frame, const VkCommandBufferInheritanceInfo& inheritance, const VkViewport& viewport,
+			const VkRect2D& scissor, VkPipelineLayout layout, const utl::vector<id::id_type>& instance_ids);
+
+		// Build a sort key for every scene draw and radix sort them. The returned ids stay valid until the next call.
+		const utl::vector<id::id_type>& sort_draws(scene::vulkan_scene& current_scene);
+
+		// Record instance_ids inline into primary
+		void record_inline(vulkan_cmd_buffer primary, VkPipelineLayout layout, const utl::vector<id::id_type>& instance_ids);
+
+		// Record draw_count draws (instance_ids repeated) with 1, 2, 4 ... N threads and report the timings.
+		// Nothing is submitted. Uses the pools of frame, the caller must have waited for that frame's fence.
+		utl::vector<recording::record_stats> benchmark(u32 frame, const VkCommandBufferInheritanceInfo& inheritance, const VkViewport& viewport,
+			const VkRect2D& scissor, VkPipelineLayout layout, const utl::vector<id::id_type>& instance_ids, u32 draw_count);
+
+		constexpr void set_enabled(bool enabled) { _enabled = enabled; }
+
+		[[nodiscard]] constexpr bool use_secondary(u32 draw_count) const { return _enabled && !_pools.empty() && draw_count >= recording::parallel_threshold; }
+
+		[[nodiscard]] constexpr const recording::record_stats& get_stats() const { return _stats; }
+
+		[[nodiscard]] constexpr const recording::bind_stats& get_bind_stats() const { return _bind_stats; }
+
+	private:
+		struct thread_pool
+		{
+			VkCommandPool								pool{ VK_NULL_HANDLE };
+			utl::vector<vulkan_cmd_buffer>				buffers;
+			u32											used{ 0 };			// Buffers handed out since the last reset
+		};
+
+		thread_pool& get_pool(u32 frame, u32 thread) { return _pools[frame * _thread_count + thread]; }
+		void reset_pools(u32 frame);
+		void record_chunks(u32 frame, const VkCommandBufferInheritanceInfo& inheritance, const VkViewport& viewport,
+			const VkRect2D& scissor, VkPipelineLayout layout, const id::id_type* const instance_ids, u32 draw_count);
+		void radix_sort(u32 count);
+		void log_bind_stats();
+
+		utl::vector<thread_pool>						_pools;				// frame_buffer_count * _thread_count
+		utl::vector<VkCommandBuffer>					_chunk_buffers;		// Secondary of each chunk, in draw order
+		utl::vector<recording::bind_counts>				_chunk_binds;
+		utl::vector<u64>								_keys[2];			// Radix sort ping-pongs between the two
+		utl::vector<id::id_type>						_sorted_ids[2];
+		utl::vector<u32>								_histograms;		// 256 digit counts per sort block
+		u32												_sorted{ 0 };		// Which of the two holds the sorted draws
+		u32												_thread_count{ 0 };
+		recording::record_stats							_stats{};
+		recording::bind_stats							_bind_stats{};
+		u32												_logged_draw_count{ u32_invalid_id };	// Bind stats are logged when the draw count changes
+		bool											_enabled{ true };
+	};
+}
@@ -14,6 +14,10 @@
 #include "Shaders/ShaderTypes.h"
 #include "VulkanLight.h"
 #include "VulkanTexture.h"
+#include "VulkanSampler.h"
+#include "VulkanProfiler.h"
+#include "VulkanRenderPass.h"
+#include "VulkanHeadless.h"
 
 #include <array>
 #include <random>
@@ -22,90 +26,41 @@ namespace primal::graphics::vulkan
 {
 	namespace
 	{
-		id::id_type createOffscreenTexture(u32 width, u32 height, bool isPosition, bool singleChannel, OUT utl::vector<VkAttachmentDescription>& attach)
-		{
-			/*image_init_info init_info;
-			init_info.width = width;
-			init_info.height = height;
-			init_info.format = singleChannel ? VK_FORMAT_D32_SFLOAT : (isPosition ? VK_FORMAT_R32G32B32A32_SFLOAT : VK_FORMAT_R8G8B8A8_UNORM);
-			init_info.view_aspect_flags = singleChannel ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;*/
-			vulkan_texture tex;// { &init_info, vulkan_texture::type::texture_2D };
-			tex.format = singleChannel ? VK_FORMAT_D32_SFLOAT : (isPosition ? VK_FORMAT_R32G32B32A32_SFLOAT : VK_FORMAT_R8G8B8A8_UNORM);
+		// Position, Normal, Albedo, Specular, Depth
+		constexpr VkFormat gbuffer_formats[5]{ VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_D32_SFLOAT };
 
-			VkImageCreateInfo image{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
-			image.imageType = VK_IMAGE_TYPE_2D;
-			image.extent.height = height;
-			image.extent.width = width;
-			image.extent.depth = 1;
-			image.mipLevels = 1;
-			image.arrayLayers = 1;
-			image.samples = VK_SAMPLE_COUNT_1_BIT;
-			image.tiling = VK_IMAGE_TILING_OPTIMAL;
-			image.format = tex.format;
-			image.flags = 0;
-			image.usage = (singleChannel ? VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT : VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT) | 
-				VK_IMAGE_USAGE_SAMPLED_BIT; // ! VK_IMAGE_USAGE_SAMPLED_BIT use to sample directly from the depth attachment for shadow mapping
-																								// (singleChannel ? VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT : VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT) |
-			VkResult result{ VK_SUCCESS };
-			VkCall(result = vkCreateImage(core::logical_device(), &image, nullptr, &tex.image), "Failed to create GBuffer(shadow mapping) image...");
-			
-			VkMemoryRequirements memReq;
-			vkGetImageMemoryRequirements(core::logical_device(), tex.image, &memReq);
-			VkMemoryAllocateInfo alloc{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
-			alloc.pNext = nullptr;
-			alloc.allocationSize = memReq.size;
-			alloc.memoryTypeIndex = core::find_memory_index(memReq.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-			result = VK_SUCCESS;
-			VkCall(result = vkAllocateMemory(core::logical_device(), &alloc, nullptr, &tex.memory), "Failed to allocate GBuffer(shadow mapping) memory...");
-			result = VK_SUCCESS;
-			VkCall(result = vkBindImageMemory(core::logical_device(), tex.image, tex.memory, 0), "Failed to bind GBuffer(shadow mapping) to memory...");
-
-			VkImageViewCreateInfo imageView{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
-			imageView.pNext = nullptr;
-			imageView.viewType = VK_IMAGE_VIEW_TYPE_2D;
-			imageView.format = tex.format;
-			imageView.subresourceRange.aspectMask = singleChannel ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
-			imageView.subresourceRange.baseMipLevel = 0;
-			imageView.subresourceRange.levelCount = 1;
-			imageView.subresourceRange.baseArrayLayer = 0;
-			imageView.subresourceRange.layerCount = 1;
-			imageView.image = tex.image;
-			result = VK_SUCCESS;
-			VkCall(result = vkCreateImageView(core::logical_device(), &imageView, nullptr, &tex.view), "Failed to create GBuffer(shadow mapping) image view...");
+		// Wrap a G-buffer image owned by the render graph into a texture, the texture only owns the sampler
+		id::id_type createAttachmentTexture(VkImage image, VkImageView view, VkFormat format, u32 width, u32 height)
+		{
+			vulkan_texture tex{};
+			tex.image = image;
+			tex.view = view;
+			tex.memory = nullptr;
+			tex.width = width;
+			tex.height = height;
+			tex.format = format;
 
 			// Create sampler to sample from to depth attachment
 			// Used to sample in the fragment shader for shadowed rendering
-			VkSamplerCreateInfo sampler{ VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
-			sampler.pNext = nullptr;
-			sampler.magFilter = VK_FILTER_LINEAR;
-			sampler.minFilter = VK_FILTER_LINEAR;
-			sampler.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-			sampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-			sampler.addressModeV = sampler.addressModeU;
-			sampler.addressModeW = sampler.addressModeU;
-			sampler.mipLodBias = 0.f;
-			sampler.maxAnisotropy = 1.f;
-			sampler.minLod = 0.f;
-			sampler.maxLod = 1.f;
-			sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-			result = VK_SUCCESS;
-			VkCall(result = vkCreateSampler(core::logical_device(), &sampler, nullptr, &tex.sampler), "Failed to create GBuffer(shadow mapping) image sampler...");
+			tex.sampler = samplers::acquire(samplers::attachment_info());
 
-			VkAttachmentDescription attachDesc{
+			return textures::add(tex);
+		}
+
+		// The render graph transitions the attachments, the render pass keeps them in their attachment layout
+		VkAttachmentDescription attachmentDescription(VkFormat format, VkImageLayout layout)
+		{
+			return {
 				0,
-				tex.format,
+				format,
 				VK_SAMPLE_COUNT_1_BIT,
 				VK_ATTACHMENT_LOAD_OP_CLEAR,
 				VK_ATTACHMENT_STORE_OP_STORE,
 				VK_ATTACHMENT_LOAD_OP_DONT_CARE,
 				VK_ATTACHMENT_STORE_OP_DONT_CARE,
-				VK_IMAGE_LAYOUT_UNDEFINED,
-				singleChannel ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-				};
-
-			attach.emplace_back(attachDesc);
-
-			return textures::add(tex);
+				layout,
+				layout
+			};
 		}
 
 		id::id_type createOffscreenTexture(u32 width, u32 height, bool isPosition, bool singleChannel)
@@ -155,21 +110,7 @@ namespace primal::graphics::vulkan
 
 			// Create sampler to sample from to depth attachment
 			// Used to sample in the fragment shader for shadowed rendering
-			VkSamplerCreateInfo sampler{ VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
-			sampler.pNext = nullptr;
-			sampler.magFilter = VK_FILTER_LINEAR;
-			sampler.minFilter = VK_FILTER_LINEAR;
-			sampler.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-			sampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-			sampler.addressModeV = sampler.addressModeU;
-			sampler.addressModeW = sampler.addressModeU;
-			sampler.mipLodBias = 0.f;
-			sampler.maxAnisotropy = 1.f;
-			sampler.minLod = 0.f;
-			sampler.maxLod = 1.f;
-			sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-			result = VK_SUCCESS;
-			VkCall(result = vkCreateSampler(core::logical_device(), &sampler, nullptr, &tex.sampler), "Failed to create GBuffer(shadow mapping) image sampler...");
+			tex.sampler = samplers::acquire(samplers::attachment_info());
 
 			return textures::add(tex);
 		}
@@ -844,11 +785,17 @@ namespace primal::graphics::vulkan
 	
 	vulkan_geometry_pass::~vulkan_geometry_pass()
 	{
+		_recorder.release();
 		for (auto id : _image_ids)
 		{
+			// Image and view belong to the render graph
+			vulkan_texture& tex{ textures::get_texture(id).getTexture() };
+			tex.image = nullptr;
+			tex.view = nullptr;
 			textures::remove(id);
 		}
 		_image_ids.clear();
+		_graph.release();
 		data::remove_data(data::engine_vulkan_data::vulkan_pipeline_layout, _pipeline_layout_id);
 		data::remove_data(data::engine_vulkan_data::vulkan_descriptor_set_layout, _descriptor_set_layout_id);
 		data::remove_data(data::engine_vulkan_data::vulkan_descriptor_pool, _descriptor_pool_id);
@@ -859,7 +806,6 @@ namespace primal::graphics::vulkan
 	void vulkan_geometry_pass::setSize(u32 width, u32 height) {
 		_width = width;
 		_height = height;
-		vkGetDeviceQueue(core::logical_device(), core::graphics_family_queue_index(), 0, &_graphics_queue);
 	}
 
 	void vulkan_geometry_pass::createUniformBuffer()
@@ -867,36 +813,98 @@ namespace primal::graphics::vulkan
 		
 	}
 
-	void vulkan_geometry_pass::create_semaphore()
+	void vulkan_geometry_pass::build_graph()
 	{
-		VkResult result{ VK_SUCCESS };
-		VkSemaphoreCreateInfo sInfo;
-		sInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-		sInfo.pNext = nullptr;
-		sInfo.flags = 0;
-		VkCall(result = vkCreateSemaphore(core::logical_device(), &sInfo, nullptr, &_signal_semaphore), "Failed to create compute signal semaphore...");
-		VkCall(result = vkCreateSemaphore(core::logical_device(), &sInfo, nullptr, &_wait_semaphore), "Failed to create compute wait semaphore...");
+		using namespace render_graph;
+
+		// The shadow pass caches cascades across frames and transitions its own attachments
+		const pass_handle shadows{ _graph.add_pass("shadow_cascades", queue_type::graphics,
+			[this](vulkan_cmd_buffer& cmd_buffer) {
+				profiler::scope gpu_scope{ cmd_buffer.cmd_buffer, profiler::shadow };
+				_surface->getShadowPass().record(cmd_buffer, _surface->getScene());
+			}) };
+		_graph.set_side_effect(shadows);
+
+		// Commands and counts are rebuilt with the scene, only their accesses are tracked
+		_indirect_draws = _graph.import_buffer("indirect_draws", VK_NULL_HANDLE);
+		const pass_handle cull{ _graph.add_pass("instance_cull", queue_type::graphics,
+			[this](vulkan_cmd_buffer& cmd_buffer) {
+				profiler::scope gpu_scope{ cmd_buffer.cmd_buffer, profiler::instance_cull };
+				_surface->getIndirectPass().cull(cmd_buffer);
+			}) };
+		_graph.write(cull, _indirect_draws, access::transfer_write);
+		_graph.write(cull, _indirect_draws, access::storage_write);
+
+		const char* names[5]{ "gbuffer_position", "gbuffer_normal", "gbuffer_albedo", "gbuffer_specular", "gbuffer_depth" };
+		const pass_handle gbuffer{ _graph.add_pass("gbuffer", queue_type::graphics,
+			[this](vulkan_cmd_buffer& cmd_buffer) {
+				profiler::scope gpu_scope{ cmd_buffer.cmd_buffer, profiler::gbuffer };
+				record_gbuffer(cmd_buffer);
+			}) };
+		_graph.read(gbuffer, _indirect_draws, access::indirect_read);
+		for (u32 i{ 0 }; i < 5; ++i)
+		{
+			_attachments[i] = _graph.create_image(names[i], { _width, _height, gbuffer_formats[i], 0 });
+			_graph.write(gbuffer, _attachments[i], i < 4 ? access::color_attachment : access::depth_attachment);
+		}
+
+		// Tile frustums and light culling run on the compute queue while the next frame's shadows may still be drawn
+		const auto import_buffer = [this](const char* name, id::id_type buffer_id) {
+			return _graph.import_buffer(name, data::get_data<data::vulkan_buffer>(buffer_id).cpu_address);
+		};
+		_frustums = import_buffer("tile_frustums", compute::get_output_buffer_id());
+		_light_index_counter = import_buffer("light_index_counter", compute::culling_light_index_counter());
+		_light_grid = import_buffer("light_grid", compute::culling_light_grid());
+		_light_list = import_buffer("light_list", compute::culling_light_list());
+
+		const pass_handle frustums{ _graph.add_pass("tile_frustums", queue_type::async_compute,
+			[](vulkan_cmd_buffer& cmd_buffer) {
+				profiler::scope gpu_scope{ cmd_buffer.cmd_buffer, profiler::frustum };
+				compute::record_frustums(cmd_buffer);
+			}) };
+		_graph.write(frustums, _frustums, access::storage_write);
+
+		const pass_handle light_culling{ _graph.add_pass("light_culling", queue_type::async_compute,
+			[](vulkan_cmd_buffer& cmd_buffer) {
+				profiler::scope gpu_scope{ cmd_buffer.cmd_buffer, profiler::light_culling };
+				compute::record_light_culling(cmd_buffer);
+			}) };
+		_graph.read(light_culling, _attachments[4], access::depth_read_compute);
+		_graph.read(light_culling, _frustums, access::storage_read);
+		_graph.write(light_culling, _light_index_counter, access::transfer_write);
+		_graph.write(light_culling, _light_index_counter, access::storage_write);
+		_graph.write(light_culling, _light_grid, access::storage_write);
+		_graph.write(light_culling, _light_list, access::storage_write);
+
+		// Composition draws into the swapchain image, whose layouts the surface's render pass takes care of.
+		// Nothing in the graph reads what it writes, so it's kept as a side effect.
+		const pass_handle composition{ _graph.add_pass("composition", queue_type::graphics,
+			[this](vulkan_cmd_buffer& cmd_buffer) {
+				profiler::scope gpu_scope{ cmd_buffer.cmd_buffer, profiler::composition };
+				record_composition(cmd_buffer);
+			}) };
+		for (u32 i{ 0 }; i < 4; ++i)
+			_graph.read(composition, _attachments[i], access::sampled_fragment);
+		_graph.read(composition, _frustums, access::storage_read_fragment);
+		_graph.read(composition, _light_grid, access::storage_read_fragment);
+		_graph.read(composition, _light_list, access::storage_read_fragment);
+		_graph.set_side_effect(composition);
+
+		// The G-buffer is consumed inside the graph now, no attachment outlives the frame
+		_graph.compile();
 	}
 
 	void vulkan_geometry_pass::setupRenderpassAndFramebuffer()
 	{
-		utl::vector<VkAttachmentDescription>	attachmentDescs;
-
-		// Position
-		_image_ids.emplace_back(createOffscreenTexture(_width, _height, true, false, attachmentDescs));
-
-		// Normal
-		_image_ids.emplace_back(createOffscreenTexture(_width, _height, false, false, attachmentDescs));
-
-		// Albedo
-		_image_ids.emplace_back(createOffscreenTexture(_width, _height, false, false, attachmentDescs));
-
-		// Specular
-		_image_ids.emplace_back(createOffscreenTexture(_width, _height, false, false, attachmentDescs));
+		build_graph();
 
-		// Depth
-		_image_ids.emplace_back(createOffscreenTexture(_width, _height, false, true, attachmentDescs));
+		utl::vector<VkAttachmentDescription>	attachmentDescs;
 
+		for (u32 i{ 0 }; i < 5; ++i)
+		{
+			_image_ids.emplace_back(createAttachmentTexture(_graph.get_image(_attachments[i]), _graph.get_image_view(_attachments[i]), gbuffer_formats[i], _width, _height));
+			attachmentDescs.emplace_back(attachmentDescription(gbuffer_formats[i], i < 4 ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL));
+		}
 
 		utl::vector<VkAttachmentReference> colorReferences;
 		colorReferences.push_back({ 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
@@ -920,33 +928,15 @@ namespace primal::graphics::vulkan
 		subpass.preserveAttachmentCount = 0;
 		subpass.pResolveAttachments = nullptr;
 
-		utl::vector<VkSubpassDependency> dependencies;
-		dependencies.resize(2);
-
-		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-		dependencies[0].dstSubpass = 0;
-		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-		dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-		dependencies[1].srcSubpass = 0;
-		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-		dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
 		VkRenderPassCreateInfo renderPassInfo = {};
 		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
 		renderPassInfo.pAttachments = attachmentDescs.data();
 		renderPassInfo.attachmentCount = static_cast<uint32_t>(attachmentDescs.size());
 		renderPassInfo.subpassCount = 1;
 		renderPassInfo.pSubpasses = &subpass;
-		renderPassInfo.dependencyCount = 2;
-		renderPassInfo.pDependencies = dependencies.data();
+		// No external dependencies, the render graph's barriers order the pass against what comes before and after
+		renderPassInfo.dependencyCount = 0;
+		renderPassInfo.pDependencies = nullptr;
 
 		_renderpass_id = data::create_data(data::engine_vulkan_data::vulkan_renderpass, static_cast<void*>(&renderPassInfo), 0);
 
@@ -1022,21 +1012,9 @@ namespace primal::graphics::vulkan
 
 	void vulkan_geometry_pass::create_command_buffer()
 	{
-		_cmd_buffers.resize(3);
-		_draw_fences.resize(3);
-		
-		_fences_in_flight = (vulkan_fence**)malloc(sizeof(vulkan_fence) * 3);
-
-		for (u32 i{ 0 }; i < 3; ++i)
-		{
-			if (_cmd_buffers[i].cmd_buffer)
-				free_cmd_buffer(core::logical_device(), core::get_current_command_pool(), _cmd_buffers[i]);
-
-			// TODO: hardcoded to true for now... 
-			_cmd_buffers[i] = allocate_cmd_buffer(core::logical_device(), core::get_current_command_pool(), true);
-			create_fence(core::logical_device(), true, _draw_fences[i]);
-			_fences_in_flight[i] = 0;
-		}
+		// Command buffers are owned by the render graph, one set per frame. The frame's fence is the surface's.
+		_recorder.release();
+		_recorder.setup();
 	}
 
 	void vulkan_geometry_pass::runRenderpass(vulkan_cmd_buffer cmd_buffer, vulkan_surface * surface)
@@ -1083,48 +1061,16 @@ namespace primal::graphics::vulkan
 
 	void vulkan_geometry_pass::run(vulkan_surface * surface)
 	{
-		// Are we currently recreating the swapchain?
-		if (surface->is_recreating())
-		{
-			VkResult result{ vkDeviceWaitIdle(core::logical_device()) };
-			if (!vulkan_success(result))
-			{
-				MESSAGE("begin_frame() [1] vkDeviceWaitIdle failed...");
-				return;
-			}
-			MESSAGE("Resizing swapchain");
-			return;
-		}
-
-		// Did the window resize?
-		if (surface->is_resized())
-		{
-			VkResult result{ vkDeviceWaitIdle(core::logical_device()) };
-			if (!vulkan_success(result))
-			{
-				MESSAGE("begin_frame() [2] vkDeviceWaitIdle failed...");
-				return;
-			}
-
-			if (!surface->recreate_swapchain())
-				return;
-
-			MESSAGE("Resized");
-			return;
-		}
-
-		u32 frame{ surface->current_frame() };
-
-		if (!wait_for_fence(core::logical_device(), _draw_fences[frame], std::numeric_limits<u64>::max()))
-		{
-			MESSAGE("Draw fence wait failere...");
-			
-		}
+		// Shadow cascades, GPU culling, the G-buffer, light culling and composition, with the barriers between them.
+		// The caller has waited for this frame's last submit and acquired the swapchain image.
+		_surface = surface;
+		_graph.record(surface->current_frame());
+	}
 
-		// Begin recording commands
-		vulkan_cmd_buffer& cmd_buffer{ _cmd_buffers[frame]};
-		reset_cmd_buffer(cmd_buffer);
-		begin_cmd_buffer(cmd_buffer, true, false, false);
+	void vulkan_geometry_pass::record_gbuffer(vulkan_cmd_buffer& cmd_buffer)
+	{
+		vulkan_surface* const surface{ _surface };
+		const u32 frame{ surface->current_frame() };
 
 		// Clear values for all attachments written in the fragment shader
 		std::vector<VkClearValue> clearValues(5);
@@ -1159,113 +1105,101 @@ namespace primal::graphics::vulkan
 		scissor.offset.y = 0;
 		vkCmdSetScissor(cmd_buffer.cmd_buffer, 0, 1, &scissor);
 
-		vkCmdBeginRenderPass(cmd_buffer.cmd_buffer, &info, VK_SUBPASS_CONTENTS_INLINE);
+		// Per-instance draws are sorted by state to skip redundant binds. Large draw lists are split over the worker
+		// threads, the render pass then only executes secondaries.
+		const bool indirect{ surface->getIndirectPass().is_ready() };
+		const utl::vector<id::id_type>& instance_ids{ indirect ? surface->getScene().getInstanceIDs() : _recorder.sort_draws(surface->getScene()) };
+		const bool secondary{ !indirect && _recorder.use_secondary((u32)instance_ids.size()) };
 
-		surface->getScene().flushBuffer(cmd_buffer, data::get_data<VkPipelineLayout>(_pipeline_layout_id));
+		vkCmdBeginRenderPass(cmd_buffer.cmd_buffer, &info, secondary ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
 
-		vkCmdEndRenderPass(cmd_buffer.cmd_buffer);
+		if (indirect)
+		{
+			surface->getIndirectPass().draw(cmd_buffer);
+		}
+		else if (secondary)
+		{
+			VkCommandBufferInheritanceInfo inheritance{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+			inheritance.pNext = nullptr;
+			inheritance.renderPass = info.renderPass;
+			inheritance.subpass = 0;
+			inheritance.framebuffer = info.framebuffer;
+			inheritance.pipelineStatistics = profiler::inherited_statistics();
+			_recorder.record(cmd_buffer, frame, inheritance, viewport, scissor, data::get_data<VkPipelineLayout>(_pipeline_layout_id), instance_ids);
+		}
+		else
+		{
+			_recorder.record_inline(cmd_buffer, data::get_data<VkPipelineLayout>(_pipeline_layout_id), instance_ids);
+		}
 
-		end_cmd_buffer(cmd_buffer);
+		vkCmdEndRenderPass(cmd_buffer.cmd_buffer);
 	}
 
-	void vulkan_geometry_pass::submit(vulkan_surface * surface)
+	void vulkan_geometry_pass::record_composition(vulkan_cmd_buffer& cmd_buffer)
 	{
-		u32 frame{ surface->current_frame() };
-
-		// Make sure the previous frame is not using this image
-		if (_fences_in_flight[frame] != VK_NULL_HANDLE)
-			wait_for_fence(core::logical_device(), *_fences_in_flight[frame], std::numeric_limits<u64>::max());
-
-		// Mark the fence as in use by this frame
-		_fences_in_flight[frame] = &_draw_fences[frame];
-
-		// Reset the femce for use in next frame
-		reset_fence(core::logical_device(), _draw_fences[frame]);
-
-		// Begin recording commands
-		vulkan_cmd_buffer& cmd_buffer{ _cmd_buffers[frame] };
-		VkSubmitInfo submitInfo;
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.pNext = nullptr;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &cmd_buffer.cmd_buffer;
-		submitInfo.waitSemaphoreCount = 0;
-		submitInfo.pWaitSemaphores = nullptr;
-		submitInfo.signalSemaphoreCount = 1;
-		submitInfo.pSignalSemaphores = &_signal_semaphore;
-		VkPipelineStageFlags flags[4]{ VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT ,VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT };
-		submitInfo.pWaitDstStageMask = flags;
-		VkResult result{ VK_SUCCESS };
-		VkCall(result = vkQueueSubmit(_graphics_queue, 1, &submitInfo, _draw_fences[frame].fence), "Failed to submit compute queue...");
-
-		update_cmd_buffer_submitted(cmd_buffer);
-	}
+		vulkan_surface* const surface{ _surface };
 
-	bool vulkan_geometry_pass::create_fence(VkDevice device, bool signaled, vulkan_fence& fence)
-	{
-		fence.signaled = signaled;
+		VkViewport viewport{};
+		viewport.x = 0.0f;
+		viewport.y = (f32)surface->height();
+		viewport.width = (f32)surface->width();
+		viewport.height = (f32)surface->height() * -1.f;
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
 
-		VkFenceCreateInfo f_info{ VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
-		if (signaled)
-			f_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;	// this ensures the fence starts signaled as open
+		VkRect2D scissor{};
+		scissor.offset.x = 0;
+		scissor.offset.y = 0;
+		scissor.extent.width = surface->width();
+		scissor.extent.height = surface->height();
 
-		VkResult result{ VK_SUCCESS };
-		VkCall(result = vkCreateFence(device, &f_info, nullptr, &fence.fence), "Failed to create fence");
-		if (result != VK_SUCCESS) return false;
+		vkCmdSetViewport(cmd_buffer.cmd_buffer, 0, 1, &viewport);
+		vkCmdSetScissor(cmd_buffer.cmd_buffer, 0, 1, &scissor);
 
-		return true;
-	}
+		surface->set_renderpass_render_area({ 0, 0, surface->width(), surface->height() });
+		surface->set_renderpass_depth(1.0f);
+		surface->set_renderpass_stencil(0);
+		surface->set_renderpass_clear_color({ 0.0f, 0.0f, 0.0f, 0.0f });
 
-	void vulkan_geometry_pass::destroy_fence(VkDevice device, vulkan_fence& fence)
-	{
-		vkDestroyFence(device, fence.fence, nullptr);
-		fence.fence = nullptr;
-		fence.signaled = false;
+		renderpass::begin_renderpass(cmd_buffer.cmd_buffer, cmd_buffer.cmd_state, surface->renderpass(), surface->current_framebuffer());
+		surface->getFinalPass().render(cmd_buffer);
+		renderpass::end_renderpass(cmd_buffer.cmd_buffer, cmd_buffer.cmd_state, surface->renderpass());
+
+		if (surface->is_headless())
+			headless::record_readback(cmd_buffer.cmd_buffer, surface->current_image(), surface->image_format(), surface->width(), surface->height());
 	}
 
-	bool vulkan_geometry_pass::wait_for_fence(VkDevice device, vulkan_fence& fence, u64 timeout)
+	utl::vector<recording::record_stats> vulkan_geometry_pass::benchmark_recording(vulkan_surface* surface, u32 draw_count)
 	{
-		if (!fence.signaled)
-		{
-			VkResult result{ vkWaitForFences(device, 1, &fence.fence, true, timeout) };
-			switch (result)
-			{
-			case VK_SUCCESS:
-				fence.signaled = true;
-				return true;
-				break;
-			case VK_TIMEOUT:
-				MESSAGE("Fence timed out...");
-				break;
-			case VK_ERROR_OUT_OF_HOST_MEMORY:
-				MESSAGE("Out of host memory error on fence wait...");
-				break;
-			case VK_ERROR_OUT_OF_DEVICE_MEMORY:
-				MESSAGE("Out of host device error on fence wait...");
-				break;
-			case VK_ERROR_DEVICE_LOST:
-				MESSAGE("Device lost error on fence wait...");
-				break;
-			default:
-				MESSAGE("Unknown error on fence wait...");
-				break;
-			}
-		}
-		else
-		{
-			return true;
-		}
+		VkCommandBufferInheritanceInfo inheritance{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+		inheritance.pNext = nullptr;
+		inheritance.renderPass = data::get_data<VkRenderPass>(_renderpass_id);
+		inheritance.subpass = 0;
+		inheritance.framebuffer = data::get_data<VkFramebuffer>(_framebuffer_id);
+
+		VkViewport viewport;
+		viewport.x = 0.0f;
+		viewport.y = (f32)surface->height();
+		viewport.width = (f32)surface->width();
+		viewport.height = (f32)surface->height() * -1.f;
+		viewport.minDepth = 0.f;
+		viewport.maxDepth = 1.f;
 
-		return false;
+		VkRect2D scissor;
+		scissor.extent.height = _height;
+		scissor.extent.width = _width;
+		scissor.offset.x = 0;
+		scissor.offset.y = 0;
+
+		// Runs while the surface is set up, nothing has been submitted with this frame's pools yet
+		const u32 frame{ surface->current_frame() };
+		return _recorder.benchmark(frame, inheritance, viewport, scissor, data::get_data<VkPipelineLayout>(_pipeline_layout_id),
+			surface->getScene().getInstanceIDs(), draw_count);
 	}
 
-	void vulkan_geometry_pass::reset_fence(VkDevice device, vulkan_fence& fence)
+	void vulkan_geometry_pass::submit(vulkan_surface * surface, const render_graph::frame_sync& sync)
 	{
-		if (fence.signaled)
-		{
-			VkCall(vkResetFences(device, 1, &fence.fence), "Failed to reset fence...");
-			fence.signaled = false;
-		}
+		_graph.submit(surface->current_frame(), sync);
 	}
 
 	vulkan_final_pass::~vulkan_final_pass()
@@ -1275,9 +1209,11 @@ namespace primal::graphics::vulkan
 		data::remove_data(data::engine_vulkan_data::vulkan_descriptor_sets, _descriptorSet_id);
 		data::remove_data(data::engine_vulkan_data::vulkan_descriptor_set_layout, _descriptorSet_layout_id);
 		data::remove_data(data::engine_vulkan_data::vulkan_descriptor_pool, _descriptor_pool_id);
+		samplers::release(_attachment_sampler);
+		samplers::release(_shadow_sampler);
 	}
 
-	void vulkan_final_pass::setupDescriptorSets(utl::vector<id::id_type> image_id, id::id_type ubo_id)
+	void vulkan_final_pass::setupDescriptorSets(utl::vector<id::id_type> image_id, id::id_type ubo_id, id::id_type shadow_map_id, id::id_type cascade_buffer_id)
 	{
 		std::vector<VkDescriptorPoolSize> poolSize = {
 			Engine_Descriptor_Pool_Size(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, frame_buffer_count * 3),
@@ -1295,10 +1231,20 @@ namespace primal::graphics::vulkan
 		poolInfo.maxSets = static_cast<u32>(image_id.size()) + 10;
 		_descriptor_pool_id = data::create_data(data::engine_vulkan_data::vulkan_descriptor_pool, static_cast<void*>(&poolInfo), 0);
 
+		// The G-buffer and shadow map always sample the same way, their samplers are baked into the layout
+		samplers::release(_attachment_sampler);
+		samplers::release(_shadow_sampler);
+		_attachment_sampler = samplers::acquire(samplers::attachment_info());
+		_shadow_sampler = samplers::acquire(samplers::shadow_info());
+		std::array<VkSampler, 4> attachment_samplers;
+		attachment_samplers.fill(_attachment_sampler);
+
 		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings{
 			descriptor::descriptorSetLayoutBinding(0, VK_SHADER_STAGE_FRAGMENT_BIT, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER),
-			descriptor::descriptorSetLayoutBinding(1, VK_SHADER_STAGE_FRAGMENT_BIT, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, nullptr, 4),
+			descriptor::descriptorSetLayoutBinding(1, VK_SHADER_STAGE_FRAGMENT_BIT, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, attachment_samplers.data(), 4),
 			descriptor::descriptorSetLayoutBinding(2, VK_SHADER_STAGE_FRAGMENT_BIT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER),
+			descriptor::descriptorSetLayoutBinding(3, VK_SHADER_STAGE_FRAGMENT_BIT, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER),
+			descriptor::descriptorSetLayoutBinding(4, VK_SHADER_STAGE_FRAGMENT_BIT, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &_shadow_sampler),
 		};
 
 		VkDescriptorSetLayoutCreateInfo descriptorLayout = descriptor::descriptorSetLayoutCreate(setLayoutBindings);
@@ -1359,7 +1305,7 @@ namespace primal::graphics::vulkan
 			VkDescriptorImageInfo imageInfo4;
 			imageInfo4.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL; //VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
 			imageInfo4.imageView = textures::get_texture(image_id[j]).getTexture().view;
-			imageInfo4.sampler = textures::get_texture(image_id[j]).getTexture().sampler;
+			imageInfo4.sampler = VK_NULL_HANDLE;		// Immutable
 			imageInfos4.emplace_back(imageInfo4);
 			//descriptorWrites.emplace_back(descriptor::setWriteDescriptorSet(VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, data::get_data<VkDescriptorSet>(_descriptorSet_id), count, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &imageInfo4));
 			//count++;
@@ -1378,6 +1324,19 @@ namespace primal::graphics::vulkan
 		outInfo.range = buffer.size;
 		descriptorWrites.emplace_back(descriptor::setWriteDescriptorSet(VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, data::get_data<VkDescriptorSet>(_descriptorSet_id), 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &outInfo));
 
+		VkDescriptorBufferInfo cascadeInfo;
+		auto cascade = data::get_data<data::vulkan_buffer>(cascade_buffer_id);
+		cascadeInfo.buffer = cascade.cpu_address;
+		cascadeInfo.offset = 0;
+		cascadeInfo.range = sizeof(glsl::ShadowCascadeData);
+		descriptorWrites.emplace_back(descriptor::setWriteDescriptorSet(VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, data::get_data<VkDescriptorSet>(_descriptorSet_id), 3, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &cascadeInfo));
+
+		VkDescriptorImageInfo shadowInfo;
+		shadowInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		shadowInfo.imageView = textures::get_texture(shadow_map_id).getTexture().view;
+		shadowInfo.sampler = VK_NULL_HANDLE;
+		descriptorWrites.emplace_back(descriptor::setWriteDescriptorSet(VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, data::get_data<VkDescriptorSet>(_descriptorSet_id), 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &shadowInfo));
+
 		/*VkDescriptorBufferInfo lightgridInfo;
 		auto lightgrid = data::get_data<data::vulkan_buffer>(compute::culling_light_grid());
 		lightgridInfo.buffer = lightgrid.cpu_address;
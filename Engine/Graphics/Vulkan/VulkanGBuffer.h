@@ -1,6 +1,8 @@
 #pragma once
 #include "VulkanCommonHeaders.h"
 #include "VulkanShader.h"
+#include "VulkanDrawRecorder.h"
+#include "VulkanRenderGraph.h"
 
 namespace primal::graphics::vulkan
 {
@@ -21,8 +23,6 @@ namespace primal::graphics::vulkan
 
 		void createUniformBuffer();
 
-		void create_semaphore();
-
 		void setupRenderpassAndFramebuffer();
 
 		void setupPoolAndLayout();
@@ -33,7 +33,8 @@ namespace primal::graphics::vulkan
 
 		void run(vulkan_surface* surface);
 
-		void submit(vulkan_surface * surface);
+		// The last submit of the frame waits on sync's semaphores and signals its semaphores and fence
+		void submit(vulkan_surface * surface, const render_graph::frame_sync& sync);
 
 
 		[[nodiscard]] utl::vector<id::id_type> getTexture() { return _image_ids; }
@@ -50,7 +51,12 @@ namespace primal::graphics::vulkan
 
 		[[nodiscard]] constexpr id::id_type getPipelineLayout() { return _pipeline_layout_id; }
 
-		[[nodiscard]] constexpr VkSemaphore const get_signal_semaphore() const { return _signal_semaphore; }
+		[[nodiscard]] constexpr vulkan_draw_recorder& getDrawRecorder() { return _recorder; }
+
+		[[nodiscard]] constexpr const vulkan_render_graph& getRenderGraph() const { return _graph; }
+
+		// Time secondary command buffer recording of draw_count scene draws for 1..N threads
+		utl::vector<recording::record_stats> benchmark_recording(vulkan_surface* surface, u32 draw_count);
 
 	private:
 		u32												_width;
@@ -61,21 +67,25 @@ namespace primal::graphics::vulkan
 		id::id_type										_descriptor_set_layout_id;
 		id::id_type										_light_descriptor_set_layout_id;
 		id::id_type										_pipeline_layout_id;
-		VkSemaphore										_signal_semaphore;
-		VkSemaphore										_wait_semaphore;
-		VkQueue											_graphics_queue;
-
-		utl::vector<vulkan_cmd_buffer>					_cmd_buffers;
-		utl::vector<vulkan_fence>						_draw_fences;
-		vulkan_fence**									_fences_in_flight;
+		vulkan_draw_recorder							_recorder;
+
+		// The whole frame: shadows, instance culling, the G-buffer, light culling and composition.
+		// The graph owns the G-buffer images and the command buffers.
+		vulkan_render_graph								_graph;
+		render_graph::resource_handle					_attachments[5];
+		render_graph::resource_handle					_indirect_draws;
+		render_graph::resource_handle					_frustums;
+		render_graph::resource_handle					_light_index_counter;
+		render_graph::resource_handle					_light_grid;
+		render_graph::resource_handle					_light_list;
+		vulkan_surface*									_surface{ nullptr };	// Surface of the frame being recorded
 
 		// Output
 		utl::vector<id::id_type>						_image_ids;
 	private:
-		void reset_fence(VkDevice device, vulkan_fence& fence);
-		bool wait_for_fence(VkDevice device, vulkan_fence& fence, u64 timeout);
-		void destroy_fence(VkDevice device, vulkan_fence& fence);
-		bool create_fence(VkDevice device, bool signaled, vulkan_fence& fence);
+		void build_graph();
+		void record_gbuffer(vulkan_cmd_buffer& cmd_buffer);
+		void record_composition(vulkan_cmd_buffer& cmd_buffer);
 	};
 
 	class vulkan_final_pass
@@ -93,7 +103,7 @@ namespace primal::graphics::vulkan
 
 		void create_semaphore();
 
-		void setupDescriptorSets(utl::vector<id::id_type> image_id, id::id_type ubo_id);
+		void setupDescriptorSets(utl::vector<id::id_type> image_id, id::id_type ubo_id, id::id_type shadow_map_id, id::id_type cascade_buffer_id);
 
 		void setupPipeline(vulkan_renderpass renderpass);
 
@@ -108,6 +118,8 @@ namespace primal::graphics::vulkan
 		id::id_type										_descriptorSet_layout_id;
 		id::id_type										_pipeline_layout_id;
 		id::id_type										_light_descriptor_set_layout_id;
+		VkSampler										_attachment_sampler{ VK_NULL_HANDLE };	// Immutable samplers of the layout
+		VkSampler										_shadow_sampler{ VK_NULL_HANDLE };
 	};
 
 
@@ -0,0 +1,545 @@
+#include "VulkanHeadless.h"
+#include "VulkanCore.h"
+#include "VulkanCamera.h"
+#include "VulkanHelpers.h"
+#include "VulkanPipelineCompiler.h"
+#include "VulkanProfiler.h"
+#include "VulkanClusterCull.h"
+#include "VulkanContent.h"
+#include "VulkanTextureStreaming.h"
+#include "VulkanShadow.h"
+#include "VulkanIndirect.h"
+#include "Components/Transform.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace primal::graphics::vulkan::headless
+{
+	namespace
+	{
+		using frame_clock = std::chrono::high_resolution_clock;
+
+		struct frame_timing
+		{
+			f32					cpu_ms;			// render_surface() from start to return
+			f32					frame_ms;		// Start of the previous frame to the start of this one
+			u32					pipelines_pending;	// Background compiles not done when the frame ended
+			f32					gpu_ms[profiler::pass::count];	// Latest GPU time of each pass, a few frames behind this one
+			u32					meshlets;		// Meshlets tested by the meshlet culling and the ones it kept
+			u32					visible_meshlets;
+			u64					triangles;
+			u64					visible_triangles;
+			u64					streamed_bytes;	// Streamed texture mips resident at the end of the frame
+			u32					pending_reads;	// Texture reads the I/O thread hadn't finished
+			f32					shadow_cull_ms;	// CPU time of the shadow cascades, summed over the cascades
+			f32					shadow_record_ms;
+			u32					shadow_static_renders;	// Cascades that rendered their static cache again
+			u32					shadow_skipped;			// Cascades that kept the last frame's depth
+		};
+
+		// Upper edges of the frame time histogram in ms, the last bucket takes everything above
+		constexpr f32			histogram_edges[]{ 4.f, 8.f, 16.7f, 33.3f, 50.f, 100.f };
+		constexpr f32			hitch_factor{ 2.f };	// Frames longer than this times the median count as hitches
+
+		struct readback_image
+		{
+			VkBuffer			buffer{ VK_NULL_HANDLE };
+			VkDeviceMemory		memory{ VK_NULL_HANDLE };
+			VkFormat			format{ VK_FORMAT_UNDEFINED };
+			u32					width{ 0 };
+			u32					height{ 0 };
+			bool				recorded{ false };
+		};
+
+		config							settings{};
+		std::vector<camera_key>			camera_path;
+		std::string						timing_csv;
+		std::string						profile_csv;
+		std::string						readback_file;
+		std::string						golden_file;
+		bool							enabled{ false };
+		bool							finished{ false };
+		u32								frame{ 0 };			// Frames begun so far
+		frame_clock::time_point			frame_start{};
+		frame_clock::time_point			previous_start{};
+		std::vector<frame_timing>		timings;
+		readback_image					readback{};
+		result							run_result{};
+
+		f32 elapsed_ms(frame_clock::time_point start, frame_clock::time_point end)
+		{
+			return std::chrono::duration<f32, std::milli>(end - start).count();
+		}
+
+		math::v3 lerp(const math::v3& a, const math::v3& b, f32 t)
+		{
+			return { a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t };
+		}
+
+		void move_camera(camera_id camera, f32 time)
+		{
+			if (camera_path.empty() || !id::is_valid(camera)) return;
+
+			// Last key at or before time, the camera holds the first and last pose outside the path
+			u32 key{ 0 };
+			while (key + 1 < camera_path.size() && camera_path[key + 1].time <= time) ++key;
+			const camera_key& k0{ camera_path[key] };
+			const camera_key& k1{ camera_path[std::min(key + 1, (u32)camera_path.size() - 1)] };
+			const f32 span{ k1.time - k0.time };
+			const f32 t{ span > 0.f ? std::clamp((time - k0.time) / span, 0.f, 1.f) : 0.f };
+
+			const math::v3 rotation{ lerp(k0.rotation, k1.rotation, t) };
+			using namespace DirectX;
+			transform::component_cache cache{};
+			XMStoreFloat4(&cache.rotation, XMQuaternionRotationRollPitchYawFromVector(XMLoadFloat3(&rotation)));
+			cache.position = lerp(k0.position, k1.position, t);
+			cache.id = transform::transform_id{ graphics::vulkan::camera::get(camera).entity_id() };
+			cache.flags = transform::component_flags::rotation | transform::component_flags::position;
+			transform::update(&cache, 1);
+		}
+
+		void release_readback()
+		{
+			if (readback.buffer) vkDestroyBuffer(core::logical_device(), readback.buffer, nullptr);
+			if (readback.memory) vkFreeMemory(core::logical_device(), readback.memory, nullptr);
+			readback = {};
+		}
+
+		// RGB8 rows, top to bottom
+		std::vector<u8> readback_pixels()
+		{
+			std::vector<u8> rgb((size_t)readback.width * readback.height * 3);
+			void* data{ nullptr };
+			VkResult result{ VK_SUCCESS };
+			VkCall(result = vkMapMemory(core::logical_device(), readback.memory, 0, VK_WHOLE_SIZE, 0, &data), "Failed to map headless readback buffer...");
+			if (result != VK_SUCCESS) return {};
+
+			const bool bgra{ readback.format == VK_FORMAT_B8G8R8A8_UNORM || readback.format == VK_FORMAT_B8G8R8A8_SRGB };
+			const u8* const src{ (const u8*)data };
+			for (size_t i{ 0 }, count{ (size_t)readback.width * readback.height }; i < count; ++i)
+			{
+				rgb[i * 3 + 0] = src[i * 4 + (bgra ? 2 : 0)];
+				rgb[i * 3 + 1] = src[i * 4 + 1];
+				rgb[i * 3 + 2] = src[i * 4 + (bgra ? 0 : 2)];
+			}
+			vkUnmapMemory(core::logical_device(), readback.memory);
+			return rgb;
+		}
+
+		bool write_ppm(const std::string& file, u32 width, u32 height, const std::vector<u8>& rgb)
+		{
+			std::ofstream out{ file, std::ios::out | std::ios::binary };
+			if (!out) return false;
+			out << "P6\n" << width << ' ' << height << "\n255\n";
+			out.write((const char*)rgb.data(), rgb.size());
+			return (bool)out;
+		}
+
+		bool read_ppm(const std::string& file, u32& width, u32& height, std::vector<u8>& rgb)
+		{
+			std::ifstream in{ file, std::ios::in | std::ios::binary };
+			std::string magic;
+			u32 max_value{ 0 };
+			if (!(in >> magic >> width >> height >> max_value) || magic != "P6" || max_value != 255) return false;
+			in.get();		// Single whitespace before the pixels
+			rgb.resize((size_t)width * height * 3);
+			return (bool)in.read((char*)rgb.data(), rgb.size());
+		}
+
+		void compare_golden(const std::vector<u8>& rgb)
+		{
+			u32 width{ 0 }, height{ 0 };
+			std::vector<u8> golden;
+			if (!read_ppm(golden_file, width, height, golden))
+			{
+				MESSAGE(("Headless: can't read golden image " + golden_file).c_str());
+				return;
+			}
+			if (width != readback.width || height != readback.height)
+			{
+				MESSAGE(("Headless: golden image is " + std::to_string(width) + "x" + std::to_string(height) + ", rendered " +
+					std::to_string(readback.width) + "x" + std::to_string(readback.height)).c_str());
+				return;
+			}
+
+			u64 sum{ 0 };
+			for (size_t i{ 0 }; i < rgb.size(); ++i)
+			{
+				const s32 d{ (s32)rgb[i] - (s32)golden[i] };
+				sum += (u64)(d * d);
+			}
+			run_result.golden_rms = std::sqrt((f32)sum / (f32)rgb.size());
+			run_result.golden_passed = run_result.golden_rms <= settings.golden_tolerance;
+			MESSAGE(("Headless: golden image RMS " + std::to_string(run_result.golden_rms) + (run_result.golden_passed ? " passed" : " FAILED")).c_str());
+		}
+
+		// Whether the streamed mips stayed within config::texture_budget for the whole run
+		bool budget_kept(u64 peak_streamed_bytes)
+		{
+			return !settings.texture_budget || !texture_streaming::is_active() || peak_streamed_bytes <= settings.texture_budget;
+		}
+
+		void write_timings()
+		{
+			if (timings.empty()) return;
+
+			std::vector<f32> frame_ms(timings.size());
+			f32 sum{ 0.f };
+			u64 triangles{ 0 }, visible_triangles{ 0 };
+			for (size_t i{ 0 }; i < timings.size(); ++i)
+			{
+				frame_ms[i] = timings[i].frame_ms;
+				sum += frame_ms[i];
+				triangles += timings[i].triangles;
+				visible_triangles += timings[i].visible_triangles;
+			}
+			std::sort(frame_ms.begin(), frame_ms.end());
+			run_result.frame_count = (u32)timings.size();
+			run_result.average_ms = sum / (f32)timings.size();
+			run_result.median_ms = frame_ms[frame_ms.size() / 2];
+			run_result.p95_ms = frame_ms[std::min(frame_ms.size() - 1, frame_ms.size() * 95 / 100)];
+			run_result.max_ms = frame_ms.back();
+			run_result.hitch_count = (u32)(frame_ms.end() - std::upper_bound(frame_ms.begin(), frame_ms.end(), run_result.median_ms * hitch_factor));
+			run_result.culled_triangle_fraction = triangles ? 1.f - (f32)((double)visible_triangles / (double)triangles) : 0.f;
+			u64 peak_streamed_bytes{ 0 };
+			run_result.shadow_static_renders = run_result.shadow_skipped = 0;
+			for (const auto& timing : timings)
+			{
+				peak_streamed_bytes = std::max(peak_streamed_bytes, timing.streamed_bytes);
+				run_result.shadow_static_renders += timing.shadow_static_renders;
+				run_result.shadow_skipped += timing.shadow_skipped;
+			}
+			run_result.texture_budget_kept = budget_kept(peak_streamed_bytes);
+			MESSAGE(("Headless: " + std::to_string(run_result.frame_count) + " frames, average " + std::to_string(run_result.average_ms) +
+				" ms, median " + std::to_string(run_result.median_ms) + " ms, 95th percentile " + std::to_string(run_result.p95_ms) +
+				" ms, max " + std::to_string(run_result.max_ms) + " ms, " + std::to_string(run_result.hitch_count) + " hitches").c_str());
+			if (triangles)
+				MESSAGE(("Headless: meshlet culling skipped " + std::to_string(run_result.culled_triangle_fraction * 100.f) + "% of the triangles").c_str());
+			MESSAGE(("Headless: shadow static caches rendered " + std::to_string(run_result.shadow_static_renders) + " times, " +
+				std::to_string(run_result.shadow_skipped) + " of " + std::to_string(run_result.frame_count * shadow::cascade_count) + " cascades skipped").c_str());
+			if (settings.verify_culling)
+				MESSAGE(("Headless: GPU instance culling didn't match the reference in " + std::to_string(run_result.culling_mismatches) + " of " +
+					std::to_string(run_result.frame_count) + " frames").c_str());
+
+			// Input assembly counts every vertex an index refers to, so this is the fetch without post-transform cache hits
+			constexpr f32 mb{ 1024.f * 1024.f };
+			const submesh::geometry_memory& memory{ submesh::get_geometry_memory() };
+			const u64 fetched_vertices{ profiler::get_statistics(profiler::gbuffer).input_vertices };
+			run_result.geometry_mb = (f32)(memory.vertex_bytes + memory.index_bytes) / mb;
+			run_result.vertex_fetch_mb = (f32)(fetched_vertices * sizeof(content::packed_vertex)) / mb;
+			MESSAGE(("Headless: geometry buffers " + std::to_string(run_result.geometry_mb) + " MB (" +
+				std::to_string((f32)(memory.float_vertex_bytes + memory.u32_index_bytes) / mb) + " MB as float vertices and 32-bit indices), geometry pass vertex fetch " +
+				std::to_string(run_result.vertex_fetch_mb) + " MB per frame (" + std::to_string((f32)(fetched_vertices * sizeof(Vertex)) / mb) + " MB)").c_str());
+
+			if (texture_streaming::is_active())
+			{
+				const texture_streaming::residency_stats residency{ texture_streaming::get_stats() };
+				run_result.streamed_texture_mb = (f32)residency.resident_bytes / mb;
+				run_result.peak_streamed_texture_mb = (f32)peak_streamed_bytes / mb;
+				run_result.texture_evictions = residency.evicted;
+				if (!run_result.texture_budget_kept) MESSAGE("Headless: streamed textures went over the budget");
+				MESSAGE(("Headless: streamed textures " + std::to_string(run_result.streamed_texture_mb) + " MB (peak " +
+					std::to_string(run_result.peak_streamed_texture_mb) + " MB, budget " + std::to_string((f32)residency.budget / mb) + " MB, wanted " +
+					std::to_string((f32)residency.wanted_bytes / mb) + " MB), " + std::to_string(residency.streamed_count) + " of " +
+					std::to_string(residency.texture_count) + " textures streamed, " + std::to_string(residency.complete_count) + " complete, " +
+					std::to_string(residency.read_bytes / (1 << 20)) + " MB read, " + std::to_string(residency.uploaded_levels) + " levels uploaded, " +
+					std::to_string(residency.evicted) + " evictions").c_str());
+			}
+
+			// frame_ms is sorted, so each bucket is the run between two edges
+			std::string histogram{ "Headless: frame time histogram" };
+			auto bucket_start{ frame_ms.begin() };
+			for (u32 i{ 0 }; i <= _countof(histogram_edges); ++i)
+			{
+				const bool last{ i == _countof(histogram_edges) };
+				const auto bucket_end{ last ? frame_ms.end() : std::upper_bound(bucket_start, frame_ms.end(), histogram_edges[i]) };
+				histogram += last ? " | >" + std::to_string(histogram_edges[i - 1]) : " | <=" + std::to_string(histogram_edges[i]);
+				histogram += " ms: " + std::to_string(bucket_end - bucket_start);
+				bucket_start = bucket_end;
+			}
+			MESSAGE(histogram.c_str());
+
+			if (timing_csv.empty()) return;
+			std::ofstream out{ timing_csv, std::ios::out | std::ios::trunc };
+			if (!out)
+			{
+				MESSAGE(("Headless: can't write " + timing_csv).c_str());
+				return;
+			}
+			out << "frame,cpu_ms,frame_ms,pipelines_pending";
+			for (u32 p{ 0 }; p < profiler::pass::count; ++p)
+				out << ",gpu_" << profiler::pass_name((profiler::pass)p) << "_ms";
+			out << ",meshlets,visible_meshlets,culled_triangle_fraction,streamed_texture_mb,texture_reads_pending";
+			out << ",shadow_cull_ms,shadow_record_ms,shadow_static_renders,shadow_skipped\n";
+			for (size_t i{ 0 }; i < timings.size(); ++i)
+			{
+				out << i << ',' << timings[i].cpu_ms << ',' << timings[i].frame_ms << ',' << timings[i].pipelines_pending;
+				for (u32 p{ 0 }; p < profiler::pass::count; ++p)
+					out << ',' << timings[i].gpu_ms[p];
+				const f32 culled{ timings[i].triangles ? 1.f - (f32)((double)timings[i].visible_triangles / (double)timings[i].triangles) : 0.f };
+				out << ',' << timings[i].meshlets << ',' << timings[i].visible_meshlets << ',' << culled;
+				out << ',' << (f32)timings[i].streamed_bytes / mb << ',' << timings[i].pending_reads;
+				out << ',' << timings[i].shadow_cull_ms << ',' << timings[i].shadow_record_ms << ',' << timings[i].shadow_static_renders << ',' << timings[i].shadow_skipped << '\n';
+			}
+		}
+
+		// The GPU times the profiler collected up to the last frame. The device is idle, so none of them trails the run.
+		void write_profile()
+		{
+			profiler::flush();
+			std::string summary{ "Headless: GPU average ms" };
+			for (u32 p{ 0 }; p < profiler::pass::count; ++p)
+			{
+				const profiler::pass_timing timing{ profiler::get_timing((profiler::pass)p) };
+				summary += std::string{ p ? ", " : " " } + profiler::pass_name((profiler::pass)p) + " " +
+					(timing.sample_count ? std::to_string(timing.avg_ms) : "unmeasured");
+			}
+			MESSAGE(summary.c_str());
+
+			if (!profile_csv.empty() && !profiler::write_csv(profile_csv.c_str()))
+				MESSAGE(("Headless: can't write " + profile_csv).c_str());
+		}
+
+		// A frame that failed to draw anything, like one where every pass was skipped, comes out as the clear color
+		bool is_drawn(const std::vector<u8>& rgb)
+		{
+			for (size_t i{ 3 }; i < rgb.size(); ++i)
+				if (rgb[i] != rgb[i % 3]) return true;
+			return false;
+		}
+
+		void finish()
+		{
+			vkDeviceWaitIdle(core::logical_device());
+
+			if (readback.recorded)
+			{
+				const std::vector<u8> rgb{ readback_pixels() };
+				if (!rgb.empty())
+				{
+					run_result.image_drawn = is_drawn(rgb);
+					if (!run_result.image_drawn) MESSAGE("Headless: the last frame is a single flat color");
+					if (!readback_file.empty() && !write_ppm(readback_file, readback.width, readback.height, rgb))
+						MESSAGE(("Headless: can't write " + readback_file).c_str());
+					if (!golden_file.empty()) compare_golden(rgb);
+				}
+			}
+			release_readback();
+
+			write_timings();
+			write_profile();
+			finished = true;
+
+			const bool checks_image{ !readback_file.empty() || !golden_file.empty() };
+			run_result.passed = run_result.frame_count == settings.frame_count && (!checks_image || run_result.image_drawn) &&
+				(run_result.golden_rms < 0.f || run_result.golden_passed) && run_result.texture_budget_kept && !run_result.culling_mismatches;
+			MESSAGE(run_result.passed ? "Headless: run passed" : "Headless: run FAILED");
+		}
+
+		// Value of -name=value, nullptr when the switch isn't there
+		const char* find_switch(s32 argc, char** argv, const char* name)
+		{
+			const size_t length{ strlen(name) };
+			for (s32 i{ 1 }; i < argc; ++i)
+			{
+				const char* const arg{ argv[i] };
+				if ((arg[0] != '-' && arg[0] != '/') || strncmp(arg + 1, name, length)) continue;
+				if (arg[length + 1] == '\0') return arg + length + 1;
+				if (arg[length + 1] == '=') return arg + length + 2;
+			}
+			return nullptr;
+		}
+	} // anonymous namespace
+
+	// Sponza is scaled by 0.02, so the atrium runs from about -26 to 24 along x between the columns at about z = -8.6
+	// and z = 8.6, and the gallery floor is about 13 up
+	const camera_key stress_path[]{
+		{ 0.f,	{ -24.f, 2.f, 0.f },	{ 0.f, 1.571f, 0.f } },		// West end, looking down the atrium
+		{ 3.f,	{ -14.f, 1.5f, -6.f },	{ 0.2f, 3.142f, 0.f } },	// Close to the south columns
+		{ 6.f,	{ -2.f, 1.5f, 6.f },	{ 0.2f, 0.f, 0.f } },		// Across to the north columns
+		{ 9.f,	{ 10.f, 1.5f, -6.f },	{ 0.1f, 3.142f, 0.f } },
+		{ 12.f,	{ 22.f, 3.f, 0.f },		{ 0.f, 4.712f, 0.f } },		// East end, turning back
+		{ 14.f,	{ 16.f, 15.f, 6.f },	{ 0.3f, 6.283f, 0.f } },	// Up to the north gallery
+		{ 17.f,	{ -10.f, 15.f, -6.f },	{ 0.6f, 4.712f, 0.f } },	// Over to the south gallery, looking down
+		{ 20.f,	{ -18.f, 1.f, 0.f },	{ 1.2f, 4.712f, 0.f } },	// Down to the floor tiles
+	};
+	const u32 stress_path_key_count{ _countof(stress_path) };
+
+	void configure(const config& info)
+	{
+		assert(info.width && info.height && info.frame_count);
+		settings = info;
+		camera_path.assign(info.camera_path, info.camera_path + (info.camera_path ? info.camera_key_count : 0));
+		timing_csv = info.timing_csv ? info.timing_csv : "";
+		profile_csv = info.profile_csv ? info.profile_csv : "";
+		readback_file = info.readback_file ? info.readback_file : "";
+		golden_file = info.golden_file ? info.golden_file : "";
+		// The strings above own the paths now
+		settings.camera_path = nullptr;
+		settings.timing_csv = settings.profile_csv = settings.readback_file = settings.golden_file = nullptr;
+
+		enabled = true;
+		finished = false;
+		frame = 0;
+		timings.clear();
+		timings.reserve(info.frame_count);
+		run_result = {};
+		run_result.golden_rms = -1.f;
+		if (info.texture_budget) texture_streaming::set_budget(info.texture_budget);
+		textures::set_generate_mipmaps(info.generate_mipmaps);
+		indirect::set_gpu_driven(info.gpu_driven);
+		indirect::set_verify_culling(info.verify_culling);
+	}
+
+	bool configure_from_command_line(s32 argc, char** argv)
+	{
+		if (!argv || !find_switch(argc, argv, "headless")) return false;
+
+		config info{};
+		if (find_switch(argc, argv, "stress"))
+		{
+			info.camera_path = stress_path;
+			info.camera_key_count = stress_path_key_count;
+			info.frame_count = stress_frame_count;
+			info.texture_budget = stress_texture_budget;
+			info.gpu_driven = true;
+		}
+		if (const char* frames{ find_switch(argc, argv, "frames") }; frames && atoi(frames) > 0) info.frame_count = (u32)atoi(frames);
+		if (const char* budget{ find_switch(argc, argv, "budget") }; budget && atoi(budget) > 0) info.texture_budget = (u64)atoi(budget) << 20;
+		if (const char* size{ find_switch(argc, argv, "size") })
+		{
+			char* end{ nullptr };
+			const u32 width{ (u32)strtoul(size, &end, 10) };
+			const u32 height{ *end == 'x' ? (u32)strtoul(end + 1, nullptr, 10) : 0 };
+			if (width && height)
+			{
+				info.width = width;
+				info.height = height;
+			}
+		}
+		const char* const readback{ find_switch(argc, argv, "readback") };
+		info.readback_file = readback && *readback ? readback : "headless.ppm";
+		info.golden_file = find_switch(argc, argv, "golden");
+		if (const char* timing{ find_switch(argc, argv, "timing") }; timing && *timing) info.timing_csv = timing;
+		const char* const profile{ find_switch(argc, argv, "profile") };
+		info.profile_csv = profile && *profile ? profile : profiler::csv_file;
+		info.generate_mipmaps = !find_switch(argc, argv, "nomips");
+		info.gpu_driven = info.gpu_driven || find_switch(argc, argv, "gpu-driven");
+		info.verify_culling = find_switch(argc, argv, "verify-culling") != nullptr;
+		configure(info);
+		MESSAGE(("Headless: rendering " + std::to_string(info.frame_count) + " frames at " + std::to_string(info.width) + "x" +
+			std::to_string(info.height) + (info.generate_mipmaps ? "" : " without texture mips") + (info.gpu_driven ? " GPU-driven" : "") +
+			(info.verify_culling ? " verifying the culling" : "") + (info.camera_path ? " along the stress path" : "") +
+			(info.texture_budget ? ", texture budget " + std::to_string(info.texture_budget >> 20) + " MB" : "")).c_str());
+		return true;
+	}
+
+	bool is_enabled()
+	{
+		return enabled;
+	}
+
+	bool is_finished()
+	{
+		return finished;
+	}
+
+	const result& get_result()
+	{
+		return run_result;
+	}
+
+	const config& get_config()
+	{
+		return settings;
+	}
+
+	bool begin_frame(frame_info& info)
+	{
+		if (finished) return false;
+
+		previous_start = frame ? frame_start : frame_clock::now();
+		frame_start = frame_clock::now();
+
+		// Everything time dependent sees the same steps on every run
+		const f32 time{ (f32)frame * settings.frame_time };
+		info.last_frame_time = info.average_frame_time = settings.frame_time * 1000.f;
+		move_camera(info.camera_id, time);
+		++frame;
+		return true;
+	}
+
+	void record_readback(VkCommandBuffer cmd_buffer, VkImage image, VkFormat format, u32 width, u32 height)
+	{
+		if (frame != settings.frame_count || (readback_file.empty() && golden_file.empty())) return;
+
+		release_readback();
+		createBuffer(core::logical_device(), (VkDeviceSize)width * height * 4, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, readback.buffer, readback.memory);
+		readback.format = format;
+		readback.width = width;
+		readback.height = height;
+
+		// The render pass orders the copy after its color writes and the transition to TRANSFER_SRC_OPTIMAL
+		VkBufferImageCopy region{};
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.layerCount = 1;
+		region.imageExtent = { width, height, 1 };
+		vkCmdCopyImageToBuffer(cmd_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.buffer, 1, &region);
+
+		VkBufferMemoryBarrier barrier{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER };
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = readback.buffer;
+		barrier.size = VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+		readback.recorded = true;
+	}
+
+	void end_frame(const vulkan_shadow_pass& shadow, bool culling_matched)
+	{
+		if (finished || !frame) return;
+
+		if (!culling_matched) ++run_result.culling_mismatches;
+
+		const frame_clock::time_point now{ frame_clock::now() };
+		frame_timing timing{ elapsed_ms(frame_start, now), frame > 1 ? elapsed_ms(previous_start, frame_start) : elapsed_ms(frame_start, now),
+			pipelines::get_stats().pending };
+		for (u32 p{ 0 }; p < profiler::pass::count; ++p)
+			timing.gpu_ms[p] = profiler::get_timing((profiler::pass)p).last_ms;
+		const clusters::cull_stats& cull{ clusters::get_stats() };
+		timing.meshlets = cull.meshlet_count;
+		timing.visible_meshlets = cull.visible_meshlet_count;
+		timing.triangles = cull.triangle_count;
+		timing.visible_triangles = cull.visible_triangle_count;
+		const texture_streaming::residency_stats residency{ texture_streaming::get_stats() };
+		timing.streamed_bytes = residency.resident_bytes;
+		timing.pending_reads = residency.pending_reads;
+		for (const shadow::cascade_stats& cascade : shadow.get_stats())
+		{
+			timing.shadow_cull_ms += cascade.cull_ms;
+			timing.shadow_record_ms += cascade.record_ms;
+			if (!cascade.static_cached && !cascade.skipped) ++timing.shadow_static_renders;
+			if (cascade.skipped) ++timing.shadow_skipped;
+		}
+		timings.emplace_back(timing);
+
+		if (frame == settings.frame_count) finish();
+	}
+
+	void shutdown()
+	{
+		// Called with the device idle
+		release_readback();
+		enabled = false;
+	}
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include "VulkanCommonHeaders.h"
+
+namespace primal::graphics::vulkan
+{
+	class vulkan_shadow_pass;
+}
+
+namespace primal::graphics::vulkan::headless
+{
+	// Camera pose at time seconds into the run. Between keys position and rotation are interpolated linearly,
+	// after the last key the camera stays there.
+	struct camera_key
+	{
+		f32					time;
+		math::v3			position;
+		math::v3			rotation;				// Pitch, yaw and roll in radians
+	};
+
+	struct config
+	{
+		u32					width{ 1600 };
+		u32					height{ 900 };
+		u32					frame_count{ 600 };		// Frames rendered before the run is finished
+		f32					frame_time{ 1.f / 60.f };	// Fixed step in seconds, the camera path and frame_info advance by it
+		const camera_key*	camera_path{ nullptr };	// Copied by configure(). Without a path the caller's camera is left alone.
+		u32					camera_key_count{ 0 };
+		const char*			timing_csv{ "headless_timing.csv" };
+		const char*			profile_csv{ nullptr };		// GPU profiler summary written when the run finishes, see profiler::write_csv()
+		const char*			readback_file{ nullptr };	// Binary PPM of the last frame
+		const char*			golden_file{ nullptr };		// Binary PPM the last frame is compared with
+		f32					golden_tolerance{ 2.f };	// Largest RMS difference per channel, in 8 bit steps, that still passes
+		u64					texture_budget{ 0 };		// Bytes of streamed texture mips, 0 keeps the default. A budget below what the
+														// camera path wants is the stress test of the eviction, see stress_path.
+		bool				generate_mipmaps{ true };	// Off loads textures without mips, for comparing the texture bandwidth
+		bool				gpu_driven{ false };		// Opt in to the GPU-driven geometry pass, see indirect::set_gpu_driven()
+		bool				verify_culling{ false };	// Compare the GPU instance culling with the CPU reference after every frame
+	};
+
+	struct result
+	{
+		u32					frame_count;
+		f32					average_ms;
+		f32					median_ms;
+		f32					p95_ms;
+		f32					max_ms;
+		u32					hitch_count;			// Frames longer than twice the median, like ones stalled by a pipeline compile
+		f32					culled_triangle_fraction;	// Triangles of meshlet culled instances that weren't drawn, over all frames
+		f32					geometry_mb;			// Vertex and index buffers of the loaded models
+		f32					vertex_fetch_mb;		// Vertices the geometry pass read in the last measured frame, times the vertex size
+		f32					streamed_texture_mb;	// Streamed texture mips resident after the last frame
+		f32					peak_streamed_texture_mb;
+		u32					texture_evictions;		// Streamed images dropped for the budget during the run
+		bool				texture_budget_kept;	// Streamed texture mips never went over config::texture_budget
+		u32					shadow_static_renders;	// Shadow cascades whose static cache was rendered again, over all frames
+		u32					shadow_skipped;			// Shadow cascades that kept the last frame's depth, over all frames
+		u32					culling_mismatches;		// Frames whose GPU instance culling didn't match the CPU reference
+		f32					golden_rms;				// Negative when there was nothing to compare
+		bool				golden_passed;
+		bool				image_drawn;			// The last frame was read back and isn't a single flat color
+		bool				passed;					// All frames rendered, the last one drawn, the culling matched the reference
+													// and, with a golden image, the last frame matching it.
+													// With a texture budget, also texture_budget_kept.
+	};
+
+	// Walk through Sponza for the texture streaming stress test: along the colonnades of the ground floor close to the columns
+	// and walls, up to the gallery and down to the floor, so most materials want their top mips at some point of the 20 seconds.
+	extern const camera_key stress_path[];
+	extern const u32 stress_path_key_count;
+	constexpr u32 stress_frame_count{ 1200 };
+	constexpr u64 stress_texture_budget{ 48ull << 20 };
+
+	// Call before graphics::initialize(). Surfaces created afterwards render into offscreen images of the
+	// configured size instead of a window swapchain, the window passed to create_surface() is ignored.
+	// No surface or swapchain extension is needed, so this runs on a CPU implementation like lavapipe.
+	void configure(const config& info);
+
+	// Configure from the command line when it has -headless. Optional switches: -frames=N, -size=WxH,
+	// -readback=file (headless.ppm by default), -golden=file, -timing=file, -profile=file (profiler::csv_file by default), -nomips, -budget=MB for the streamed texture mips,
+	// -gpu-driven and -verify-culling (see config).
+	// -stress moves the camera along stress_path for stress_frame_count frames under stress_texture_budget on the GPU-driven
+	// path, the only one that streams textures. -frames and -budget still override those. Returns true when it had -headless. The caller quits once is_finished(), get_result().passed tells the exit code.
+	bool configure_from_command_line(s32 argc, char** argv);
+
+	[[nodiscard]] bool is_enabled();
+
+	// frame_count frames were rendered, the readback and timing files are written and the surface renders nothing more
+	[[nodiscard]] bool is_finished();
+
+	[[nodiscard]] const result& get_result();
+
+	[[nodiscard]] const config& get_config();
+
+	// Used by the backend
+	// Advance the camera path and fix the frame time. Returns false once the run is finished.
+	bool begin_frame(frame_info& info);
+
+	// Copy image to the readback buffer if this is the last frame and a readback or golden file is set.
+	// image is in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, last written as a color attachment.
+	void record_readback(VkCommandBuffer cmd_buffer, VkImage image, VkFormat format, u32 width, u32 height);
+
+	// Record the frame's timing and the shadow cascade stats. culling_matched is false when the frame's instance culling
+	// was verified and didn't match. After the last frame waits for the device and writes the results.
+	void end_frame(const vulkan_shadow_pass& shadow, bool culling_matched);
+
+	// Called by the headless surface when it's released, with the device idle
+	void shutdown();
+}
@@ -844,7 +844,8 @@ namespace primal::graphics::vulkan
 		viewCreateInfo.subresourceRange.levelCount = 1;
 		tex_id = textures::add(imageCreateInfo, viewCreateInfo, samplerCreateInfo);
 
-		textures::vulkan_texture_2d texture{ textures::get_texture(tex_id) };
+		// A copy would give back the texture's sampler and image when it goes out of scope
+		textures::vulkan_texture_2d& texture{ textures::get_texture(tex_id) };
 
 		vkGetImageMemoryRequirements(core::logical_device(), texture.getTexture().image, &memReqs);
 
@@ -899,7 +900,7 @@ namespace primal::graphics::vulkan
 	{
 		utl::vector<VkVertexInputBindingDescription> _bindingDescription;
 		_bindingDescription.emplace_back([]() {
-			VkVertexInputBindingDescription bBind{ 0, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX };
+			VkVertexInputBindingDescription bBind{ 0, sizeof(content::packed_vertex), VK_VERTEX_INPUT_RATE_VERTEX };
 			return bBind;
 			}());
 
@@ -907,16 +908,14 @@ namespace primal::graphics::vulkan
 	}
 
 	// TODO: Make a configuration to bind id
+	// content::packed_vertex. Location 1 was the per-vertex color, which was always white and is now a constant in the shaders.
 	utl::vector<VkVertexInputAttributeDescription> getVertexInputAttributeDescriptor()
 	{
 		utl::vector<VkVertexInputAttributeDescription> _attributeDescriptions;
-		for (u32 i{ 0 }; i < sizeof(Vertex) / sizeof(math::v3); ++i)
-		{
-			_attributeDescriptions.emplace_back([i]() {
-				VkVertexInputAttributeDescription attributeDescriptions{ i, 0, VK_FORMAT_R32G32B32_SFLOAT, sizeof(math::v3) * i };
-				return attributeDescriptions;
-			}());
-		}
+		_attributeDescriptions.emplace_back(VkVertexInputAttributeDescription{ 0, 0, VK_FORMAT_R16G16B16A16_UNORM, (u32)offsetof(content::packed_vertex, position) });
+		_attributeDescriptions.emplace_back(VkVertexInputAttributeDescription{ 2, 0, VK_FORMAT_R16G16_SFLOAT, (u32)offsetof(content::packed_vertex, uv) });
+		_attributeDescriptions.emplace_back(VkVertexInputAttributeDescription{ 3, 0, VK_FORMAT_R16G16_SNORM, (u32)offsetof(content::packed_vertex, normal) });
+		_attributeDescriptions.emplace_back(VkVertexInputAttributeDescription{ 4, 0, VK_FORMAT_R16G16_SNORM, (u32)offsetof(content::packed_vertex, tangent) });
 		return _attributeDescriptions;
 	}
 }
\ No newline at end of file
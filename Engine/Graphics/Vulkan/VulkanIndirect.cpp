@@ -0,0 +1,916 @@
+#include "VulkanIndirect.h"
+#include "VulkanBindless.h"
+#include "VulkanCore.h"
+#include "VulkanHelpers.h"
+#include "VulkanData.h"
+#include "VulkanContent.h"
+#include "VulkanCamera.h"
+#include "VulkanShader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <string>
+
+namespace primal::graphics::vulkan
+{
+	namespace
+	{
+		using indirect_clock = std::chrono::high_resolution_clock;
+
+		// Spheres this close to a frustum plane may land on either side on the GPU and the CPU
+		constexpr f32 cull_tolerance{ 1e-3f };
+
+		bool gpu_driven{ false };
+		bool verify_culling{ false };
+
+		f32 elapsed_ms(indirect_clock::time_point start)
+		{
+			return std::chrono::duration<f32, std::milli>(indirect_clock::now() - start).count();
+		}
+
+		// Smallest signed distance of the sphere to the frustum planes, negative when the sphere is culled.
+		// Same arithmetic as SphereInsideFrustum() in instance_cull.comp.
+		f32 frustum_margin(const math::v4& sphere, const glsl::IndirectCullData& cull_data)
+		{
+			f32 margin{ std::numeric_limits<f32>::max() };
+			for (u32 i{ 0 }; i < 6; ++i)
+			{
+				const math::v4& plane{ cull_data.FrustumPlanes[i] };
+				margin = std::min(margin, plane.x * sphere.x + plane.y * sphere.y + plane.z * sphere.z + plane.w + sphere.w);
+			}
+			return margin;
+		}
+
+		void buffer_barrier(VkCommandBuffer cmd, VkPipelineStageFlags src_stage, VkAccessFlags src_access, VkPipelineStageFlags dst_stage, VkAccessFlags dst_access)
+		{
+			VkMemoryBarrier barrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+			barrier.pNext = nullptr;
+			barrier.srcAccessMask = src_access;
+			barrier.dstAccessMask = dst_access;
+			vkCmdPipelineBarrier(cmd, src_stage, dst_stage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		}
+	} // anonymous namespace
+
+	namespace indirect
+	{
+		void set_gpu_driven(bool enabled)
+		{
+			gpu_driven = enabled;
+		}
+
+		bool is_gpu_driven()
+		{
+			return gpu_driven;
+		}
+
+		void set_verify_culling(bool enabled)
+		{
+			verify_culling = enabled;
+		}
+
+		bool is_verifying_culling()
+		{
+			return verify_culling;
+		}
+
+		void cull_reference(const utl::vector<glsl::IndirectInstanceData>& instances, const glsl::IndirectCullData& cull_data,
+			OUT utl::vector<VkDrawIndexedIndirectCommand>& commands, OUT u32& count)
+		{
+			commands.clear();
+			commands.resize(instances.size());
+			count = 0;
+			for (u32 i{ 0 }; i < cull_data.InstanceCount; ++i)
+			{
+				const glsl::IndirectInstanceData& instance{ instances[i] };
+				if (frustum_margin(instance.BoundingSphere, cull_data) < 0.f) continue;
+
+				commands[count++] = { instance.IndexCount, 1, instance.FirstIndex, instance.VertexOffset, i };
+			}
+		}
+	}
+
+	void vulkan_indirect_pass::setup(id::id_type renderpass_id, id::id_type ubo_id)
+	{
+		_renderpass_id = renderpass_id;
+		_ubo_id = ubo_id;
+		// Nothing to create for the per-instance draws
+		_enabled = indirect::is_gpu_driven();
+		if (!_enabled) return;
+
+		_supported = core::draw_indirect_count_supported() && bindless::is_supported();
+		if (!_supported)
+		{
+			MESSAGE("drawIndirectCount or descriptor indexing is not supported, the geometry pass keeps drawing per instance");
+			return;
+		}
+
+		create_layouts();
+		create_cull_pipeline();
+		create_draw_pipeline();
+	}
+
+	void vulkan_indirect_pass::release()
+	{
+		if (!_supported) return;
+
+		// Called with the device idle. Retired buffers and descriptor sets go now, before their pool does.
+		core::flush_deferred_release();
+		release_scene_data();
+
+		data::remove_data(data::engine_vulkan_data::vulkan_pipeline, _draw_pipeline_id);
+		data::remove_data(data::engine_vulkan_data::vulkan_pipeline, _cull_pipeline_id);
+		data::remove_data(data::engine_vulkan_data::vulkan_pipeline_layout, _cull_pipeline_layout_id);
+		data::remove_data(data::engine_vulkan_data::vulkan_pipeline_layout, _draw_pipeline_layout_id);
+		data::remove_data(data::engine_vulkan_data::vulkan_descriptor_set_layout, _cull_set_layout_id);
+		data::remove_data(data::engine_vulkan_data::vulkan_descriptor_set_layout, _instance_set_layout_id);
+		data::remove_data(data::engine_vulkan_data::vulkan_descriptor_pool, _descriptor_pool_id);
+	}
+
+	void vulkan_indirect_pass::release_scene_data()
+	{
+		_instances.clear();
+		_slot_owners.clear();
+		_slot_vertices.clear();
+		_slot_indices.clear();
+		_instance_slots.clear();
+		_material_refs.clear();
+		_staging.clear();
+		_dirty_first = u32_invalid_id;
+		_dirty_last = 0;
+		_synced = false;
+		_stats = {};
+
+		for (packed_buffer* buffer : { &_vertex_buffer, &_index_buffer, &_instance_buffer })
+		{
+			if (buffer->grown_from)
+			{
+				vkDestroyBuffer(core::logical_device(), buffer->grown_from, nullptr);
+				vkFreeMemory(core::logical_device(), buffer->grown_from_memory, nullptr);
+			}
+			if (buffer->buffer)
+			{
+				vkDestroyBuffer(core::logical_device(), buffer->buffer, nullptr);
+				vkFreeMemory(core::logical_device(), buffer->memory, nullptr);
+			}
+			*buffer = {};
+		}
+
+		for (id::id_type* buffer_id : { &_command_buffer_id, &_count_buffer_id })
+		{
+			if (!id::is_valid(*buffer_id)) continue;
+			data::remove_data(data::engine_vulkan_data::vulkan_buffer, *buffer_id);
+			*buffer_id = id::invalid_id;
+		}
+
+		for (id::id_type* set_id : { &_cull_set_id, &_instance_set_id })
+		{
+			if (!id::is_valid(*set_id)) continue;
+			VkDescriptorSet set{ data::get_data<VkDescriptorSet>(*set_id) };
+			vkFreeDescriptorSets(core::logical_device(), data::get_data<VkDescriptorPool>(_descriptor_pool_id), 1, &set);
+			data::remove_data(data::engine_vulkan_data::vulkan_descriptor_sets, *set_id);
+			*set_id = id::invalid_id;
+		}
+	}
+
+	void vulkan_indirect_pass::create_layouts()
+	{
+		// Every growth of the instance buffer allocates new sets, the old ones are freed once no frame uses them
+		constexpr u32 set_generations{ frame_buffer_count + 2 };
+		std::vector<VkDescriptorPoolSize> poolSize = {
+			Engine_Descriptor_Pool_Size(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 * set_generations),
+			Engine_Descriptor_Pool_Size(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 * set_generations)
+		};
+
+		VkDescriptorPoolCreateInfo poolInfo;
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.pNext = VK_NULL_HANDLE;
+		poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+		poolInfo.poolSizeCount = static_cast<u32>(poolSize.size());
+		poolInfo.pPoolSizes = poolSize.data();
+		poolInfo.maxSets = 2 * set_generations;
+		_descriptor_pool_id = data::create_data(data::engine_vulkan_data::vulkan_descriptor_pool, static_cast<void*>(&poolInfo), 0);
+
+		{
+			// Cull set: instances in, commands and counts out
+			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings{
+				descriptor::descriptorSetLayoutBinding(0, VK_SHADER_STAGE_COMPUTE_BIT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER),
+				descriptor::descriptorSetLayoutBinding(1, VK_SHADER_STAGE_COMPUTE_BIT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER),
+				descriptor::descriptorSetLayoutBinding(2, VK_SHADER_STAGE_COMPUTE_BIT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER),
+			};
+			VkDescriptorSetLayoutCreateInfo descriptorLayout = descriptor::descriptorSetLayoutCreate(setLayoutBindings);
+			_cull_set_layout_id = data::create_data(data::engine_vulkan_data::vulkan_descriptor_set_layout, static_cast<void*>(&descriptorLayout), 0);
+		}
+
+		{
+			// Instance set: model matrices and material ids for the vertex shader, camera data
+			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings{
+				descriptor::descriptorSetLayoutBinding(0, VK_SHADER_STAGE_VERTEX_BIT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER),
+				descriptor::descriptorSetLayoutBinding(1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER),
+			};
+			VkDescriptorSetLayoutCreateInfo descriptorLayout = descriptor::descriptorSetLayoutCreate(setLayoutBindings);
+			_instance_set_layout_id = data::create_data(data::engine_vulkan_data::vulkan_descriptor_set_layout, static_cast<void*>(&descriptorLayout), 0);
+		}
+
+		VkPushConstantRange push{ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(glsl::IndirectCullData) };
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo;
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.pNext = nullptr;
+		pipelineLayoutInfo.flags = 0;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &data::get_data<VkDescriptorSetLayout>(_cull_set_layout_id);
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &push;
+		_cull_pipeline_layout_id = data::create_data(data::engine_vulkan_data::vulkan_pipeline_layout, static_cast<void*>(&pipelineLayoutInfo), 0);
+
+		// Set 0 is the bindless material set, set 1 the instance set. Both are bound once per frame.
+		std::vector<VkDescriptorSetLayout> descriptorSetArray{ data::get_data<VkDescriptorSetLayout>(bindless::descriptor_set_layout_id()), data::get_data<VkDescriptorSetLayout>(_instance_set_layout_id) };
+		pipelineLayoutInfo.setLayoutCount = static_cast<u32>(descriptorSetArray.size());
+		pipelineLayoutInfo.pSetLayouts = descriptorSetArray.data();
+		pipelineLayoutInfo.pushConstantRangeCount = 0;
+		pipelineLayoutInfo.pPushConstantRanges = nullptr;
+		_draw_pipeline_layout_id = data::create_data(data::engine_vulkan_data::vulkan_pipeline_layout, static_cast<void*>(&pipelineLayoutInfo), 0);
+	}
+
+	void vulkan_indirect_pass::create_cull_pipeline()
+	{
+		std::string base_dir{ SOLUTION_DIR };
+		VkComputePipelineCreateInfo info;
+		info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		info.pNext = nullptr;
+		info.layout = data::get_data<VkPipelineLayout>(_cull_pipeline_layout_id);
+		info.stage = shaders::get_shader(shaders::add(base_dir + "Engine\\Graphics\\Vulkan\\Shaders\\spv\\instance_cull.comp.spv", shader_type::compute)).getShaderStage();
+		info.flags = 0;
+		info.basePipelineHandle = nullptr;
+
+		_cull_pipeline_id = data::create_data(data::engine_vulkan_data::vulkan_pipeline, static_cast<void*>(&info), 1);
+	}
+
+	void vulkan_indirect_pass::create_draw_pipeline()
+	{
+		// Same state as vulkan_instance_model::createPipeline(), the shaders read everything through the bindless and instance sets
+		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = descriptor::pipelineInputAssemblyStateCreate(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
+		VkPipelineViewportStateCreateInfo viewportState = descriptor::pipelineViewportStateCreate(1, 1);
+		VkPipelineRasterizationStateCreateInfo rasterizationState = descriptor::pipelineRasterizationStateCreate(VK_POLYGON_MODE_FILL, VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE);
+		VkPipelineMultisampleStateCreateInfo multisampleState = descriptor::pipelineMultisampleStateCreate(VK_SAMPLE_COUNT_1_BIT);
+		std::vector<VkPipelineColorBlendAttachmentState> blendAttachmentState = { descriptor::pipelineColorBlendAttachmentState(VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT, VK_FALSE),
+																				descriptor::pipelineColorBlendAttachmentState(VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT, VK_FALSE),
+																				descriptor::pipelineColorBlendAttachmentState(VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT, VK_FALSE),
+																				descriptor::pipelineColorBlendAttachmentState(VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT, VK_FALSE), };
+		VkPipelineColorBlendStateCreateInfo colorBlendState = descriptor::pipelineColorBlendStateCreate(static_cast<u32>(blendAttachmentState.size()), *blendAttachmentState.data());
+		std::vector<VkDynamicState> dynamicStateEnables{ VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+		VkPipelineDynamicStateCreateInfo dynamicState = descriptor::pipelineDynamicStateCreate(dynamicStateEnables);
+		VkPipelineDepthStencilStateCreateInfo depthStencilState = descriptor::pipelineDepthStencilStateCreateInfo(VK_TRUE, VK_TRUE, VK_FALSE, VK_FALSE, VK_COMPARE_OP_LESS_OR_EQUAL);
+
+		auto bind = getVertexInputBindDescriptor();
+		auto attr = getVertexInputAttributeDescriptor();
+
+		VkPipelineVertexInputStateCreateInfo vertexInputInfo;
+		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+		vertexInputInfo.pNext = nullptr;
+		vertexInputInfo.flags = 0;
+		vertexInputInfo.vertexBindingDescriptionCount = static_cast<u32>(bind.size());
+		vertexInputInfo.pVertexBindingDescriptions = bind.data();
+		vertexInputInfo.vertexAttributeDescriptionCount = static_cast<u32>(attr.size());
+		vertexInputInfo.pVertexAttributeDescriptions = attr.data();
+
+		std::string base_dir{ SOLUTION_DIR };
+		VkPipelineShaderStageCreateInfo shaderStages[2]{
+			shaders::get_shader(shaders::add(base_dir + "Engine\\Graphics\\Vulkan\\Shaders\\spv\\gbuffer_indirect.vert.spv", shader_type::vertex)).getShaderStage(),
+			shaders::get_shader(shaders::add(base_dir + "Engine\\Graphics\\Vulkan\\Shaders\\spv\\gbuffer_bindless.frag.spv", shader_type::pixel)).getShaderStage(),
+		};
+
+		VkGraphicsPipelineCreateInfo pipelineCI;
+		pipelineCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipelineCI.pNext = nullptr;
+		pipelineCI.flags = 0;
+		pipelineCI.stageCount = 2;
+		pipelineCI.pStages = shaderStages;
+		pipelineCI.pVertexInputState = &vertexInputInfo;
+		pipelineCI.pInputAssemblyState = &inputAssemblyState;
+		pipelineCI.pTessellationState = VK_NULL_HANDLE;
+		pipelineCI.pViewportState = &viewportState;
+		pipelineCI.pRasterizationState = &rasterizationState;
+		pipelineCI.pMultisampleState = &multisampleState;
+		pipelineCI.pDepthStencilState = &depthStencilState;
+		pipelineCI.pColorBlendState = &colorBlendState;
+		pipelineCI.pDynamicState = &dynamicState;
+		pipelineCI.layout = data::get_data<VkPipelineLayout>(_draw_pipeline_layout_id);
+		pipelineCI.renderPass = data::get_data<VkRenderPass>(_renderpass_id);
+		pipelineCI.subpass = 0;
+		pipelineCI.basePipelineHandle = VK_NULL_HANDLE;
+		pipelineCI.basePipelineIndex = -1;
+
+		_draw_pipeline_id = data::create_data(data::engine_vulkan_data::vulkan_pipeline, static_cast<void*>(&pipelineCI), 0);
+	}
+
+	void vulkan_indirect_pass::write_descriptor_sets()
+	{
+		// Frames in flight still read the old buffers through the current sets, so the new buffers go into new sets
+		if (id::is_valid(_cull_set_id))
+		{
+			const VkDescriptorPool pool{ data::get_data<VkDescriptorPool>(_descriptor_pool_id) };
+			core::deferred_release([pool, cull_set_id{ _cull_set_id }, instance_set_id{ _instance_set_id }]() {
+				const VkDescriptorSet sets[2]{ data::get_data<VkDescriptorSet>(cull_set_id), data::get_data<VkDescriptorSet>(instance_set_id) };
+				vkFreeDescriptorSets(core::logical_device(), pool, 2, sets);
+				data::remove_data(data::engine_vulkan_data::vulkan_descriptor_sets, cull_set_id);
+				data::remove_data(data::engine_vulkan_data::vulkan_descriptor_sets, instance_set_id);
+			});
+		}
+
+		VkDescriptorSetAllocateInfo allocInfo;
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.pNext = VK_NULL_HANDLE;
+		allocInfo.descriptorPool = data::get_data<VkDescriptorPool>(_descriptor_pool_id);
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &data::get_data<VkDescriptorSetLayout>(_cull_set_layout_id);
+		_cull_set_id = data::create_data(data::engine_vulkan_data::vulkan_descriptor_sets, static_cast<void*>(&allocInfo), 0);
+		allocInfo.pSetLayouts = &data::get_data<VkDescriptorSetLayout>(_instance_set_layout_id);
+		_instance_set_id = data::create_data(data::engine_vulkan_data::vulkan_descriptor_sets, static_cast<void*>(&allocInfo), 0);
+
+		VkDescriptorSet cull_set{ data::get_data<VkDescriptorSet>(_cull_set_id) };
+		VkDescriptorSet instance_set{ data::get_data<VkDescriptorSet>(_instance_set_id) };
+
+		VkDescriptorBufferInfo bufferInfos[3];
+		bufferInfos[0].buffer = _instance_buffer.buffer;
+		bufferInfos[0].offset = 0;
+		bufferInfos[0].range = VK_WHOLE_SIZE;
+		const id::id_type buffer_ids[2]{ _command_buffer_id, _count_buffer_id };
+		for (u32 i{ 0 }; i < 2; ++i)
+		{
+			auto& buffer = data::get_data<data::vulkan_buffer>(buffer_ids[i]);
+			bufferInfos[i + 1].buffer = buffer.cpu_address;
+			bufferInfos[i + 1].offset = 0;
+			bufferInfos[i + 1].range = buffer.size;
+		}
+
+		std::vector<VkWriteDescriptorSet> descriptorWrites;
+		for (u32 i{ 0 }; i < 3; ++i)
+		{
+			descriptorWrites.emplace_back(descriptor::setWriteDescriptorSet(VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, cull_set, i, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfos[i]));
+		}
+		descriptorWrites.emplace_back(descriptor::setWriteDescriptorSet(VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, instance_set, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfos[0]));
+
+		VkDescriptorBufferInfo uboInfo;
+		uboInfo.buffer = data::get_data<data::vulkan_buffer>(_ubo_id).cpu_address;
+		uboInfo.offset = 0;
+		uboInfo.range = data::get_data<data::vulkan_buffer>(_ubo_id).size;
+		descriptorWrites.emplace_back(descriptor::setWriteDescriptorSet(VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, instance_set, 1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &uboInfo));
+
+		vkUpdateDescriptorSets(core::logical_device(), static_cast<u32>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+	}
+
+	void vulkan_indirect_pass::create_scene_buffers()
+	{
+		constexpr VkBufferUsageFlags copy_usage{ VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT };
+		_vertex_buffer.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | copy_usage;
+		_vertex_buffer.element_size = sizeof(content::packed_vertex);
+		_index_buffer.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | copy_usage;
+		_index_buffer.element_size = sizeof(u32);
+		_instance_buffer.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | copy_usage;
+		_instance_buffer.element_size = sizeof(glsl::IndirectInstanceData);
+
+		grow(_vertex_buffer, indirect::initial_vertex_capacity);
+		grow(_index_buffer, indirect::initial_index_capacity);
+
+		auto flags = data::vulkan_buffer::indirect_buffer;
+		_count_buffer_id = data::create_data(data::engine_vulkan_data::vulkan_buffer, (void*)(&flags), (u32)sizeof(math::v4));
+		reserve_slots(indirect::initial_instance_capacity);
+	}
+
+	// Replace the buffer with a larger one. Nothing waits: its content is copied over on the GPU by the next
+	// record_uploads(), the old buffer is released once the frame that copies it is done.
+	void vulkan_indirect_pass::grow(packed_buffer& buffer, u32 capacity)
+	{
+		assert(capacity > buffer.capacity);
+		VkBuffer grown{ VK_NULL_HANDLE };
+		VkDeviceMemory grown_memory{ VK_NULL_HANDLE };
+		createBuffer(core::logical_device(), (VkDeviceSize)capacity * buffer.element_size, buffer.usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, grown, grown_memory);
+
+		if (buffer.grown_from)
+		{
+			// Grown twice before a frame was recorded, the GPU never saw the intermediate buffer
+			vkDestroyBuffer(core::logical_device(), buffer.buffer, nullptr);
+			vkFreeMemory(core::logical_device(), buffer.memory, nullptr);
+		}
+		else if (buffer.buffer)
+		{
+			buffer.grown_from = buffer.buffer;
+			buffer.grown_from_memory = buffer.memory;
+			buffer.grown_size = buffer.end * buffer.element_size;
+		}
+
+		buffer.buffer = grown;
+		buffer.memory = grown_memory;
+		buffer.capacity = capacity;
+	}
+
+	vulkan_indirect_pass::range vulkan_indirect_pass::allocate_range(packed_buffer& buffer, u32 count)
+	{
+		// First fit among the ranges of removed instances
+		for (u32 i{ 0 }; i < buffer.free_ranges.size(); ++i)
+		{
+			range& free_range{ buffer.free_ranges[i] };
+			if (free_range.count < count) continue;
+
+			const range r{ free_range.offset, count };
+			free_range.offset += count;
+			free_range.count -= count;
+			if (!free_range.count) buffer.free_ranges.erase(buffer.free_ranges.begin() + i);
+			return r;
+		}
+
+		if (buffer.end + count > buffer.capacity)
+			grow(buffer, std::max(buffer.capacity * 2, buffer.end + count));
+
+		const range r{ buffer.end, count };
+		buffer.end += count;
+		return r;
+	}
+
+	void vulkan_indirect_pass::release_range(packed_buffer& buffer, range r)
+	{
+		if (!r.count) return;
+
+		// Keep the free ranges sorted and merged, so that the space of several small models can go to a larger one
+		buffer.free_ranges.emplace_back(r);
+		std::sort(buffer.free_ranges.begin(), buffer.free_ranges.end(), [](const range& a, const range& b) { return a.offset < b.offset; });
+		u32 merged{ 0 };
+		for (u32 i{ 1 }; i < buffer.free_ranges.size(); ++i)
+		{
+			range& last{ buffer.free_ranges[merged] };
+			const range& next{ buffer.free_ranges[i] };
+			if (last.offset + last.count == next.offset) last.count += next.count;
+			else buffer.free_ranges[++merged] = next;
+		}
+		buffer.free_ranges.resize(merged + 1);
+
+		// Space at the end goes back to the end, appends don't have to search for it
+		const range& last{ buffer.free_ranges.back() };
+		if (last.offset + last.count == buffer.end)
+		{
+			buffer.end = last.offset;
+			buffer.free_ranges.resize(buffer.free_ranges.size() - 1);
+		}
+	}
+
+	void vulkan_indirect_pass::stage(packed_buffer& buffer, u32 offset, const void* const data, u32 count)
+	{
+		if (!count) return;
+
+		const u32 size{ count * buffer.element_size };
+		const u32 staging_offset{ (u32)_staging.size() };
+		_staging.resize(_staging.size() + size);
+		memcpy(&_staging[staging_offset], data, size);
+		buffer.uploads.emplace_back(VkBufferCopy{ staging_offset, (VkDeviceSize)offset * buffer.element_size, size });
+	}
+
+	void vulkan_indirect_pass::reserve_slots(u32 count)
+	{
+		if (count <= _instance_buffer.capacity) return;
+
+		u32 capacity{ std::max(_instance_buffer.capacity, indirect::initial_instance_capacity) };
+		while (capacity < count) capacity *= 2;
+		_instance_buffer.end = (u32)_instances.size();
+		grow(_instance_buffer, capacity);
+
+		// Commands are rewritten by every cull dispatch, there's nothing to copy over
+		if (id::is_valid(_command_buffer_id))
+		{
+			core::deferred_release([command_buffer_id{ _command_buffer_id }]() { data::remove_data(data::engine_vulkan_data::vulkan_buffer, command_buffer_id); });
+		}
+		auto flags = data::vulkan_buffer::indirect_buffer;
+		_command_buffer_id = data::create_data(data::engine_vulkan_data::vulkan_buffer, (void*)(&flags), (u32)(sizeof(VkDrawIndexedIndirectCommand) * capacity));
+
+		write_descriptor_sets();
+	}
+
+	void vulkan_indirect_pass::mark_dirty(u32 slot)
+	{
+		_dirty_first = std::min(_dirty_first, slot);
+		_dirty_last = std::max(_dirty_last, slot);
+	}
+
+	void vulkan_indirect_pass::reference_material(id::id_type material_id)
+	{
+		if (material_id >= _material_refs.size()) _material_refs.resize(material_id + 1, 0);
+		if (!_material_refs[material_id]++) ++_stats.material_count;
+
+		// The material's maps may have changed even when it's already drawn, refresh its entry either way
+		bindless::update_material(material_id);
+	}
+
+	void vulkan_indirect_pass::release_material(id::id_type material_id)
+	{
+		assert(material_id < _material_refs.size() && _material_refs[material_id]);
+		if (!--_material_refs[material_id]) --_stats.material_count;
+	}
+
+	void vulkan_indirect_pass::add_slot(id::id_type instance_id)
+	{
+		const submesh::vulkan_instance_model& instance{ scene::get_instance(instance_id) };
+		const submesh::vulkan_model& model{ instance.getModel() };
+		const u32 slot{ (u32)_instances.size() };
+
+		const range vertices{ allocate_range(_vertex_buffer, (u32)model.getVertices().size()) };
+		const range indices{ allocate_range(_index_buffer, (u32)model.getIndicesCount()) };
+		stage(_vertex_buffer, vertices.offset, model.getVertices().data(), vertices.count);
+		if (model.getIndexType() == VK_INDEX_TYPE_UINT16)
+		{
+			// The shared index buffer is 32-bit, it holds models of any size
+			utl::vector<u32> widened(indices.count);
+			for (u32 i{ 0 }; i < indices.count; ++i) widened[i] = model.getIndices16()[i];
+			stage(_index_buffer, indices.offset, widened.data(), indices.count);
+		}
+		else
+		{
+			stage(_index_buffer, indices.offset, model.getIndices().data(), indices.count);
+		}
+
+		glsl::IndirectInstanceData data{};
+		data.Model = instance.getModelMatrix();
+		data.BoundingSphere = instance.getWorldBoundingSphere();
+		data.IndexCount = indices.count;
+		data.FirstIndex = indices.offset;
+		data.VertexOffset = (s32)vertices.offset;
+		data.MaterialID = instance.getMaterialID();
+		data.IsReflect = instance.is_reflect() ? 1 : 0;
+		const content::quantization_box& box{ model.getPositionBox() };
+		data.PositionMin = { box.min.x, box.min.y, box.min.z, 0.f };
+		data.PositionScale = { box.scale.x, box.scale.y, box.scale.z, 0.f };
+		_instances.emplace_back(data);
+
+		_slot_owners.emplace_back(slot_owner{ instance_id, instance.getEntityID() });
+		_slot_vertices.emplace_back(vertices);
+		_slot_indices.emplace_back(indices);
+		if (instance_id >= _instance_slots.size()) _instance_slots.resize(instance_id + 1, u32_invalid_id);
+		_instance_slots[instance_id] = slot;
+
+		reference_material(data.MaterialID);
+		mark_dirty(slot);
+	}
+
+	// Free the slot's geometry and move the last slot into it, the cull shader reads a dense array
+	void vulkan_indirect_pass::remove_slot(u32 slot)
+	{
+		const u32 last{ (u32)_instances.size() - 1 };
+		const slot_owner owner{ _slot_owners[slot] };
+		if (_instance_slots[owner.instance_id] == slot) _instance_slots[owner.instance_id] = u32_invalid_id;
+
+		release_range(_vertex_buffer, _slot_vertices[slot]);
+		release_range(_index_buffer, _slot_indices[slot]);
+		release_material(_instances[slot].MaterialID);
+
+		if (slot != last)
+		{
+			_instances[slot] = _instances[last];
+			_slot_owners[slot] = _slot_owners[last];
+			_slot_vertices[slot] = _slot_vertices[last];
+			_slot_indices[slot] = _slot_indices[last];
+			_instance_slots[_slot_owners[slot].instance_id] = slot;
+			mark_dirty(slot);
+		}
+
+		_instances.resize(last);
+		_slot_owners.resize(last);
+		_slot_vertices.resize(last);
+		_slot_indices.resize(last);
+	}
+
+	u32 vulkan_indirect_pass::unread_entries(log_cursor& cursor, u32 count, u32 epoch)
+	{
+		// The log was cleared since the last read, every entry is new
+		const u32 first{ epoch == cursor.epoch ? cursor.read : 0 };
+		cursor = { epoch, count };
+		return first;
+	}
+
+	// Give every drawn instance of the scene a slot. The logs only matter from here on, what they hold is already in the scene.
+	u32 vulkan_indirect_pass::add_instances(scene::vulkan_scene& scene)
+	{
+		skip_changes(scene);
+		if (!_vertex_buffer.buffer) create_scene_buffers();
+		_synced = true;
+
+		utl::vector<id::id_type> added;
+		for (const id::id_type instance_id : scene.getInstanceIDs())
+		{
+			// Every material is drawn with the bindless shaders, instances without one aren't drawn
+			if (id::is_valid(scene::get_instance(instance_id).getMaterialID())) added.emplace_back(instance_id);
+		}
+
+		reserve_slots((u32)(_instances.size() + added.size()));
+		for (const id::id_type instance_id : added) add_slot(instance_id);
+		return (u32)added.size();
+	}
+
+	// Apply the instances removed and the materials changed since the last call, only the touched slots are uploaded again
+	u32 vulkan_indirect_pass::apply_changes(scene::vulkan_scene& scene)
+	{
+		u32 removed_count{ 0 };
+		u32 epoch{ 0 };
+		const scene::instance_change* const removed{ scene.getRemovedInstances(removed_count, epoch) };
+		const u32 first_removed{ unread_entries(_removed_cursor, removed_count, epoch) };
+
+		u32 patched{ 0 };
+		for (u32 i{ first_removed }; i < removed_count; ++i)
+		{
+			const id::id_type instance_id{ removed[i].instance_id };
+			const u32 slot{ instance_id < _instance_slots.size() ? _instance_slots[instance_id] : u32_invalid_id };
+			// Not drawn, or the slot already belongs to a newer instance with the same id
+			if (slot == u32_invalid_id || _slot_owners[slot].entity_id != removed[i].entity_id) continue;
+
+			remove_slot(slot);
+			++patched;
+		}
+
+		u32 changed_count{ 0 };
+		const scene::instance_change* const changed{ scene.getChangedInstances(changed_count, epoch) };
+		for (u32 i{ unread_entries(_changed_cursor, changed_count, epoch) }; i < changed_count; ++i)
+		{
+			const scene::instance_change& change{ changed[i] };
+			// Both logs are read every frame, an instance changed and then removed has its removal in this frame's entries
+			const auto same_instance = [&change](const scene::instance_change& r) { return r.instance_id == change.instance_id && r.entity_id == change.entity_id; };
+			if (std::any_of(removed + first_removed, removed + removed_count, same_instance)) continue;
+
+			const submesh::vulkan_instance_model& instance{ scene::get_instance(change.instance_id) };
+			const bool drawn{ id::is_valid(instance.getMaterialID()) };
+			const u32 slot{ change.instance_id < _instance_slots.size() ? _instance_slots[change.instance_id] : u32_invalid_id };
+			if (slot == u32_invalid_id)
+			{
+				if (!drawn) continue;
+				reserve_slots((u32)_instances.size() + 1);
+				add_slot(change.instance_id);
+				++patched;
+				continue;
+			}
+
+			if (!drawn)
+			{
+				remove_slot(slot);
+				++patched;
+				continue;
+			}
+
+			glsl::IndirectInstanceData& data{ _instances[slot] };
+			const u32 is_reflect{ instance.is_reflect() ? 1u : 0u };
+			const bool moved{ memcmp(&data.Model, &instance.getModelMatrix(), sizeof(math::m4x4)) != 0 };
+			if (data.MaterialID == instance.getMaterialID() && data.IsReflect == is_reflect && !moved) continue;
+
+			if (data.MaterialID != instance.getMaterialID())
+			{
+				release_material(data.MaterialID);
+				reference_material(instance.getMaterialID());
+				data.MaterialID = instance.getMaterialID();
+			}
+			data.IsReflect = is_reflect;
+			data.Model = instance.getModelMatrix();
+			data.BoundingSphere = instance.getWorldBoundingSphere();
+			mark_dirty(slot);
+			++patched;
+		}
+
+		return patched;
+	}
+
+	// Move both cursors to the end of the logs, without applying anything
+	void vulkan_indirect_pass::skip_changes(scene::vulkan_scene& scene)
+	{
+		u32 count{ 0 };
+		u32 epoch{ 0 };
+		scene.getRemovedInstances(count, epoch);
+		_removed_cursor = { epoch, count };
+		scene.getChangedInstances(count, epoch);
+		_changed_cursor = { epoch, count };
+	}
+
+	// Stage the instance slots changed since the last upload and the materials they reference
+	void vulkan_indirect_pass::upload_slots(u32 patched)
+	{
+		if (_dirty_first != u32_invalid_id && _dirty_first < _instances.size())
+		{
+			const u32 last{ std::min(_dirty_last, (u32)_instances.size() - 1) };
+			stage(_instance_buffer, _dirty_first, &_instances[_dirty_first], last - _dirty_first + 1);
+		}
+		_dirty_first = u32_invalid_id;
+		_dirty_last = 0;
+
+		bindless::flush_materials();
+		_stats.patched_instances = patched;
+	}
+
+	// Copy this frame's staged data into the packed buffers. The frames before this one, which still read them,
+	// are ordered before the copies by the first barrier, the cull dispatch and the draws after them by the second.
+	void vulkan_indirect_pass::record_uploads(VkCommandBuffer cmd)
+	{
+		packed_buffer* const buffers[3]{ &_vertex_buffer, &_index_buffer, &_instance_buffer };
+		bool grown{ false };
+		for (const packed_buffer* buffer : buffers) grown |= buffer->grown_from != VK_NULL_HANDLE;
+		_stats.uploaded_bytes = (u32)_staging.size();
+		if (_staging.empty() && !grown) return;
+
+		constexpr VkPipelineStageFlags read_stages{ VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT };
+		constexpr VkAccessFlags read_access{ VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT };
+		buffer_barrier(cmd, read_stages, read_access, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+
+		if (grown)
+		{
+			for (packed_buffer* buffer : buffers)
+			{
+				if (!buffer->grown_from) continue;
+				if (buffer->grown_size)
+				{
+					const VkBufferCopy region{ 0, 0, buffer->grown_size };
+					vkCmdCopyBuffer(cmd, buffer->grown_from, buffer->buffer, 1, &region);
+				}
+				core::deferred_release([old_buffer{ buffer->grown_from }, old_memory{ buffer->grown_from_memory }]() {
+					vkDestroyBuffer(core::logical_device(), old_buffer, nullptr);
+					vkFreeMemory(core::logical_device(), old_memory, nullptr);
+				});
+				buffer->grown_from = VK_NULL_HANDLE;
+				buffer->grown_from_memory = VK_NULL_HANDLE;
+				buffer->grown_size = 0;
+			}
+			// Uploads may land in ranges the copies just wrote
+			buffer_barrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+		}
+
+		if (!_staging.empty())
+		{
+			// Only frames that change the scene upload anything, their staging buffer goes with the frame
+			VkBuffer staging{ VK_NULL_HANDLE };
+			VkDeviceMemory staging_memory{ VK_NULL_HANDLE };
+			createBuffer(core::logical_device(), _staging.size(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging, staging_memory);
+			void* mapped{ nullptr };
+			vkMapMemory(core::logical_device(), staging_memory, 0, _staging.size(), 0, &mapped);
+			memcpy(mapped, _staging.data(), _staging.size());
+			vkUnmapMemory(core::logical_device(), staging_memory);
+
+			for (packed_buffer* buffer : buffers)
+			{
+				if (buffer->uploads.empty()) continue;
+				vkCmdCopyBuffer(cmd, staging, buffer->buffer, (u32)buffer->uploads.size(), buffer->uploads.data());
+				buffer->uploads.clear();
+			}
+
+			core::deferred_release([staging, staging_memory]() {
+				vkDestroyBuffer(core::logical_device(), staging, nullptr);
+				vkFreeMemory(core::logical_device(), staging_memory, nullptr);
+			});
+			_staging.clear();
+		}
+
+		buffer_barrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, read_stages, read_access);
+	}
+
+	void vulkan_indirect_pass::update(const frame_info& info, scene::vulkan_scene& scene)
+	{
+		if (!_supported)
+		{
+			// Nothing is drawn, but the scene only clears its logs once they were read
+			skip_changes(scene);
+			return;
+		}
+
+		// Changes are applied even while disabled so the scene's logs keep being consumed. Until the first sync
+		// nothing is drawn, that sync reads the scene as it is and waits for the pass to be enabled.
+		u32 patched{ 0 };
+		if (_synced) patched = apply_changes(scene);
+		else if (_enabled) patched = add_instances(scene);
+		else skip_changes(scene);
+		if (patched) upload_slots(patched);
+		if (!_enabled) return;
+
+		using namespace DirectX;
+		// Planes of the row-vector view-projection come from its columns, so work on the transpose.
+		// Depth is [0, 1]: near is the third column alone.
+		const XMMATRIX vp{ XMMatrixTranspose(camera::get(info.camera_id).view_projection()) };
+		const XMVECTOR planes[6]{
+			vp.r[3] + vp.r[0],		// left
+			vp.r[3] - vp.r[0],		// right
+			vp.r[3] + vp.r[1],		// bottom
+			vp.r[3] - vp.r[1],		// top
+			vp.r[2],				// near
+			vp.r[3] - vp.r[2],		// far
+		};
+		for (u32 i{ 0 }; i < 6; ++i)
+		{
+			XMStoreFloat4(&_cull_data.FrustumPlanes[i], XMPlaneNormalize(planes[i]));
+		}
+		_cull_data.InstanceCount = (u32)_instances.size();
+	}
+
+	void vulkan_indirect_pass::cull(vulkan_cmd_buffer cmd_buffer)
+	{
+		if (!_enabled || !_supported) return;
+
+		const auto start{ indirect_clock::now() };
+		VkCommandBuffer cmd{ cmd_buffer.cmd_buffer };
+		// Also when the last instance was just removed: buffers replaced this frame still have to be copied and retired
+		record_uploads(cmd);
+		if (!is_ready()) return;
+
+		// The render graph orders this after last frame's indirect draws and the draws below after the dispatch
+		vkCmdFillBuffer(cmd, data::get_data<data::vulkan_buffer>(_count_buffer_id).cpu_address, 0, VK_WHOLE_SIZE, 0);
+
+		buffer_barrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+		const VkPipelineLayout layout{ data::get_data<VkPipelineLayout>(_cull_pipeline_layout_id) };
+		VkDescriptorSet set{ data::get_data<VkDescriptorSet>(_cull_set_id) };
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, data::get_data<VkPipeline>(_cull_pipeline_id));
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, 1, &set, 0, nullptr);
+		vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(glsl::IndirectCullData), &_cull_data);
+		vkCmdDispatch(cmd, (u32)math::align_size_up<indirect::cull_group_size>(_cull_data.InstanceCount) / indirect::cull_group_size, 1, 1);
+
+		_stats.record_ms = elapsed_ms(start);
+	}
+
+	void vulkan_indirect_pass::draw(vulkan_cmd_buffer cmd_buffer)
+	{
+		if (!is_ready()) return;
+
+		const auto start{ indirect_clock::now() };
+		VkCommandBuffer cmd{ cmd_buffer.cmd_buffer };
+		const VkPipelineLayout layout{ data::get_data<VkPipelineLayout>(_draw_pipeline_layout_id) };
+
+		VkDeviceSize offset[] = { 0 };
+		vkCmdBindVertexBuffers(cmd, 0, 1, &_vertex_buffer.buffer, offset);
+		vkCmdBindIndexBuffer(cmd, _index_buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+		const VkDescriptorSet sets[2]{ data::get_data<VkDescriptorSet>(bindless::descriptor_set_id()), data::get_data<VkDescriptorSet>(_instance_set_id) };
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, data::get_data<VkPipeline>(_draw_pipeline_id));
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 2, sets, 0, nullptr);
+		vkCmdDrawIndexedIndirectCount(cmd, data::get_data<data::vulkan_buffer>(_command_buffer_id).cpu_address, 0,
+			data::get_data<data::vulkan_buffer>(_count_buffer_id).cpu_address, 0, (u32)_instances.size(), sizeof(VkDrawIndexedIndirectCommand));
+
+		_stats.instance_count = _cull_data.InstanceCount;
+		_stats.record_ms += elapsed_ms(start);
+	}
+
+	bool vulkan_indirect_pass::verify()
+	{
+		if (!is_ready()) return true;
+
+		vkDeviceWaitIdle(core::logical_device());
+
+		utl::vector<VkDrawIndexedIndirectCommand> reference_commands;
+		u32 reference_count{ 0 };
+		indirect::cull_reference(_instances, _cull_data, reference_commands, reference_count);
+
+		const auto& command_buffer = data::get_data<data::vulkan_buffer>(_command_buffer_id);
+		const auto& count_buffer = data::get_data<data::vulkan_buffer>(_count_buffer_id);
+		void* mapped_commands{ nullptr };
+		void* mapped_count{ nullptr };
+		vkMapMemory(core::logical_device(), command_buffer.cpu_memory, 0, command_buffer.size, 0, &mapped_commands);
+		vkMapMemory(core::logical_device(), count_buffer.cpu_memory, 0, count_buffer.size, 0, &mapped_count);
+		const VkDrawIndexedIndirectCommand* const gpu_commands{ (const VkDrawIndexedIndirectCommand*)mapped_commands };
+		const u32 gpu_count{ *(const u32*)mapped_count };
+
+		bool result{ true };
+		utl::vector<u8> gpu_visible(_instances.size(), 0);
+		utl::vector<u8> cpu_visible(_instances.size(), 0);
+		if (gpu_count > _instances.size())
+		{
+			MESSAGE(("Indirect cull: count " + std::to_string(gpu_count) + " exceeds the instance count").c_str());
+			result = false;
+		}
+		else
+		{
+			for (u32 i{ 0 }; i < gpu_count; ++i)
+			{
+				const VkDrawIndexedIndirectCommand& command{ gpu_commands[i] };
+				const u32 instance{ command.firstInstance };
+				if (instance >= _instances.size() ||
+					command.indexCount != _instances[instance].IndexCount || command.firstIndex != _instances[instance].FirstIndex ||
+					command.vertexOffset != _instances[instance].VertexOffset || command.instanceCount != 1)
+				{
+					MESSAGE(("Indirect cull: bad command in slot " + std::to_string(i)).c_str());
+					result = false;
+					continue;
+				}
+				gpu_visible[instance] = 1;
+			}
+		}
+		for (u32 i{ 0 }; i < reference_count; ++i)
+		{
+			cpu_visible[reference_commands[i].firstInstance] = 1;
+		}
+
+		for (u32 i{ 0 }; i < _instances.size(); ++i)
+		{
+			if (gpu_visible[i] == cpu_visible[i]) continue;
+			if (std::abs(frustum_margin(_instances[i].BoundingSphere, _cull_data)) < cull_tolerance) continue;
+
+			MESSAGE(("Indirect cull: instance " + std::to_string(i) + (gpu_visible[i] ? " drawn by the GPU but culled by the reference" : " culled by the GPU but drawn by the reference")).c_str());
+			result = false;
+		}
+
+		vkUnmapMemory(core::logical_device(), command_buffer.cpu_memory);
+		vkUnmapMemory(core::logical_device(), count_buffer.cpu_memory);
+
+		return result;
+	}
+}
@@ -0,0 +1,184 @@
+#pragma once
+#include "VulkanCommonHeaders.h"
+#include "Shaders/ShaderTypes.h"
+
+namespace primal::graphics::vulkan
+{
+	namespace scene
+	{
+		class vulkan_scene;
+	}
+
+	namespace indirect
+	{
+		constexpr u32 cull_group_size{ 64 };				// local_size_x of instance_cull.comp
+		constexpr u32 initial_instance_capacity{ 256 };		// Buffers start this large and double when they run out
+		constexpr u32 initial_vertex_capacity{ 1 << 16 };
+		constexpr u32 initial_index_capacity{ 1 << 18 };
+
+		// CPU side cost of the GPU-driven path in the last frame
+		struct draw_stats
+		{
+			u32			instance_count;		// Instances handed to the cull shader
+			u32			material_count;		// Materials written to the bindless material buffer
+			u32			patched_instances;	// Instances added, removed or changed by the last scene update
+			u32			uploaded_bytes;		// Instance and geometry data copied to the GPU this frame
+			f32			record_ms;			// Time spent recording the uploads, the cull dispatch and the indirect draws
+		};
+
+		// The GPU-driven path is opt-in and off by default. It draws every material with one bindless pipeline, while the
+		// per-instance path keeps the material pipelines and the draw recording work that isn't part of it yet.
+		// Call before the surfaces are created.
+		void set_gpu_driven(bool enabled);
+		[[nodiscard]] bool is_gpu_driven();
+
+		// Read back the GPU culling result after every frame and compare it with cull_reference(). Off by default,
+		// vulkan_indirect_pass::verify() waits for the device.
+		void set_verify_culling(bool enabled);
+		[[nodiscard]] bool is_verifying_culling();
+
+		// CPU reference of instance_cull.comp. Commands are written in instance order, the GPU writes
+		// them in whatever order the atomics resolve, so compare them as a set.
+		void cull_reference(const utl::vector<glsl::IndirectInstanceData>& instances, const glsl::IndirectCullData& cull_data,
+			OUT utl::vector<VkDrawIndexedIndirectCommand>& commands, OUT u32& count);
+	}
+
+	// GPU-driven path of the geometry pass. All instances are packed into shared vertex/index buffers and an
+	// instance storage buffer, a compute shader culls them and writes the draw commands, and the geometry pass
+	// draws the whole scene with one vkCmdDrawIndexedIndirectCount. Materials are bindless, so recording cost
+	// depends neither on instance count nor on material count.
+	// Scene changes are patched in place: only the instance slots and geometry ranges that changed are copied
+	// to the GPU, in the frame's command buffer. Buffers that have to grow are replaced and retired with
+	// core::deferred_release, the pass never waits for the device.
+	class vulkan_indirect_pass
+	{
+	public:
+		vulkan_indirect_pass() = default;
+
+		DISABLE_COPY_AND_MOVE(vulkan_indirect_pass);
+
+		~vulkan_indirect_pass() = default;
+
+		void setup(id::id_type renderpass_id, id::id_type ubo_id);
+
+		void release();
+
+		// Patch the packed buffers when the scene changed and extract the camera frustum for culling
+		void update(const frame_info& info, scene::vulkan_scene& scene);
+
+		// Record the pending uploads and the cull dispatch into cmd_buffer, must be outside of a render pass. Runs as
+		// a render graph pass, the graph places the barriers against the indirect draws.
+		void cull(vulkan_cmd_buffer cmd_buffer);
+
+		// Record the indirect draws into cmd_buffer, must be inside the geometry render pass
+		void draw(vulkan_cmd_buffer cmd_buffer);
+
+		// Wait for the GPU and compare its culling output with indirect::cull_reference()
+		bool verify();
+
+		constexpr void set_enabled(bool enabled) { _enabled = enabled; }
+
+		// False when disabled, not opted in with indirect::set_gpu_driven(), unsupported by the device or there is nothing to draw.
+		// The geometry pass then falls back to per-instance draws.
+		[[nodiscard]] constexpr bool is_ready() const { return _enabled && _supported && !_instances.empty(); }
+
+		[[nodiscard]] constexpr const indirect::draw_stats& get_stats() const { return _stats; }
+
+	private:
+		// Span of elements in one of the packed geometry buffers
+		struct range
+		{
+			u32													offset;
+			u32													count;
+		};
+
+		// Device local buffer the pass sub-allocates from
+		struct packed_buffer
+		{
+			VkBuffer											buffer{ VK_NULL_HANDLE };
+			VkDeviceMemory										memory{ VK_NULL_HANDLE };
+			VkBufferUsageFlags									usage{ 0 };
+			u32													element_size{ 0 };
+			u32													capacity{ 0 };			// In elements
+			u32													end{ 0 };				// Elements up to the end of the last allocation
+			utl::vector<range>									free_ranges;
+			utl::vector<VkBufferCopy>							uploads;				// From the frame's staging data, recorded by cull()
+			VkBuffer											grown_from{ VK_NULL_HANDLE };	// Smaller buffer this one replaced, its content is copied over before the uploads
+			VkDeviceMemory										grown_from_memory{ VK_NULL_HANDLE };
+			u32													grown_size{ 0 };		// Bytes to copy from grown_from
+		};
+
+		// Scene instance drawn from a slot, ids are recycled so the entity tells a new instance apart
+		struct slot_owner
+		{
+			id::id_type											instance_id;
+			id::id_type											entity_id;
+		};
+
+		// Position in one of the scene's instance change logs
+		struct log_cursor
+		{
+			u32													epoch{ u32_invalid_id };
+			u32													read{ 0 };				// Entries already applied
+		};
+
+		// First entry of a log the cursor hasn't applied yet, the cursor moves past every entry
+		static u32 unread_entries(log_cursor& cursor, u32 count, u32 epoch);
+		u32 add_instances(scene::vulkan_scene& scene);
+		u32 apply_changes(scene::vulkan_scene& scene);
+		void skip_changes(scene::vulkan_scene& scene);
+		void upload_slots(u32 patched);
+		void add_slot(id::id_type instance_id);
+		void remove_slot(u32 slot);
+		void reserve_slots(u32 count);
+		void mark_dirty(u32 slot);
+		void reference_material(id::id_type material_id);
+		void release_material(id::id_type material_id);
+		range allocate_range(packed_buffer& buffer, u32 count);
+		void release_range(packed_buffer& buffer, range r);
+		void grow(packed_buffer& buffer, u32 capacity);
+		void stage(packed_buffer& buffer, u32 offset, const void* const data, u32 count);
+		void record_uploads(VkCommandBuffer cmd);
+		void release_scene_data();
+		void create_scene_buffers();
+		void create_layouts();
+		void create_cull_pipeline();
+		void create_draw_pipeline();
+		void write_descriptor_sets();
+
+		utl::vector<glsl::IndirectInstanceData>					_instances;
+		utl::vector<slot_owner>									_slot_owners;			// Owner of each instance slot
+		utl::vector<range>										_slot_vertices;			// Geometry ranges of each instance slot
+		utl::vector<range>										_slot_indices;
+		utl::vector<u32>										_instance_slots;		// Slot of each scene instance by instance id, u32_invalid_id when it isn't drawn
+		utl::vector<u32>										_material_refs;			// Slots drawn with each material, by material id
+		utl::vector<u8>											_staging;				// Data of this frame's uploads
+		u32														_dirty_first{ u32_invalid_id };	// Instance slots to upload, inclusive
+		u32														_dirty_last{ 0 };
+		packed_buffer											_vertex_buffer;
+		packed_buffer											_index_buffer;
+		packed_buffer											_instance_buffer;
+		glsl::IndirectCullData									_cull_data{};
+		indirect::draw_stats									_stats{};
+		log_cursor												_removed_cursor;
+		log_cursor												_changed_cursor;
+		bool													_synced{ false };		// Every drawn instance of the scene has a slot
+		bool													_enabled{ false };
+		bool													_supported{ false };
+
+		id::id_type												_renderpass_id{ id::invalid_id };		// Geometry render pass, owned by vulkan_geometry_pass
+		id::id_type												_ubo_id{ id::invalid_id };				// Global shader data, owned by vulkan_scene
+		id::id_type												_command_buffer_id{ id::invalid_id };
+		id::id_type												_count_buffer_id{ id::invalid_id };
+
+		id::id_type												_descriptor_pool_id{ id::invalid_id };
+		id::id_type												_cull_set_layout_id{ id::invalid_id };
+		id::id_type												_instance_set_layout_id{ id::invalid_id };
+		id::id_type												_cull_set_id{ id::invalid_id };
+		id::id_type												_instance_set_id{ id::invalid_id };
+		id::id_type												_cull_pipeline_layout_id{ id::invalid_id };
+		id::id_type												_draw_pipeline_layout_id{ id::invalid_id };
+		id::id_type												_cull_pipeline_id{ id::invalid_id };
+		id::id_type												_draw_pipeline_id{ id::invalid_id };
+	};
+}
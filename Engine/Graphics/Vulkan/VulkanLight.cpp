@@ -50,20 +50,19 @@ namespace primal::graphics::vulkan::light
 			{
 				if (info.type == graphics::light::directional)
 				{
-					u32 index{ id::invalid_id };
-					for (u32 i{ 0 }; i < _non_cullable_owners.size(); ++i)
+					u32 index{ u32_invalid_id };
+
+					// Reuse the most recently freed slot, if any
+					if (!_free_non_cullable_slots.empty())
 					{
-						if (!id::is_valid(_non_cullable_owners[i]))
-						{
-							index = i;
-							break;
-						}
+						index = _free_non_cullable_slots.back();
+						_free_non_cullable_slots.resize(_free_non_cullable_slots.size() - 1);
+						assert(!id::is_valid(_non_cullable_owners[index]));
 					}
-
-					if (index == id::invalid_id)
+					else
 					{
 						index = (u32)_non_cullable_owners.size();
-						_non_cullable_owners.emplace_back();
+						_non_cullable_owners.emplace_back(id::invalid_id);
 						_non_cullable_lights.emplace_back();
 					}
 
@@ -74,32 +73,25 @@ namespace primal::graphics::vulkan::light
 					light_owner owner{ game_entity::entity_id{info.entity_id}, index, info.type, info.is_enabled };
 					const light_id id{ _owners.add(owner) };
 					_non_cullable_owners[index] = id;
+					set_entity_light(owner.id, id);
+					params.Direction = game_entity::entity{ owner.id }.orientation();
 
 					return graphics::light{ id, info.light_set_key };
 				}
 				else
 				{
-					u32 index{ u32_invalid_id };
+					// NOTE: cullable lights are kept packed as [enabled | disabled | free], so the first
+					//		 free slot is always right after the last valid light.
+					const u32 index{ _cullable_light_count };
 
-					// Try to find an empty slot
-					for (u32 i{ _enabled_light_count }; i < _cullable_owners.size(); ++i)
+					// If there's no free slot then add a new item
+					if (index == _cullable_owners.size())
 					{
-						if (!id::is_valid(_cullable_owners[i]))
-						{
-							index = i;
-							break;
-						}
-					}
-
-					// If no empty slot was found then add a new item
-					if (index == u32_invalid_id)
-					{
-						index = (u32)_cullable_owners.size();
 						_cullable_lights.emplace_back();
 						_culling_info.emplace_back();
 						_bounding_spheres.emplace_back();
 						_cullable_entity_ids.emplace_back();
-						_cullable_owners.emplace_back();
+						_cullable_owners.emplace_back(id::invalid_id);
 						_dirty_bits.emplace_back();
 						assert(_cullable_owners.size() == _cullable_lights.size());
 						assert(_cullable_owners.size() == _culling_info.size());
@@ -108,69 +100,145 @@ namespace primal::graphics::vulkan::light
 						assert(_cullable_owners.size() == _dirty_bits.size());
 					}
 
+					assert(!id::is_valid(_cullable_owners[index]));
+					++_cullable_light_count;
+
 					add_cullable_light_parameters(info, index);
 					add_light_culling_info(info, index);
 					const light_id id{ _owners.add(light_owner{game_entity::entity_id{info.entity_id}, index, info.type, info.is_enabled}) };
 					_cullable_entity_ids[index] = _owners[id].id;
 					_cullable_owners[index] = id;
+					set_entity_light(_owners[id].id, id);
 					make_dirty(index);
 					enable(id, info.is_enabled);
-					update_transform(index);
+					update_transform(_owners[id].data_index);
 
 					return graphics::light{ id, info.light_set_key };
 				}
 			}
 
+			// Add 'count' lights in one go. Storage is reserved once up front so that
+			// creating many lights doesn't reallocate the parallel arrays over and over.
+			void add(const light_init_info* const infos, u32 count, graphics::light* const lights)
+			{
+				assert(infos && lights);
+				u32 directional_count{ 0 };
+				for (u32 i{ 0 }; i < count; ++i)
+				{
+					if (infos[i].type == graphics::light::directional) ++directional_count;
+				}
+
+				const u32 cullable_count{ count - directional_count };
+				if (directional_count > _free_non_cullable_slots.size())
+				{
+					const u64 capacity{ _non_cullable_owners.size() + directional_count - _free_non_cullable_slots.size() };
+					_non_cullable_owners.reserve(capacity);
+					_non_cullable_lights.reserve(capacity);
+				}
+
+				if (cullable_count)
+				{
+					const u64 capacity{ (u64)_cullable_light_count + cullable_count };
+					_cullable_lights.reserve(capacity);
+					_culling_info.reserve(capacity);
+					_bounding_spheres.reserve(capacity);
+					_cullable_entity_ids.reserve(capacity);
+					_cullable_owners.reserve(capacity);
+					_dirty_bits.reserve(capacity);
+				}
+
+				for (u32 i{ 0 }; i < count; ++i)
+				{
+					lights[i] = add(infos[i]);
+				}
+			}
+
 			constexpr void remove(light_id id)
 			{
 				enable(id, false);
 
 				const light_owner& owner{ _owners[id] };
+				assert(_entity_lights[id::index(owner.id)] == id);
+				_entity_lights[id::index(owner.id)] = light_id{ id::invalid_id };
 
 				if (owner.type == graphics::light::directional)
 				{
 					_non_cullable_owners[owner.data_index] = light_id{ id::invalid_id };
+					_free_non_cullable_slots.emplace_back(owner.data_index);
 				}
 				else
 				{
 					// Cullable lights
 					assert(_owners[_cullable_owners[owner.data_index]].data_index == owner.data_index);
-					_cullable_owners[owner.data_index] = light_id{ id::invalid_id };
+					assert(owner.data_index >= _enabled_light_count && _cullable_light_count > 0);
+
+					// Move the removed light to the end of the disabled lights, so the free slots
+					// stay packed at the end of the arrays.
+					const u32 last{ _cullable_light_count - 1 };
+					if (owner.data_index != last)
+					{
+						swap_cullable_lights(owner.data_index, last);
+					}
+
+					assert(owner.data_index == last);
+					_cullable_owners[last] = light_id{ id::invalid_id };
+					--_cullable_light_count;
 				}
 
 				_owners.remove(id);
 			}
 
+			void remove(const light_id* const ids, u32 count)
+			{
+				assert(ids);
+				for (u32 i{ 0 }; i < count; ++i)
+				{
+					remove(ids[i]);
+				}
+			}
+
+			// Recompute position, direction and bounding sphere only for lights whose entity
+			// transform changed since the last time this light set was updated.
 			void update_transforms()
 			{
-				// Update direction for non_cullable_lights
-				for (const auto& id : _non_cullable_owners)
+				u32 count{ 0 };
+				u32 epoch{ 0 };
+				const game_entity::entity_id *const ids{ transform::get_changed_entity_ids(count, epoch) };
+
+				// Only look at the entries that were added since we last read the list.
+				const u32 first{ epoch == _transform_epoch ? _transform_cursor : 0 };
+				_transform_epoch = epoch;
+				_transform_cursor = count;
+				if (first >= count) return;
+
+				_changed_cullable_lights.clear();
+				for (u32 i{ first }; i < count; ++i)
 				{
+					const game_entity::entity_id entity_id{ ids[i] };
+					const u32 entity_index{ id::index(entity_id) };
+					if (entity_index >= _entity_lights.size()) continue;
+
+					const light_id id{ _entity_lights[entity_index] };
 					if (!id::is_valid(id)) continue;
 
 					const light_owner& owner{ _owners[id] };
-					if (owner.is_enabled)
+					// Skip changes of an older entity that used the same slot.
+					if ((id::id_type)owner.id != (id::id_type)entity_id) continue;
+
+					if (owner.type == graphics::light::directional)
+					{
+						const game_entity::entity entity{ entity_id };
+						_non_cullable_lights[owner.data_index].Direction = entity.orientation();
+					}
+					else
 					{
-						const game_entity::entity entity{ game_entity::entity_id{ owner.id } };
-						glsl::DirectionalLightParameters& params{ _non_cullable_lights[owner.data_index] };
-						params.Direction = entity.orientation();
+						_changed_cullable_lights.emplace_back(owner.data_index);
 					}
 				}
 
-				// Update position and direction of cullable lights
-				const u32 count{ _enabled_light_count };
-				if (!count) return;
-
-				assert(_cullable_entity_ids.size() >= count);
-				_transform_flags_cache.resize(count);
-				transform::get_updated_components_flags(_cullable_entity_ids.data(), count, _transform_flags_cache.data());
-
-				for (u32 i{ 0 }; i < count; ++i)
+				if (!_changed_cullable_lights.empty())
 				{
-					if (_transform_flags_cache[i])
-					{
-						update_transform(i);
-					}
+					update_transforms(_changed_cullable_lights.data(), (u32)_changed_cullable_lights.size());
 				}
 			}
 
@@ -458,6 +526,24 @@ namespace primal::graphics::vulkan::light
 				}
 			}
 
+			// Return the direction of the first enabled directional light, if there is one.
+			CONSTEXPR bool first_directional_light(math::v3& direction) const
+			{
+				const u32 count{ (u32)_non_cullable_owners.size() };
+				for (u32 i{ 0 }; i < count; ++i)
+				{
+					if (!id::is_valid(_non_cullable_owners[i])) continue;
+
+					if (_owners[_non_cullable_owners[i]].is_enabled)
+					{
+						direction = _non_cullable_lights[i].Direction;
+						return true;
+					}
+				}
+
+				return false;
+			}
+
 			constexpr u32 cullable_light_count() const
 			{
 				return _enabled_light_count;
@@ -498,22 +584,134 @@ namespace primal::graphics::vulkan::light
 				}
 			}
 
+			void set_entity_light(game_entity::entity_id entity_id, light_id id)
+			{
+				const u32 entity_index{ id::index(entity_id) };
+				if (entity_index >= _entity_lights.size())
+				{
+					_entity_lights.reserve(((entity_index + 1) * 3) >> 1);
+					_entity_lights.resize(entity_index + 1, light_id{ id::invalid_id });
+				}
+
+				// NOTE: we assume one light per entity.
+				assert(!id::is_valid(_entity_lights[entity_index]));
+				_entity_lights[entity_index] = id;
+			}
+
 			void update_transform(u32 index)
 			{
-				const game_entity::entity entity{ game_entity::entity_id{ _cullable_entity_ids[index] } };
-				glsl::LightParameters& params{ _cullable_lights[index] };
-				params.Position = entity.position();
+				update_transforms(&index, 1);
+			}
 
-				glsl::LightCullingLightInfo& culling_info{ _culling_info[index] };
-				culling_info.Position = _bounding_spheres[index].Center = params.Position;
+			// Update cullable lights at 'indices' from their entities' transforms.
+			// The bounding sphere math is done for 4 lights at a time on SoA data.
+			void update_transforms(const u32 *const indices, u32 count)
+			{
+				using namespace DirectX;
+				constexpr u32 batch_size{ 4 };
 
-				if (_owners[_cullable_owners[index]].type == graphics::light::spot)
+				struct alignas(16) light_batch
 				{
-					culling_info.Direction = params.Direction = entity.orientation();
-					calculate_cone_bounding_sphere(params, _bounding_spheres[index]);
-				}
+					f32 px[batch_size], py[batch_size], pz[batch_size];
+					f32 dx[batch_size], dy[batch_size], dz[batch_size];
+					f32 range[batch_size];
+					f32 cos_penumbra[batch_size];
+					u32 is_spot[batch_size];
+				};
 
-				make_dirty(index);
+				const XMVECTOR one{ XMVectorSplatOne() };
+				const XMVECTOR narrow_cone_cos{ XMVectorReplicate(0.707107f) };
+
+				for (u32 first{ 0 }; first < count; first += batch_size)
+				{
+					const u32 n{ std::min(batch_size, count - first) };
+					light_batch batch{};
+
+					// Gather
+					for (u32 i{ 0 }; i < batch_size; ++i)
+					{
+						if (i >= n)
+						{
+							// Keep unused lanes well-defined.
+							batch.range[i] = batch.cos_penumbra[i] = 1.f;
+							continue;
+						}
+
+						const u32 index{ indices[first + i] };
+						assert(index < _cullable_lights.size());
+						const game_entity::entity entity{ game_entity::entity_id{ _cullable_entity_ids[index] } };
+						const math::v3 position{ entity.position() };
+						const glsl::LightParameters& params{ _cullable_lights[index] };
+						batch.px[i] = position.x;
+						batch.py[i] = position.y;
+						batch.pz[i] = position.z;
+						batch.range[i] = params.Range;
+
+						if (_owners[_cullable_owners[index]].type == graphics::light::spot)
+						{
+							const math::v3 direction{ entity.orientation() };
+							batch.dx[i] = direction.x;
+							batch.dy[i] = direction.y;
+							batch.dz[i] = direction.z;
+							batch.cos_penumbra[i] = params.CosPenumbra;
+							batch.is_spot[i] = 0xffffffff;
+							assert(params.CosPenumbra > 0.f);
+						}
+						else
+						{
+							batch.cos_penumbra[i] = 1.f;
+						}
+					}
+
+					// Same as calculate_cone_bounding_sphere(), 4 lights at a time.
+					const XMVECTOR range{ XMLoadFloat4A((const XMFLOAT4A*)batch.range) };
+					const XMVECTOR cone_cos{ XMLoadFloat4A((const XMFLOAT4A*)batch.cos_penumbra) };
+					const XMVECTOR cone_sin{ XMVectorSqrt(XMVectorNegativeMultiplySubtract(cone_cos, cone_cos, one)) };
+					const XMVECTOR is_spot{ XMLoadInt4A(batch.is_spot) };
+					const XMVECTOR is_narrow{ XMVectorGreaterOrEqual(cone_cos, narrow_cone_cos) };
+
+					const XMVECTOR narrow_radius{ XMVectorDivide(range, XMVectorAdd(cone_cos, cone_cos)) };
+					const XMVECTOR wide_radius{ XMVectorMultiply(cone_sin, range) };
+					const XMVECTOR wide_offset{ XMVectorMultiply(cone_cos, range) };
+
+					// Point lights: the sphere is centered at the light with radius equal to range.
+					const XMVECTOR radius{ XMVectorSelect(range, XMVectorSelect(wide_radius, narrow_radius, is_narrow), is_spot) };
+					const XMVECTOR offset{ XMVectorAndInt(XMVectorSelect(wide_offset, narrow_radius, is_narrow), is_spot) };
+
+					const XMVECTOR cx{ XMVectorMultiplyAdd(offset, XMLoadFloat4A((const XMFLOAT4A*)batch.dx), XMLoadFloat4A((const XMFLOAT4A*)batch.px)) };
+					const XMVECTOR cy{ XMVectorMultiplyAdd(offset, XMLoadFloat4A((const XMFLOAT4A*)batch.dy), XMLoadFloat4A((const XMFLOAT4A*)batch.py)) };
+					const XMVECTOR cz{ XMVectorMultiplyAdd(offset, XMLoadFloat4A((const XMFLOAT4A*)batch.dz), XMLoadFloat4A((const XMFLOAT4A*)batch.pz)) };
+
+					alignas(16) f32 center_x[batch_size];
+					alignas(16) f32 center_y[batch_size];
+					alignas(16) f32 center_z[batch_size];
+					alignas(16) f32 radii[batch_size];
+					XMStoreFloat4A((XMFLOAT4A*)center_x, cx);
+					XMStoreFloat4A((XMFLOAT4A*)center_y, cy);
+					XMStoreFloat4A((XMFLOAT4A*)center_z, cz);
+					XMStoreFloat4A((XMFLOAT4A*)radii, radius);
+
+					// Scatter
+					for (u32 i{ 0 }; i < n; ++i)
+					{
+						const u32 index{ indices[first + i] };
+						glsl::LightParameters& params{ _cullable_lights[index] };
+						glsl::LightCullingLightInfo& culling_info{ _culling_info[index] };
+						glsl::Sphere& sphere{ _bounding_spheres[index] };
+
+						params.Position = { batch.px[i], batch.py[i], batch.pz[i] };
+						culling_info.Position = params.Position;
+
+						if (batch.is_spot[i])
+						{
+							culling_info.Direction = params.Direction = { batch.dx[i], batch.dy[i], batch.dz[i] };
+						}
+
+						sphere.Center = { center_x[i], center_y[i], center_z[i] };
+						sphere.Radius = radii[i];
+						make_dirty(index);
+					}
+				}
 			}
 
 			CONSTEXPR void add_cullable_light_parameters(const light_init_info& info, u32 index)
@@ -651,6 +849,8 @@ namespace primal::graphics::vulkan::light
 			utl::free_list<light_owner>								_owners;
 			utl::vector<glsl::DirectionalLightParameters>			_non_cullable_lights;
 			utl::vector<light_id>									_non_cullable_owners;
+			// Directional slots freed by remove(), reused most recent first
+			utl::vector<u32>										_free_non_cullable_slots;
 
 			// NOTE: there are tightly packed
 			utl::vector<glsl::LightParameters>						_cullable_lights;
@@ -659,8 +859,16 @@ namespace primal::graphics::vulkan::light
 			utl::vector<game_entity::entity_id>						_cullable_entity_ids;
 			utl::vector<light_id>									_cullable_owners;
 			utl::vector<u8>											_dirty_bits;
-
-			utl::vector<u8>											_transform_flags_cache;
+			// Valid cullable lights, enabled and disabled. The first free slot is right after them.
+			u32														_cullable_light_count{ 0 };
+
+			// Light of each entity by entity index, invalid for entities without one
+			utl::vector<light_id>									_entity_lights;
+			// Cullable slots whose entity moved, gathered by update_transforms()
+			utl::vector<u32>										_changed_cullable_lights;
+			// Epoch and length of the transforms' changed entity list when update_transforms() last read it
+			u32														_transform_epoch{ u32_invalid_id };
+			u32														_transform_cursor{ 0 };
 			// number of cullable lights
 			u32														_enabled_light_count{ 0 }; 
 			// flag is set if any of cullable lights were changed.
@@ -1032,12 +1240,33 @@ namespace primal::graphics::vulkan::light
 		return light_sets[info.light_set_key].add(info);
 	}
 
+	void create(const light_init_info* const infos, u32 count, graphics::light* const lights)
+	{
+		if (!count) return;
+		const u64 light_set_key{ infos[0].light_set_key };
+		assert(light_sets.count(light_set_key));
+#ifdef _DEBUG
+		for (u32 i{ 0 }; i < count; ++i)
+		{
+			assert(infos[i].light_set_key == light_set_key);
+			assert(id::is_valid(infos[i].entity_id));
+		}
+#endif
+		light_sets[light_set_key].add(infos, count, lights);
+	}
+
 	void remove(light_id id, u64 light_set_key)
 	{
 		assert(light_sets.count(light_set_key));
 		light_sets[light_set_key].remove(id);
 	}
 
+	void remove(const light_id* const ids, u32 count, u64 light_set_key)
+	{
+		assert(light_sets.count(light_set_key));
+		light_sets[light_set_key].remove(ids, count);
+	}
+
 	void set_parameter(light_id id, u64 light_set_key, light_parameter::parameter parameter, const void* const data, u32 data_size)
 	{
 		assert(data && data_size);
@@ -1102,4 +1331,10 @@ namespace primal::graphics::vulkan::light
 		assert(light_sets.count(light_set_key));
 		return light_sets[light_set_key].cullable_light_count();
 	}
+
+	bool directional_light_direction(u64 light_set_key, math::v3& direction)
+	{
+		assert(light_sets.count(light_set_key));
+		return light_sets[light_set_key].first_directional_light(direction);
+	}
 }
\ No newline at end of file
@@ -14,13 +14,16 @@ namespace primal::graphics::vulkan::light
 	void create_light_set(u64 light_set_key);
 	void remove_light_set(u64 light_set_key);
 	graphics::light create(light_init_info);
+	void create(const light_init_info* const infos, u32 count, graphics::light* const lights);
 	void remove(light_id id, u64 light_set_key);
+	void remove(const light_id* const ids, u32 count, u64 light_set_key);
 	void set_parameter(light_id id, u64 light_set_key, light_parameter::parameter parameter, const void* const data, u32 data_size);
 	void get_parameter(light_id id, u64 light_set_key, light_parameter::parameter parameter, void* const data, u32 data_size);
 
 	void update_light_buffers(const frame_info& info);
 	u32 non_cullable_light_count(u64 light_set_key);
 	u32 cullable_light_count(u64 light_set_key);
+	bool directional_light_direction(u64 light_set_key, math::v3& direction);
 	id::id_type non_cullable_light_buffer_id();
 	id::id_type cullable_light_buffer_id();
 	id::id_type culling_info_buffer_id();
@@ -0,0 +1,400 @@
+#include "VulkanPipelineCompiler.h"
+#include "VulkanCore.h"
+#include "VulkanShader.h"
+#include "TaskScheduler/TaskScheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace primal::graphics::vulkan::pipelines
+{
+	namespace
+	{
+		using compile_clock = std::chrono::high_resolution_clock;
+
+		// Deep copy of a VkGraphicsPipelineCreateInfo. It isn't moved once filled, info points into it.
+		struct graphics_state
+		{
+			VkGraphicsPipelineCreateInfo						info;
+			std::vector<VkPipelineShaderStageCreateInfo>		stages;
+			std::vector<std::string>							entry_points;
+			std::vector<VkVertexInputBindingDescription>		bindings;
+			std::vector<VkVertexInputAttributeDescription>		attributes;
+			std::vector<VkViewport>								viewports;
+			std::vector<VkRect2D>								scissors;
+			std::vector<VkSampleMask>							sample_mask;
+			std::vector<VkPipelineColorBlendAttachmentState>	blend_attachments;
+			std::vector<VkDynamicState>							dynamic_states;
+			VkPipelineVertexInputStateCreateInfo				vertex_input;
+			VkPipelineInputAssemblyStateCreateInfo				input_assembly;
+			VkPipelineTessellationStateCreateInfo				tessellation;
+			VkPipelineViewportStateCreateInfo					viewport;
+			VkPipelineRasterizationStateCreateInfo				rasterization;
+			VkPipelineMultisampleStateCreateInfo				multisample;
+			VkPipelineDepthStencilStateCreateInfo				depth_stencil;
+			VkPipelineColorBlendStateCreateInfo					color_blend;
+			VkPipelineDynamicStateCreateInfo					dynamic;
+		};
+
+		struct compile_request
+		{
+			graphics_state										state;
+			VkPipeline											pipeline{ VK_NULL_HANDLE };
+			status												state_status{ status::pending };
+			bool												canceled{ false };
+			enki::TaskSet										task;				// Scheduled once, the request outlives it
+		};
+
+		using request_ptr = std::shared_ptr<compile_request>;
+
+		std::unordered_map<id::id_type, request_ptr>	requests;
+		std::vector<request_ptr>						in_flight;			// Scheduled tasks, kept until they're complete
+		std::mutex										compiler_mutex;
+		id::id_type										next_request{ 0 };
+		compile_stats									stats{};
+		bool											stopping{ false };
+
+		VkPipelineCache									pipeline_cache{ VK_NULL_HANDLE };
+		std::once_flag									cache_created;
+
+		template<typename T>
+		void copy_array(std::vector<T>& out, const T* const data, u32 count)
+		{
+			if (data && count) out.assign(data, data + count);
+		}
+
+		bool is_dynamic(const graphics_state& s, VkDynamicState dynamic_state)
+		{
+			return std::find(s.dynamic_states.begin(), s.dynamic_states.end(), dynamic_state) != s.dynamic_states.end();
+		}
+
+		void copy_state(const VkGraphicsPipelineCreateInfo& in, graphics_state& s)
+		{
+			assert(!in.pNext);
+			s.info = in;
+			s.info.pNext = nullptr;
+
+			copy_array(s.stages, in.pStages, in.stageCount);
+			s.entry_points.reserve(s.stages.size());
+			for (auto& stage : s.stages)
+			{
+				assert(!stage.pNext && !stage.pSpecializationInfo);
+				s.entry_points.emplace_back(stage.pName ? stage.pName : "main");
+				stage.pName = s.entry_points.back().c_str();
+			}
+			s.info.pStages = s.stages.data();
+
+			if (in.pDynamicState)
+			{
+				s.dynamic = *in.pDynamicState;
+				copy_array(s.dynamic_states, in.pDynamicState->pDynamicStates, in.pDynamicState->dynamicStateCount);
+				s.dynamic.pDynamicStates = s.dynamic_states.data();
+				s.info.pDynamicState = &s.dynamic;
+			}
+
+			if (in.pVertexInputState)
+			{
+				s.vertex_input = *in.pVertexInputState;
+				copy_array(s.bindings, in.pVertexInputState->pVertexBindingDescriptions, in.pVertexInputState->vertexBindingDescriptionCount);
+				copy_array(s.attributes, in.pVertexInputState->pVertexAttributeDescriptions, in.pVertexInputState->vertexAttributeDescriptionCount);
+				s.vertex_input.pVertexBindingDescriptions = s.bindings.data();
+				s.vertex_input.pVertexAttributeDescriptions = s.attributes.data();
+				s.info.pVertexInputState = &s.vertex_input;
+			}
+
+			if (in.pInputAssemblyState)
+			{
+				s.input_assembly = *in.pInputAssemblyState;
+				s.info.pInputAssemblyState = &s.input_assembly;
+			}
+
+			if (in.pTessellationState)
+			{
+				s.tessellation = *in.pTessellationState;
+				s.info.pTessellationState = &s.tessellation;
+			}
+
+			if (in.pViewportState)
+			{
+				// The helpers leave pViewports and pScissors unset, they're only valid when the state isn't dynamic
+				s.viewport = *in.pViewportState;
+				if (!is_dynamic(s, VK_DYNAMIC_STATE_VIEWPORT)) copy_array(s.viewports, in.pViewportState->pViewports, in.pViewportState->viewportCount);
+				if (!is_dynamic(s, VK_DYNAMIC_STATE_SCISSOR)) copy_array(s.scissors, in.pViewportState->pScissors, in.pViewportState->scissorCount);
+				s.viewport.pViewports = s.viewports.empty() ? nullptr : s.viewports.data();
+				s.viewport.pScissors = s.scissors.empty() ? nullptr : s.scissors.data();
+				s.info.pViewportState = &s.viewport;
+			}
+
+			if (in.pRasterizationState)
+			{
+				s.rasterization = *in.pRasterizationState;
+				s.info.pRasterizationState = &s.rasterization;
+			}
+
+			if (in.pMultisampleState)
+			{
+				s.multisample = *in.pMultisampleState;
+				copy_array(s.sample_mask, in.pMultisampleState->pSampleMask, (in.pMultisampleState->rasterizationSamples + 31) / 32);
+				s.multisample.pSampleMask = s.sample_mask.empty() ? nullptr : s.sample_mask.data();
+				s.info.pMultisampleState = &s.multisample;
+			}
+
+			if (in.pDepthStencilState)
+			{
+				s.depth_stencil = *in.pDepthStencilState;
+				s.info.pDepthStencilState = &s.depth_stencil;
+			}
+
+			if (in.pColorBlendState)
+			{
+				s.color_blend = *in.pColorBlendState;
+				copy_array(s.blend_attachments, in.pColorBlendState->pAttachments, in.pColorBlendState->attachmentCount);
+				s.color_blend.pAttachments = s.blend_attachments.data();
+				s.info.pColorBlendState = &s.color_blend;
+			}
+		}
+
+		void add_module_references(const graphics_state& s)
+		{
+			for (const auto& stage : s.stages) shaders::add_module_reference(stage.module);
+		}
+
+		void remove_module_references(const graphics_state& s)
+		{
+			for (const auto& stage : s.stages) shaders::remove_module_reference(stage.module);
+		}
+
+		// Doesn't touch the request list, so it runs without compiler_mutex
+		VkPipeline create_pipeline(const graphics_state& s, f32& ms)
+		{
+			const auto start{ compile_clock::now() };
+			VkPipeline pipeline{ VK_NULL_HANDLE };
+			VkResult result{ VK_SUCCESS };
+			VkCall(result = vkCreateGraphicsPipelines(core::logical_device(), cache(), 1, &s.info, nullptr, &pipeline), "Failed to create graphics pipeline...");
+			ms = std::chrono::duration<f32, std::milli>(compile_clock::now() - start).count();
+			return result == VK_SUCCESS ? pipeline : VK_NULL_HANDLE;
+		}
+
+		// Call with compiler_mutex locked
+		void finish_request(compile_request& request, VkPipeline pipeline, f32 ms)
+		{
+			if (pipeline)
+			{
+				++stats.compiled;
+				stats.total_ms += ms;
+				stats.max_ms = std::max(stats.max_ms, ms);
+			}
+			else
+			{
+				++stats.failed;
+			}
+
+			if (request.canceled)
+			{
+				if (pipeline) vkDestroyPipeline(core::logical_device(), pipeline, nullptr);
+				return;
+			}
+			request.pipeline = pipeline;
+			request.state_status = pipeline ? status::ready : status::failed;
+		}
+
+		// Runs on a task thread. Requests canceled while they were queued are dropped without compiling.
+		void run_request(compile_request& request)
+		{
+			{
+				std::unique_lock lock{ compiler_mutex };
+				if (request.canceled || stopping)
+				{
+					--stats.pending;
+					lock.unlock();
+					remove_module_references(request.state);
+					return;
+				}
+			}
+
+			f32 ms{ 0.f };
+			const VkPipeline pipeline{ create_pipeline(request.state, ms) };
+			remove_module_references(request.state);
+
+			std::lock_guard lock{ compiler_mutex };
+			--stats.pending;
+			finish_request(request, pipeline, ms);
+		}
+
+		// Call with compiler_mutex locked
+		void release_completed_tasks()
+		{
+			in_flight.erase(std::remove_if(in_flight.begin(), in_flight.end(),
+				[](const request_ptr& request) { return request->task.GetIsComplete(); }), in_flight.end());
+		}
+
+		std::vector<u8> read_cache_file(const VkPhysicalDeviceProperties& properties)
+		{
+			std::ifstream in{ cache_file, std::ios::in | std::ios::binary | std::ios::ate };
+			if (!in) return {};
+			std::vector<u8> data((size_t)in.tellg());
+			in.seekg(0);
+			if (data.size() < sizeof(VkPipelineCacheHeaderVersionOne) || !in.read((char*)data.data(), data.size())) return {};
+
+			// The driver checks this too, a stale file is dropped here so it isn't worth a warning
+			VkPipelineCacheHeaderVersionOne header;
+			memcpy(&header, data.data(), sizeof(header));
+			if (header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE || header.vendorID != properties.vendorID ||
+				header.deviceID != properties.deviceID || memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE))
+			{
+				MESSAGE(("Pipeline cache: " + std::string{ cache_file } + " was written by another device or driver, starting empty").c_str());
+				return {};
+			}
+			return data;
+		}
+
+		void write_cache_file()
+		{
+			size_t size{ 0 };
+			if (vkGetPipelineCacheData(core::logical_device(), pipeline_cache, &size, nullptr) != VK_SUCCESS || !size) return;
+			std::vector<u8> data(size);
+			if (vkGetPipelineCacheData(core::logical_device(), pipeline_cache, &size, data.data()) != VK_SUCCESS) return;
+
+			std::ofstream out{ cache_file, std::ios::out | std::ios::binary | std::ios::trunc };
+			if (!out || !out.write((const char*)data.data(), size))
+				MESSAGE(("Pipeline cache: can't write " + std::string{ cache_file }).c_str());
+		}
+	} // anonymous namespace
+
+	VkPipelineCache cache()
+	{
+		std::call_once(cache_created, [] {
+			VkPhysicalDeviceProperties properties;
+			vkGetPhysicalDeviceProperties(core::physical_device(), &properties);
+			const std::vector<u8> data{ read_cache_file(properties) };
+
+			VkPipelineCacheCreateInfo info{ VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO };
+			info.pNext = nullptr;
+			info.flags = 0;			// Not externally synchronized, the task threads share it
+			info.initialDataSize = data.size();
+			info.pInitialData = data.empty() ? nullptr : data.data();
+			VkResult result{ VK_SUCCESS };
+			VkCall(result = vkCreatePipelineCache(core::logical_device(), &info, nullptr, &pipeline_cache), "Failed to create pipeline cache...");
+			if (result != VK_SUCCESS) pipeline_cache = VK_NULL_HANDLE;
+		});
+		return pipeline_cache;
+	}
+
+	id::id_type compile(const VkGraphicsPipelineCreateInfo& info)
+	{
+		request_ptr request{ std::make_shared<compile_request>() };
+		copy_state(info, request->state);
+		add_module_references(request->state);
+
+		if constexpr (!compile_async)
+		{
+			f32 ms{ 0.f };
+			const VkPipeline pipeline{ create_pipeline(request->state, ms) };
+			remove_module_references(request->state);
+
+			std::lock_guard lock{ compiler_mutex };
+			finish_request(*request, pipeline, ms);
+			requests.emplace(next_request, request);
+			return next_request++;
+		}
+
+		compile_request* const r{ request.get() };
+		r->task.m_Priority = enki::TASK_PRIORITY_LOW;
+		r->task.m_Function = [r](enki::TaskSetPartition, u32) { run_request(*r); };
+
+		id::id_type request_id{ id::invalid_id };
+		{
+			std::lock_guard lock{ compiler_mutex };
+			requests.emplace(next_request, request);
+			++stats.pending;
+			request_id = next_request++;
+		}
+
+		// Outside the lock, the scheduler runs the task right here when its pipe is full
+		core::task_scheduler().AddTaskSetToPipe(&r->task);
+
+		// Only tracked once it's in the pipe, a task that was never added reads as complete
+		std::lock_guard lock{ compiler_mutex };
+		release_completed_tasks();
+		in_flight.emplace_back(std::move(request));
+		return request_id;
+	}
+
+	status get_status(id::id_type request)
+	{
+		std::lock_guard lock{ compiler_mutex };
+		auto it = requests.find(request);
+		assert(it != requests.end());
+		return it == requests.end() ? status::failed : it->second->state_status;
+	}
+
+	VkPipeline take(id::id_type request)
+	{
+		std::lock_guard lock{ compiler_mutex };
+		auto it = requests.find(request);
+		assert(it != requests.end() && it->second->state_status == status::ready);
+		if (it == requests.end()) return VK_NULL_HANDLE;
+
+		const VkPipeline pipeline{ it->second->pipeline };
+		requests.erase(it);
+		return pipeline;
+	}
+
+	void cancel(id::id_type request)
+	{
+		std::lock_guard lock{ compiler_mutex };
+		auto it = requests.find(request);
+		if (it == requests.end()) return;
+
+		compile_request& r{ *it->second };
+		r.canceled = true;
+		// Not handed out yet, nothing else refers to it
+		if (r.pipeline) vkDestroyPipeline(core::logical_device(), r.pipeline, nullptr);
+		r.pipeline = VK_NULL_HANDLE;
+		requests.erase(it);
+	}
+
+	compile_stats get_stats()
+	{
+		std::lock_guard lock{ compiler_mutex };
+		return stats;
+	}
+
+	void shutdown()
+	{
+		std::vector<request_ptr> tasks;
+		{
+			std::lock_guard lock{ compiler_mutex };
+			stopping = true;
+			tasks.swap(in_flight);
+		}
+		// The queued tasks see stopping and only drop their shader module references
+		for (auto& request : tasks) core::task_scheduler().WaitforTask(&request->task);
+		tasks.clear();
+		stopping = false;
+
+		for (auto& [id, request] : requests)
+		{
+			if (request->pipeline) vkDestroyPipeline(core::logical_device(), request->pipeline, nullptr);
+		}
+		requests.clear();
+		stats.pending = 0;
+
+		MESSAGE(("Pipeline compiler: " + std::to_string(stats.compiled) + " pipelines in " + std::to_string(stats.total_ms) +
+			" ms, slowest " + std::to_string(stats.max_ms) + " ms, " + std::to_string(stats.failed) + " failed").c_str());
+
+		if (pipeline_cache)
+		{
+			write_cache_file();
+			vkDestroyPipelineCache(core::logical_device(), pipeline_cache, nullptr);
+			pipeline_cache = VK_NULL_HANDLE;
+		}
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "VulkanCommonHeaders.h"
+
+namespace primal::graphics::vulkan::pipelines
+{
+	constexpr bool compile_async{ true };				// false compiles on the calling thread, to compare the hitches against
+	constexpr bool draw_fallback{ true };				// Draws whose pipeline isn't ready use the fallback pipeline, otherwise they're skipped
+	constexpr const char* cache_file{ "pipeline_cache.bin" };
+
+	enum class status : u32
+	{
+		pending,
+		ready,
+		failed,
+	};
+
+	struct compile_stats
+	{
+		u32			compiled;			// Pipelines created, on the task scheduler or synchronously
+		u32			failed;
+		u32			pending;			// Queued or being compiled right now
+		f32			total_ms;			// Time spent in vkCreateGraphicsPipelines
+		f32			max_ms;
+	};
+
+	// Every pipeline of the engine is created with this cache, so equal state compiles once per run. Created on first use
+	// and seeded from cache_file when the file was written by the same device and driver. Safe to use from any thread.
+	[[nodiscard]] VkPipelineCache cache();
+
+	// Queue info as a low priority task of core::task_scheduler(). Everything info points to is copied, so it may go out of scope on return.
+	// The shader modules are kept alive until the request is done. pNext chains and specialization info aren't supported.
+	// Viewports and scissors are only read when they aren't dynamic state.
+	[[nodiscard]] id::id_type compile(const VkGraphicsPipelineCreateInfo& info);
+
+	[[nodiscard]] status get_status(id::id_type request);
+
+	// Hands the pipeline of a ready request to the caller, who destroys it, and forgets the request
+	[[nodiscard]] VkPipeline take(id::id_type request);
+
+	// Forgets a request that is no longer needed. If it's already compiling the pipeline is destroyed when it's done.
+	void cancel(id::id_type request);
+
+	[[nodiscard]] compile_stats get_stats();
+
+	// Called before the shader modules and the device are destroyed. Waits for the compiles in progress,
+	// drops the queued ones and writes cache_file.
+	void shutdown();
+}
@@ -0,0 +1,304 @@
+#include "VulkanProfiler.h"
+#include "VulkanCore.h"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace primal::graphics::vulkan::profiler
+{
+	namespace
+	{
+		// A slot is reused once the frame recorded into it is done, which the frame fences guarantee
+		// after frame_buffer_count newer frames
+		constexpr u32 slot_count{ frame_buffer_count + 1 };
+
+		constexpr VkQueryPipelineStatisticFlags graphics_statistics{ VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+			VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+			VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT | VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT };
+		// Queues without graphics can't count graphics stages
+		constexpr VkQueryPipelineStatisticFlags compute_statistics{ VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT };
+
+		struct pass_info
+		{
+			const char*			name;
+			bool				compute_queue;		// Recorded for the compute family queue
+		};
+
+		constexpr pass_info passes[]
+		{
+			{ "frustum", true },
+			{ "light_culling", true },
+			{ "shadow", false },
+			{ "instance_cull", false },
+			{ "gbuffer", false },
+			{ "composition", false },
+		};
+		static_assert(_countof(passes) == pass::count);
+
+		struct frame_slot
+		{
+			VkQueryPool			timestamps{ VK_NULL_HANDLE };		// Begin and end of every pass
+			VkQueryPool			statistics[2]{};				// Graphics and compute queue passes, one query per pass
+			u32					written{ 0 };					// Passes whose queries were recorded, bit per pass
+		};
+
+		struct pass_history
+		{
+			f32					samples[history_size]{};
+			u32					next{ 0 };
+			u32					count{ 0 };
+			pass_statistics		statistics{};
+		};
+
+		frame_slot				slots[slot_count];
+		pass_history			history[pass::count];
+		u32						current_slot{ 0 };
+		u64						timestamp_mask[2]{};			// Valid bits of the graphics and compute family, 0 when it has none
+		f32						timestamp_period{ 1.f };		// Nanoseconds per tick
+		bool					use_statistics{ false };
+		bool					initialized{ false };
+		bool					available{ false };				// Device can measure, host query reset is supported
+		bool					recording{ false };				// Current slot was reset and takes queries
+
+		u64 valid_bits(u32 family)
+		{
+			u32 count{ 0 };
+			vkGetPhysicalDeviceQueueFamilyProperties(core::physical_device(), &count, nullptr);
+			std::vector<VkQueueFamilyProperties> families(count);
+			vkGetPhysicalDeviceQueueFamilyProperties(core::physical_device(), &count, families.data());
+			if (family >= count) return 0;
+			const u32 bits{ families[family].timestampValidBits };
+			return bits >= 64 ? ~0ull : (1ull << bits) - 1;
+		}
+
+		VkQueryPool create_pool(VkQueryType type, u32 query_count, VkQueryPipelineStatisticFlags statistics)
+		{
+			VkQueryPoolCreateInfo info{ VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+			info.pNext = nullptr;
+			info.flags = 0;
+			info.queryType = type;
+			info.queryCount = query_count;
+			info.pipelineStatistics = statistics;
+
+			VkQueryPool pool{ VK_NULL_HANDLE };
+			VkResult result{ VK_SUCCESS };
+			VkCall(result = vkCreateQueryPool(core::logical_device(), &info, nullptr, &pool), "Failed to create query pool...");
+			if (result != VK_SUCCESS) return VK_NULL_HANDLE;
+			vkResetQueryPool(core::logical_device(), pool, 0, query_count);
+			return pool;
+		}
+
+		void initialize()
+		{
+			initialized = true;
+			if (!core::host_query_reset_supported())
+			{
+				MESSAGE("GPU profiler: host query reset isn't supported, passes aren't measured");
+				return;
+			}
+
+			VkPhysicalDeviceProperties properties;
+			vkGetPhysicalDeviceProperties(core::physical_device(), &properties);
+			VkPhysicalDeviceFeatures features;
+			vkGetPhysicalDeviceFeatures(core::physical_device(), &features);
+
+			timestamp_period = properties.limits.timestampPeriod;
+			timestamp_mask[0] = valid_bits(core::graphics_family_queue_index());
+			timestamp_mask[1] = valid_bits(core::compute_family_queue_index());
+			// Secondaries of the G-buffer pass run inside its statistics query, so they have to inherit it
+			use_statistics = features.pipelineStatisticsQuery && features.inheritedQueries;
+
+			for (auto& slot : slots)
+			{
+				slot.timestamps = create_pool(VK_QUERY_TYPE_TIMESTAMP, pass::count * 2, 0);
+				if (!use_statistics) continue;
+				slot.statistics[0] = create_pool(VK_QUERY_TYPE_PIPELINE_STATISTICS, pass::count, graphics_statistics);
+				slot.statistics[1] = create_pool(VK_QUERY_TYPE_PIPELINE_STATISTICS, pass::count, compute_statistics);
+			}
+			available = true;
+		}
+
+		void add_sample(pass_history& h, f32 ms)
+		{
+			h.samples[h.next] = ms;
+			h.next = (h.next + 1) % history_size;
+			h.count = std::min(h.count + 1, history_size);
+		}
+
+		// Returns false while the GPU hasn't finished the frame recorded into the slot
+		bool collect(frame_slot& slot)
+		{
+			for (u32 p{ 0 }; p < pass::count; ++p)
+			{
+				if (!(slot.written & (1u << p))) continue;
+
+				// Value and availability of the begin and end timestamp
+				u64 ticks[4]{};
+				const VkResult result{ vkGetQueryPoolResults(core::logical_device(), slot.timestamps, p * 2, 2, sizeof(ticks), ticks,
+					sizeof(u64) * 2, VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT) };
+				if (result != VK_SUCCESS || !ticks[1] || !ticks[3]) return false;
+			}
+
+			for (u32 p{ 0 }; p < pass::count; ++p)
+			{
+				if (!(slot.written & (1u << p))) continue;
+
+				u64 ticks[2]{};
+				vkGetQueryPoolResults(core::logical_device(), slot.timestamps, p * 2, 2, sizeof(ticks), ticks, sizeof(u64), VK_QUERY_RESULT_64_BIT);
+				const u64 mask{ timestamp_mask[passes[p].compute_queue ? 1 : 0] };
+				const u64 elapsed{ ((ticks[1] & mask) - (ticks[0] & mask)) & mask };
+				add_sample(history[p], (f32)elapsed * timestamp_period * 1e-6f);
+
+				if (!use_statistics) continue;
+				if (passes[p].compute_queue)
+				{
+					u64 value{ 0 };
+					if (vkGetQueryPoolResults(core::logical_device(), slot.statistics[1], p, 1, sizeof(value), &value, sizeof(value), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+						history[p].statistics = { 0, 0, 0, 0, value };
+				}
+				else
+				{
+					// Results are in the order of the flag bits
+					u64 values[5]{};
+					if (vkGetQueryPoolResults(core::logical_device(), slot.statistics[0], p, 1, sizeof(values), values, sizeof(values), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+						history[p].statistics = { values[0], values[1], values[2], values[3], values[4] };
+				}
+			}
+			return true;
+		}
+
+		void reset(frame_slot& slot)
+		{
+			vkResetQueryPool(core::logical_device(), slot.timestamps, 0, pass::count * 2);
+			for (auto pool : slot.statistics)
+				if (pool) vkResetQueryPool(core::logical_device(), pool, 0, pass::count);
+			slot.written = 0;
+		}
+
+		bool can_measure(pass p)
+		{
+			return recording && timestamp_mask[passes[p].compute_queue ? 1 : 0];
+		}
+	} // anonymous namespace
+
+	void begin_frame()
+	{
+		if constexpr (!enabled) return;
+		if (!initialized) initialize();
+		if (!available) return;
+
+		current_slot = (current_slot + 1) % slot_count;
+		frame_slot& slot{ slots[current_slot] };
+		// A slot the GPU isn't done with can't be reset, this frame goes unmeasured
+		recording = collect(slot);
+		if (recording) reset(slot);
+	}
+
+	void begin_pass(VkCommandBuffer cmd_buffer, pass p)
+	{
+		if constexpr (!enabled) return;
+		assert(p < pass::count);
+		if (!can_measure(p)) return;
+		frame_slot& slot{ slots[current_slot] };
+		if (slot.written & (1u << p)) return;
+
+		vkCmdWriteTimestamp(cmd_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, slot.timestamps, p * 2);
+		if (use_statistics) vkCmdBeginQuery(cmd_buffer, slot.statistics[passes[p].compute_queue ? 1 : 0], p, 0);
+	}
+
+	void end_pass(VkCommandBuffer cmd_buffer, pass p)
+	{
+		if constexpr (!enabled) return;
+		assert(p < pass::count);
+		if (!can_measure(p)) return;
+		frame_slot& slot{ slots[current_slot] };
+		if (slot.written & (1u << p)) return;
+
+		if (use_statistics) vkCmdEndQuery(cmd_buffer, slot.statistics[passes[p].compute_queue ? 1 : 0], p);
+		vkCmdWriteTimestamp(cmd_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, slot.timestamps, p * 2 + 1);
+		slot.written |= 1u << p;
+	}
+
+	VkQueryPipelineStatisticFlags inherited_statistics()
+	{
+		return use_statistics && recording ? graphics_statistics : 0;
+	}
+
+	const char* pass_name(pass p)
+	{
+		assert(p < pass::count);
+		return passes[p].name;
+	}
+
+	pass_timing get_timing(pass p)
+	{
+		assert(p < pass::count);
+		const pass_history& h{ history[p] };
+		if (!h.count) return {};
+
+		pass_timing timing{ h.samples[(h.next + history_size - 1) % history_size], h.samples[0], 0.f, h.samples[0], h.count };
+		for (u32 i{ 0 }; i < h.count; ++i)
+		{
+			timing.min_ms = std::min(timing.min_ms, h.samples[i]);
+			timing.max_ms = std::max(timing.max_ms, h.samples[i]);
+			timing.avg_ms += h.samples[i];
+		}
+		timing.avg_ms /= (f32)h.count;
+		return timing;
+	}
+
+	pass_statistics get_statistics(pass p)
+	{
+		assert(p < pass::count);
+		return history[p].statistics;
+	}
+
+	bool write_csv(const char* file)
+	{
+		std::ofstream out{ file, std::ios::out | std::ios::trunc };
+		if (!out) return false;
+
+		out << "pass,samples,last_ms,min_ms,avg_ms,max_ms,input_vertices,vertex_invocations,clipped_primitives,fragment_invocations,compute_invocations\n";
+		for (u32 p{ 0 }; p < pass::count; ++p)
+		{
+			const pass_timing t{ get_timing((pass)p) };
+			const pass_statistics& s{ history[p].statistics };
+			out << passes[p].name << ',' << t.sample_count << ',' << t.last_ms << ',' << t.min_ms << ',' << t.avg_ms << ',' << t.max_ms << ','
+				<< s.input_vertices << ',' << s.vertex_invocations << ',' << s.clipped_primitives << ',' << s.fragment_invocations << ',' << s.compute_invocations << '\n';
+		}
+		return (bool)out;
+	}
+
+	void flush()
+	{
+		if (!available) return;
+
+		// Oldest first, the device is idle so every slot is complete. Reset them so no frame is counted twice.
+		for (u32 i{ 1 }; i <= slot_count; ++i)
+		{
+			frame_slot& slot{ slots[(current_slot + i) % slot_count] };
+			if (collect(slot)) reset(slot);
+		}
+	}
+
+	void shutdown()
+	{
+		if (!available) return;
+
+		flush();
+		if (!write_csv(csv_file)) MESSAGE(("GPU profiler: can't write " + std::string{ csv_file }).c_str());
+
+		for (auto& slot : slots)
+		{
+			vkDestroyQueryPool(core::logical_device(), slot.timestamps, nullptr);
+			for (auto pool : slot.statistics)
+				if (pool) vkDestroyQueryPool(core::logical_device(), pool, nullptr);
+			slot = {};
+		}
+		available = false;
+		initialized = false;
+		recording = false;
+	}
+}
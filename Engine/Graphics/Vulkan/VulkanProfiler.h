@@ -0,0 +1,80 @@
+#pragma once
+#include "VulkanCommonHeaders.h"
+
+namespace primal::graphics::vulkan::profiler
+{
+	constexpr bool enabled{ true };
+	constexpr u32 history_size{ 120 };				// Frames the rolling min, average and max cover
+	constexpr const char* csv_file{ "gpu_profile.csv" };
+
+	enum pass : u32
+	{
+		frustum,
+		light_culling,
+		shadow,
+		instance_cull,
+		gbuffer,
+		composition,
+
+		count
+	};
+
+	struct pass_timing
+	{
+		f32			last_ms;			// Most recent frame that finished on the GPU
+		f32			min_ms;
+		f32			avg_ms;
+		f32			max_ms;
+		u32			sample_count;		// Frames in the rolling window, at most history_size
+	};
+
+	// Counts of the most recent finished frame. Passes on the compute queue only count compute invocations.
+	struct pass_statistics
+	{
+		u64			input_vertices;
+		u64			vertex_invocations;
+		u64			clipped_primitives;		// Primitives that made it through clipping to the rasterizer
+		u64			fragment_invocations;
+		u64			compute_invocations;
+	};
+
+	// Collect the queries of a frame that the GPU finished and reset its slot for the frame about to be recorded.
+	// Results trail the recorded frame by up to frame_buffer_count frames, nothing ever waits for the GPU.
+	// Called on the render thread before the frame's first pass is recorded.
+	void begin_frame();
+
+	// Timestamps and pipeline statistics around the commands recorded between the two calls. cmd_buffer has to be
+	// on the queue the pass is registered for. A pass recorded a second time in the same frame isn't measured again.
+	void begin_pass(VkCommandBuffer cmd_buffer, pass p);
+	void end_pass(VkCommandBuffer cmd_buffer, pass p);
+
+	// VkCommandBufferInheritanceInfo::pipelineStatistics of secondaries executed inside a measured pass
+	[[nodiscard]] VkQueryPipelineStatisticFlags inherited_statistics();
+
+	[[nodiscard]] const char* pass_name(pass p);
+	[[nodiscard]] pass_timing get_timing(pass p);
+	[[nodiscard]] pass_statistics get_statistics(pass p);
+
+	// One row per pass with its rolling timings and last statistics
+	bool write_csv(const char* file);
+
+	// Collect every frame still in its slot, for reading the results at the end of a run. Called with the device idle.
+	void flush();
+
+	// Called before the device is destroyed, writes csv_file
+	void shutdown();
+
+	class scope
+	{
+	public:
+		scope(VkCommandBuffer cmd_buffer, pass p) : _cmd_buffer{ cmd_buffer }, _pass{ p } { begin_pass(cmd_buffer, p); }
+
+		DISABLE_COPY_AND_MOVE(scope);
+
+		~scope() { end_pass(_cmd_buffer, _pass); }
+
+	private:
+		VkCommandBuffer				_cmd_buffer;
+		pass						_pass;
+	};
+}
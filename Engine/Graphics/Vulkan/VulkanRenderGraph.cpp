@@ -0,0 +1,959 @@
+#include "VulkanRenderGraph.h"
+#include "VulkanCore.h"
+#include "VulkanCommandBuffer.h"
+
+#include <algorithm>
+
+namespace primal::graphics::vulkan
+{
+	namespace
+	{
+		using namespace render_graph;
+
+		struct access_info
+		{
+			VkImageLayout			layout;
+			VkPipelineStageFlags	stage;
+			VkAccessFlags			access;
+			VkImageUsageFlags		image_usage;
+			VkBufferUsageFlags		buffer_usage;
+		};
+
+		access_info get_access_info(access a)
+		{
+			constexpr VkPipelineStageFlags depth_tests{ VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT };
+			switch (a)
+			{
+			case access::color_attachment:
+				return { VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+					VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, 0 };
+			case access::depth_attachment:
+				return { VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, depth_tests,
+					VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 0 };
+			case access::sampled_fragment:
+				return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_USAGE_SAMPLED_BIT, 0 };
+			case access::depth_read_fragment:
+				return { VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_USAGE_SAMPLED_BIT, 0 };
+			case access::sampled_compute:
+				return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_USAGE_SAMPLED_BIT, 0 };
+			case access::depth_read_compute:
+				return { VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_USAGE_SAMPLED_BIT, 0 };
+			case access::storage_read:
+				return { VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+					VK_IMAGE_USAGE_STORAGE_BIT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT };
+			case access::storage_write:
+				return { VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+					VK_IMAGE_USAGE_STORAGE_BIT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT };
+			case access::storage_read_fragment:
+				return { VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+					VK_IMAGE_USAGE_STORAGE_BIT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT };
+			case access::indirect_read:
+				return { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, 0, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT };
+			case access::transfer_read:
+				return { VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+					VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_BUFFER_USAGE_TRANSFER_SRC_BIT };
+			case access::transfer_write:
+				return { VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+					VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_BUFFER_USAGE_TRANSFER_DST_BIT };
+			default:
+				return { VK_IMAGE_LAYOUT_UNDEFINED, 0, 0, 0, 0 };
+			}
+		}
+
+		u32 queue_family(queue_type queue)
+		{
+			return queue == queue_type::graphics ? core::graphics_family_queue_index() : core::compute_family_queue_index();
+		}
+
+		bool is_depth_format(VkFormat format)
+		{
+			return format == VK_FORMAT_D16_UNORM || format == VK_FORMAT_D32_SFLOAT || format == VK_FORMAT_D16_UNORM_S8_UINT ||
+				format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+		}
+
+		constexpr VkAccessFlags write_access_mask{ VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT };
+
+		VkImageMemoryBarrier image_barrier(VkImage image, VkImageAspectFlags aspect, VkAccessFlags src_access, VkAccessFlags dst_access,
+			VkImageLayout old_layout, VkImageLayout new_layout, u32 src_family = VK_QUEUE_FAMILY_IGNORED, u32 dst_family = VK_QUEUE_FAMILY_IGNORED)
+		{
+			VkImageMemoryBarrier barrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+			barrier.pNext = nullptr;
+			barrier.srcAccessMask = src_access;
+			barrier.dstAccessMask = dst_access;
+			barrier.oldLayout = old_layout;
+			barrier.newLayout = new_layout;
+			barrier.srcQueueFamilyIndex = src_family;
+			barrier.dstQueueFamilyIndex = dst_family;
+			barrier.image = image;
+			barrier.subresourceRange = { aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+			return barrier;
+		}
+
+		VkBufferMemoryBarrier buffer_barrier(VkBuffer buffer, VkAccessFlags src_access, VkAccessFlags dst_access, u32 src_family, u32 dst_family)
+		{
+			VkBufferMemoryBarrier barrier{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER };
+			barrier.pNext = nullptr;
+			barrier.srcAccessMask = src_access;
+			barrier.dstAccessMask = dst_access;
+			barrier.srcQueueFamilyIndex = src_family;
+			barrier.dstQueueFamilyIndex = dst_family;
+			barrier.buffer = buffer;
+			barrier.offset = 0;
+			barrier.size = VK_WHOLE_SIZE;
+			return barrier;
+		}
+
+		// Barriers in front of a pass or at the end of a batch, recorded with a single vkCmdPipelineBarrier
+		struct barrier_batch
+		{
+			VkPipelineStageFlags				src_stage{ 0 };
+			VkPipelineStageFlags				dst_stage{ 0 };
+			VkMemoryBarrier						memory{ VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, 0, 0 };
+			bool								has_memory{ false };
+			utl::vector<VkImageMemoryBarrier>	images;
+			utl::vector<VkBufferMemoryBarrier>	buffers;
+
+			void add_stages(VkPipelineStageFlags src, VkPipelineStageFlags dst)
+			{
+				src_stage |= src ? src : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+				dst_stage |= dst ? dst : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+			}
+
+			void add_memory(VkAccessFlags src_access, VkAccessFlags dst_access)
+			{
+				memory.srcAccessMask |= src_access;
+				memory.dstAccessMask |= dst_access;
+				has_memory = true;
+			}
+
+			bool flush(VkCommandBuffer cmd, compile_stats& stats)
+			{
+				if (!src_stage) return false;
+				vkCmdPipelineBarrier(cmd, src_stage, dst_stage, 0, has_memory ? 1 : 0, has_memory ? &memory : nullptr,
+					(u32)buffers.size(), buffers.data(), (u32)images.size(), images.data());
+				++stats.barrier_count;
+				stats.image_barrier_count += (u32)images.size();
+				return true;
+			}
+		};
+
+		// Reads after a write were ordered behind it, waiting for them covers the write as well
+		template<typename S>
+		void previous_accesses(const S& state, VkPipelineStageFlags& stage, VkAccessFlags& access)
+		{
+			stage |= state.read_stages ? state.read_stages : state.write_stage;
+			access |= state.read_stages ? 0 : state.write_access;
+		}
+
+		VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment)
+		{
+			return alignment ? (value + alignment - 1) / alignment * alignment : value;
+		}
+	} // anonymous namespace
+
+	resource_handle vulkan_render_graph::create_image(const char* name, const image_desc& desc)
+	{
+		assert(!_compiled);
+		resource r{};
+		r.name = name;
+		r.is_image = true;
+		r.image_info = desc;
+		r.usage = desc.usage;
+		r.aspect = is_depth_format(desc.format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+		_resources.emplace_back(std::move(r));
+		return (resource_handle)_resources.size() - 1;
+	}
+
+	resource_handle vulkan_render_graph::create_buffer(const char* name, const buffer_desc& desc)
+	{
+		assert(!_compiled);
+		resource r{};
+		r.name = name;
+		r.buffer_info = desc;
+		r.usage = desc.usage;
+		_resources.emplace_back(std::move(r));
+		return (resource_handle)_resources.size() - 1;
+	}
+
+	resource_handle vulkan_render_graph::import_image(const char* name, VkImage image, VkImageAspectFlags aspect, VkImageLayout current_layout)
+	{
+		assert(!_compiled && image);
+		resource r{};
+		r.name = name;
+		r.is_image = true;
+		r.imported = true;
+		r.image = image;
+		r.aspect = aspect;
+		r.state.layout = current_layout;
+		_resources.emplace_back(std::move(r));
+		return (resource_handle)_resources.size() - 1;
+	}
+
+	resource_handle vulkan_render_graph::import_buffer(const char* name, VkBuffer buffer)
+	{
+		assert(!_compiled);
+		resource r{};
+		r.name = name;
+		r.imported = true;
+		r.buffer = buffer;
+		_resources.emplace_back(std::move(r));
+		return (resource_handle)_resources.size() - 1;
+	}
+
+	pass_handle vulkan_render_graph::add_pass(const char* name, queue_type queue, execute_func execute)
+	{
+		assert(!_compiled);
+		pass p{};
+		p.name = name;
+		p.queue = queue;
+		p.execute = std::move(execute);
+		_passes.emplace_back(std::move(p));
+		return (pass_handle)_passes.size() - 1;
+	}
+
+	vulkan_render_graph::resource_use& vulkan_render_graph::add_use(pass_handle pass_id, resource_handle resource_id, access a)
+	{
+		assert(!_compiled && pass_id < _passes.size() && resource_id < _resources.size());
+		const access_info info{ get_access_info(a) };
+		resource& r{ _resources[resource_id] };
+		r.usage |= r.is_image ? info.image_usage : info.buffer_usage;
+
+		// Several accesses of one resource in a pass are merged, they have to agree on the layout
+		for (auto& use : _passes[pass_id].uses)
+		{
+			if (use.resource != resource_id) continue;
+			assert(!r.is_image || use.layout == info.layout);
+			use.stage |= info.stage;
+			use.access |= info.access;
+			return use;
+		}
+
+		resource_use use{};
+		use.resource = resource_id;
+		use.stage = info.stage;
+		use.access = info.access;
+		use.layout = r.is_image ? info.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+		use.read = false;
+		use.write = false;
+		return _passes[pass_id].uses.emplace_back(use);
+	}
+
+	void vulkan_render_graph::read(pass_handle pass_id, resource_handle resource_id, access a)
+	{
+		add_use(pass_id, resource_id, a).read = true;
+	}
+
+	void vulkan_render_graph::write(pass_handle pass_id, resource_handle resource_id, access a)
+	{
+		add_use(pass_id, resource_id, a).write = true;
+	}
+
+	void vulkan_render_graph::set_side_effect(pass_handle pass_id)
+	{
+		assert(pass_id < _passes.size());
+		_passes[pass_id].side_effect = true;
+	}
+
+	void vulkan_render_graph::mark_output(resource_handle resource_id, access final_access)
+	{
+		assert(resource_id < _resources.size());
+		resource& r{ _resources[resource_id] };
+		const access_info info{ get_access_info(final_access) };
+		r.output = true;
+		r.final_access = final_access;
+		r.usage |= r.is_image ? info.image_usage : info.buffer_usage;
+	}
+
+	bool vulkan_render_graph::compile()
+	{
+		assert(!_compiled);
+		if (_compiled) return true;
+
+		vkGetDeviceQueue(core::logical_device(), core::graphics_family_queue_index(), 0, &_queues[(u32)queue_type::graphics]);
+		vkGetDeviceQueue(core::logical_device(), core::compute_family_queue_index(), 0, &_queues[(u32)queue_type::async_compute]);
+
+		cull_passes();
+		build_batches();
+		if (!create_transients() || !create_frame_objects())
+		{
+			release();
+			return false;
+		}
+
+		_compiled = true;
+		report();
+		return true;
+	}
+
+	void vulkan_render_graph::cull_passes()
+	{
+		// Walk back from the outputs, a pass lives if it has side effects or writes something a live pass or the
+		// caller reads. Writers of a resource are all kept, the graph doesn't know which one wins.
+		utl::vector<bool> needed(_resources.size(), false);
+		for (u32 i{ 0 }; i < _resources.size(); ++i) needed[i] = _resources[i].output;
+
+		_stats = {};
+		_stats.pass_count = (u32)_passes.size();
+		for (u32 i{ (u32)_passes.size() }; i-- > 0;)
+		{
+			pass& p{ _passes[i] };
+			p.culled = !p.side_effect && std::none_of(p.uses.begin(), p.uses.end(), [&](const resource_use& use) { return use.write && needed[use.resource]; });
+			if (p.culled)
+			{
+				++_stats.culled_pass_count;
+				continue;
+			}
+
+			for (const auto& use : p.uses)
+				if (use.read) needed[use.resource] = true;
+		}
+	}
+
+	void vulkan_render_graph::build_batches()
+	{
+		// Consecutive passes on one queue share a submission
+		for (u32 i{ 0 }; i < _passes.size(); ++i)
+		{
+			pass& p{ _passes[i] };
+			if (p.culled) continue;
+			if (_batches.empty() || _batches.back().queue != p.queue)
+			{
+				batch b{};
+				b.queue = p.queue;
+				_batches.emplace_back(std::move(b));
+			}
+			p.batch = (u32)_batches.size() - 1;
+			_batches.back().passes.emplace_back(i);
+			_async |= p.queue == queue_type::async_compute;
+		}
+
+		// Lifetimes, the queue using each resource and the cross-queue dependencies
+		utl::vector<resource_use*> last_use(_resources.size(), nullptr);
+		utl::vector<u32> last_pass(_resources.size(), invalid_handle);
+		utl::vector<resource_use*> first_use(_resources.size(), nullptr);
+		for (u32 i{ 0 }; i < _passes.size(); ++i)
+		{
+			pass& p{ _passes[i] };
+			if (p.culled) continue;
+
+			for (auto& use : p.uses)
+			{
+				resource& r{ _resources[use.resource] };
+				if (r.first_use == invalid_handle)
+				{
+					r.first_use = i;
+					r.queue = (u32)p.queue;
+					first_use[use.resource] = &use;
+				}
+				else if (r.queue != (u32)p.queue)
+				{
+					r.queue = invalid_handle;
+				}
+				r.last_use = i;
+
+				const u32 prev{ last_pass[use.resource] };
+				if (prev != invalid_handle && _passes[prev].queue != p.queue)
+				{
+					const resource_use& prev_use{ *last_use[use.resource] };
+					if (prev_use.write || use.write || prev_use.layout != use.layout)
+					{
+						batch& b{ _batches[p.batch] };
+						const u32 signaller{ _passes[prev].batch };
+						auto it = std::find(b.waits.begin(), b.waits.end(), signaller);
+						if (it == b.waits.end())
+						{
+							b.waits.emplace_back(signaller);
+							b.wait_stages.emplace_back(use.stage);
+							_batches[signaller].signal = true;
+						}
+						else
+						{
+							b.wait_stages[it - b.waits.begin()] |= use.stage;
+						}
+					}
+
+					const u32 family{ queue_family(p.queue) };
+					if (queue_family(_passes[prev].queue) != family)
+					{
+						last_use[use.resource]->release_family = family;
+						last_use[use.resource]->release_layout = use.layout;
+					}
+				}
+				last_use[use.resource] = &use;
+				last_pass[use.resource] = i;
+			}
+		}
+
+		for (u32 i{ 0 }; i < _resources.size(); ++i)
+		{
+			resource& r{ _resources[i] };
+			if (r.first_use == invalid_handle) continue;
+
+			// The caller reads outputs after the graph, their memory can't be handed to anything later
+			if (r.output)
+			{
+				r.last_use = (u32)_passes.size();
+				_batches[_passes[last_pass[i]].batch].outputs.emplace_back(i);
+			}
+
+			// Imported resources keep their contents, hand them back to the family of the next frame's first user
+			if (r.imported && !r.output)
+			{
+				const u32 first_family{ queue_family(_passes[r.first_use].queue) };
+				if (queue_family(_passes[last_pass[i]].queue) != first_family)
+				{
+					last_use[i]->release_family = first_family;
+					last_use[i]->release_layout = first_use[i]->layout;
+				}
+			}
+		}
+
+		// The last batch signals the caller, it has to come after every batch nobody waits on
+		if (_batches.size() > 1)
+		{
+			utl::vector<bool> waited_on(_batches.size(), false);
+			for (u32 i{ 0 }; i < _batches.size(); ++i)
+				for (u32 w : _batches[i].waits) waited_on[w] = true;
+			for (u32 i{ 0 }; i < _batches.size() - 1; ++i)
+			{
+				// Earlier submits to the last batch's queue are covered by its signal operations already
+				if (waited_on[i] || _batches[i].queue == _batches.back().queue) continue;
+				_batches.back().waits.emplace_back(i);
+				_batches.back().wait_stages.emplace_back(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+				_batches[i].signal = true;
+			}
+		}
+
+		_stats.batch_count = (u32)_batches.size();
+		for (const auto& b : _batches) _stats.semaphore_count += (u32)b.waits.size();
+	}
+
+	bool vulkan_render_graph::create_transients()
+	{
+		VkDevice device{ core::logical_device() };
+		VkResult result{ VK_SUCCESS };
+
+		for (auto& r : _resources)
+		{
+			if (r.imported || r.first_use == invalid_handle) continue;
+
+			if (r.is_image)
+			{
+				VkImageCreateInfo info{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+				info.pNext = nullptr;
+				info.flags = 0;
+				info.imageType = VK_IMAGE_TYPE_2D;
+				info.format = r.image_info.format;
+				info.extent = { r.image_info.width, r.image_info.height, 1 };
+				info.mipLevels = 1;
+				info.arrayLayers = 1;
+				info.samples = VK_SAMPLE_COUNT_1_BIT;
+				info.tiling = VK_IMAGE_TILING_OPTIMAL;
+				info.usage = r.usage;
+				info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+				info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+				VkCall(result = vkCreateImage(device, &info, nullptr, &r.image), "Failed to create render graph image...");
+				if (result != VK_SUCCESS) return false;
+				vkGetImageMemoryRequirements(device, r.image, &r.requirements);
+			}
+			else
+			{
+				VkBufferCreateInfo info{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+				info.pNext = nullptr;
+				info.flags = 0;
+				info.size = r.buffer_info.size;
+				info.usage = r.usage;
+				info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+				VkCall(result = vkCreateBuffer(device, &info, nullptr, &r.buffer), "Failed to create render graph buffer...");
+				if (result != VK_SUCCESS) return false;
+				vkGetBufferMemoryRequirements(device, r.buffer, &r.requirements);
+			}
+			_stats.transient_bytes += r.requirements.size;
+		}
+
+		place_transients();
+
+		for (auto& heap : _heaps)
+		{
+			VkMemoryAllocateInfo alloc{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+			alloc.pNext = nullptr;
+			alloc.allocationSize = heap.size;
+			alloc.memoryTypeIndex = heap.memory_type;
+			VkCall(result = vkAllocateMemory(device, &alloc, nullptr, &heap.memory), "Failed to allocate render graph memory...");
+			if (result != VK_SUCCESS) return false;
+			_stats.aliased_bytes += heap.size;
+		}
+
+		for (auto& r : _resources)
+		{
+			if (r.heap == invalid_handle) continue;
+
+			VkDeviceMemory memory{ _heaps[r.heap].memory };
+			if (!r.is_image)
+			{
+				VkCall(result = vkBindBufferMemory(device, r.buffer, memory, r.offset), "Failed to bind render graph buffer memory...");
+				if (result != VK_SUCCESS) return false;
+				continue;
+			}
+
+			VkCall(result = vkBindImageMemory(device, r.image, memory, r.offset), "Failed to bind render graph image memory...");
+			if (result != VK_SUCCESS) return false;
+
+			VkImageViewCreateInfo view{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+			view.pNext = nullptr;
+			view.flags = 0;
+			view.image = r.image;
+			view.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			view.format = r.image_info.format;
+			view.components = { VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY };
+			view.subresourceRange = { r.aspect, 0, 1, 0, 1 };
+			VkCall(result = vkCreateImageView(device, &view, nullptr, &r.view), "Failed to create render graph image view...");
+			if (result != VK_SUCCESS) return false;
+		}
+
+		return true;
+	}
+
+	void vulkan_render_graph::place_transients()
+	{
+		// Transients used by a single queue may share memory when one's last pass comes before the other's first.
+		// Passes on other queues run concurrently, what they use gets memory of its own.
+		auto can_share = [&](const resource& a, const resource& b) {
+			return a.queue != invalid_handle && a.queue == b.queue && (a.last_use < b.first_use || b.last_use < a.first_use);
+		};
+
+		utl::vector<u32> order;
+		for (u32 i{ 0 }; i < _resources.size(); ++i)
+			if (!_resources[i].imported && _resources[i].first_use != invalid_handle) order.emplace_back(i);
+
+		// Largest first, smaller ones then fill the gaps
+		std::stable_sort(order.begin(), order.end(), [&](u32 a, u32 b) { return _resources[a].requirements.size > _resources[b].requirements.size; });
+
+		for (u32 i : order)
+		{
+			resource& r{ _resources[i] };
+			const s32 memory_type{ core::find_memory_index(r.requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) };
+			assert(memory_type >= 0);
+
+			// Images and buffers live in separate heaps so bufferImageGranularity never applies
+			u32 heap_index{ invalid_handle };
+			for (u32 h{ 0 }; h < _heaps.size(); ++h)
+				if (_heaps[h].memory_type == (u32)memory_type && _heaps[h].images == r.is_image) heap_index = h;
+			if (heap_index == invalid_handle)
+			{
+				memory_heap heap{};
+				heap.memory_type = (u32)memory_type;
+				heap.images = r.is_image;
+				_heaps.emplace_back(heap);
+				heap_index = (u32)_heaps.size() - 1;
+			}
+
+			// Lowest offset that doesn't overlap anything live at the same time
+			utl::vector<u32> conflicts;
+			utl::vector<VkDeviceSize> candidates;
+			candidates.emplace_back(0);
+			for (u32 j : order)
+			{
+				if (j == i) break;
+				const resource& other{ _resources[j] };
+				if (other.heap != heap_index || can_share(r, other)) continue;
+				conflicts.emplace_back(j);
+				candidates.emplace_back(align_up(other.offset + other.requirements.size, r.requirements.alignment));
+			}
+			std::sort(candidates.begin(), candidates.end());
+
+			for (VkDeviceSize offset : candidates)
+			{
+				const bool fits{ std::none_of(conflicts.begin(), conflicts.end(), [&](u32 j) {
+					const resource& other{ _resources[j] };
+					return offset < other.offset + other.requirements.size && other.offset < offset + r.requirements.size;
+				}) };
+				if (!fits) continue;
+				r.offset = offset;
+				break;
+			}
+			r.heap = heap_index;
+			_heaps[heap_index].size = std::max(_heaps[heap_index].size, r.offset + r.requirements.size);
+
+			for (u32 j : order)
+			{
+				if (j == i) break;
+				resource& other{ _resources[j] };
+				if (other.heap == heap_index && r.offset < other.offset + other.requirements.size && other.offset < r.offset + r.requirements.size)
+				{
+					r.aliases.emplace_back(j);
+					other.aliases.emplace_back(i);
+				}
+			}
+		}
+	}
+
+	bool vulkan_render_graph::create_frame_objects()
+	{
+		VkDevice device{ core::logical_device() };
+		VkResult result{ VK_SUCCESS };
+		const u32 batch_count{ (u32)_batches.size() };
+
+		_pools.resize(frame_buffer_count * batch_count, VK_NULL_HANDLE);
+		_cmd_buffers.resize(frame_buffer_count * batch_count);
+		_semaphores.resize(frame_buffer_count * batch_count, VK_NULL_HANDLE);
+
+		VkSemaphoreCreateInfo semaphore_info{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+		semaphore_info.pNext = nullptr;
+		semaphore_info.flags = 0;
+
+		for (u32 frame{ 0 }; frame < frame_buffer_count; ++frame)
+		{
+			for (u32 b{ 0 }; b < batch_count; ++b)
+			{
+				const u32 index{ frame * batch_count + b };
+				VkCommandPoolCreateInfo info{ VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+				info.pNext = nullptr;
+				info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+				info.queueFamilyIndex = queue_family(_batches[b].queue);
+				VkCall(result = vkCreateCommandPool(device, &info, nullptr, &_pools[index]), "Failed to create render graph command pool...");
+				if (result != VK_SUCCESS) return false;
+
+				_cmd_buffers[index] = allocate_cmd_buffer(device, _pools[index], true);
+
+				if (_batches[b].signal)
+				{
+					VkCall(result = vkCreateSemaphore(device, &semaphore_info, nullptr, &_semaphores[index]), "Failed to create render graph semaphore...");
+					if (result != VK_SUCCESS) return false;
+				}
+			}
+		}
+
+		if (_async)
+		{
+			_frame_semaphores.resize(frame_buffer_count, VK_NULL_HANDLE);
+			for (auto& semaphore : _frame_semaphores)
+			{
+				VkCall(result = vkCreateSemaphore(device, &semaphore_info, nullptr, &semaphore), "Failed to create render graph semaphore...");
+				if (result != VK_SUCCESS) return false;
+			}
+		}
+
+		_states.resize(_resources.size());
+		_touched.resize(_resources.size());
+		return true;
+	}
+
+	void vulkan_render_graph::record(u32 frame)
+	{
+		assert(_compiled && frame < frame_buffer_count);
+		if (!_compiled) return;
+
+		for (u32 i{ 0 }; i < _resources.size(); ++i)
+		{
+			_states[i] = _resources[i].state;
+			_touched[i] = false;
+		}
+		_stats.barrier_count = 0;
+		_stats.image_barrier_count = 0;
+
+		const u32 batch_count{ (u32)_batches.size() };
+		for (u32 b{ 0 }; b < batch_count; ++b)
+		{
+			const u32 index{ frame * batch_count + b };
+			VkCall(vkResetCommandPool(core::logical_device(), _pools[index], 0), "Failed to reset render graph command pool...");
+
+			vulkan_cmd_buffer& cmd_buffer{ _cmd_buffers[index] };
+			reset_cmd_buffer(cmd_buffer);
+			begin_cmd_buffer(cmd_buffer, true, false, false);
+
+			for (u32 p : _batches[b].passes)
+			{
+				record_pass_barriers(cmd_buffer, _passes[p]);
+				_passes[p].execute(cmd_buffer);
+			}
+			record_batch_end_barriers(cmd_buffer, _batches[b]);
+
+			end_cmd_buffer(cmd_buffer);
+		}
+
+		for (u32 i{ 0 }; i < _resources.size(); ++i) _resources[i].state = _states[i];
+	}
+
+	void vulkan_render_graph::record_pass_barriers(vulkan_cmd_buffer& cmd_buffer, const pass& p)
+	{
+		barrier_batch barriers{};
+		const u32 queue{ (u32)p.queue };
+		const u32 family{ queue_family(p.queue) };
+
+		for (const auto& use : p.uses)
+		{
+			const resource& r{ _resources[use.resource] };
+			resource_state& state{ _states[use.resource] };
+			VkImageLayout old_layout{ state.layout };
+			VkPipelineStageFlags src_stage{ 0 };
+			VkAccessFlags src_access{ 0 };
+			bool needed{ false };
+			bool rebased{ false };			// Arrived from another queue, only stages of this queue may be waited on from here
+
+			if (state.acquire_family != VK_QUEUE_FAMILY_IGNORED)
+			{
+				// Second half of an ownership transfer, the semaphore wait already ordered it after the release
+				barriers.add_stages(use.stage, use.stage);
+				if (r.is_image)
+					barriers.images.emplace_back(image_barrier(r.image, r.aspect, 0, use.access, state.acquire_layout, state.layout, state.acquire_family, family));
+				else if (r.buffer)
+					barriers.buffers.emplace_back(buffer_barrier(r.buffer, 0, use.access, state.acquire_family, family));
+				state.acquire_family = VK_QUEUE_FAMILY_IGNORED;
+				old_layout = state.layout;
+				rebased = true;
+			}
+			else if (!r.imported && !_touched[use.resource])
+			{
+				// Contents are discarded but the memory may still be in use, by last frame or by an alias
+				old_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+				if (state.queue == queue) previous_accesses(state, src_stage, src_access);
+				for (u32 alias : r.aliases) previous_accesses(_states[alias], src_stage, src_access);
+				needed = r.is_image || src_stage;
+			}
+			else if (state.queue != invalid_handle && state.queue != queue)
+			{
+				// The semaphore made the other queue's writes visible, only the layout may still change
+				src_stage = use.stage;
+				needed = r.is_image && old_layout != use.layout;
+				rebased = true;
+			}
+			else if (r.is_image && old_layout != use.layout)
+			{
+				previous_accesses(state, src_stage, src_access);
+				needed = true;
+			}
+			else if (use.write)
+			{
+				previous_accesses(state, src_stage, src_access);
+				needed = src_stage != 0;
+			}
+			else if ((state.read_stages & use.stage) != use.stage && state.write_stage)
+			{
+				src_stage = state.write_stage;
+				src_access = state.write_access;
+				needed = true;
+			}
+
+			if (needed)
+			{
+				barriers.add_stages(src_stage, use.stage);
+				if (r.is_image)
+					barriers.images.emplace_back(image_barrier(r.image, r.aspect, src_access & write_access_mask, use.access, old_layout, use.layout));
+				else
+					barriers.add_memory(src_access & write_access_mask, use.access);
+			}
+
+			const bool transitioned{ r.is_image && old_layout != use.layout };
+			if (use.write || transitioned || rebased)
+			{
+				state.write_stage = use.stage;
+				state.write_access = use.write ? use.access : 0;
+				state.read_stages = use.write ? 0 : use.stage;
+			}
+			else
+			{
+				state.read_stages |= use.stage;
+			}
+			state.layout = r.is_image ? use.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+			state.queue = queue;
+			_touched[use.resource] = true;
+		}
+
+		barriers.flush(cmd_buffer.cmd_buffer, _stats);
+	}
+
+	void vulkan_render_graph::record_batch_end_barriers(vulkan_cmd_buffer& cmd_buffer, const batch& b)
+	{
+		barrier_batch barriers{};
+		const u32 family{ queue_family(b.queue) };
+
+		// Outputs go to the layout the caller reads them in. On the compute queue graphics stages can't be named,
+		// the caller's semaphore wait covers them.
+		for (u32 i : b.outputs)
+		{
+			const resource& r{ _resources[i] };
+			resource_state& state{ _states[i] };
+			const access_info info{ get_access_info(r.final_access) };
+			const VkPipelineStageFlags dst_stage{ b.queue == queue_type::graphics ? info.stage : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT };
+			const VkAccessFlags dst_access{ b.queue == queue_type::graphics ? info.access : 0 };
+
+			VkPipelineStageFlags src_stage{ 0 };
+			VkAccessFlags src_access{ 0 };
+			previous_accesses(state, src_stage, src_access);
+			barriers.add_stages(src_stage, dst_stage);
+			if (r.is_image)
+			{
+				barriers.images.emplace_back(image_barrier(r.image, r.aspect, src_access & write_access_mask, dst_access, state.layout, info.layout));
+				state.layout = info.layout;
+			}
+			else
+			{
+				barriers.add_memory(src_access & write_access_mask, dst_access);
+			}
+			state.write_stage = dst_stage;
+			state.write_access = 0;
+			state.read_stages = dst_stage;
+		}
+
+		// First half of ownership transfers to a queue of another family
+		for (u32 p : b.passes)
+		{
+			for (const auto& use : _passes[p].uses)
+			{
+				if (use.release_family == VK_QUEUE_FAMILY_IGNORED) continue;
+				const resource& r{ _resources[use.resource] };
+				resource_state& state{ _states[use.resource] };
+				if (!r.is_image && !r.buffer) continue;
+
+				VkPipelineStageFlags src_stage{ 0 };
+				VkAccessFlags src_access{ 0 };
+				previous_accesses(state, src_stage, src_access);
+				barriers.add_stages(src_stage, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+				if (r.is_image)
+					barriers.images.emplace_back(image_barrier(r.image, r.aspect, src_access & write_access_mask, 0, state.layout, use.release_layout, family, use.release_family));
+				else
+					barriers.buffers.emplace_back(buffer_barrier(r.buffer, src_access & write_access_mask, 0, family, use.release_family));
+
+				state.acquire_family = family;
+				state.acquire_layout = state.layout;
+				state.layout = r.is_image ? use.release_layout : VK_IMAGE_LAYOUT_UNDEFINED;
+			}
+		}
+
+		barriers.flush(cmd_buffer.cmd_buffer, _stats);
+	}
+
+	void vulkan_render_graph::submit(u32 frame, const frame_sync& sync)
+	{
+		assert(_compiled && frame < frame_buffer_count);
+		if (!_compiled) return;
+
+		const u32 batch_count{ (u32)_batches.size() };
+		utl::vector<VkSemaphore> waits;
+		utl::vector<VkPipelineStageFlags> wait_stages;
+		utl::vector<VkSemaphore> signals;
+
+		for (u32 b{ 0 }; b < batch_count; ++b)
+		{
+			const batch& current{ _batches[b] };
+			const bool last{ b == batch_count - 1 };
+			waits.clear();
+			wait_stages.clear();
+			signals.clear();
+
+			if (last)
+			{
+				for (u32 i{ 0 }; i < sync.wait_count; ++i)
+				{
+					waits.emplace_back(sync.wait_semaphores[i]);
+					wait_stages.emplace_back(sync.wait_stages[i]);
+				}
+			}
+			if (b == 0 && _previous_frame)
+			{
+				waits.emplace_back(_previous_frame);
+				wait_stages.emplace_back(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+				_previous_frame = VK_NULL_HANDLE;
+			}
+			for (u32 i{ 0 }; i < current.waits.size(); ++i)
+			{
+				waits.emplace_back(_semaphores[frame * batch_count + current.waits[i]]);
+				wait_stages.emplace_back(current.wait_stages[i]);
+			}
+
+			if (current.signal) signals.emplace_back(_semaphores[frame * batch_count + b]);
+			if (last)
+			{
+				for (u32 i{ 0 }; i < sync.signal_count; ++i) signals.emplace_back(sync.signal_semaphores[i]);
+				if (_async)
+				{
+					signals.emplace_back(_frame_semaphores[frame]);
+					_previous_frame = _frame_semaphores[frame];
+				}
+			}
+
+			vulkan_cmd_buffer& cmd_buffer{ _cmd_buffers[frame * batch_count + b] };
+			VkSubmitInfo info{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
+			info.pNext = nullptr;
+			info.waitSemaphoreCount = (u32)waits.size();
+			info.pWaitSemaphores = waits.data();
+			info.pWaitDstStageMask = wait_stages.data();
+			info.commandBufferCount = 1;
+			info.pCommandBuffers = &cmd_buffer.cmd_buffer;
+			info.signalSemaphoreCount = (u32)signals.size();
+			info.pSignalSemaphores = signals.data();
+
+			VkResult result{ VK_SUCCESS };
+			VkCall(result = vkQueueSubmit(_queues[(u32)current.queue], 1, &info, last ? sync.fence : VK_NULL_HANDLE), "Failed to submit render graph batch...");
+			update_cmd_buffer_submitted(cmd_buffer);
+		}
+	}
+
+	void vulkan_render_graph::release()
+	{
+		VkDevice device{ core::logical_device() };
+
+		for (auto& r : _resources)
+		{
+			if (r.imported) continue;
+			if (r.view) vkDestroyImageView(device, r.view, nullptr);
+			if (r.image) vkDestroyImage(device, r.image, nullptr);
+			if (r.buffer) vkDestroyBuffer(device, r.buffer, nullptr);
+		}
+		for (auto& heap : _heaps)
+			if (heap.memory) vkFreeMemory(device, heap.memory, nullptr);
+
+		// Destroying the pools frees their command buffers
+		for (auto pool : _pools)
+			if (pool) vkDestroyCommandPool(device, pool, nullptr);
+		for (auto semaphore : _semaphores)
+			if (semaphore) vkDestroySemaphore(device, semaphore, nullptr);
+		for (auto semaphore : _frame_semaphores)
+			if (semaphore) vkDestroySemaphore(device, semaphore, nullptr);
+
+		_resources.clear();
+		_passes.clear();
+		_batches.clear();
+		_heaps.clear();
+		_pools.clear();
+		_cmd_buffers.clear();
+		_semaphores.clear();
+		_frame_semaphores.clear();
+		_previous_frame = VK_NULL_HANDLE;
+		_async = false;
+		_states.clear();
+		_touched.clear();
+		_stats = {};
+		_compiled = false;
+	}
+
+	VkImage vulkan_render_graph::get_image(resource_handle resource_id) const
+	{
+		assert(resource_id < _resources.size() && _resources[resource_id].is_image);
+		return _resources[resource_id].image;
+	}
+
+	VkImageView vulkan_render_graph::get_image_view(resource_handle resource_id) const
+	{
+		assert(resource_id < _resources.size() && _resources[resource_id].is_image);
+		return _resources[resource_id].view;
+	}
+
+	VkBuffer vulkan_render_graph::get_buffer(resource_handle resource_id) const
+	{
+		assert(resource_id < _resources.size() && !_resources[resource_id].is_image);
+		return _resources[resource_id].buffer;
+	}
+
+	void vulkan_render_graph::report() const
+	{
+		constexpr f32 mb{ 1024.f * 1024.f };
+		const std::string culled{ _stats.culled_pass_count ? ", " + std::to_string(_stats.culled_pass_count) + " culled" : "" };
+		MESSAGE(("Render graph: " + std::to_string(_stats.pass_count) + " passes" + culled + ", " + std::to_string(_stats.batch_count) +
+			" submits, " + std::to_string(_stats.semaphore_count) + " cross-queue waits").c_str());
+		MESSAGE(("Render graph transient memory: " + std::to_string(_stats.transient_bytes / mb) + " MB before aliasing, " +
+			std::to_string(_stats.aliased_bytes / mb) + " MB after").c_str());
+	}
+}
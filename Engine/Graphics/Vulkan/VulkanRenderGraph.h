@@ -0,0 +1,250 @@
+#pragma once
+#include "VulkanCommonHeaders.h"
+
+#include <functional>
+#include <string>
+
+namespace primal::graphics::vulkan
+{
+	namespace render_graph
+	{
+		using resource_handle = u32;
+		using pass_handle = u32;
+		constexpr u32 invalid_handle{ 0xffff'ffff };
+
+		enum class queue_type : u32
+		{
+			graphics,
+			async_compute,			// Submitted to the compute family queue, overlaps with graphics work
+		};
+
+		// How a pass uses a resource. Each access has a fixed layout, stage and access mask so passes never spell
+		// out barriers themselves.
+		enum class access : u32
+		{
+			none,
+			color_attachment,
+			depth_attachment,
+			sampled_fragment,		// Color read in a fragment shader
+			depth_read_fragment,	// Depth read in a fragment shader
+			sampled_compute,
+			depth_read_compute,
+			storage_read,			// Storage image or buffer read in a compute shader
+			storage_write,
+			storage_read_fragment,	// Storage image or buffer read in a fragment shader
+			indirect_read,			// Indirect draw commands and counts
+			transfer_read,
+			transfer_write,
+		};
+
+		struct image_desc
+		{
+			u32					width;
+			u32					height;
+			VkFormat			format;
+			VkImageUsageFlags	usage;			// Added to the usage the declared accesses need
+		};
+
+		struct buffer_desc
+		{
+			VkDeviceSize		size;
+			VkBufferUsageFlags	usage;
+		};
+
+		struct compile_stats
+		{
+			u32					pass_count;			// Declared passes
+			u32					culled_pass_count;	// Passes nothing reads from
+			u32					batch_count;		// Queue submissions per frame
+			u32					barrier_count;		// vkCmdPipelineBarrier calls per frame
+			u32					image_barrier_count;
+			u32					semaphore_count;	// Cross queue dependencies per frame
+			u64					transient_bytes;	// Transient memory if every resource had its own allocation
+			u64					aliased_bytes;		// Transient memory actually allocated
+		};
+
+		// Semaphores and fence the graph's submissions connect to. The last batch waits on the wait semaphores, so
+		// only the pass writing the caller's image (the swapchain) is held up by them, and signals the signal
+		// semaphores and the fence.
+		struct frame_sync
+		{
+			u32							wait_count;
+			const VkSemaphore*			wait_semaphores;
+			const VkPipelineStageFlags*	wait_stages;
+			u32							signal_count;
+			const VkSemaphore*			signal_semaphores;
+			VkFence						fence;
+		};
+	}
+
+	// Passes declare which resources they read and write, compile() works out everything in between: passes
+	// nothing depends on are culled, the barriers in front of each pass are merged into one vkCmdPipelineBarrier,
+	// async compute passes get their own submissions joined by semaphores and transient resources whose lifetimes
+	// don't overlap share memory. Transient resources are discarded at their first use in every frame, imported
+	// ones keep their contents and the graph remembers their state between frames.
+	class vulkan_render_graph
+	{
+	public:
+		using execute_func = std::function<void(vulkan_cmd_buffer&)>;
+
+		vulkan_render_graph() = default;
+
+		DISABLE_COPY_AND_MOVE(vulkan_render_graph);
+
+		~vulkan_render_graph() = default;
+
+		render_graph::resource_handle create_image(const char* name, const render_graph::image_desc& desc);
+
+		render_graph::resource_handle create_buffer(const char* name, const render_graph::buffer_desc& desc);
+
+		// Resources created and owned elsewhere. A buffer with a null handle is synchronized with memory barriers
+		// only, so it can't be shared by passes on queues of different families.
+		render_graph::resource_handle import_image(const char* name, VkImage image, VkImageAspectFlags aspect, VkImageLayout current_layout);
+
+		render_graph::resource_handle import_buffer(const char* name, VkBuffer buffer);
+
+		// Passes run in the order they're added
+		render_graph::pass_handle add_pass(const char* name, render_graph::queue_type queue, execute_func execute);
+
+		void read(render_graph::pass_handle pass, render_graph::resource_handle resource, render_graph::access access);
+
+		void write(render_graph::pass_handle pass, render_graph::resource_handle resource, render_graph::access access);
+
+		// Keep the pass even if nothing in the graph reads what it writes
+		void set_side_effect(render_graph::pass_handle pass);
+
+		// The resource is used after the graph, it's left in final_access at the end of every frame
+		void mark_output(render_graph::resource_handle resource, render_graph::access final_access);
+
+		// Cull, schedule, alias and create the transient resources. Reports the transient memory saved by aliasing.
+		bool compile();
+
+		// Record every batch of frame. Waits on nothing, the caller makes sure the frame's last submit is done.
+		void record(u32 frame);
+
+		void submit(u32 frame, const render_graph::frame_sync& sync);
+
+		void release();
+
+		[[nodiscard]] VkImage get_image(render_graph::resource_handle resource) const;
+
+		[[nodiscard]] VkImageView get_image_view(render_graph::resource_handle resource) const;
+
+		[[nodiscard]] VkBuffer get_buffer(render_graph::resource_handle resource) const;
+
+		[[nodiscard]] constexpr const render_graph::compile_stats& get_stats() const { return _stats; }
+
+		[[nodiscard]] constexpr bool is_compiled() const { return _compiled; }
+
+	private:
+		struct resource_state
+		{
+			VkImageLayout			layout{ VK_IMAGE_LAYOUT_UNDEFINED };
+			VkPipelineStageFlags	write_stage{ 0 };		// Last write, or layout transition
+			VkAccessFlags			write_access{ 0 };
+			VkPipelineStageFlags	read_stages{ 0 };		// Stages that read since the last write, the write is visible to them
+			u32						queue{ render_graph::invalid_handle };
+			u32						acquire_family{ VK_QUEUE_FAMILY_IGNORED };	// Released by this family, not yet acquired
+			VkImageLayout			acquire_layout{ VK_IMAGE_LAYOUT_UNDEFINED };	// Layout the release transitioned from
+		};
+
+		struct resource_use
+		{
+			render_graph::resource_handle	resource;
+			VkPipelineStageFlags	stage;
+			VkAccessFlags			access;
+			VkImageLayout			layout;
+			bool					read;
+			bool					write;
+			u32						release_family{ VK_QUEUE_FAMILY_IGNORED };	// Next use is on a queue of this family
+			VkImageLayout			release_layout{ VK_IMAGE_LAYOUT_UNDEFINED };
+		};
+
+		struct resource
+		{
+			std::string				name;
+			bool					is_image{ false };
+			bool					imported{ false };
+			render_graph::image_desc	image_info{};
+			render_graph::buffer_desc	buffer_info{};
+			VkImageUsageFlags		usage{ 0 };				// Declared usage plus what the accesses need
+			VkImageAspectFlags		aspect{ 0 };
+			VkImage					image{ VK_NULL_HANDLE };
+			VkImageView				view{ VK_NULL_HANDLE };
+			VkBuffer				buffer{ VK_NULL_HANDLE };
+			bool					output{ false };
+			render_graph::access	final_access{ render_graph::access::none };
+
+			// Filled in by compile()
+			u32						first_use{ render_graph::invalid_handle };	// Position in the execution order of the first and last pass using it
+			u32						last_use{ render_graph::invalid_handle };
+			u32						queue{ render_graph::invalid_handle };		// Only queue using it, invalid_handle when several do
+			VkMemoryRequirements	requirements{};
+			u32						heap{ render_graph::invalid_handle };
+			VkDeviceSize			offset{ 0 };
+			utl::vector<u32>		aliases;				// Transients sharing part of its memory
+			resource_state			state{};				// Where the previous frame left it
+		};
+
+		struct pass
+		{
+			std::string				name;
+			render_graph::queue_type	queue;
+			execute_func			execute;
+			utl::vector<resource_use>	uses;
+			bool					side_effect{ false };
+			bool					culled{ false };
+			u32						batch{ render_graph::invalid_handle };
+		};
+
+		struct batch
+		{
+			render_graph::queue_type		queue;
+			utl::vector<u32>				passes;			// Indices into _passes in execution order
+			utl::vector<u32>				waits;			// Batches this one waits on, each signals a semaphore
+			utl::vector<VkPipelineStageFlags>	wait_stages;
+			utl::vector<u32>				outputs;		// Outputs last used in this batch, transitioned at its end
+			bool							signal{ false };
+		};
+
+		struct memory_heap
+		{
+			VkDeviceMemory			memory{ VK_NULL_HANDLE };
+			VkDeviceSize			size{ 0 };
+			u32						memory_type{ 0 };
+			bool					images{ false };
+		};
+
+		resource_use& add_use(render_graph::pass_handle pass, render_graph::resource_handle resource, render_graph::access access);
+		void cull_passes();
+		void build_batches();
+		bool create_transients();
+		void place_transients();
+		bool create_frame_objects();
+		void record_pass_barriers(vulkan_cmd_buffer& cmd_buffer, const pass& p);
+		void record_batch_end_barriers(vulkan_cmd_buffer& cmd_buffer, const batch& b);
+		void report() const;
+
+		// Deques, resources and passes hold strings and callables that can't be moved by utl::vector's realloc
+		utl::deque<resource>								_resources;
+		utl::deque<pass>									_passes;
+		utl::vector<batch>									_batches;
+		utl::vector<memory_heap>							_heaps;
+		VkQueue												_queues[2]{};		// Indexed by queue_type
+
+		// frame_buffer_count sets, one entry per batch each
+		utl::vector<VkCommandPool>							_pools;
+		utl::vector<vulkan_cmd_buffer>						_cmd_buffers;
+		utl::vector<VkSemaphore>							_semaphores;
+		// With async compute the next frame's first batch waits for this frame's last batch. Resources move
+		// between queues inside a frame only, the semaphores above don't order them across frames.
+		utl::vector<VkSemaphore>							_frame_semaphores;
+		VkSemaphore											_previous_frame{ VK_NULL_HANDLE };
+		bool												_async{ false };
+
+		utl::vector<resource_state>							_states;			// Scratch while recording
+		utl::vector<bool>									_touched;			// Transients used so far in the frame being recorded
+		render_graph::compile_stats							_stats{};
+		bool												_compiled{ false };
+	};
+}
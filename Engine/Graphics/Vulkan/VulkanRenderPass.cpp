@@ -32,7 +32,8 @@ namespace primal::graphics::vulkan::renderpass
     } // anonymous namespace
 
 vulkan_renderpass
-create_renderpass(VkDevice device, VkFormat swapchain_image_format, VkFormat depth_format, math::u32v4 render_area, math::v4 clear_color, f32 depth, u32 stencil)
+create_renderpass(VkDevice device, VkFormat swapchain_image_format, VkFormat depth_format, math::u32v4 render_area, math::v4 clear_color, f32 depth, u32 stencil,
+    VkImageLayout final_layout)
 {
     // Create the main subpass
     VkSubpassDescription subpass{};
@@ -53,7 +54,7 @@ create_renderpass(VkDevice device, VkFormat swapchain_image_format, VkFormat dep
         desc.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         desc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
         desc.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;				// We do not expect any particular layout before render pass starts
-        desc.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;			// Transitions to a present optomized layout after the render pass
+        desc.finalLayout = final_layout;							// Transitions to a present (or transfer for offscreen images) optimized layout after the render pass
         desc.flags = 0;
 
         attachment_desc[0] = desc;
@@ -120,6 +121,16 @@ create_renderpass(VkDevice device, VkFormat swapchain_image_format, VkFormat dep
                                 VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT),
     };
 
+    // Offscreen targets are copied out after the pass
+    if (final_layout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL)
+    {
+        dependencies.emplace_back(createSubpassDependency(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                                VK_ACCESS_TRANSFER_READ_BIT,
+                                0, VK_SUBPASS_EXTERNAL));
+    }
+
     // TODO: Several of these fields are hard coded, and should be configurable in the future
     VkRenderPassCreateInfo info{ VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO };
     info.pNext = 0;
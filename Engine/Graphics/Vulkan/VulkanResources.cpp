@@ -25,7 +25,7 @@ create_image(VkDevice device, const image_init_info *const init_info, vulkan_ima
         info.extent.width = init_info->width;
         info.extent.height = init_info->height;
         info.extent.depth = 1;								// TODO: should be configurable and supported
-        info.mipLevels = 1;									// TODO: should be configurable, and need to support mip maps
+        info.mipLevels = init_info->mipmap;
         info.arrayLayers = 1;								// TODO: should be configurable and offer image layer support
         info.format = init_info->format;
         info.tiling = init_info->tiling;
@@ -65,14 +65,14 @@ create_image(VkDevice device, const image_init_info *const init_info, vulkan_ima
     if (init_info->create_view)
     {
         image.view = nullptr;
-        if (!create_image_view(device, init_info->format, &image, init_info->view_aspect_flags)) return false;
+        if (!create_image_view(device, init_info->format, &image, init_info->view_aspect_flags, init_info->mipmap)) return false;
     }
 
     return true;
 }
 
 bool
-create_image_view(VkDevice device, VkFormat format, vulkan_image* image, VkImageAspectFlags view_aspect_flags)
+create_image_view(VkDevice device, VkFormat format, vulkan_image* image, VkImageAspectFlags view_aspect_flags, u32 mip_levels)
 {
     VkImageViewCreateInfo info{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
     info.image = image->image;
@@ -80,7 +80,7 @@ create_image_view(VkDevice device, VkFormat format, vulkan_image* image, VkImage
     info.format = format;
     info.subresourceRange.aspectMask = view_aspect_flags;
     info.subresourceRange.baseMipLevel = 0;								// TODO: This should be configurable
-    info.subresourceRange.levelCount = 1;								// TODO: This should be configurable
+    info.subresourceRange.levelCount = mip_levels;
     info.subresourceRange.baseArrayLayer = 0;							// TODO: This should be configurable
     info.subresourceRange.layerCount = 1;								// TODO: This should be configurable
 
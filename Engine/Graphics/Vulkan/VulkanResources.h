@@ -25,7 +25,7 @@ namespace primal::graphics::vulkan
     };
 
 bool create_image(VkDevice device, const image_init_info *const init_info, vulkan_image& image);
-bool create_image_view(VkDevice device, VkFormat format, vulkan_image* image, VkImageAspectFlags view_aspect_flags);
+bool create_image_view(VkDevice device, VkFormat format, vulkan_image* image, VkImageAspectFlags view_aspect_flags, u32 mip_levels = 1);
 void destroy_image(VkDevice device, vulkan_image* image);
 
 bool create_framebuffer(VkDevice device, vulkan_renderpass& renderpass, u32 width, u32 height, u32 attach_count, utl::vector<VkImageView> attachments, vulkan_framebuffer& framebuffer);
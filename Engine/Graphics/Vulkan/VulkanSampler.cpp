@@ -0,0 +1,227 @@
+#include "VulkanSampler.h"
+#include "VulkanCore.h"
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace primal::graphics::vulkan::samplers
+{
+	namespace
+	{
+		struct sampler_entry
+		{
+			VkSamplerCreateInfo		info;
+			u64						hash;
+			u32						ref_count;
+			bool					shared;			// Found by its settings, false for infos with a pNext chain
+		};
+
+		std::unordered_map<VkSampler, sampler_entry>	samplers;
+		std::unordered_multimap<u64, VkSampler>			samplers_by_hash;
+		std::mutex										sampler_mutex;
+		u32												reference_total{ 0 };
+		u32												peak_live_count{ 0 };
+		u32												max_allocation_count{ 0 };		// 0 until the first sampler is created
+		bool											is_shut_down{ false };
+
+		u64 hash_info(const VkSamplerCreateInfo& info)
+		{
+			// FNV-1a over the settings. sType and pNext aren't part of them.
+			const u32 values[]{
+				(u32)info.flags, (u32)info.magFilter, (u32)info.minFilter, (u32)info.mipmapMode,
+				(u32)info.addressModeU, (u32)info.addressModeV, (u32)info.addressModeW,
+				(u32)info.anisotropyEnable, (u32)info.compareEnable, (u32)info.compareOp,
+				(u32)info.borderColor, (u32)info.unnormalizedCoordinates,
+			};
+			const f32 floats[]{ info.mipLodBias, info.maxAnisotropy, info.minLod, info.maxLod };
+
+			u64 hash{ 0xcbf2'9ce4'8422'2325ull };
+			auto add = [&hash](const void* const data, size_t size) {
+				const u8* const bytes{ (const u8*)data };
+				for (size_t i{ 0 }; i < size; ++i)
+				{
+					hash ^= bytes[i];
+					hash *= 0x100'0000'01b3ull;
+				}
+			};
+			add(values, sizeof(values));
+			add(floats, sizeof(floats));
+			return hash;
+		}
+
+		bool equal_info(const VkSamplerCreateInfo& a, const VkSamplerCreateInfo& b)
+		{
+			return a.flags == b.flags && a.magFilter == b.magFilter && a.minFilter == b.minFilter && a.mipmapMode == b.mipmapMode &&
+				a.addressModeU == b.addressModeU && a.addressModeV == b.addressModeV && a.addressModeW == b.addressModeW &&
+				a.mipLodBias == b.mipLodBias && a.anisotropyEnable == b.anisotropyEnable && a.maxAnisotropy == b.maxAnisotropy &&
+				a.compareEnable == b.compareEnable && a.compareOp == b.compareOp && a.minLod == b.minLod && a.maxLod == b.maxLod &&
+				a.borderColor == b.borderColor && a.unnormalizedCoordinates == b.unnormalizedCoordinates;
+		}
+
+		VkSampler create_sampler(const VkSamplerCreateInfo& info)
+		{
+			if (!max_allocation_count)
+			{
+				VkPhysicalDeviceProperties properties;
+				vkGetPhysicalDeviceProperties(core::physical_device(), &properties);
+				max_allocation_count = properties.limits.maxSamplerAllocationCount;
+			}
+			if (samplers.size() >= max_allocation_count)
+			{
+				MESSAGE(("Sampler cache: " + std::to_string(samplers.size()) + " live samplers, the device allows " + std::to_string(max_allocation_count)).c_str());
+			}
+
+			VkSampler sampler{ VK_NULL_HANDLE };
+			VkResult result{ VK_SUCCESS };
+			VkCall(result = vkCreateSampler(core::logical_device(), &info, nullptr, &sampler), "Failed to create sampler...");
+			return result == VK_SUCCESS ? sampler : VK_NULL_HANDLE;
+		}
+	} // anonymous namespace
+
+	VkSamplerCreateInfo texture_info()
+	{
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(core::physical_device(), &properties);
+
+		VkSamplerCreateInfo info{ VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+		info.pNext = nullptr;
+		info.flags = 0;
+		info.magFilter = VK_FILTER_LINEAR;
+		info.minFilter = VK_FILTER_LINEAR;
+		info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		info.mipLodBias = 0.f;
+		info.minLod = 0.f;
+		info.maxLod = VK_LOD_CLAMP_NONE;		// The view limits it to the levels the texture has
+		info.anisotropyEnable = VK_TRUE;
+		info.maxAnisotropy = properties.limits.maxSamplerAnisotropy;
+		info.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+		info.unnormalizedCoordinates = VK_FALSE;
+		info.compareEnable = VK_FALSE;
+		info.compareOp = VK_COMPARE_OP_ALWAYS;
+		return info;
+	}
+
+	VkSamplerCreateInfo attachment_info()
+	{
+		VkSamplerCreateInfo info{ VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+		info.pNext = nullptr;
+		info.magFilter = VK_FILTER_LINEAR;
+		info.minFilter = VK_FILTER_LINEAR;
+		info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		info.addressModeV = info.addressModeU;
+		info.addressModeW = info.addressModeU;
+		info.mipLodBias = 0.f;
+		info.maxAnisotropy = 1.f;
+		info.minLod = 0.f;
+		info.maxLod = 1.f;
+		info.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+		return info;
+	}
+
+	VkSamplerCreateInfo shadow_info()
+	{
+		VkSamplerCreateInfo info{ attachment_info() };
+		info.magFilter = VK_FILTER_NEAREST;
+		info.minFilter = VK_FILTER_NEAREST;
+		info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+		info.addressModeV = info.addressModeU;
+		info.addressModeW = info.addressModeU;
+		return info;
+	}
+
+	VkSampler acquire(const VkSamplerCreateInfo& info)
+	{
+		std::lock_guard lock{ sampler_mutex };
+		assert(!is_shut_down);
+
+		const bool shared{ info.pNext == nullptr };
+		const u64 hash{ hash_info(info) };
+		if (shared)
+		{
+			auto range = samplers_by_hash.equal_range(hash);
+			for (auto it = range.first; it != range.second; ++it)
+			{
+				sampler_entry& entry{ samplers.at(it->second) };
+				if (!equal_info(entry.info, info)) continue;
+				++entry.ref_count;
+				++reference_total;
+				return it->second;
+			}
+		}
+
+		const VkSampler sampler{ create_sampler(info) };
+		if (!sampler) return VK_NULL_HANDLE;
+
+		sampler_entry entry{ info, hash, 1, shared };
+		entry.info.pNext = nullptr;
+		samplers.emplace(sampler, entry);
+		if (shared) samplers_by_hash.emplace(hash, sampler);
+		++reference_total;
+		peak_live_count = std::max(peak_live_count, (u32)samplers.size());
+		return sampler;
+	}
+
+	void release(VkSampler sampler)
+	{
+		if (!sampler) return;
+
+		std::lock_guard lock{ sampler_mutex };
+		auto it = samplers.find(sampler);
+		// After shutdown() textures still alive at exit may let go of samplers that are already destroyed
+		if (it == samplers.end())
+		{
+			assert(is_shut_down);
+			return;
+		}
+
+		assert(it->second.ref_count && reference_total);
+		--reference_total;
+		if (--it->second.ref_count) return;
+
+		if (it->second.shared)
+		{
+			auto range = samplers_by_hash.equal_range(it->second.hash);
+			for (auto h = range.first; h != range.second; ++h)
+			{
+				if (h->second != sampler) continue;
+				samplers_by_hash.erase(h);
+				break;
+			}
+		}
+		samplers.erase(it);
+		vkDestroySampler(core::logical_device(), sampler, nullptr);
+	}
+
+	u32 live_count()
+	{
+		std::lock_guard lock{ sampler_mutex };
+		return (u32)samplers.size();
+	}
+
+	u32 reference_count()
+	{
+		std::lock_guard lock{ sampler_mutex };
+		return reference_total;
+	}
+
+	void shutdown()
+	{
+		std::lock_guard lock{ sampler_mutex };
+		MESSAGE(("Sampler cache: at most " + std::to_string(peak_live_count) + " live samplers, " +
+			std::to_string(samplers.size()) + " left with " + std::to_string(reference_total) + " references at shutdown").c_str());
+
+		for (auto& [sampler, entry] : samplers)
+			vkDestroySampler(core::logical_device(), sampler, nullptr);
+		samplers.clear();
+		samplers_by_hash.clear();
+		reference_total = 0;
+		is_shut_down = true;
+	}
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "VulkanCommonHeaders.h"
+
+namespace primal::graphics::vulkan::samplers
+{
+	// Material textures: trilinear over all mip levels, repeat, the device's maximum anisotropy
+	[[nodiscard]] VkSamplerCreateInfo texture_info();
+
+	// Render targets read by later passes: linear, clamp to edge
+	[[nodiscard]] VkSamplerCreateInfo attachment_info();
+
+	// Shadow maps, depth is compared in the shader: point sampled, outside of the map is the white border
+	[[nodiscard]] VkSamplerCreateInfo shadow_info();
+
+	// Samplers are looked up by their settings, equal settings share one VkSampler. Every acquire() needs
+	// a release() of the returned handle. Infos with a pNext chain can't be compared and always get their own sampler.
+	[[nodiscard]] VkSampler acquire(const VkSamplerCreateInfo& info);
+
+	// The sampler is destroyed with its last reference, so release it once no frame in flight uses it.
+	// Releasing VK_NULL_HANDLE does nothing.
+	void release(VkSampler sampler);
+
+	// VkSampler objects alive now, these count against maxSamplerAllocationCount
+	[[nodiscard]] u32 live_count();
+
+	// References held on the live samplers, the number of samplers there would be without sharing
+	[[nodiscard]] u32 reference_count();
+
+	// Called before the device is destroyed. Destroys and reports samplers that were never released.
+	void shutdown();
+}
@@ -3,6 +3,13 @@
 #include <iostream>
 #include <filesystem>
 #include "VulkanCore.h"
+#include "Utilities/Hash.h"
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // __linux__
 
 namespace primal::graphics::vulkan::shaders
 {
@@ -13,83 +20,226 @@ namespace primal::graphics::vulkan::shaders
 		std::mutex											shader_mutex;
 
 		const std::string absolutePath = "C:/Users/27042/Desktop/DX_Test/PrimalMerge/Engine/Graphics/Vulkan/Shaders/";
-	} // anonymous namespace
 
-	void vulkan_shader::loadFile(std::string path, shader_type::type type)
-	{
-		_path = path;
-		_function = "main";
+		struct module_hash
+		{
+			u64												value[2];
 
-		std::ifstream file(path, std::ios::binary | std::ios::in);
-		if (file.is_open())
+			bool operator==(const module_hash& other) const { return value[0] == other.value[0] && value[1] == other.value[1]; }
+		};
+		static_assert(sizeof(module_hash) == content::compiled_shader::hash_length);
+
+		struct module_hash_hasher
 		{
-			std::vector<u8> fileContents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-			file.close();
+			size_t operator()(const module_hash& hash) const { return (size_t)(hash.value[0] ^ hash.value[1]); }
+		};
 
-			assert(fileContents.size() > 0);
-			//_code_size = fileContents.size();
-			//std::unique_ptr<u8[]> code{ std::make_unique<u8[]>(fileContents.size()) };
-			//memcpy(code.get(), fileContents.data(), fileContents.size());
-			//_code.swap(code);
+		struct cached_module
+		{
+			VkShaderModule									module;
+			u64												code_size;
+			u32												ref_count;
+		};
 
-			VkShaderStageFlagBits stage;
-			//if (type == shader_type::vertex) stage = VK_SHADER_STAGE_VERTEX_BIT;
-			//if (type == shader_type::pixel) stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+		// Modules are shared by every shader with the same byte code. Paths remember the hash of their file so
+		// adding a path again doesn't read it.
+		std::unordered_map<module_hash, cached_module, module_hash_hasher>	modules;
+		std::unordered_map<VkShaderModule, module_hash>		module_hashes;
+		std::unordered_map<std::string, module_hash>		path_hashes;
+		module_cache_stats									stats{};
 
-			switch(type)
+		// Read only view of a whole file
+		class mapped_file
+		{
+		public:
+			explicit mapped_file(const std::string& path)
 			{
-				case shader_type::vertex:
-				{
-					stage = VK_SHADER_STAGE_VERTEX_BIT;
-				}	break;
-				case shader_type::pixel:
-				{
-					stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-				}	break;
-				case shader_type::compute:
-				{
-					stage = VK_SHADER_STAGE_COMPUTE_BIT;
-				}	break;
-				default:
-					stage = VK_SHADER_STAGE_FLAG_BITS_MAX_ENUM;
+#ifdef _WIN32
+				_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+				if (_file == INVALID_HANDLE_VALUE) return;
+				LARGE_INTEGER size;
+				if (!GetFileSizeEx(_file, &size) || !size.QuadPart) return;
+				_mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+				if (!_mapping) return;
+				_data = (const u8*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+				if (_data) _size = (u64)size.QuadPart;
+#elif __linux__
+				_file = open(path.c_str(), O_RDONLY);
+				if (_file < 0) return;
+				struct stat info;
+				if (fstat(_file, &info) || !info.st_size) return;
+				void* const data{ mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, _file, 0) };
+				if (data == MAP_FAILED) return;
+				_data = (const u8*)data;
+				_size = (u64)info.st_size;
+#endif // _WIN32
+			}
+
+			DISABLE_COPY_AND_MOVE(mapped_file);
+
+			~mapped_file()
+			{
+#ifdef _WIN32
+				if (_data) UnmapViewOfFile(_data);
+				if (_mapping) CloseHandle(_mapping);
+				if (_file != INVALID_HANDLE_VALUE) CloseHandle(_file);
+#elif __linux__
+				if (_data) munmap((void*)_data, (size_t)_size);
+				if (_file >= 0) close(_file);
+#endif // _WIN32
 			}
 
-			VkShaderModule shaderModule;
+			[[nodiscard]] constexpr const u8* data() const { return _data; }
+			[[nodiscard]] constexpr u64 size() const { return _size; }
+
+		private:
+#ifdef _WIN32
+			HANDLE											_file{ INVALID_HANDLE_VALUE };
+			HANDLE											_mapping{ nullptr };
+#elif __linux__
+			int												_file{ -1 };
+#endif // _WIN32
+			const u8*										_data{ nullptr };
+			u64												_size{ 0 };
+		};
+
+		VkShaderStageFlagBits shader_stage(shader_type::type type)
+		{
+			switch (type)
+			{
+			case shader_type::vertex: return VK_SHADER_STAGE_VERTEX_BIT;
+			case shader_type::pixel: return VK_SHADER_STAGE_FRAGMENT_BIT;
+			case shader_type::compute: return VK_SHADER_STAGE_COMPUTE_BIT;
+			default: return VK_SHADER_STAGE_FLAG_BITS_MAX_ENUM;
+			}
+		}
+
+		// Takes a reference on the cached module, creating it from byte_code on a miss. Call with shader_mutex locked.
+		VkShaderModule acquire_module(const module_hash& hash, const u8* const byte_code, u64 code_size)
+		{
+			auto it = modules.find(hash);
+			if (it != modules.end())
+			{
+				assert(it->second.code_size == code_size);
+				++it->second.ref_count;
+				++stats.content_hits;
+				return it->second.module;
+			}
+
+			assert(code_size && !(code_size & 3));
 			VkShaderModuleCreateInfo moduleCreateInfo;
 			moduleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
 			moduleCreateInfo.pNext = nullptr;
 			moduleCreateInfo.flags = 0;
-			moduleCreateInfo.codeSize = fileContents.size();
-			moduleCreateInfo.pCode = reinterpret_cast<const u32*>(fileContents.data());
+			moduleCreateInfo.codeSize = (size_t)code_size;
+			moduleCreateInfo.pCode = reinterpret_cast<const u32*>(byte_code);
 
+			VkShaderModule shaderModule{ VK_NULL_HANDLE };
 			VkResult result{ VK_SUCCESS };
 			VkCall(result = vkCreateShaderModule(core::logical_device(), &moduleCreateInfo, NULL, &shaderModule), "Failed to create shader module...");
+			if (result != VK_SUCCESS) return VK_NULL_HANDLE;
+
+			modules.emplace(hash, cached_module{ shaderModule, code_size, 1 });
+			module_hashes.emplace(shaderModule, hash);
+			++stats.misses;
+			stats.live_modules = (u32)modules.size();
+			return shaderModule;
+		}
+
+		VkShaderModule acquire_module(const std::string& path)
+		{
+			std::lock_guard lock{ shader_mutex };
 
-			_shaderstage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-			_shaderstage.pNext = nullptr;
-			_shaderstage.flags = 0;
-			_shaderstage.stage = stage;
-			_shaderstage.module = shaderModule;
-			_shaderstage.pName = "main";
-			_shaderstage.pSpecializationInfo = nullptr;
-			assert(_shaderstage.module != VK_NULL_HANDLE);
+			auto known = path_hashes.find(path);
+			if (known != path_hashes.end())
+			{
+				auto it = modules.find(known->second);
+				if (it != modules.end())
+				{
+					++it->second.ref_count;
+					++stats.path_hits;
+					return it->second.module;
+				}
+			}
+
+			const mapped_file file{ path };
+			if (!file.data())
+			{
+				std::cerr << "Error: Could not open shader file \"" << path.c_str() << "\"" << "\n";
+				return VK_NULL_HANDLE;
+			}
+			stats.bytes_mapped += file.size();
+
+			module_hash hash;
+			utl::MurmurHash3_x64_128(file.data(), (int)file.size(), 0, &hash.value[0]);
+			path_hashes[path] = hash;
+			return acquire_module(hash, file.data(), file.size());
 		}
-		else
+
+		void release_module(VkShaderModule module)
 		{
-			std::cerr << "Error: Could not open shader file \"" << path.c_str() << "\"" << "\n";
+			if (!module) return;
+
+			std::lock_guard lock{ shader_mutex };
+			auto hash = module_hashes.find(module);
+			if (hash == module_hashes.end()) return;		// Already destroyed by shutdown()
+			auto it = modules.find(hash->second);
+			assert(it != modules.end() && it->second.ref_count);
+			if (--it->second.ref_count) return;
+
+			// Pipelines keep what they need, the module isn't used once they're created
+			vkDestroyShaderModule(core::logical_device(), module, nullptr);
+			modules.erase(it);
+			module_hashes.erase(hash);
+			stats.live_modules = (u32)modules.size();
 		}
+	} // anonymous namespace
+
+	void vulkan_shader::loadFile(std::string path, shader_type::type type)
+	{
+		_path = path;
+		_function = "main";
+
+		setModule(acquire_module(path), type);
+	}
+
+	void vulkan_shader::loadCompiled(content::compiled_shader_ptr shader, shader_type::type type)
+	{
+		assert(shader);
+		_path.clear();
+		_function = "main";
+
+		// The content pipeline already hashed the byte code
+		module_hash hash;
+		memcpy(&hash.value[0], shader->hash(), content::compiled_shader::hash_length);
+		std::lock_guard lock{ shader_mutex };
+		setModule(acquire_module(hash, shader->byte_code(), shader->byte_code_size()), type);
+	}
+
+	void vulkan_shader::setModule(VkShaderModule module, shader_type::type type)
+	{
+		if (!module) return;
+
+		_shaderstage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		_shaderstage.pNext = nullptr;
+		_shaderstage.flags = 0;
+		_shaderstage.stage = shader_stage(type);
+		_shaderstage.module = module;
+		_shaderstage.pName = "main";
+		_shaderstage.pSpecializationInfo = nullptr;
 	}
 
 	void vulkan_shader::freeModule()
 	{
-		vkDestroyShaderModule(core::logical_device(), _shaderstage.module, nullptr);
+		release_module(_shaderstage.module);
+		_shaderstage.module = VK_NULL_HANDLE;
 	}
 
 	vulkan_shader::~vulkan_shader()
 	{
 		//_entity_id = id::invalid_id;
 		//_path = nullptr;
-		//freeModule();
+		// Copies of a shader share its module, shaders::remove() releases it
 	}
 
 	/// <summary>
@@ -105,6 +255,14 @@ namespace primal::graphics::vulkan::shaders
 		return shaders.add(shader);
 	}
 
+	id::id_type add(content::compiled_shader_ptr compiled, shader_type::type type)
+	{
+		vulkan_shader shader;
+		shader.loadCompiled(compiled, type);
+		std::lock_guard lock{ shader_mutex };
+		return shaders.add(shader);
+	}
+
 	/// <summary>
 	//  ɾshaderԭʼID
 	///	1 ִйmaterialremove_shader 
@@ -113,8 +271,9 @@ namespace primal::graphics::vulkan::shaders
 	/// <param name="id"></param>
 	void remove(id::id_type id)
 	{
-		std::lock_guard lock{ shader_mutex };
 		assert(id::is_valid(id));
+		get_shader(id).freeModule();
+		std::lock_guard lock{ shader_mutex };
 		shaders.remove(id);
 	}
 
@@ -124,4 +283,38 @@ namespace primal::graphics::vulkan::shaders
 		assert(id::is_valid(id));
 		return shaders[id];
 	}
+
+	void add_module_reference(VkShaderModule module)
+	{
+		std::lock_guard lock{ shader_mutex };
+		auto hash = module_hashes.find(module);
+		assert(hash != module_hashes.end());
+		if (hash == module_hashes.end()) return;
+		++modules.at(hash->second).ref_count;
+	}
+
+	void remove_module_reference(VkShaderModule module)
+	{
+		release_module(module);
+	}
+
+	module_cache_stats get_cache_stats()
+	{
+		std::lock_guard lock{ shader_mutex };
+		return stats;
+	}
+
+	void shutdown()
+	{
+		std::lock_guard lock{ shader_mutex };
+		MESSAGE(("Shader module cache: " + std::to_string(stats.misses) + " modules created, " + std::to_string(stats.path_hits) + " path hits, " +
+			std::to_string(stats.content_hits) + " content hits, " + std::to_string(stats.bytes_mapped) + " bytes mapped").c_str());
+
+		for (auto& [hash, entry] : modules)
+			vkDestroyShaderModule(core::logical_device(), entry.module, nullptr);
+		modules.clear();
+		module_hashes.clear();
+		path_hashes.clear();
+		stats.live_modules = 0;
+	}
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 #include "VulkanCommonHeaders.h"
 #include "Graphics/Renderer.h"
+#include "Content/ContentToEngine.h"
 
 namespace primal::graphics::vulkan::shaders
 {
@@ -20,18 +21,40 @@ namespace primal::graphics::vulkan::shaders
 
 		//void setID(id::id_type id) { _entity_id = id; }
 		void loadFile(std::string path, shader_type::type type);
+		void loadCompiled(content::compiled_shader_ptr shader, shader_type::type type);
 		void freeModule();
 
 		[[nodiscard]] const VkPipelineShaderStageCreateInfo getShaderStage() const { return _shaderstage; }
 
 	private:
+		void setModule(VkShaderModule module, shader_type::type type);
+
 		//id::id_type								_entity_id;
 		std::string								_path;
 		std::string								_function;
-		VkPipelineShaderStageCreateInfo			_shaderstage;
+		VkPipelineShaderStageCreateInfo			_shaderstage{};
+	};
+
+	struct module_cache_stats
+	{
+		u32										path_hits;		// Path added before, the file isn't read again
+		u32										content_hits;	// Same byte code as a live module
+		u32										misses;			// Modules created
+		u32										live_modules;
+		u64										bytes_mapped;	// Shader files read
 	};
 
+	// Shaders with the same byte code share one VkShaderModule, keyed by a 128 bit hash of the code.
+	// Every add() takes a reference on it and remove() gives it back.
 	id::id_type add(std::string path, shader_type::type type);
+	id::id_type add(content::compiled_shader_ptr compiled, shader_type::type type);
 	void remove(id::id_type id);
 	vulkan_shader& get_shader(id::id_type id);
+	// Keeps module alive after the shaders using it are removed, for pipelines compiled later.
+	// Every add_module_reference() needs a remove_module_reference().
+	void add_module_reference(VkShaderModule module);
+	void remove_module_reference(VkShaderModule module);
+	[[nodiscard]] module_cache_stats get_cache_stats();
+	// Called before the device is destroyed, destroys the modules still referenced
+	void shutdown();
 }
\ No newline at end of file
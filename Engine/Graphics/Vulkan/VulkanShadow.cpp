@@ -0,0 +1,623 @@
+#include "VulkanShadow.h"
+#include "VulkanCore.h"
+#include "VulkanHelpers.h"
+#include "VulkanData.h"
+#include "VulkanContent.h"
+#include "VulkanCamera.h"
+#include "VulkanLight.h"
+#include "VulkanSampler.h"
+
+#include <chrono>
+#include <cmath>
+
+namespace primal::graphics::vulkan
+{
+	namespace
+	{
+		constexpr VkFormat shadow_format{ VK_FORMAT_D32_SFLOAT };
+
+		using shadow_clock = std::chrono::high_resolution_clock;
+
+		f32 elapsed_ms(shadow_clock::time_point start)
+		{
+			return std::chrono::duration<f32, std::milli>(shadow_clock::now() - start).count();
+		}
+
+		// Create a depth array texture with one layer per cascade. The texture's own view covers all layers,
+		// layer_views gets one 2D view per layer for rendering.
+		id::id_type createCascadeTexture(bool sampled, OUT utl::vector<VkImageView>& layer_views)
+		{
+			vulkan_texture tex{};
+			tex.format = shadow_format;
+			tex.width = shadow::shadow_map_size;
+			tex.height = shadow::shadow_map_size;
+
+			VkImageCreateInfo image{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+			image.imageType = VK_IMAGE_TYPE_2D;
+			image.extent.width = shadow::shadow_map_size;
+			image.extent.height = shadow::shadow_map_size;
+			image.extent.depth = 1;
+			image.mipLevels = 1;
+			image.arrayLayers = shadow::cascade_count;
+			image.samples = VK_SAMPLE_COUNT_1_BIT;
+			image.tiling = VK_IMAGE_TILING_OPTIMAL;
+			image.format = tex.format;
+			image.flags = 0;
+			// The static cache is copied into the sampled shadow map every time a cascade is refreshed
+			image.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+				(sampled ? (VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT) : VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+			VkResult result{ VK_SUCCESS };
+			VkCall(result = vkCreateImage(core::logical_device(), &image, nullptr, &tex.image), "Failed to create shadow cascade image...");
+
+			VkMemoryRequirements memReq;
+			vkGetImageMemoryRequirements(core::logical_device(), tex.image, &memReq);
+			VkMemoryAllocateInfo alloc{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+			alloc.pNext = nullptr;
+			alloc.allocationSize = memReq.size;
+			alloc.memoryTypeIndex = core::find_memory_index(memReq.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			result = VK_SUCCESS;
+			VkCall(result = vkAllocateMemory(core::logical_device(), &alloc, nullptr, &tex.memory), "Failed to allocate shadow cascade memory...");
+			result = VK_SUCCESS;
+			VkCall(result = vkBindImageMemory(core::logical_device(), tex.image, tex.memory, 0), "Failed to bind shadow cascade image to memory...");
+
+			VkImageViewCreateInfo imageView{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+			imageView.pNext = nullptr;
+			imageView.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+			imageView.format = tex.format;
+			imageView.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+			imageView.subresourceRange.baseMipLevel = 0;
+			imageView.subresourceRange.levelCount = 1;
+			imageView.subresourceRange.baseArrayLayer = 0;
+			imageView.subresourceRange.layerCount = shadow::cascade_count;
+			imageView.image = tex.image;
+			result = VK_SUCCESS;
+			VkCall(result = vkCreateImageView(core::logical_device(), &imageView, nullptr, &tex.view), "Failed to create shadow cascade image view...");
+
+			imageView.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			imageView.subresourceRange.layerCount = 1;
+			for (u32 i{ 0 }; i < shadow::cascade_count; ++i)
+			{
+				imageView.subresourceRange.baseArrayLayer = i;
+				VkImageView view{ VK_NULL_HANDLE };
+				result = VK_SUCCESS;
+				VkCall(result = vkCreateImageView(core::logical_device(), &imageView, nullptr, &view), "Failed to create shadow cascade layer view...");
+				layer_views.emplace_back(view);
+			}
+
+			if (sampled)
+			{
+				// Depth is compared manually in the shader, so use point sampling. Outside of the map is always lit.
+				tex.sampler = samplers::acquire(samplers::shadow_info());
+			}
+
+			return textures::add(tex);
+		}
+
+		// clear: render pass for the static cache, it's cleared and left ready to be copied from.
+		// !clear: render pass for the sampled shadow map, it starts from the copied static depth
+		//		   and is left ready to be sampled by the composition pass.
+		id::id_type createCascadeRenderpass(bool clear)
+		{
+			VkAttachmentDescription attachment{
+				0,
+				shadow_format,
+				VK_SAMPLE_COUNT_1_BIT,
+				clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD,
+				VK_ATTACHMENT_STORE_OP_STORE,
+				VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+				VK_ATTACHMENT_STORE_OP_DONT_CARE,
+				clear ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				clear ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+			};
+
+			VkAttachmentReference depthReference{ 0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+			VkSubpassDescription subpass;
+			subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+			subpass.flags = 0;
+			subpass.pColorAttachments = nullptr;
+			subpass.colorAttachmentCount = 0;
+			subpass.pDepthStencilAttachment = &depthReference;
+			subpass.inputAttachmentCount = 0;
+			subpass.pInputAttachments = nullptr;
+			subpass.pPreserveAttachments = nullptr;
+			subpass.preserveAttachmentCount = 0;
+			subpass.pResolveAttachments = nullptr;
+
+			utl::vector<VkSubpassDependency> dependencies;
+			dependencies.resize(2);
+
+			// The static cache was last read by a copy, the shadow map was last written by one
+			dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+			dependencies[0].dstSubpass = 0;
+			dependencies[0].srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+			dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			dependencies[0].srcAccessMask = clear ? VK_ACCESS_TRANSFER_READ_BIT : VK_ACCESS_TRANSFER_WRITE_BIT;
+			dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			dependencies[0].dependencyFlags = 0;
+
+			dependencies[1].srcSubpass = 0;
+			dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+			dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			dependencies[1].dstStageMask = clear ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+			dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			dependencies[1].dstAccessMask = clear ? VK_ACCESS_TRANSFER_READ_BIT : VK_ACCESS_SHADER_READ_BIT;
+			dependencies[1].dependencyFlags = 0;
+
+			VkRenderPassCreateInfo renderPassInfo = {};
+			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+			renderPassInfo.pAttachments = &attachment;
+			renderPassInfo.attachmentCount = 1;
+			renderPassInfo.subpassCount = 1;
+			renderPassInfo.pSubpasses = &subpass;
+			renderPassInfo.dependencyCount = static_cast<u32>(dependencies.size());
+			renderPassInfo.pDependencies = dependencies.data();
+
+			return data::create_data(data::engine_vulkan_data::vulkan_renderpass, static_cast<void*>(&renderPassInfo), 0);
+		}
+	} // anonymous namespace
+
+	void vulkan_shadow_pass::setup(id::id_type descriptor_set_layout_id)
+	{
+		create_images();
+		create_renderpasses();
+		create_framebuffers();
+		create_pipeline(descriptor_set_layout_id);
+		create_queries();
+
+		auto flags = data::vulkan_buffer::per_frame_update_uniform_buffer;
+		_cascade_buffer_id = data::create_data(data::engine_vulkan_data::vulkan_buffer, (void*)(&flags), sizeof(glsl::ShadowCascadeData));
+	}
+
+	void vulkan_shadow_pass::release()
+	{
+		for (auto id : _static_framebuffer_ids)
+			data::remove_data(data::engine_vulkan_data::vulkan_framebuffer, id);
+		for (auto id : _shadow_framebuffer_ids)
+			data::remove_data(data::engine_vulkan_data::vulkan_framebuffer, id);
+		_static_framebuffer_ids.clear();
+		_shadow_framebuffer_ids.clear();
+
+		data::remove_data(data::engine_vulkan_data::vulkan_pipeline, _pipeline_id);
+		data::remove_data(data::engine_vulkan_data::vulkan_pipeline_layout, _pipeline_layout_id);
+		data::remove_data(data::engine_vulkan_data::vulkan_renderpass, _clear_renderpass_id);
+		data::remove_data(data::engine_vulkan_data::vulkan_renderpass, _load_renderpass_id);
+		data::remove_data(data::engine_vulkan_data::vulkan_buffer, _cascade_buffer_id);
+
+		for (auto view : _static_cache_layer_views)
+			vkDestroyImageView(core::logical_device(), view, nullptr);
+		for (auto view : _shadow_map_layer_views)
+			vkDestroyImageView(core::logical_device(), view, nullptr);
+		_static_cache_layer_views.clear();
+		_shadow_map_layer_views.clear();
+
+		for (auto& slot : _query_slots)
+		{
+			if (slot.pool) vkDestroyQueryPool(core::logical_device(), slot.pool, nullptr);
+			slot = {};
+		}
+		_timestamp_mask = 0;
+		_measuring = false;
+
+		textures::remove(_static_cache_id);
+		textures::remove(_shadow_map_id);
+	}
+
+	void vulkan_shadow_pass::create_images()
+	{
+		_shadow_map_id = createCascadeTexture(true, _shadow_map_layer_views);
+		_static_cache_id = createCascadeTexture(false, _static_cache_layer_views);
+	}
+
+	void vulkan_shadow_pass::create_renderpasses()
+	{
+		_clear_renderpass_id = createCascadeRenderpass(true);
+		_load_renderpass_id = createCascadeRenderpass(false);
+	}
+
+	void vulkan_shadow_pass::create_framebuffers()
+	{
+		VkFramebufferCreateInfo framebuffer{ VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO };
+		framebuffer.pNext = nullptr;
+		framebuffer.attachmentCount = 1;
+		framebuffer.width = shadow::shadow_map_size;
+		framebuffer.height = shadow::shadow_map_size;
+		framebuffer.layers = 1;
+
+		for (u32 i{ 0 }; i < shadow::cascade_count; ++i)
+		{
+			framebuffer.renderPass = data::get_data<VkRenderPass>(_clear_renderpass_id);
+			framebuffer.pAttachments = &_static_cache_layer_views[i];
+			_static_framebuffer_ids.emplace_back(data::create_data(data::engine_vulkan_data::vulkan_framebuffer, static_cast<void*>(&framebuffer), 0));
+
+			framebuffer.renderPass = data::get_data<VkRenderPass>(_load_renderpass_id);
+			framebuffer.pAttachments = &_shadow_map_layer_views[i];
+			_shadow_framebuffer_ids.emplace_back(data::create_data(data::engine_vulkan_data::vulkan_framebuffer, static_cast<void*>(&framebuffer), 0));
+		}
+	}
+
+	void vulkan_shadow_pass::create_pipeline(id::id_type descriptor_set_layout_id)
+	{
+		// Casters use the same per-instance descriptor sets as the geometry pass, only the model matrix is read.
+		VkPushConstantRange push{ VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(math::m4x4) };
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo;
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.pNext = nullptr;
+		pipelineLayoutInfo.flags = 0;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &data::get_data<VkDescriptorSetLayout>(descriptor_set_layout_id);
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &push;
+		_pipeline_layout_id = data::create_data(data::engine_vulkan_data::vulkan_pipeline_layout, static_cast<void*>(&pipelineLayoutInfo), 0);
+
+		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = descriptor::pipelineInputAssemblyStateCreate(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
+		VkPipelineViewportStateCreateInfo viewportState = descriptor::pipelineViewportStateCreate(1, 1, 0);
+		VkPipelineRasterizationStateCreateInfo rasterizationState = descriptor::pipelineRasterizationStateCreate(VK_POLYGON_MODE_FILL, VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE);
+		// Slope scaled bias against shadow acne
+		rasterizationState.depthBiasEnable = VK_TRUE;
+		rasterizationState.depthBiasConstantFactor = 1.25f;
+		rasterizationState.depthBiasSlopeFactor = 1.75f;
+		VkPipelineMultisampleStateCreateInfo multisampleState = descriptor::pipelineMultisampleStateCreate(VK_SAMPLE_COUNT_1_BIT);
+		VkPipelineColorBlendAttachmentState blendAttachmentState = descriptor::pipelineColorBlendAttachmentState(0xf, VK_FALSE);
+		VkPipelineColorBlendStateCreateInfo colorBlendState = descriptor::pipelineColorBlendStateCreate(0, blendAttachmentState);
+		VkPipelineDepthStencilStateCreateInfo depthStencilState = descriptor::pipelineDepthStencilStateCreateInfo(VK_TRUE, VK_TRUE, VK_FALSE, VK_FALSE, VK_COMPARE_OP_LESS_OR_EQUAL);
+		std::vector<VkDynamicState> dynamicStateEnables{ VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+		VkPipelineDynamicStateCreateInfo dynamicState = descriptor::pipelineDynamicStateCreate(dynamicStateEnables);
+
+		// Depth only, so position is the only attribute we need
+		auto bind = getVertexInputBindDescriptor();
+		auto attr = getVertexInputAttributeDescriptor();
+
+		VkPipelineVertexInputStateCreateInfo vertexInputInfo;
+		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+		vertexInputInfo.pNext = nullptr;
+		vertexInputInfo.flags = 0;
+		vertexInputInfo.vertexBindingDescriptionCount = static_cast<u32>(bind.size());
+		vertexInputInfo.pVertexBindingDescriptions = bind.data();
+		vertexInputInfo.vertexAttributeDescriptionCount = 1;
+		vertexInputInfo.pVertexAttributeDescriptions = attr.data();
+
+		std::string base_dir{ SOLUTION_DIR };
+		VkPipelineShaderStageCreateInfo shaderStage = shaders::get_shader(shaders::add(base_dir + "Engine\\Graphics\\Vulkan\\Shaders\\spv\\shadow_cascade.vert.spv", shader_type::vertex)).getShaderStage();
+
+		VkGraphicsPipelineCreateInfo pipelineCI;
+		pipelineCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipelineCI.pNext = nullptr;
+		pipelineCI.flags = 0;
+		pipelineCI.stageCount = 1;
+		pipelineCI.pStages = &shaderStage;
+		pipelineCI.pVertexInputState = &vertexInputInfo;
+		pipelineCI.pInputAssemblyState = &inputAssemblyState;
+		pipelineCI.pTessellationState = VK_NULL_HANDLE;
+		pipelineCI.pViewportState = &viewportState;
+		pipelineCI.pRasterizationState = &rasterizationState;
+		pipelineCI.pMultisampleState = &multisampleState;
+		pipelineCI.pDepthStencilState = &depthStencilState;
+		pipelineCI.pColorBlendState = &colorBlendState;
+		pipelineCI.pDynamicState = &dynamicState;
+		pipelineCI.layout = data::get_data<VkPipelineLayout>(_pipeline_layout_id);
+		// Both cascade render passes have the same single depth attachment, so they're compatible
+		pipelineCI.renderPass = data::get_data<VkRenderPass>(_clear_renderpass_id);
+		pipelineCI.subpass = 0;
+		pipelineCI.basePipelineHandle = VK_NULL_HANDLE;
+		pipelineCI.basePipelineIndex = -1;
+
+		_pipeline_id = data::create_data(data::engine_vulkan_data::vulkan_pipeline, static_cast<void*>(&pipelineCI), 0);
+	}
+
+	void vulkan_shadow_pass::create_queries()
+	{
+		// Queries are reset from the host so that a slot can be recycled without recording a reset
+		if (!core::host_query_reset_supported()) return;
+
+		u32 count{ 0 };
+		vkGetPhysicalDeviceQueueFamilyProperties(core::physical_device(), &count, nullptr);
+		utl::vector<VkQueueFamilyProperties> families(count);
+		vkGetPhysicalDeviceQueueFamilyProperties(core::physical_device(), &count, families.data());
+		const u32 bits{ families[core::graphics_family_queue_index()].timestampValidBits };
+		if (!bits) return;
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(core::physical_device(), &properties);
+		_timestamp_period = properties.limits.timestampPeriod;
+
+		VkQueryPoolCreateInfo info{ VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+		info.pNext = nullptr;
+		info.flags = 0;
+		info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		info.queryCount = shadow::cascade_count * 2;
+		info.pipelineStatistics = 0;
+
+		for (auto& slot : _query_slots)
+		{
+			VkResult result{ VK_SUCCESS };
+			VkCall(result = vkCreateQueryPool(core::logical_device(), &info, nullptr, &slot.pool), "Failed to create shadow cascade query pool...");
+			if (result != VK_SUCCESS) return;
+			vkResetQueryPool(core::logical_device(), slot.pool, 0, info.queryCount);
+		}
+
+		_timestamp_mask = bits >= 64 ? ~0ull : (1ull << bits) - 1;
+	}
+
+	// Read the timestamps of the frame recorded into the current slot. Returns false while the GPU isn't done with it.
+	bool vulkan_shadow_pass::collect_gpu_times()
+	{
+		query_slot& slot{ _query_slots[_query_slot] };
+		for (u32 i{ 0 }; i < shadow::cascade_count; ++i)
+		{
+			if (!(slot.written & (1u << i))) continue;
+
+			// Value and availability of the begin and end timestamp
+			u64 ticks[4]{};
+			const VkResult result{ vkGetQueryPoolResults(core::logical_device(), slot.pool, i * 2, 2, sizeof(ticks), ticks,
+				sizeof(u64) * 2, VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT) };
+			if (result != VK_SUCCESS || !ticks[1] || !ticks[3]) return false;
+		}
+
+		for (u32 i{ 0 }; i < shadow::cascade_count; ++i)
+		{
+			if (!(slot.written & (1u << i)))
+			{
+				_stats[i].gpu_ms = 0.f;
+				continue;
+			}
+
+			u64 ticks[2]{};
+			vkGetQueryPoolResults(core::logical_device(), slot.pool, i * 2, 2, sizeof(ticks), ticks, sizeof(u64), VK_QUERY_RESULT_64_BIT);
+			const u64 elapsed{ ((ticks[1] & _timestamp_mask) - (ticks[0] & _timestamp_mask)) & _timestamp_mask };
+			_stats[i].gpu_ms = (f32)elapsed * _timestamp_period * 1e-6f;
+		}
+
+		return true;
+	}
+
+	void vulkan_shadow_pass::update(const frame_info& info, scene::vulkan_scene& scene)
+	{
+		using namespace DirectX;
+
+		// Direction the light travels in. Without a directional light the cascades are still kept valid for sampling.
+		math::v3 light_direction{ 0.f, -1.f, 0.f };
+		light::directional_light_direction(info.light_set_key, light_direction);
+
+		const camera::vulkan_camera& view_camera{ camera::get(info.camera_id) };
+		const f32 near_z{ view_camera.near_z() };
+		const f32 far_z{ std::min(view_camera.far_z(), shadow::max_shadow_distance) };
+		const f32 tan_half_fov{ std::tan(view_camera.field_of_view() * XM_PI * 0.5f) };
+		const f32 aspect_ratio{ view_camera.aspect_ratio() };
+		const XMVECTOR camera_position{ view_camera.position() };
+		const XMVECTOR camera_direction{ XMVector3Normalize(view_camera.direction()) };
+		const XMVECTOR camera_right{ XMVector3Normalize(XMVector3Cross(camera_direction, view_camera.up())) };
+		const XMVECTOR camera_up{ XMVector3Cross(camera_right, camera_direction) };
+
+		// Light space rotation used to snap cascades to texels. It has no translation, so its inverse is its transpose.
+		const XMVECTOR direction{ XMVector3Normalize(XMLoadFloat3(&light_direction)) };
+		const XMVECTOR light_up{ std::abs(XMVectorGetY(direction)) > 0.99f ? XMVectorSet(0.f, 0.f, 1.f, 0.f) : XMVectorSet(0.f, 1.f, 0.f, 0.f) };
+		const XMMATRIX light_rotation{ XMMatrixLookToRH(XMVectorZero(), direction, light_up) };
+		const XMMATRIX inverse_light_rotation{ XMMatrixTranspose(light_rotation) };
+
+		const utl::vector<id::id_type>& instances{ scene.getInstanceIDs() };
+		const u32 static_version{ scene.getStaticVersion() };
+
+		f32 split_near{ near_z };
+		for (u32 i{ 0 }; i < shadow::cascade_count; ++i)
+		{
+			const auto start{ shadow_clock::now() };
+			cascade& c{ _cascades[i] };
+
+			// Practical split scheme: blend of logarithmic and uniform split distances
+			const f32 p{ (f32)(i + 1) / (f32)shadow::cascade_count };
+			const f32 log_split{ near_z * std::pow(far_z / near_z, p) };
+			const f32 uniform_split{ near_z + (far_z - near_z) * p };
+			const f32 split_far{ shadow::split_lambda * log_split + (1.f - shadow::split_lambda) * uniform_split };
+
+			// Bounding sphere of the frustum slice. The corners are symmetric around the view axis,
+			// so the radius doesn't change when the camera rotates.
+			XMVECTOR corners[8];
+			XMVECTOR center{ XMVectorZero() };
+			for (u32 j{ 0 }; j < 8; ++j)
+			{
+				const f32 distance{ j < 4 ? split_near : split_far };
+				const f32 half_height{ distance * tan_half_fov };
+				const f32 half_width{ half_height * aspect_ratio };
+				corners[j] = camera_position + camera_direction * distance +
+					camera_right * ((j & 1) ? half_width : -half_width) +
+					camera_up * ((j & 2) ? half_height : -half_height);
+				center += corners[j];
+			}
+			center *= 1.f / 8.f;
+
+			f32 radius{ 0.f };
+			for (u32 j{ 0 }; j < 8; ++j)
+			{
+				radius = std::max(radius, XMVectorGetX(XMVector3Length(corners[j] - center)));
+			}
+			// Round up so that floating point noise doesn't resize the cascade from frame to frame
+			radius = std::ceil(radius * 16.f) / 16.f;
+
+			// The cascade covers the slice plus a guard band and stays put while the slice is inside it. Refitting
+			// invalidates the static cache, this way that happens once per guard band of camera movement.
+			const f32 guard{ radius * shadow::cache_guard_band };
+			const f32 extent{ radius + guard };
+			const f32 texel_size{ 2.f * extent / (f32)shadow::shadow_map_size };
+			const f32 depth_range{ 2.f * extent + shadow::caster_z_backoff };
+			XMVECTOR light_center{ XMVector3TransformCoord(center, light_rotation) };
+			const XMVECTOR offset{ XMVectorAbs(light_center - XMLoadFloat3(&c.light_center)) };
+			const bool refit{ !c.fitted || c.radius != radius ||
+				memcmp(&c.light_direction, &light_direction, sizeof(math::v3)) != 0 ||
+				!XMVector3LessOrEqual(offset, XMVectorReplicate(guard)) };
+			if (refit)
+			{
+				// Move the cascade in whole texels only, this keeps shadow edges from shimmering
+				light_center = XMVectorSetX(light_center, std::floor(XMVectorGetX(light_center) / texel_size) * texel_size);
+				light_center = XMVectorSetY(light_center, std::floor(XMVectorGetY(light_center) / texel_size) * texel_size);
+				center = XMVector3TransformCoord(light_center, inverse_light_rotation);
+
+				// Pull the near plane back towards the light so casters in front of the slice are kept
+				const XMVECTOR eye{ center - direction * (extent + shadow::caster_z_backoff) };
+				const XMMATRIX view{ XMMatrixLookToRH(eye, direction, light_up) };
+				const XMMATRIX projection{ XMMatrixOrthographicRH(2.f * extent, 2.f * extent, 0.f, depth_range) };
+				XMStoreFloat4x4(&c.view, view);
+				XMStoreFloat4x4(&c.view_projection, view * projection);
+
+				XMStoreFloat3(&c.light_center, light_center);
+				c.light_direction = light_direction;
+				c.radius = radius;
+				c.fitted = true;
+				c.static_dirty = true;
+			}
+			const XMMATRIX view{ XMLoadFloat4x4(&c.view) };
+
+			_cascade_data.ViewProjection[i] = c.view_projection;
+			(&_cascade_data.SplitDepths.x)[i] = split_far;
+			(&_cascade_data.TexelSizes.x)[i] = texel_size;
+
+			// The cached static depth stays valid until the cascade is refitted or a static instance is added, removed or moved.
+			// It's cleared once record() rebuilt it.
+			c.static_dirty = c.static_dirty || c.cached_static_version != static_version;
+
+			// Cull casters against the cascade box in light view space. The view looks down -z,
+			// the box spans [-extent, extent] in x and y and [-depth_range, 0] in z.
+			c.static_casters.clear();
+			c.dynamic_casters.clear();
+			for (const id::id_type instance_id : instances)
+			{
+				const submesh::vulkan_instance_model& instance{ scene::get_instance(instance_id) };
+				// Static casters are only needed when the cached depth is rebuilt
+				if (instance.is_static() && !c.static_dirty) continue;
+
+				const math::v4 sphere{ instance.getWorldBoundingSphere() };
+				const XMVECTOR position{ XMVector3TransformCoord(XMVectorSet(sphere.x, sphere.y, sphere.z, 1.f), view) };
+				const f32 reach{ extent + sphere.w };
+				if (std::abs(XMVectorGetX(position)) > reach || std::abs(XMVectorGetY(position)) > reach) continue;
+				const f32 z{ XMVectorGetZ(position) };
+				if (z - sphere.w > 0.f || z + sphere.w < -depth_range) continue;
+
+				if (instance.is_static()) c.static_casters.emplace_back(instance_id);
+				else c.dynamic_casters.emplace_back(instance_id);
+			}
+
+			shadow::cascade_stats& stats{ _stats[i] };
+			stats.cull_ms = elapsed_ms(start);
+			stats.static_casters = (u32)c.static_casters.size();
+			stats.dynamic_casters = (u32)c.dynamic_casters.size();
+
+			split_near = split_far;
+		}
+
+		data::get_data<data::vulkan_buffer>(_cascade_buffer_id).update((void*)(&_cascade_data), sizeof(_cascade_data));
+	}
+
+	void vulkan_shadow_pass::record(vulkan_cmd_buffer cmd_buffer, scene::vulkan_scene& scene)
+	{
+		VkCommandBuffer cmd{ cmd_buffer.cmd_buffer };
+		const VkImage static_cache{ textures::get_texture(_static_cache_id).getTexture().image };
+		const VkImage shadow_map{ textures::get_texture(_shadow_map_id).getTexture().image };
+
+		VkViewport viewport{ 0.f, 0.f, (f32)shadow::shadow_map_size, (f32)shadow::shadow_map_size, 0.f, 1.f };
+		VkRect2D scissor{ { 0, 0 }, { shadow::shadow_map_size, shadow::shadow_map_size } };
+
+		VkClearValue clearValue;
+		clearValue.depthStencil = { 1.0f, 0 };
+
+		VkRenderPassBeginInfo info{ VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+		info.pNext = nullptr;
+		info.renderArea = scissor;
+
+		// A slot the GPU isn't done with can't be reset, this frame's cascades go unmeasured
+		_measuring = false;
+		if (_timestamp_mask)
+		{
+			_query_slot = (_query_slot + 1) % (u32)_query_slots.size();
+			_measuring = collect_gpu_times();
+			if (_measuring)
+			{
+				vkResetQueryPool(core::logical_device(), _query_slots[_query_slot].pool, 0, shadow::cascade_count * 2);
+				_query_slots[_query_slot].written = 0;
+			}
+		}
+
+		for (u32 i{ 0 }; i < shadow::cascade_count; ++i)
+		{
+			const auto start{ shadow_clock::now() };
+			cascade& c{ _cascades[i] };
+			shadow::cascade_stats& stats{ _stats[i] };
+			const bool has_dynamic{ !c.dynamic_casters.empty() };
+
+			stats.static_cached = !c.static_dirty;
+			// The shadow map layer still holds exactly the cached static depth, nothing to do
+			stats.skipped = !c.static_dirty && c.main_valid && !has_dynamic && !c.has_dynamic;
+			if (stats.skipped)
+			{
+				stats.record_ms = elapsed_ms(start);
+				continue;
+			}
+
+			if (_measuring) vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _query_slots[_query_slot].pool, i * 2);
+
+			vkCmdSetViewport(cmd, 0, 1, &viewport);
+			vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+			if (c.static_dirty)
+			{
+				info.renderPass = data::get_data<VkRenderPass>(_clear_renderpass_id);
+				info.framebuffer = data::get_data<VkFramebuffer>(_static_framebuffer_ids[i]);
+				info.clearValueCount = 1;
+				info.pClearValues = &clearValue;
+				vkCmdBeginRenderPass(cmd, &info, VK_SUBPASS_CONTENTS_INLINE);
+				draw_casters(cmd_buffer, c.static_casters, c.view_projection);
+				vkCmdEndRenderPass(cmd);
+
+				c.cached_static_version = scene.getStaticVersion();
+				c.static_dirty = false;
+			}
+
+			// Start the shadow map layer from the cached static depth. Its old content is overwritten completely.
+			VkImageSubresourceRange range{ VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, i, 1 };
+			setImageLayout(cmd, shadow_map, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, range,
+				VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+			VkImageCopy region{};
+			region.srcSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, i, 1 };
+			region.dstSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, i, 1 };
+			region.extent = { shadow::shadow_map_size, shadow::shadow_map_size, 1 };
+			vkCmdCopyImage(cmd, static_cache, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, shadow_map, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+			info.renderPass = data::get_data<VkRenderPass>(_load_renderpass_id);
+			info.framebuffer = data::get_data<VkFramebuffer>(_shadow_framebuffer_ids[i]);
+			info.clearValueCount = 0;
+			info.pClearValues = nullptr;
+			vkCmdBeginRenderPass(cmd, &info, VK_SUBPASS_CONTENTS_INLINE);
+			draw_casters(cmd_buffer, c.dynamic_casters, c.view_projection);
+			vkCmdEndRenderPass(cmd);
+
+			c.has_dynamic = has_dynamic;
+			c.main_valid = true;
+
+			if (_measuring)
+			{
+				vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _query_slots[_query_slot].pool, i * 2 + 1);
+				_query_slots[_query_slot].written |= 1u << i;
+			}
+
+			stats.record_ms = elapsed_ms(start);
+		}
+	}
+
+	void vulkan_shadow_pass::draw_casters(vulkan_cmd_buffer cmd_buffer, const utl::vector<id::id_type>& casters, const math::m4x4& view_projection)
+	{
+		if (casters.empty()) return;
+
+		const VkPipelineLayout layout{ data::get_data<VkPipelineLayout>(_pipeline_layout_id) };
+		vkCmdBindPipeline(cmd_buffer.cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, data::get_data<VkPipeline>(_pipeline_id));
+		vkCmdPushConstants(cmd_buffer.cmd_buffer, layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(math::m4x4), &view_projection);
+
+		for (const id::id_type instance_id : casters)
+		{
+			submesh::vulkan_instance_model& instance{ scene::get_instance(instance_id) };
+			auto descriptorSet = data::get_data<VkDescriptorSet>(instance.getDescriptorSet());
+			vkCmdBindDescriptorSets(cmd_buffer.cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &descriptorSet, 0, nullptr);
+			instance.flushBuffer(cmd_buffer);
+			instance.draw(cmd_buffer);
+		}
+	}
+}
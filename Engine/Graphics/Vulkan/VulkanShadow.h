@@ -0,0 +1,118 @@
+#pragma once
+#include "VulkanCommonHeaders.h"
+#include "Shaders/ShaderTypes.h"
+
+#include <array>
+
+namespace primal::graphics::vulkan
+{
+	class vulkan_surface;
+
+	namespace scene
+	{
+		class vulkan_scene;
+	}
+
+	namespace shadow
+	{
+		constexpr u32 cascade_count{ SHADOW_CASCADE_COUNT };
+		constexpr u32 shadow_map_size{ 2048 };
+		constexpr f32 max_shadow_distance{ 60.f };		// Cascades stop at this view distance even if the camera sees further
+		constexpr f32 split_lambda{ 0.75f };			// 0: uniform splits, 1: logarithmic splits
+		constexpr f32 caster_z_backoff{ 50.f };			// Distance behind a cascade (towards the light) from which casters are still drawn
+		constexpr f32 cache_guard_band{ 0.15f };		// A cascade covers this much of its radius more than its frustum slice needs, so the
+														// camera can move that far before the cascade and its static cache are refitted
+
+		// Cost and caching result of one cascade in the last frame
+		struct cascade_stats
+		{
+			f32			cull_ms;			// CPU time spent culling casters against the cascade
+			f32			record_ms;			// CPU time spent recording the cascade's draw commands
+			f32			gpu_ms;				// GPU time of the cascade's commands in the last frame the GPU finished, 0 if it was skipped
+			u32			static_casters;		// Static casters inside the cascade
+			u32			dynamic_casters;	// Dynamic casters inside the cascade
+			bool		static_cached;		// Static casters were not re-rendered, the cached depth was reused
+			bool		skipped;			// Nothing changed, the cascade kept last frame's depth
+		};
+	}
+
+	class vulkan_shadow_pass
+	{
+	public:
+		vulkan_shadow_pass() = default;
+
+		DISABLE_COPY_AND_MOVE(vulkan_shadow_pass);
+
+		~vulkan_shadow_pass() = default;
+
+		void setup(id::id_type descriptor_set_layout_id);
+
+		void release();
+
+		// Fit the cascades to the camera and cull casters for each of them
+		void update(const frame_info& info, scene::vulkan_scene& scene);
+
+		// Record the cascades that need to be redrawn into cmd_buffer, must be outside of a render pass
+		void record(vulkan_cmd_buffer cmd_buffer, scene::vulkan_scene& scene);
+
+		[[nodiscard]] constexpr id::id_type getShadowMap() const { return _shadow_map_id; }
+
+		[[nodiscard]] constexpr id::id_type getCascadeBufferID() const { return _cascade_buffer_id; }
+
+		[[nodiscard]] constexpr const std::array<shadow::cascade_stats, shadow::cascade_count>& get_stats() const { return _stats; }
+
+	private:
+		struct cascade
+		{
+			math::m4x4									view;
+			math::m4x4									view_projection;				// Only changes when the cascade is refitted
+			math::v3									light_center{};					// Light space center the cascade was fitted to
+			math::v3									light_direction{};
+			f32											radius{ 0.f };					// Radius of the frustum slice, without the guard band
+			bool										fitted{ false };
+			u32											cached_static_version{ u32_invalid_id };
+			bool										static_dirty{ true };			// Static cache must be re-rendered this frame
+			bool										has_dynamic{ false };			// Main layer contains dynamic casters from the last update
+			bool										main_valid{ false };			// Main layer holds the static cache plus dynamic casters
+			utl::vector<id::id_type>					static_casters;
+			utl::vector<id::id_type>					dynamic_casters;
+		};
+
+		void create_images();
+		void create_renderpasses();
+		void create_framebuffers();
+		void create_pipeline(id::id_type descriptor_set_layout_id);
+		void draw_casters(vulkan_cmd_buffer cmd_buffer, const utl::vector<id::id_type>& casters, const math::m4x4& view_projection);
+		void create_queries();
+		bool collect_gpu_times();
+
+		// Timestamp queries, begin and end of every cascade. A pool is reused once the frame recorded into it is done,
+		// which the frame fences guarantee after frame_buffer_count newer frames.
+		struct query_slot
+		{
+			VkQueryPool											pool{ VK_NULL_HANDLE };
+			u32													written{ 0 };		// Cascades whose timestamps were recorded, bit per cascade
+		};
+
+		std::array<cascade, shadow::cascade_count>				_cascades;
+		std::array<shadow::cascade_stats, shadow::cascade_count>	_stats{};
+		glsl::ShadowCascadeData									_cascade_data{};
+
+		id::id_type												_shadow_map_id{ id::invalid_id };		// Sampled array, static cache + dynamic casters
+		id::id_type												_static_cache_id{ id::invalid_id };		// Static casters only
+		utl::vector<VkImageView>								_shadow_map_layer_views;
+		utl::vector<VkImageView>								_static_cache_layer_views;
+		id::id_type												_cascade_buffer_id{ id::invalid_id };
+		id::id_type												_clear_renderpass_id{ id::invalid_id };
+		id::id_type												_load_renderpass_id{ id::invalid_id };
+		utl::vector<id::id_type>								_static_framebuffer_ids;
+		utl::vector<id::id_type>								_shadow_framebuffer_ids;
+		id::id_type												_pipeline_layout_id{ id::invalid_id };
+		id::id_type												_pipeline_id{ id::invalid_id };
+		std::array<query_slot, frame_buffer_count + 1>			_query_slots{};
+		u32														_query_slot{ 0 };
+		u64														_timestamp_mask{ 0 };				// Valid timestamp bits of the graphics queue, 0 when it can't measure
+		f32														_timestamp_period{ 1.f };			// Nanoseconds per tick
+		bool													_measuring{ false };				// Current slot was reset and takes timestamps
+	};
+}
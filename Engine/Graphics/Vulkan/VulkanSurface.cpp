@@ -16,14 +16,59 @@
 #include "VulkanData.h"
 #include "VulkanLight.h"
 #include "VulkanCompute.h"
+#include "VulkanBindless.h"
+#include "VulkanTextureStreaming.h"
+#include "VulkanSampler.h"
 #include <fstream>
 #include <filesystem>
 #include <exception>
+#include <cstdlib>
 
 namespace primal::graphics::vulkan
 {
 namespace
 {
+    // Pack the float vertices of files written before ContentTools packed them, against their own bounding box
+    void pack_vertices(const utl::vector<Vertex>& float_vertices, geometry_config& g)
+    {
+        math::v3 min{ float_vertices.empty() ? math::v3{} : float_vertices[0].pos };
+        math::v3 max{ min };
+        for (const auto& v : float_vertices)
+        {
+            min = { std::min(min.x, v.pos.x), std::min(min.y, v.pos.y), std::min(min.z, v.pos.z) };
+            max = { std::max(max.x, v.pos.x), std::max(max.y, v.pos.y), std::max(max.z, v.pos.z) };
+        }
+
+        g.position_box = content::make_quantization_box(min, max);
+        g.vertices.resize(float_vertices.size());
+        for (u32 i{ 0 }; i < float_vertices.size(); ++i)
+        {
+            const Vertex& v{ float_vertices[i] };
+            g.vertices[i] = content::pack_vertex(v.pos, { v.texCoord.x, v.texCoord.y }, v.normal, v.tangent, g.position_box);
+        }
+    }
+
+    // Diffuse color a material's fragment shader was generated with from the PBR template, white when it can't be read
+    math::v3 read_diffuse_color(const std::string& fragment_source)
+    {
+        constexpr char prefix[]{ "#define diffuse_color vec3(" };
+        std::ifstream infile(fragment_source, std::ios::in);
+        std::string line;
+        while (std::getline(infile, line))
+        {
+            if (line.compare(0, sizeof(prefix) - 1, prefix) != 0) continue;
+
+            math::v3 color{};
+            char* next{ line.data() + sizeof(prefix) - 1 };
+            color.x = std::strtof(next, &next);
+            color.y = std::strtof(next + 1, &next);
+            color.z = std::strtof(next + 1, &next);
+            return color;
+        }
+
+        return { 1.f, 1.f, 1.f };
+    }
+
     bool load_kms_file(const char* file, utl::vector<geometry_config>& out_geometry_array)
     {
         //std::unique_ptr<std::ifstream, std::function<void(std::ifstream*)>> infile(new std::ifstream{ file, std::ios::binary }, [](std::ifstream *fptr) {fptr->close(); delete fptr; });
@@ -50,32 +95,46 @@ namespace
         {
             geometry_config g{};
 
-            // Vertices (size/count/array)
+            // Vertices (size/count/array), packed or, in older files, floats
             infile.read(reinterpret_cast<char*>(&g.vertex_size), sizeof(u32)); address += sizeof(u32);
             infile.seekg(address, std::ios::beg);
             infile.read(reinterpret_cast<char*>(&g.vertex_count), sizeof(u32)); address += sizeof(u32);
             infile.seekg(address, std::ios::beg);
-            //g.vertices.resize(g.vertex_count);
-            for (u32 x{ 0 }; x < g.vertex_count; ++x)
+            const bool packed{ g.vertex_size == sizeof(content::packed_vertex) };
+            if (packed)
+            {
+                g.vertices.resize(g.vertex_count);
+                infile.read(reinterpret_cast<char*>(g.vertices.data()), g.vertex_count * sizeof(content::packed_vertex)); address += g.vertex_count * sizeof(content::packed_vertex);
+                infile.seekg(address, std::ios::beg);
+            }
+            else if (g.vertex_size == sizeof(Vertex))
             {
-                Vertex vertex;
-                infile.read(reinterpret_cast<char*>(&vertex), sizeof(Vertex)); address += sizeof(Vertex);
+                utl::vector<Vertex> float_vertices(g.vertex_count);
+                infile.read(reinterpret_cast<char*>(float_vertices.data()), g.vertex_count * sizeof(Vertex)); address += g.vertex_count * sizeof(Vertex);
                 infile.seekg(address, std::ios::beg);
-                g.vertices.emplace_back(vertex);
+                pack_vertices(float_vertices, g);
+            }
+            else
+            {
+                return false;
             }
 
-            // Indices (size/count/array)
+            // Indices (size/count/array), 16 or 32 bits in the file
             infile.read(reinterpret_cast<char*>(&g.index_size), sizeof(u32)); address += sizeof(u32);
             infile.seekg(address, std::ios::beg);
             infile.read(reinterpret_cast<char*>(&g.index_count), sizeof(u32)); address += sizeof(u32);
             infile.seekg(address, std::ios::beg);
-            for (u32 y{ 0 }; y < g.index_count; ++y)
+            if (g.index_size == sizeof(u16))
             {
-                u32 index{ 0 };
-                infile.read(reinterpret_cast<char*>(&index), sizeof(u32)); address += sizeof(u32);
-                infile.seekg(address, std::ios::beg);
-                g.indices.emplace_back(index);
+                g.indices16.resize(g.index_count);
+                infile.read(reinterpret_cast<char*>(g.indices16.data()), g.index_count * sizeof(u16)); address += g.index_count * sizeof(u16);
+            }
+            else
+            {
+                g.indices.resize(g.index_count);
+                infile.read(reinterpret_cast<char*>(g.indices.data()), g.index_count * sizeof(u32)); address += g.index_count * sizeof(u32);
             }
+            infile.seekg(address, std::ios::beg);
 
             // Name
             u32 g_name_lenght = 0;
@@ -136,9 +195,25 @@ namespace
             infile.read(reinterpret_cast<char*>(&g.max_extents), sizeof(math::v3)); address += sizeof(math::v3);
             infile.seekg(address, std::ios::beg);
 
+            // Packed positions are quantized in the extents
+            if (packed) g.position_box = content::make_quantization_box(g.min_extents, g.max_extents);
+
             out_geometry_array.emplace_back(g);
         }
 
+        // Meshlets (count/array) of each geometry, files written before meshlets end here
+        for (auto& g : out_geometry_array)
+        {
+            u32 meshlet_count{ 0 };
+            if (!infile.read(reinterpret_cast<char*>(&meshlet_count), sizeof(u32))) break;
+            g.meshlets.resize(meshlet_count);
+            if (!infile.read(reinterpret_cast<char*>(g.meshlets.data()), meshlet_count * sizeof(content::meshlet)))
+            {
+                g.meshlets.clear();
+                break;
+            }
+        }
+
         infile.clear();
         infile.close();
 
@@ -231,25 +306,36 @@ create_image_view(VkImage image, VkFormat format, VkImageAspectFlags flags)
 void
 vulkan_surface::create(VkInstance instance)
 {
-    create_surface(instance);
-    core::create_device(_surface);
+    if (_headless)
+    {
+        // Without a surface any device with a graphics queue will do
+        core::create_device(VK_NULL_HANDLE);
+        vkGetDeviceQueue(core::logical_device(), core::graphics_family_queue_index(), 0, &_headless_queue);
+        create_offscreen_images();
+    }
+    else
+    {
+        create_surface(instance);
+        core::create_device(_surface);
 
-    GET_DEVICE_PROC_ADDR(core::logical_device(), CreateSwapchainKHR);
-    GET_DEVICE_PROC_ADDR(core::logical_device(), DestroySwapchainKHR);
-    GET_DEVICE_PROC_ADDR(core::logical_device(), GetSwapchainImagesKHR);
-    GET_DEVICE_PROC_ADDR(core::logical_device(), AcquireNextImageKHR);
-    GET_DEVICE_PROC_ADDR(core::logical_device(), QueuePresentKHR);
+        GET_DEVICE_PROC_ADDR(core::logical_device(), CreateSwapchainKHR);
+        GET_DEVICE_PROC_ADDR(core::logical_device(), DestroySwapchainKHR);
+        GET_DEVICE_PROC_ADDR(core::logical_device(), GetSwapchainImagesKHR);
+        GET_DEVICE_PROC_ADDR(core::logical_device(), AcquireNextImageKHR);
+        GET_DEVICE_PROC_ADDR(core::logical_device(), QueuePresentKHR);
 
-    create_swapchain();
+        create_swapchain();
+    }
     create_render_pass();
     recreate_framebuffers();
 
     data::initialize();
 
+    // Light culling's buffers are imported into the geometry pass's render graph
+    compute::create_buffers();
     _geometry.setSize(this->width(), this->height());
     _geometry.setupPoolAndLayout();
     _geometry.setupRenderpassAndFramebuffer();
-    _geometry.create_semaphore();
     _final.setSize(this->width(), this->height());
 
     core::create_graphics_command((u32)_swapchain.images.size());
@@ -257,8 +343,12 @@ vulkan_surface::create(VkInstance instance)
     //geometry_initialize(this->width(), this->height());
 
     light::initialize();
+    bindless::initialize();
+    texture_streaming::initialize();
 
     const std::string base_dir{ SOLUTION_DIR };
+    // Every material decodes content::packed_vertex the same way, only the fragment shaders are generated per material
+    const id::id_type material_vs_id{ shaders::add(base_dir + std::string({ "Engine\\Graphics\\Vulkan\\Shaders\\spv\\material.vert.spv" }), shader_type::vertex) };
 
     std::string sponza_package{ base_dir };
     sponza_package.append("EngineTest\\assets\\kms\\sponza\\");
@@ -286,12 +376,12 @@ vulkan_surface::create(VkInstance instance)
             {
                 normal_map_id = textures::add(base_dir + std::string{"EngineTest\\assets\\"} + std::string{ model_2[0].normal_map });
             }
-            auto sponza_vs_id = shaders::add(base_dir + std::string({ "Engine\\Graphics\\Vulkan\\Shaders\\spv\\" }) + std::string({ model_2[0].material_name }) + std::string({ ".vert.spv" }), shader_type::vertex);
             auto sponza_frag_id = shaders::add(base_dir + std::string({ "Engine\\Graphics\\Vulkan\\Shaders\\spv\\" }) + std::string({ model_2[0].material_name }) + std::string({ ".frag.spv" }), shader_type::pixel);
-            auto sponza_material_id = materials::add({ material_type::opauqe, 0, {sponza_vs_id, id::invalid_id, id::invalid_id, id::invalid_id, sponza_frag_id, id::invalid_id, id::invalid_id, id::invalid_id}, nullptr });
+            auto sponza_material_id = materials::add({ material_type::opauqe, 0, {material_vs_id, id::invalid_id, id::invalid_id, id::invalid_id, sponza_frag_id, id::invalid_id, id::invalid_id, id::invalid_id}, nullptr });
             if (id::is_valid(diffuse_map_id))    materials::get_material(sponza_material_id).add_texture(diffuse_map_id);
             if (id::is_valid(specular_map_id))    materials::get_material(sponza_material_id).add_texture(specular_map_id);
             if (id::is_valid(normal_map_id))    materials::get_material(sponza_material_id).add_texture(normal_map_id);
+            materials::get_material(sponza_material_id).setDiffuseColor(read_diffuse_color(sponza_package + "shaders\\" + std::string{ model_2[0].material_name } + ".frag"));
 
             transform::init_info sponza_transform_info{};
             math::v3 sponza_rotation{ 0.f, 0.f, 0.f };
@@ -303,6 +393,7 @@ vulkan_surface::create(VkInstance instance)
             memcpy(&sponza_transform_info.scale[0], &sponza_scale.x, sizeof(sponza_transform_info.scale));
             memcpy(&sponza_transform_info.rotation[0], &sponza_rot_quat.x, sizeof(sponza_transform_info.rotation));
             memcpy(&sponza_transform_info.position[0], &sponza_position.x, sizeof(sponza_transform_info.position));
+            sponza_transform_info.is_static = true;
             game_entity::entity_info sponza_entity_info{};
             sponza_entity_info.transform = &sponza_transform_info;
             game_entity::entity sponza_ntt{ game_entity::create(sponza_entity_info) };
@@ -328,9 +419,8 @@ vulkan_surface::create(VkInstance instance)
             load_kms_file(file.path().string().c_str(), model_2);
             void* model_2_data = &model_2;
             auto sphere_sub_id = submesh::add(model_2_data);
-            auto sphere_vs_id = shaders::add(base_dir + std::string({ "Engine\\Graphics\\Vulkan\\Shaders\\spv\\sphere.vert.spv" }), shader_type::vertex);
             auto sphere_frag_id = shaders::add(base_dir + std::string({ "Engine\\Graphics\\Vulkan\\Shaders\\spv\\sphere.frag.spv" }), shader_type::pixel);
-            auto sphere_material_id = materials::add({ material_type::opauqe, 0, {sphere_vs_id, id::invalid_id, id::invalid_id, id::invalid_id, sphere_frag_id, id::invalid_id, id::invalid_id, id::invalid_id}, nullptr });
+            auto sphere_material_id = materials::add({ material_type::opauqe, 0, {material_vs_id, id::invalid_id, id::invalid_id, id::invalid_id, sphere_frag_id, id::invalid_id, id::invalid_id, id::invalid_id}, nullptr });
 
             transform::init_info sphere_transform_info{};
             math::v3 sphere_rotation{ 0.f, 0.f, 0.f };
@@ -366,13 +456,38 @@ vulkan_surface::create(VkInstance instance)
     
     _scene.createDescriptorSets(data::get_data<VkDescriptorPool>(_geometry.getDescriptorPool()), data::get_data<VkDescriptorSetLayout>(_geometry.getDescriptorSetLayout()));
     //_scene.createDescriptorSets(data::get_data<VkDescriptorPool>(geometry_descriptor_pool()), data::get_data<VkDescriptorSetLayout>(geometry_pipeline_layout()));
-    _final.setupDescriptorSets(_geometry.getTexture(), _scene.getUboID());
+    _shadow.setup(_geometry.getDescriptorSetLayout());
+    _indirect.setup(_geometry.getRenderpass(), _scene.getUboID());
+
+    if constexpr (recording::run_benchmark)
+        _geometry.benchmark_recording(this, recording::benchmark_draw_count);
+    _final.setupDescriptorSets(_geometry.getTexture(), _scene.getUboID(), _shadow.getShadowMap(), _shadow.getCascadeBufferID());
     _final.setupPipeline(_renderpass);
+
+    // Every texture, attachment and shadow map holds a reference, the scene's few sampler settings should map to as many samplers
+    const u32 live_samplers{ samplers::live_count() };
+    const u32 sampler_references{ samplers::reference_count() };
+    assert(live_samplers <= sampler_references);
+    MESSAGE(("Sampler cache: " + std::to_string(live_samplers) + " live samplers for " + std::to_string(sampler_references) + " references").c_str());
 }
 
 void
 vulkan_surface::present(VkSemaphore image_available, VkSemaphore render_finished, VkFence fence, VkQueue presentation_queue)
 {
+    if (_headless)
+    {
+        // Consume render_finished like the presentation engine would, so it can be signaled again
+        const VkPipelineStageFlags wait_stage{ VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT };
+        VkSubmitInfo info{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
+        info.waitSemaphoreCount = 1;
+        info.pWaitSemaphores = &render_finished;
+        info.pWaitDstStageMask = &wait_stage;
+        VkCall(vkQueueSubmit(_headless_queue, 1, &info, VK_NULL_HANDLE), "Failed to submit headless present...");
+
+        _frame_index = (_frame_index + 1) % _swapchain.images.size();
+        return;
+    }
+
     // Present image
     VkPresentInfoKHR info{ VK_STRUCTURE_TYPE_PRESENT_INFO_KHR };
     info.waitSemaphoreCount = 1;
@@ -398,7 +513,8 @@ vulkan_surface::present(VkSemaphore image_available, VkSemaphore render_finished
 void
 vulkan_surface::resize()
 {
-    _framebuffer_resized = true;
+    // Offscreen images keep the configured size
+    _framebuffer_resized = !_headless;
 }
 
 void
@@ -407,7 +523,13 @@ vulkan_surface::release()
 
     vkDeviceWaitIdle(core::logical_device());
 
+    if (_headless) headless::shutdown();
     compute::shutdown();
+    _shadow.release();
+    _indirect.release();
+    texture_streaming::shutdown();
+    bindless::shutdown();
+    _geometry.getDrawRecorder().release();
 
     for (u32 i{ 0 }; i < _swapchain.images.size(); ++i)
     {
@@ -420,8 +542,10 @@ vulkan_surface::release()
     /// Own function destroy
     /// </summary>
     _scene.~vulkan_scene();
+    // The device is idle, the instances' queued releases can run before the data they point at is gone
+    core::flush_deferred_release();
 
-    vkDestroySurfaceKHR(core::get_instance(), _surface, nullptr);
+    if (_surface) vkDestroySurfaceKHR(core::get_instance(), _surface, nullptr);
 
     data::shutdown();
 }
@@ -545,6 +669,52 @@ vulkan_surface::create_swapchain()
         _swapchain.images.push_back(temp);
     }
 
+    if (!detect_device_features() || !create_depth_attachment())
+        return false;
+
+
+    MESSAGE("Swapchain created successfully");
+
+    return true;
+}
+
+bool
+vulkan_surface::create_offscreen_images()
+{
+    // One image per frame in flight, handed out in order like a swapchain would
+    _swapchain.image_format = VK_FORMAT_R8G8B8A8_UNORM;
+    _offscreen_images.resize(frame_buffer_count);
+
+    image_init_info image_info;
+    image_info.image_type = VK_IMAGE_TYPE_2D;
+    image_info.width = _swapchain.extent.width;
+    image_info.height = _swapchain.extent.height;
+    image_info.format = _swapchain.image_format;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage_flags = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;	// Copied out for readback
+    image_info.memory_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    image_info.create_view = true;
+    image_info.view_aspect_flags = VK_IMAGE_ASPECT_COLOR_BIT;
+
+    for (auto& image : _offscreen_images)
+    {
+        if (!create_image(core::logical_device(), &image_info, image))
+            return false;
+
+        _swapchain.images.push_back({ image.image, image.view });
+    }
+
+    if (!detect_device_features() || !create_depth_attachment())
+        return false;
+
+    MESSAGE("Offscreen images created successfully");
+
+    return true;
+}
+
+bool
+vulkan_surface::detect_device_features()
+{
     if (!core::detect_depth_format(core::physical_device()))
     {
         ERROR_MSSG("Failed to find a supported depth format...");
@@ -563,6 +733,12 @@ vulkan_surface::create_swapchain()
         return false;
     }
 
+    return true;
+}
+
+bool
+vulkan_surface::create_depth_attachment()
+{
     // Create depthbuffer image and view
     image_init_info image_info;
     image_info.image_type = VK_IMAGE_TYPE_2D;
@@ -574,20 +750,15 @@ vulkan_surface::create_swapchain()
     image_info.memory_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
     image_info.create_view = true;
     image_info.view_aspect_flags = VK_IMAGE_ASPECT_DEPTH_BIT;
-    if (!create_image(core::logical_device(), &image_info, _swapchain.depth_attachment))
-        return false;
-
-
-    MESSAGE("Swapchain created successfully");
-
-    return true;
+    return create_image(core::logical_device(), &image_info, _swapchain.depth_attachment);
 }
 
 void
 vulkan_surface::create_render_pass()
 {
     _renderpass = renderpass::create_renderpass(core::logical_device(), _swapchain.image_format, core::depth_format(),
-        { 0, 0, _window.width(), _window.height() }, { 0.0f, 0.0f, 0.0f, 0.0f }, 1.0f, 0);
+        { 0, 0, width(), height() }, { 0.0f, 0.0f, 0.0f, 0.0f }, 1.0f, 0,
+        _headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
 
 }
 
@@ -627,7 +798,7 @@ vulkan_surface::recreate_framebuffers()
         attachments[0] = _swapchain.images[i].image_view;
         attachments[1] = _swapchain.depth_attachment.view;
 
-        if (!create_framebuffer(core::logical_device(), _renderpass, _window.width(), _window.height(), attach_count, attachments, _framebuffers[i])) return false;
+        if (!create_framebuffer(core::logical_device(), _renderpass, width(), height(), attach_count, attachments, _framebuffers[i])) return false;
     }
 
     return true;
@@ -638,6 +809,14 @@ vulkan_surface::clean_swapchain()
 {
     destroy_image(core::logical_device(), &_swapchain.depth_attachment);
 
+    if (_headless)
+    {
+        for (auto& image : _offscreen_images)
+            destroy_image(core::logical_device(), &image);
+        _offscreen_images.clear();
+        return;
+    }
+
     // NOTE: Swapchain provides images for us, but not the views. Therefore, we are responsible
     //		 for destroying only the views... the swapchain destroys images for us.
     for (u32 i{ 0 }; i < _swapchain.images.size(); ++i)
@@ -651,6 +830,18 @@ vulkan_surface::clean_swapchain()
 bool
 vulkan_surface::next_image_index(VkSemaphore image_available, VkFence fence, u64 timeout)
 {
+    if (_headless)
+    {
+        // Signal image_available like an acquire would, the frame's submit waits on it
+        _image_index = _frame_index;
+        VkSubmitInfo info{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
+        info.signalSemaphoreCount = 1;
+        info.pSignalSemaphores = &image_available;
+        VkResult result{ VK_SUCCESS };
+        VkCall(result = vkQueueSubmit(_headless_queue, 1, &info, fence), "Failed to submit headless acquire...");
+        return result == VK_SUCCESS;
+    }
+
     // Get next image
     VkResult result{ VK_SUCCESS };
     result = vkAcquireNextImageKHR(core::logical_device(), _swapchain.swapchain, timeout, image_available, fence, &_image_index);
@@ -6,6 +6,9 @@
 #include "VulkanCore.h"
 #include "VulkanHelpers.h"
 #include "VulkanGBuffer.h"
+#include "VulkanShadow.h"
+#include "VulkanIndirect.h"
+#include "VulkanHeadless.h"
 
 namespace primal::graphics::vulkan
 {
@@ -41,6 +44,11 @@ public:
     {
         assert(window.handle());
     }
+    // No window or VkSurfaceKHR, renders into one offscreen image per frame in flight
+    explicit vulkan_surface(const headless::config& config) : _headless{ true }
+    {
+        _swapchain.extent = { config.width, config.height };
+    }
     DISABLE_COPY_AND_MOVE(vulkan_surface);
     ~vulkan_surface() { release(); }
 
@@ -56,8 +64,11 @@ public:
 
     [[nodiscard]] constexpr VkFramebuffer& current_framebuffer() { return _framebuffers[_image_index].framebuffer; }
     [[nodiscard]] constexpr vulkan_renderpass& renderpass() { return _renderpass; }
-    u32 width() const { return _window.width(); }
-    u32 height() const { return _window.height(); }
+    u32 width() const { return _headless ? _swapchain.extent.width : _window.width(); }
+    u32 height() const { return _headless ? _swapchain.extent.height : _window.height(); }
+    [[nodiscard]] VkImage current_image() const { return _swapchain.images[_image_index].image; }
+    constexpr VkFormat image_format() const { return _swapchain.image_format; }
+    constexpr bool is_headless() const { return _headless; }
     constexpr u32 current_frame() const { return _frame_index; }
     constexpr bool is_recreating() const { return _is_recreating; }
     constexpr bool is_resized() const { return _framebuffer_resized; }
@@ -66,11 +77,16 @@ public:
     [[nodiscard]] constexpr scene::vulkan_scene& getScene() { return _scene; }
     [[nodiscard]] vulkan_geometry_pass& getGeometryPass() { return _geometry; }
     [[nodiscard]] vulkan_final_pass& getFinalPass() { return _final; }
+    [[nodiscard]] vulkan_shadow_pass& getShadowPass() { return _shadow; }
+    [[nodiscard]] vulkan_indirect_pass& getIndirectPass() { return _indirect; }
 
 private:
     void create_surface(VkInstance instance);
     void create_render_pass();
     bool create_swapchain();
+    bool create_offscreen_images();
+    bool detect_device_features();
+    bool create_depth_attachment();
     bool recreate_framebuffers();
     void clean_swapchain();
     void release();
@@ -80,6 +96,9 @@ private:
     vulkan_renderpass				_renderpass{};
     utl::vector<vulkan_framebuffer>	_framebuffers{};
     platform::window				_window{};
+    utl::vector<vulkan_image>		_offscreen_images{};	// Headless only, _swapchain.images refer to these
+    VkQueue							_headless_queue{};		// Stands in for acquire and present when headless
+    bool							_headless{ false };
     bool							_framebuffer_resized{ false };
     bool							_is_recreating{ false };
     u32								_image_index{ 0 };
@@ -89,6 +108,8 @@ private:
     scene::vulkan_scene             _scene;
     vulkan_geometry_pass            _geometry;
     vulkan_final_pass               _final;
+    vulkan_shadow_pass              _shadow;
+    vulkan_indirect_pass            _indirect;
     
 
     // Function Pointers
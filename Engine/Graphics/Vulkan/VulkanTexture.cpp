@@ -3,6 +3,8 @@
 #include "VulkanResources.h"
 #include "VulkanCommandBuffer.h"
 #include "VulkanCore.h"
+#include "VulkanSampler.h"
+#include <algorithm>
 //#define STB_IMAGE_IMPLEMENTATION
 //#include "Content/stb_image.h"
 
@@ -13,14 +15,14 @@ namespace primal::graphics::vulkan
 
 	} // anontmous namespace
 
-	void transitionImageLayout(VkDevice device, u32 index, VkCommandPool pool, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout)
+	void transitionImageLayout(VkDevice device, u32 index, VkCommandPool pool, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, u32 mipLevels)
 	{
 		vulkan_cmd_buffer cmdBuffer{ allocate_cmd_buffer_begin_single_use(device, pool) };
 
 		VkImageSubresourceRange subresourceRange = {};
 		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 		subresourceRange.baseMipLevel = 0;
-		subresourceRange.levelCount = 1;
+		subresourceRange.levelCount = mipLevels;
 		subresourceRange.layerCount = 1;
 
 		if (newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
@@ -88,32 +90,126 @@ namespace primal::graphics::vulkan
 		endSingleCommand(device, index, pool, commandBuffer);
 	}
 
-	void createTextureSampler(VkPhysicalDevice physicalDevice, VkDevice device, vulkan_texture& tex)
+	u32 mipLevelCount(u32 width, u32 height)
+	{
+		u32 levels{ 1 };
+		while (width > 1 || height > 1)
+		{
+			width >>= 1;
+			height >>= 1;
+			++levels;
+		}
+		return levels;
+	}
+
+	bool supportsMipmapBlit(VkPhysicalDevice physicalDevice, VkFormat format)
+	{
+		VkFormatProperties properties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+		constexpr VkFormatFeatureFlags needed{ VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT };
+		return (properties.optimalTilingFeatures & needed) == needed;
+	}
+
+	void generateMipmaps(VkDevice device, u32 index, VkCommandPool pool, VkImage image, u32 width, u32 height, u32 mipLevels)
+	{
+		VkCommandBuffer commandBuffer = beginSingleCommand(device, pool);
+
+		VkImageSubresourceRange subresourceRange = {};
+		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		subresourceRange.levelCount = 1;
+		subresourceRange.layerCount = 1;
+
+		s32 mipWidth{ (s32)width };
+		s32 mipHeight{ (s32)height };
+		for (u32 i{ 1 }; i < mipLevels; ++i)
+		{
+			// The level above is complete, read from it
+			subresourceRange.baseMipLevel = i - 1;
+			setImageLayout(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, subresourceRange,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+			VkImageBlit blit{};
+			blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i - 1, 0, 1 };
+			blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
+			mipWidth = std::max(mipWidth / 2, 1);
+			mipHeight = std::max(mipHeight / 2, 1);
+			blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1 };
+			blit.dstOffsets[1] = { mipWidth, mipHeight, 1 };
+			vkCmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+			setImageLayout(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+		}
+
+		// The smallest level is only written
+		subresourceRange.baseMipLevel = mipLevels - 1;
+		setImageLayout(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+		endSingleCommand(device, index, pool, commandBuffer);
+	}
+
+	VkFormat formatFromDxgi(u32 dxgiFormat)
+	{
+		// Values of the DXGI_FORMAT enumeration, the engine doesn't include the DXGI headers in the Vulkan backend
+		switch (dxgiFormat)
+		{
+		case 2:  return VK_FORMAT_R32G32B32A32_SFLOAT;		// R32G32B32A32_FLOAT
+		case 10: return VK_FORMAT_R16G16B16A16_SFLOAT;		// R16G16B16A16_FLOAT
+		case 28: return VK_FORMAT_R8G8B8A8_UNORM;			// R8G8B8A8_UNORM
+		case 29: return VK_FORMAT_R8G8B8A8_SRGB;			// R8G8B8A8_UNORM_SRGB
+		case 49: return VK_FORMAT_R8G8_UNORM;				// R8G8_UNORM
+		case 61: return VK_FORMAT_R8_UNORM;					// R8_UNORM
+		case 71: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;		// BC1_UNORM
+		case 72: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;		// BC1_UNORM_SRGB
+		case 77: return VK_FORMAT_BC3_UNORM_BLOCK;			// BC3_UNORM
+		case 78: return VK_FORMAT_BC3_SRGB_BLOCK;			// BC3_UNORM_SRGB
+		case 80: return VK_FORMAT_BC4_UNORM_BLOCK;			// BC4_UNORM
+		case 83: return VK_FORMAT_BC5_UNORM_BLOCK;			// BC5_UNORM
+		case 87: return VK_FORMAT_B8G8R8A8_UNORM;			// B8G8R8A8_UNORM
+		case 91: return VK_FORMAT_B8G8R8A8_SRGB;			// B8G8R8A8_UNORM_SRGB
+		case 95: return VK_FORMAT_BC6H_UFLOAT_BLOCK;		// BC6H_UF16
+		case 96: return VK_FORMAT_BC6H_SFLOAT_BLOCK;		// BC6H_SF16
+		case 98: return VK_FORMAT_BC7_UNORM_BLOCK;			// BC7_UNORM
+		case 99: return VK_FORMAT_BC7_SRGB_BLOCK;			// BC7_UNORM_SRGB
+		}
+
+		return VK_FORMAT_UNDEFINED;
+	}
+
+	bool supportsSampledFormat(VkPhysicalDevice physicalDevice, VkFormat format)
+	{
+		// Not enabled on the device, the loader takes the decode fallback even if the format reports features
+		const bool is_bc{ format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_BC7_SRGB_BLOCK };
+		if (is_bc && !core::texture_compression_bc_supported()) return false;
+
+		VkFormatProperties properties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+		constexpr VkFormatFeatureFlags needed{ VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT };
+		return (properties.optimalTilingFeatures & needed) == needed;
+	}
+
+	void copyBufferToImageRegions(VkDevice device, u32 index, VkCommandPool pool, VkBuffer buffer, VkImage image,
+		const VkBufferImageCopy* regions, u32 regionCount, u32 mipLevels)
+	{
+		VkCommandBuffer commandBuffer = beginSingleCommand(device, pool);
+
+		VkImageSubresourceRange subresourceRange = {};
+		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		subresourceRange.levelCount = mipLevels;
+		subresourceRange.layerCount = 1;
+
+		setImageLayout(commandBuffer, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+		vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, regionCount, regions);
+		setImageLayout(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+		endSingleCommand(device, index, pool, commandBuffer);
+	}
+
+	void createTextureSampler([[maybe_unused]] VkPhysicalDevice physicalDevice, [[maybe_unused]] VkDevice device, vulkan_texture& tex)
 	{
-		VkPhysicalDeviceProperties properties;
-		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
-
-		VkSamplerCreateInfo samplerInfo;
-		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-		samplerInfo.pNext = nullptr;
-		samplerInfo.flags = /*VK_SAMPLER_CREATE_SUBSAMPLED_BIT_EXT | */VK_SAMPLER_CREATE_SUBSAMPLED_COARSE_RECONSTRUCTION_BIT_EXT;
-		samplerInfo.magFilter = VK_FILTER_LINEAR;
-		samplerInfo.minFilter = VK_FILTER_LINEAR;
-		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-		samplerInfo.mipLodBias = 0.0f;
-		samplerInfo.minLod = 0.0f;
-		samplerInfo.maxLod = 0.0f;
-		samplerInfo.anisotropyEnable = VK_TRUE;
-		samplerInfo.maxAnisotropy = properties.limits.maxSamplerAnisotropy;
-		samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
-		samplerInfo.unnormalizedCoordinates = VK_FALSE;
-		samplerInfo.compareEnable = VK_FALSE;
-		samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
-		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-
-		VkResult result{ VK_SUCCESS };
-		VkCall(result = vkCreateSampler(device, &samplerInfo, nullptr, &tex.sampler), "Failed to create texture sampler...");
+		tex.sampler = samplers::acquire(samplers::texture_info());
 	}
 }
\ No newline at end of file
@@ -7,12 +7,33 @@
 namespace primal::graphics::vulkan
 {
 	
-	void transitionImageLayout(VkDevice device, u32 index, VkCommandPool pool, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
+	void transitionImageLayout(VkDevice device, u32 index, VkCommandPool pool, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, u32 mipLevels = 1);
 
 	void copyBufferToImage(VkDevice device, u32 index, VkCommandPool pool, VkBuffer buffer, VkImage image, u32 width, u32 height);
 
+	// Levels down to 1x1
+	u32 mipLevelCount(u32 width, u32 height);
+
+	// vkCmdBlitImage can filter the format linearly in optimal tiling
+	bool supportsMipmapBlit(VkPhysicalDevice physicalDevice, VkFormat format);
+
+	// Fills levels 1..mipLevels-1 by blitting each level from the one above. All levels start in TRANSFER_DST_OPTIMAL
+	// with level 0 written and end in SHADER_READ_ONLY_OPTIMAL. Blits of sRGB formats filter in linear space.
+	void generateMipmaps(VkDevice device, u32 index, VkCommandPool pool, VkImage image, u32 width, u32 height, u32 mipLevels);
+
 	void createTextureSampler(VkPhysicalDevice physicalDevice, VkDevice device, vulkan_texture& tex);
 
+	// VkFormat of a DXGI_FORMAT value from a cooked texture file, VK_FORMAT_UNDEFINED for the ones the engine doesn't load
+	VkFormat formatFromDxgi(u32 dxgiFormat);
+
+	// Block compressed formats are only supported when the device enabled textureCompressionBC, see core::create_device
+	bool supportsSampledFormat(VkPhysicalDevice physicalDevice, VkFormat format);
+
+	// Uploads every region in one submission: all levels go to TRANSFER_DST_OPTIMAL, one vkCmdCopyBufferToImage writes
+	// the regions and all levels end in SHADER_READ_ONLY_OPTIMAL
+	void copyBufferToImageRegions(VkDevice device, u32 index, VkCommandPool pool, VkBuffer buffer, VkImage image,
+		const VkBufferImageCopy* regions, u32 regionCount, u32 mipLevels);
+
 	//class vulkan_texture
 	//{
 	//public:
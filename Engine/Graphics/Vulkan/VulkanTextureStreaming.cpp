@@ -0,0 +1,750 @@
+#include "VulkanTextureStreaming.h"
+#include "VulkanCore.h"
+#include "VulkanHelpers.h"
+#include "VulkanResources.h"
+#include "VulkanCommandBuffer.h"
+#include "VulkanSampler.h"
+#include "VulkanBindless.h"
+#include "VulkanIndirect.h"
+#include "VulkanContent.h"
+#include "VulkanCamera.h"
+#include "VulkanClusterCull.h"
+#include "Content/ContentToEngine.h"
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace primal::graphics::vulkan::texture_streaming
+{
+	namespace
+	{
+		// Each mip's texels follow its width, height, row pitch and slice pitch in the file
+		constexpr u32 subresource_header_size{ sizeof(u32) * 4 };
+
+		struct mip_info
+		{
+			u64									offset;				// Of the texels in the file
+			u32									width;
+			u32									height;
+			u32									slice_pitch;
+		};
+
+		struct streamed_texture
+		{
+			std::string							path;
+			utl::vector<mip_info>				mips;
+			u32									base_mip;			// First mip of the texture's own image, which is always resident
+			u32									image_mip;			// First mip of image, base_mip while there's none
+			u32									resident_mip;		// First mip the bindless slot samples, above image_mip while levels are uploading
+			u32									wanted_mip;			// Finest mip any material asked for in the frame it was last visible
+			u32									read_mip;			// First mip of the read in flight
+			u64									last_used;			// Frame it was last visible in
+			u32									generation;			// Results of reads queued for an earlier registration are dropped
+			bool								reading;
+			bool								failed;				// The file couldn't be read, it isn't asked again
+			vulkan_texture						image{};			// Mips image_mip..end, sampled instead of the texture's own image
+			u64									image_bytes;
+			std::vector<u8>						texels;				// Mips image_mip..end as they are in the file, until the last level is uploaded
+		};
+
+		struct read_request
+		{
+			id::id_type							texture_id;
+			u32									generation;
+			std::string							path;
+			u64									offset;
+			u64									size;
+		};
+
+		struct read_result
+		{
+			id::id_type							texture_id;
+			u32									generation;
+			std::vector<u8>						data;
+			bool								succeeded;
+		};
+
+		// Uploads are recorded into a command buffer of the streamer's own, submitted to the graphics queue ahead of the
+		// frame's passes. Its fence tells when the part of the staging ring it copied from can be written again.
+		struct upload_frame
+		{
+			VkCommandBuffer						cmd_buffer{ VK_NULL_HANDLE };
+			VkFence								fence{ VK_NULL_HANDLE };
+			bool								recording{ false };
+		};
+
+		std::unordered_map<id::id_type, streamed_texture>	streamed;					// Also changed by the loader threads, under stream_mutex
+		std::mutex											stream_mutex;
+		utl::vector<surface_id>								frame_views;				// Surfaces that added their view this frame
+		std::unordered_map<id::id_type, f32>				material_densities;		// Most pixels per UV unit of the material's visible instances
+		u64													budget{ default_budget };
+		u64													frame{ 0 };
+		u32													generation{ 0 };
+		f32													projection_scale{ 0.f };	// Pixels one world unit covers one unit in front of the camera
+		f32													near_z{ 0.f };
+		u32													pending_reads{ 0 };
+		residency_stats										totals{};					// Only the counters since start are kept here
+
+		VkCommandPool										upload_pool{ VK_NULL_HANDLE };
+		upload_frame										upload_frames[frame_buffer_count]{};
+		u32													upload_index{ 0 };
+		VkBuffer											staging_buffer{ VK_NULL_HANDLE };	// One part of max_upload_bytes per upload frame
+		VkDeviceMemory										staging_memory{ VK_NULL_HANDLE };
+		u8*													staging_mapped{ nullptr };
+		VkDeviceSize										staging_used{ 0 };			// Of the current upload frame's part
+
+		std::thread											io_thread;
+		std::mutex											io_mutex;
+		std::condition_variable								io_changed;
+		std::deque<read_request>							requests;
+		std::vector<read_result>							results;
+		bool												quit{ false };
+
+		void read_loop()
+		{
+			while (true)
+			{
+				read_request request{};
+				{
+					std::unique_lock lock{ io_mutex };
+					io_changed.wait(lock, [] { return quit || !requests.empty(); });
+					if (quit) return;
+					request = std::move(requests.front());
+					requests.pop_front();
+				}
+
+				read_result result{ request.texture_id, request.generation, std::vector<u8>(request.size), false };
+				std::ifstream file{ request.path, std::ios::in | std::ios::binary };
+				result.succeeded = file && file.seekg(request.offset) && file.read((char*)result.data.data(), request.size);
+				if (!result.succeeded) result.data.clear();
+
+				std::lock_guard lock{ io_mutex };
+				results.emplace_back(std::move(result));
+			}
+		}
+
+		// Texel bytes of the mips from first down to the smallest
+		u64 chain_bytes(const streamed_texture& t, u32 first)
+		{
+			u64 bytes{ 0 };
+			for (u32 i{ first }; i < t.mips.size(); ++i) bytes += t.mips[i].slice_pitch;
+			return bytes;
+		}
+
+		// What the texture holds once its read is done
+		u64 committed_bytes(const streamed_texture& t)
+		{
+			return t.reading ? chain_bytes(t, t.read_mip) : t.image_bytes;
+		}
+
+		VkDescriptorImageInfo streamed_descriptor(const streamed_texture& t)
+		{
+			return { t.image.sampler, t.image.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		}
+
+		// Frames in flight may still sample the image, it goes once they're done
+		void release_image(streamed_texture& t)
+		{
+			if (!t.image.image) return;
+			vulkan_texture image{ t.image };
+			core::deferred_release([image]() mutable {
+				samplers::release(image.sampler);
+				destroy_image(core::logical_device(), &image);
+			});
+			t.image = {};
+			t.image_bytes = 0;
+			t.texels.clear();
+			t.texels.shrink_to_fit();
+			t.image_mip = t.resident_mip = t.base_mip;
+		}
+
+		bool create_upload_resources()
+		{
+			VkCommandPoolCreateInfo pool_info{ VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+			pool_info.pNext = nullptr;
+			pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+			pool_info.queueFamilyIndex = core::graphics_family_queue_index();
+			VkResult result{ VK_SUCCESS };
+			VkCall(result = vkCreateCommandPool(core::logical_device(), &pool_info, nullptr, &upload_pool), "Failed to create the texture streaming command pool...");
+			if (result != VK_SUCCESS) return false;
+
+			for (upload_frame& f : upload_frames)
+			{
+				f.cmd_buffer = allocate_cmd_buffer(core::logical_device(), upload_pool, true).cmd_buffer;
+				VkFenceCreateInfo fence_info{ VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+				fence_info.pNext = nullptr;
+				fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+				VkCall(result = vkCreateFence(core::logical_device(), &fence_info, nullptr, &f.fence), "Failed to create the texture streaming fence...");
+				if (result != VK_SUCCESS) return false;
+			}
+
+			const VkDeviceSize size{ max_upload_bytes * frame_buffer_count };
+			createBuffer(core::logical_device(), size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging_buffer, staging_memory);
+			VkCall(result = vkMapMemory(core::logical_device(), staging_memory, 0, size, 0, (void**)&staging_mapped), "Failed to map the texture streaming staging buffer...");
+			return result == VK_SUCCESS;
+		}
+
+		// Called with the device idle
+		void destroy_upload_resources()
+		{
+			if (staging_memory)
+			{
+				vkUnmapMemory(core::logical_device(), staging_memory);
+				vkDestroyBuffer(core::logical_device(), staging_buffer, nullptr);
+				vkFreeMemory(core::logical_device(), staging_memory, nullptr);
+			}
+			staging_buffer = VK_NULL_HANDLE;
+			staging_memory = VK_NULL_HANDLE;
+			staging_mapped = nullptr;
+
+			for (upload_frame& f : upload_frames)
+			{
+				if (f.fence) vkDestroyFence(core::logical_device(), f.fence, nullptr);
+				f = {};
+			}
+			if (upload_pool) vkDestroyCommandPool(core::logical_device(), upload_pool, nullptr);
+			upload_pool = VK_NULL_HANDLE;
+		}
+
+		// The next upload frame was submitted frame_buffer_count frames ago, its fence is normally signaled by now
+		void begin_uploads()
+		{
+			upload_index = (upload_index + 1) % frame_buffer_count;
+			vkWaitForFences(core::logical_device(), 1, &upload_frames[upload_index].fence, VK_TRUE, UINT64_MAX);
+			staging_used = 0;
+		}
+
+		VkCommandBuffer upload_cmd_buffer()
+		{
+			upload_frame& f{ upload_frames[upload_index] };
+			if (!f.recording)
+			{
+				vkResetCommandBuffer(f.cmd_buffer, 0);
+				VkCommandBufferBeginInfo info{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+				info.pNext = nullptr;
+				info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+				info.pInheritanceInfo = nullptr;
+				VkCall(vkBeginCommandBuffer(f.cmd_buffer, &info), "Failed to begin the texture streaming command buffer...");
+				f.recording = true;
+			}
+			return f.cmd_buffer;
+		}
+
+		// Submitted ahead of the frame's passes on the same queue, the barriers after the copies order them before the frame's reads
+		void submit_uploads()
+		{
+			upload_frame& f{ upload_frames[upload_index] };
+			if (!f.recording) return;
+			f.recording = false;
+			VkCall(vkEndCommandBuffer(f.cmd_buffer), "Failed to end the texture streaming command buffer...");
+
+			VkSubmitInfo info{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
+			info.pNext = nullptr;
+			info.commandBufferCount = 1;
+			info.pCommandBuffers = &f.cmd_buffer;
+			VkQueue queue{ VK_NULL_HANDLE };
+			vkGetDeviceQueue(core::logical_device(), core::graphics_family_queue_index(), 0, &queue);
+			vkResetFences(core::logical_device(), 1, &f.fence);
+			VkCall(vkQueueSubmit(queue, 1, &info, f.fence), "Failed to submit the texture streaming uploads...");
+		}
+
+		// Room for size bytes in the current upload frame's part of the staging ring. An upload larger than what's
+		// left gets a staging buffer of its own, released with the frame. Returns the offset in buffer.
+		VkDeviceSize stage(VkDeviceSize size, VkBuffer& buffer, u8*& mapped)
+		{
+			if (staging_used + size <= max_upload_bytes)
+			{
+				const VkDeviceSize offset{ upload_index * max_upload_bytes + staging_used };
+				staging_used += size;
+				buffer = staging_buffer;
+				mapped = staging_mapped + offset;
+				return offset;
+			}
+
+			VkDeviceMemory memory{ VK_NULL_HANDLE };
+			createBuffer(core::logical_device(), size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer, memory);
+			vkMapMemory(core::logical_device(), memory, 0, size, 0, (void**)&mapped);
+			core::deferred_release([buffer, memory]() {
+				vkDestroyBuffer(core::logical_device(), buffer, nullptr);
+				vkFreeMemory(core::logical_device(), memory, nullptr);
+			});
+			return 0;
+		}
+
+		// View of the levels from resident_mip down. The descriptor can't name the levels above them, they're
+		// still being written and aren't in SHADER_READ_ONLY_OPTIMAL.
+		VkImageView create_view(const streamed_texture& t, u32 resident_mip)
+		{
+			VkImageViewCreateInfo info{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+			info.pNext = nullptr;
+			info.image = t.image.image;
+			info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			info.format = t.image.format;
+			info.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, resident_mip - t.image_mip, (u32)t.mips.size() - resident_mip, 0, 1 };
+			VkImageView view{ VK_NULL_HANDLE };
+			VkResult result{ VK_SUCCESS };
+			VkCall(result = vkCreateImageView(core::logical_device(), &info, nullptr, &view), "Failed to create the streamed image view...");
+			return result == VK_SUCCESS ? view : VK_NULL_HANDLE;
+		}
+
+		// Point the texture's bindless slot at a view of the levels from resident_mip down. The previous view
+		// may still be read by frames in flight, it goes once they're done.
+		void sample_from(id::id_type texture_id, streamed_texture& t, u32 resident_mip)
+		{
+			const VkImageView view{ create_view(t, resident_mip) };
+			if (!view) return;
+
+			const VkImageView previous{ t.image.view };
+			t.image.view = view;
+			t.resident_mip = resident_mip;
+			bindless::replace_texture(texture_id, streamed_descriptor(t));
+			if (previous) core::deferred_release([previous]() { vkDestroyImageView(core::logical_device(), previous, nullptr); });
+		}
+
+		// Records the copy of mips [first, last) of the read texels into the streamed image. Only those levels change
+		// layout, the ones the descriptor's view covers stay in SHADER_READ_ONLY_OPTIMAL.
+		void upload_levels(streamed_texture& t, u32 first, u32 last)
+		{
+			utl::vector<VkBufferImageCopy> regions;
+			VkDeviceSize size{ 0 };
+			for (u32 mip{ first }; mip < last; ++mip)
+			{
+				VkBufferImageCopy region{};
+				region.bufferOffset = size;
+				region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mip - t.image_mip, 0, 1 };
+				region.imageExtent = { t.mips[mip].width, t.mips[mip].height, 1 };
+				regions.emplace_back(region);
+				// Buffer offsets have to be multiples of the texel block size, 16 covers every format
+				size += math::align_size_up<16>((VkDeviceSize)t.mips[mip].slice_pitch);
+			}
+
+			VkBuffer buffer{ VK_NULL_HANDLE };
+			u8* mapped{ nullptr };
+			const VkDeviceSize offset{ stage(size, buffer, mapped) };
+			for (u32 mip{ first }; mip < last; ++mip)
+			{
+				VkBufferImageCopy& region{ regions[mip - first] };
+				const u64 source{ t.mips[mip].offset - t.mips[t.image_mip].offset };
+				memcpy(mapped + region.bufferOffset, t.texels.data() + source, t.mips[mip].slice_pitch);
+				region.bufferOffset += offset;
+			}
+
+			VkImageSubresourceRange range{};
+			range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			range.baseMipLevel = first - t.image_mip;
+			range.levelCount = last - first;
+			range.layerCount = 1;
+
+			const VkCommandBuffer cmd_buffer{ upload_cmd_buffer() };
+			setImageLayout(cmd_buffer, t.image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, range,
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+			vkCmdCopyBufferToImage(cmd_buffer, buffer, t.image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (u32)regions.size(), regions.data());
+			setImageLayout(cmd_buffer, t.image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, range,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+			totals.uploaded_levels += last - first;
+		}
+
+		// The texture goes back to its own image and isn't streamed again
+		void fail_upload(id::id_type texture_id, streamed_texture& t)
+		{
+			MESSAGE(("Failed to create the streamed image of " + t.path).c_str());
+			release_image(t);
+			t.failed = true;
+			bindless::replace_texture(texture_id, textures::get_texture(texture_id).get_descriptor_info());
+		}
+
+		// The read mips replace the streamed image. The levels the texture samples now go up right away,
+		// so the swap never shows less detail, the ones above follow in the next frames.
+		void begin_upload(id::id_type texture_id, streamed_texture& t, std::vector<u8>&& data)
+		{
+			const u32 resident_mip{ t.resident_mip };
+			release_image(t);
+
+			image_init_info image_info{};
+			image_info.image_type = VK_IMAGE_TYPE_2D;
+			image_info.width = t.mips[t.read_mip].width;
+			image_info.height = t.mips[t.read_mip].height;
+			image_info.mipmap = (u32)t.mips.size() - t.read_mip;
+			image_info.format = textures::get_texture(texture_id).getTexture().format;
+			image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+			image_info.usage_flags = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+			image_info.memory_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+			image_info.create_view = false;			// sample_from makes the views, of the uploaded levels only
+			if (!create_image(core::logical_device(), &image_info, t.image))
+			{
+				t.image = {};
+				fail_upload(texture_id, t);
+				return;
+			}
+			t.image.format = image_info.format;
+			t.image.sampler = samplers::acquire(samplers::texture_info());
+			t.image_mip = t.read_mip;
+			t.image_bytes = chain_bytes(t, t.image_mip);
+			t.texels = std::move(data);
+
+			upload_levels(t, resident_mip, (u32)t.mips.size());
+			sample_from(texture_id, t, resident_mip);
+			if (!t.image.view)
+			{
+				fail_upload(texture_id, t);
+				return;
+			}
+			if (t.resident_mip == t.image_mip) t.texels = {};
+		}
+
+		void evict(id::id_type texture_id, streamed_texture& t)
+		{
+			release_image(t);
+			bindless::replace_texture(texture_id, textures::get_texture(texture_id).get_descriptor_info());
+			++totals.evicted;
+		}
+
+		// Least recently visible texture with a streamed image that isn't visible this frame
+		id::id_type eviction_candidate()
+		{
+			id::id_type candidate{ id::invalid_id };
+			u64 oldest{ frame };
+			for (const auto& [texture_id, t] : streamed)
+			{
+				if (!t.image.image || t.reading || t.last_used >= oldest) continue;
+				candidate = texture_id;
+				oldest = t.last_used;
+			}
+			return candidate;
+		}
+
+		void take_results()
+		{
+			std::vector<read_result> done;
+			{
+				std::lock_guard lock{ io_mutex };
+				done.swap(results);
+			}
+
+			for (auto& result : done)
+			{
+				--pending_reads;
+				auto it = streamed.find(result.texture_id);
+				if (it == streamed.end() || it->second.generation != result.generation) continue;
+
+				streamed_texture& t{ it->second };
+				t.reading = false;
+				if (!result.succeeded)
+				{
+					MESSAGE(("Failed to read the mips of " + t.path).c_str());
+					t.failed = true;
+					continue;
+				}
+				totals.read_bytes += result.data.size();
+				begin_upload(result.texture_id, t, std::move(result.data));
+			}
+		}
+
+		// One level per texture and frame, the finest ones wait once max_upload_bytes went up this frame
+		void continue_uploads()
+		{
+			u64 uploaded{ 0 };
+			for (auto& [texture_id, t] : streamed)
+			{
+				if (t.resident_mip == t.image_mip || !t.image.image) continue;
+				const u32 mip{ t.resident_mip - 1 };
+				if (uploaded && uploaded + t.mips[mip].slice_pitch > max_upload_bytes) continue;
+
+				upload_levels(t, mip, mip + 1);
+				sample_from(texture_id, t, mip);
+				uploaded += t.mips[mip].slice_pitch;
+				if (t.resident_mip == t.image_mip) t.texels = {};
+			}
+		}
+
+		void queue_reads()
+		{
+			u64 committed{ 0 };
+			utl::vector<id::id_type> wanting;
+			for (const auto& [texture_id, t] : streamed)
+			{
+				committed += committed_bytes(t);
+				// Only what's visible now is read, and a texture still uploading finishes first
+				if (t.last_used == frame && !t.reading && !t.failed && t.resident_mip == t.image_mip && t.wanted_mip < t.image_mip)
+					wanting.emplace_back(texture_id);
+			}
+
+			// A lower budget drops the least recently visible images first
+			while (committed > budget)
+			{
+				const id::id_type texture_id{ eviction_candidate() };
+				if (!id::is_valid(texture_id)) break;
+				committed -= streamed[texture_id].image_bytes;
+				evict(texture_id, streamed[texture_id]);
+			}
+
+			// The textures missing the most mips first
+			std::sort(wanting.begin(), wanting.end(), [](id::id_type a, id::id_type b) {
+				const streamed_texture& ta{ streamed[a] };
+				const streamed_texture& tb{ streamed[b] };
+				const u32 missing_a{ ta.image_mip - ta.wanted_mip }, missing_b{ tb.image_mip - tb.wanted_mip };
+				return missing_a != missing_b ? missing_a > missing_b : a < b;
+			});
+
+			for (const id::id_type texture_id : wanting)
+			{
+				if (pending_reads >= max_pending_reads) break;
+
+				streamed_texture& t{ streamed[texture_id] };
+				u32 mip{ t.wanted_mip };
+				while (mip < t.image_mip && committed - t.image_bytes + chain_bytes(t, mip) > budget)
+				{
+					// Make room from textures that aren't visible, once there are none settle for smaller mips
+					const id::id_type candidate{ eviction_candidate() };
+					if (id::is_valid(candidate))
+					{
+						committed -= streamed[candidate].image_bytes;
+						evict(candidate, streamed[candidate]);
+					}
+					else
+					{
+						++mip;
+					}
+				}
+				if (mip >= t.image_mip) continue;
+
+				committed += chain_bytes(t, mip) - t.image_bytes;
+				t.reading = true;
+				t.read_mip = mip;
+				++pending_reads;
+
+				// The mips from read_mip down are one range of the file, the sub-headers between them are read along
+				const u64 offset{ t.mips[mip].offset };
+				const u64 size{ t.mips.back().offset + t.mips.back().slice_pitch - offset };
+				std::lock_guard lock{ io_mutex };
+				requests.emplace_back(read_request{ texture_id, t.generation, t.path, offset, size });
+			}
+			io_changed.notify_one();
+		}
+
+		void apply_densities()
+		{
+			for (const auto& [material_id, density] : material_densities)
+			{
+				if (density <= 0.f) continue;
+				for (const id::id_type texture_id : materials::get_material(material_id).getTextureIDS())
+				{
+					auto it = streamed.find(texture_id);
+					if (it == streamed.end()) continue;
+
+					// Texels of the top mip per pixel along the longer side, each mip halves them
+					streamed_texture& t{ it->second };
+					const f32 size{ (f32)std::max(t.mips[0].width, t.mips[0].height) };
+					const f32 mip{ std::log2(size / density) + mip_bias };
+					const u32 wanted{ (u32)math::clamp(mip, 0.f, (f32)t.base_mip) };
+					t.wanted_mip = t.last_used == frame ? std::min(t.wanted_mip, wanted) : wanted;
+					t.last_used = frame;
+				}
+			}
+		}
+
+		// The instance is visible and its nearest visible part is distance away from the camera
+		void add_visible(const submesh::vulkan_instance_model& instance, f32 distance)
+		{
+			if (!id::is_valid(instance.getMaterialID())) return;
+			const f32 uv_scale{ instance.getModel().getUVScale() };
+			if (uv_scale <= 0.f) return;
+
+			// The largest axis scale, the same the culling applies to the meshlet spheres
+			using namespace DirectX;
+			const XMMATRIX m{ XMLoadFloat4x4(&instance.getModelMatrix()) };
+			const f32 scale{ std::max({ XMVectorGetX(XMVector3Length(m.r[0])), XMVectorGetX(XMVector3Length(m.r[1])), XMVectorGetX(XMVector3Length(m.r[2])) }) };
+
+			const f32 density{ projection_scale * uv_scale * scale / std::max(distance, near_z) };
+			f32& material{ material_densities[instance.getMaterialID()] };
+			material = std::max(material, density);
+		}
+
+		// Tests the instance's bounding sphere against the view first
+		void add_visible(const submesh::vulkan_instance_model& instance, const clusters::cull_view& view)
+		{
+			using namespace DirectX;
+			const math::v4 sphere{ instance.getWorldBoundingSphere() };
+			const XMVECTOR center{ XMLoadFloat4(&sphere) };
+			for (u32 i{ 0 }; i < 6; ++i)
+			{
+				if (XMVectorGetX(XMPlaneDotCoord(XMLoadFloat4(&view.frustum_planes[i]), center)) < -sphere.w) return;
+			}
+
+			const f32 distance{ XMVectorGetX(XMVector3Length(center - XMLoadFloat3(&view.position))) - sphere.w };
+			if (distance > view.max_distance) return;
+			add_visible(instance, distance);
+		}
+
+		// Upload what the I/O thread read, evict over the budget and queue the reads of the mips the frame's views
+		// wanted. Called with stream_mutex held.
+		void end_frame()
+		{
+			apply_densities();
+			begin_uploads();
+			take_results();
+			continue_uploads();
+			submit_uploads();
+			queue_reads();
+			bindless::flush_materials();
+
+			++frame;
+			material_densities.clear();
+			frame_views.clear();
+		}
+	} // anonymous namespace
+
+	bool initialize()
+	{
+		// Every surface initializes the renderer's modules, the streamer is shared
+		if (!is_active() || io_thread.joinable()) return true;
+
+		if (!create_upload_resources())
+		{
+			destroy_upload_resources();
+			return false;
+		}
+		quit = false;
+		io_thread = std::thread{ read_loop };
+		return true;
+	}
+
+	void shutdown()
+	{
+		if (io_thread.joinable())
+		{
+			{
+				std::lock_guard lock{ io_mutex };
+				quit = true;
+				requests.clear();
+			}
+			io_changed.notify_all();
+			io_thread.join();
+		}
+		results.clear();
+
+		std::lock_guard lock{ stream_mutex };
+		for (auto& [texture_id, t] : streamed)
+		{
+			if (!t.image.image) continue;
+			samplers::release(t.image.sampler);
+			destroy_image(core::logical_device(), &t.image);
+		}
+		streamed.clear();
+		material_densities.clear();
+		frame_views.clear();
+		pending_reads = 0;
+		destroy_upload_resources();
+	}
+
+	bool is_active()
+	{
+		return enabled && indirect::is_gpu_driven() && bindless::is_supported() && core::draw_indirect_count_supported();
+	}
+
+	u32 first_resident_mip(u32 width, u32 height, u32 mip_levels)
+	{
+		if (!is_active()) return 0;
+
+		u32 mip{ 0 };
+		while (mip + 1 < mip_levels && std::max(width >> mip, height >> mip) > resident_size) ++mip;
+		return mip;
+	}
+
+	void add(id::id_type texture_id, const std::string& path, u32 base_mip)
+	{
+		if (!base_mip || !is_active()) return;
+
+		std::ifstream file{ path, std::ios::in | std::ios::binary };
+		content::texture_file_header header{};
+		if (!file.read((char*)&header, sizeof(header)) || header.mip_levels <= base_mip) return;
+
+		streamed_texture t{};
+		u64 offset{ sizeof(header) };
+		for (u32 i{ 0 }; i < header.mip_levels; ++i)
+		{
+			u32 subresource[4];
+			if (!file.seekg(offset) || !file.read((char*)subresource, subresource_header_size)) return;
+			t.mips.emplace_back(mip_info{ offset + subresource_header_size, subresource[0], subresource[1], subresource[3] });
+			offset += subresource_header_size + subresource[3];
+		}
+
+		t.path = path;
+		t.base_mip = t.image_mip = t.resident_mip = t.wanted_mip = base_mip;
+		std::lock_guard lock{ stream_mutex };
+		t.generation = ++generation;
+		streamed[texture_id] = std::move(t);
+	}
+
+	void remove(id::id_type texture_id)
+	{
+		std::lock_guard lock{ stream_mutex };
+		auto it = streamed.find(texture_id);
+		if (it == streamed.end()) return;
+
+		// A read in flight is dropped when it's done, the generation won't match anything
+		release_image(it->second);
+		streamed.erase(it);
+	}
+
+	void set_budget(u64 bytes)
+	{
+		budget = bytes;
+	}
+
+	void begin_frame(const frame_info& info, u32 surface_height)
+	{
+		if (!is_active()) return;
+
+		++frame;
+		material_densities.clear();
+		const camera::vulkan_camera& c{ camera::get(info.camera_id) };
+		projection_scale = (f32)surface_height / (2.f * std::tan(c.field_of_view() * DirectX::XM_PI * 0.5f));
+		near_z = c.near_z();
+	}
+
+	void add_view(surface_id surface, const frame_info& info, u32 surface_height, scene::vulkan_scene& scene)
+	{
+		if (!is_active()) return;
+
+		std::lock_guard lock{ stream_mutex };
+		// The surface drawing again means a new frame, the last one's views are all in
+		if (std::find(frame_views.begin(), frame_views.end(), surface) != frame_views.end()) end_frame();
+		frame_views.emplace_back(surface);
+
+		const camera::vulkan_camera& c{ camera::get(info.camera_id) };
+		projection_scale = (f32)surface_height / (2.f * std::tan(c.field_of_view() * DirectX::XM_PI * 0.5f));
+		near_z = c.near_z();
+
+		const clusters::cull_view view{ clusters::make_view(info.camera_id) };
+		for (const id::id_type instance_id : scene.getInstanceIDs())
+		{
+			add_visible(scene::get_instance(instance_id), view);
+		}
+	}
+
+	residency_stats get_stats()
+	{
+		std::lock_guard lock{ stream_mutex };
+		residency_stats stats{ totals };
+		stats.texture_count = (u32)streamed.size();
+		stats.pending_reads = pending_reads;
+		stats.budget = budget;
+		for (const auto& [texture_id, t] : streamed)
+		{
+			if (t.image.image) ++stats.streamed_count;
+			if (t.resident_mip == 0) ++stats.complete_count;
+			if (t.resident_mip != t.image_mip) ++stats.uploading;
+			stats.resident_bytes += t.image_bytes;
+			stats.wanted_bytes += t.wanted_mip < t.base_mip ? chain_bytes(t, t.wanted_mip) : 0;
+		}
+		return stats;
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include "VulkanCommonHeaders.h"
+
+#include <string>
+
+namespace primal::graphics::vulkan
+{
+	namespace scene
+	{
+		class vulkan_scene;
+	}
+}
+
+// Mip streaming of the .texture files. A texture is created with its small mips only, they stay resident and are what
+// the per-instance path samples. Every instance visible in a view the GPU-driven path draws reports how many pixels
+// a UV unit of it covers, the densest instance of a material decides which mip its textures need. A background thread
+// reads the missing mips from the texture file into a second image that replaces the resident one in the bindless
+// array. Its levels are uploaded one per frame from the smallest up, through a fenced command buffer and a persistent
+// staging ring, and the bindless slot gets a view of the uploaded levels only. When the streamed images would exceed
+// the budget, textures that weren't visible for the longest lose theirs.
+namespace primal::graphics::vulkan::texture_streaming
+{
+	constexpr bool enabled{ true };
+	constexpr u32 resident_size{ 128 };				// Mips up to this width and height are loaded with the texture and never evicted
+	constexpr u64 default_budget{ 256ull << 20 };	// Bytes of streamed images, the resident mips aren't counted
+	constexpr f32 mip_bias{ 0.f };					// Added to the mip the texel density asks for, larger streams less
+	constexpr u32 max_pending_reads{ 8 };			// Reads queued for the I/O thread at once
+	constexpr u64 max_upload_bytes{ 16ull << 20 };	// Texels uploaded per frame, a single larger level still goes in alone
+
+	struct residency_stats
+	{
+		u32					texture_count;			// Textures that stream
+		u32					streamed_count;			// Textures sampled from a streamed image
+		u32					complete_count;			// Textures with every mip resident
+		u32					pending_reads;			// Queued or being read
+		u32					uploading;				// Read, with levels left to upload
+		u64					resident_bytes;			// Streamed images
+		u64					wanted_bytes;			// Streamed images if every texture had the mip it last wanted
+		u64					budget;
+		u64					read_bytes;				// Since start: bytes read from texture files
+		u32					uploaded_levels;		// Since start
+		u32					evicted;				// Since start: streamed images dropped for the budget
+	};
+
+	bool initialize();
+	// Called with the device idle, the streamed images are destroyed right away
+	void shutdown();
+
+	// Streaming is enabled and the GPU-driven path is opted in and supported, it's the only one that samples the streamed mips.
+	// Decided before the first texture loads, see indirect::set_gpu_driven().
+	[[nodiscard]] bool is_active();
+
+	// Mip the texture's own image starts at: the largest one within resident_size, 0 when streaming isn't active
+	[[nodiscard]] u32 first_resident_mip(u32 width, u32 height, u32 mip_levels);
+
+	// Stream the mips above base_mip of a texture loaded from path. Does nothing when base_mip is 0.
+	void add(id::id_type texture_id, const std::string& path, u32 base_mip);
+	void remove(id::id_type texture_id);
+
+	void set_budget(u64 bytes);
+
+	// Collects the texel densities of the scene's instances visible from a surface surface_height pixels high, drawn
+	// by the GPU-driven path. Once a surface adds its view again the last frame is done: what the I/O thread read is
+	// uploaded, textures over the budget are evicted and the mips that frame's views wanted are queued for reading.
+	void add_view(surface_id surface, const frame_info& info, u32 surface_height, scene::vulkan_scene& scene);
+
+	[[nodiscard]] residency_stats get_stats();
+}
@@ -13,6 +13,8 @@ dir_paths = ["C:/Users/zy/Desktop/PrimalMerge/PrimalEngine/Engine/Graphics/Vulka
              "C:/Users/zy/Desktop/PrimalMerge/PrimalEngine/EngineTest/assets/kms/sponza/shaders",
              "C:/Users/zy/Desktop/PrimalMerge/PrimalEngine/EngineTest/assets/kms/sphere/shaders"]
 output_path = "C:/Users/zy/Desktop/PrimalMerge/PrimalEngine/Engine/Graphics/Vulkan/Shaders/spv"
+# The material fragment shaders next to the models include the engine's Common.h, every material uses material.vert
+include_path = dir_paths[0]
 for dir_path in dir_paths:
     for root, dirs, files in os.walk(dir_path):
         for file in files:
@@ -20,7 +22,7 @@ for dir_path in dir_paths:
                 input_file = os.path.join(root, file)
                 output_file = os.path.join(output_path, file) + ".spv" #input_file + ".spv"
 
-                add_params = "--target-env=vulkan1.3"
+                add_params = "--target-env=vulkan1.3 -I %s" % (include_path)
                 # if args.g:
                 #     add_params = "-g"
 
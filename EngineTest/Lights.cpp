@@ -2,6 +2,7 @@
 #include "EngineAPI/Light.h"
 #include "EngineAPI/TransformComponent.h"
 #include "Graphics/Renderer.h"
+#include "Test.h"
 
 #define RANDOM_LIGHTS 1
 
@@ -18,15 +19,16 @@ namespace
 
 	utl::vector<graphics::light>	lights;
 	utl::vector<graphics::light>	disabled_lights;
+	utl::vector<graphics::light>	churn_lights;
+
+	constexpr u32 churn_light_count{ 20'000 };
+	constexpr u32 churn_per_frame{ 1'000 };
 
 	constexpr math::v3 rgb_to_color(u8 r, u8 g, u8 b) { return { r / 255.f, g / 255.f, b / 255.f }; }
 	f32 random(f32 min = 0.f) { return std::max(min, rand() * inv_rand_max); }
 
-	void create_light(math::v3 position, math::v3 rotation, graphics::light::type type, u64 light_set_key)
+	graphics::light_init_info light_info(game_entity::entity_id entity_id, graphics::light::type type, u64 light_set_key)
 	{
-		const char* scripy_name{ nullptr }; // { type == graphics::light::spot ? "rotate_script" : nullptr };
-		game_entity::entity_id entity_id{ create_one_game_entity(position, rotation, scripy_name).get_id() };
-
 		graphics::light_init_info info{};
 		info.entity_id = entity_id;
 		info.type = type;
@@ -63,10 +65,35 @@ namespace
 			info.spot_param.attenuation = { 1, 1, 1 };
 		}
 #endif
-		graphics::light light{ graphics::create_light(info) };
+		return info;
+	}
+
+	void create_light(math::v3 position, math::v3 rotation, graphics::light::type type, u64 light_set_key)
+	{
+		const char* scripy_name{ nullptr }; // { type == graphics::light::spot ? "rotate_script" : nullptr };
+		game_entity::entity_id entity_id{ create_one_game_entity(position, rotation, scripy_name).get_id() };
+
+		graphics::light light{ graphics::create_light(light_info(entity_id, type, light_set_key)) };
 		assert(light.is_valid());
 		lights.push_back(light);
 	}
+
+	math::v3 random_light_position()
+	{
+		constexpr f32 scale1{ 2.f };
+		constexpr math::v3 scale{ 1.f * scale1, 0.5f * scale1, 1.f * scale1 };
+		return { (random() * 2 - 1.f) * 13.f * scale.x, random() * 2 * 13.f * scale.y, (random() * 2 - 1.f) * 13.f * scale.z };
+	}
+
+	game_entity::entity_id create_churn_entity()
+	{
+		return create_one_game_entity(random_light_position(), { random() * 3.14f, random() * 3.14f, random() * 3.14f }, nullptr).get_id();
+	}
+
+	graphics::light::type random_light_type()
+	{
+		return random() > 0.5 ? graphics::light::spot : graphics::light::point;
+	}
 } // anonymous namespace
 
 void generate_lights()
@@ -105,7 +132,17 @@ void generate_lights()
 	info.color = rgb_to_color(163, 47, 30);
 	lights.emplace_back(graphics::create_light(info));
 
-#if !RANDOM_LIGHTS
+#if TEST_LIGHT_CHURN
+	srand(37);
+	utl::vector<graphics::light_init_info> infos;
+	infos.reserve(churn_light_count);
+	for (u32 i{ 0 }; i < churn_light_count; ++i)
+	{
+		infos.emplace_back(light_info(create_churn_entity(), random_light_type(), left_set));
+	}
+	churn_lights.resize(churn_light_count);
+	graphics::create_lights(infos.data(), churn_light_count, churn_lights.data());
+#elif !RANDOM_LIGHTS
 	create_light({ 0, -3, 0 }, {}, graphics::light::point, left_set);
 	create_light({ 0, 0.2f, 1.f }, {}, graphics::light::point, left_set);
 	create_light({ 0, 1.2f, 2.f }, {}, graphics::light::point, left_set);
@@ -149,6 +186,14 @@ void remove_lights()
 		remove_game_entity(id);
 	}
 	disabled_lights.clear();
+
+	for (auto& light : churn_lights)
+	{
+		const game_entity::entity_id id{ light.entity_id() };
+		graphics::remove_light(light.get_id(), light.light_set_key());
+		remove_game_entity(id);
+	}
+	churn_lights.clear();
 	
 
 	graphics::remove_light_set(left_set);
@@ -228,4 +273,64 @@ void test_lights(f32 dt)
 			random() > 0.5 ? graphics::light::spot : graphics::light::point, right_set);
 	}
 #endif
-}
\ No newline at end of file
+}
+
+// Replaces churn_per_frame random lights of the churn set every frame. Only the bulk light calls are timed, the entities are
+// created and removed outside of the measurement. Reports the average cost per frame once a second.
+void test_light_churn()
+{
+	using clock = std::chrono::steady_clock;
+	static f32 remove_ms{ 0.f };
+	static f32 create_ms{ 0.f };
+	static u32 frames{ 0 };
+	static clock::time_point report{ clock::now() };
+
+	if (churn_lights.empty()) return;
+
+	// The entities are looked up before their lights are gone
+	utl::vector<graphics::light_id> removed_ids;
+	utl::vector<game_entity::entity_id> removed_entities;
+	removed_ids.reserve(churn_per_frame);
+	removed_entities.reserve(churn_per_frame);
+	for (u32 i{ 0 }; i < churn_per_frame && !churn_lights.empty(); ++i)
+	{
+		const u32 index{ (u32)(random() * (churn_lights.size() - 1)) };
+		removed_ids.emplace_back(churn_lights[index].get_id());
+		removed_entities.emplace_back(churn_lights[index].entity_id());
+		utl::erase_unordered(churn_lights, index);
+	}
+
+	clock::time_point start{ clock::now() };
+	graphics::remove_lights(removed_ids.data(), (u32)removed_ids.size(), left_set);
+	remove_ms += std::chrono::duration<f32, std::milli>(clock::now() - start).count();
+
+	utl::vector<graphics::light_init_info> infos;
+	infos.reserve(removed_entities.size());
+	for (const game_entity::entity_id id : removed_entities)
+	{
+		remove_game_entity(id);
+		infos.emplace_back(light_info(create_churn_entity(), random_light_type(), left_set));
+	}
+
+	const u32 first{ (u32)churn_lights.size() };
+	churn_lights.resize(first + infos.size());
+	start = clock::now();
+	graphics::create_lights(infos.data(), (u32)infos.size(), &churn_lights[first]);
+	create_ms += std::chrono::duration<f32, std::milli>(clock::now() - start).count();
+
+	++frames;
+	if (std::chrono::duration_cast<std::chrono::seconds>(clock::now() - report).count() >= 1)
+	{
+		char message[256];
+		snprintf(message, sizeof(message), "Light churn: %u lights, %u removed and created per frame, remove %.3f ms, create %.3f ms (avg. over %u frames)\n",
+			(u32)churn_lights.size(), churn_per_frame, remove_ms / frames, create_ms / frames, frames);
+#ifdef _WIN64
+		OutputDebugStringA(message);
+#else
+		std::cout << message;
+#endif // _WIN64
+		remove_ms = create_ms = 0.f;
+		frames = 0;
+		report = clock::now();
+	}
+}
@@ -1,6 +1,7 @@
 // Copyright (c) Contributors of Primal+
 // Distributed under the MIT license. See the LICENSE file in the project root for more information.
 #include "Test.h"
+#include "Graphics/Renderer.h"
 
 #pragma comment(lib, "Engine.lib")
 
@@ -38,7 +39,10 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
 #endif
 
     //set_current_directory_to_executable_path();
+    // A -headless run quits once it rendered its frames, with exit code 0 when its check passed and 1 when it didn't
+    primal::graphics::configure_headless(__argc, __argv);
     Engine_Test test{};
+    s32 exit_code{ 0 };
     if (test.initialize())
     {
         MSG msg{};
@@ -53,10 +57,11 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
             }
 
             test.run();
+            if (primal::graphics::is_headless_finished(exit_code)) is_running = false;
         }
     }
     test.shutdown();
-    return 0;
+    return exit_code;
 }
 
 #elif __linux__
@@ -64,9 +69,26 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
 
 int main(int argc, char* argv[])
 {
+    // A -headless run renders offscreen, it needs no X server. It quits once it rendered its frames,
+    // with exit code 0 when its check passed and 1 when it didn't.
+    if (primal::graphics::configure_headless(argc, argv))
+    {
+        Engine_Test test{};
+        s32 exit_code{ 1 };
+        if (test.initialize(nullptr))
+        {
+            while (!primal::graphics::is_headless_finished(exit_code))
+            {
+                test.run(nullptr);
+            }
+        }
+        test.shutdown();
+        return exit_code;
+    }
+
     XInitThreads();
 
-    engine_test test{};
+    Engine_Test test{};
 
     // Open an X server connection
     Display* display{ XOpenDisplay(NULL) };
@@ -109,9 +131,9 @@ int main(int argc, char* argv[])
             }
             test.run(display);
         }
-        test.shutdown();
-        XCloseDisplay(display);
-        return 0;
     }
+    test.shutdown();
+    XCloseDisplay(display);
+    return 0;
 }
 #endif // platforms
\ No newline at end of file
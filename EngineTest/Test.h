@@ -10,6 +10,9 @@
 #define TEST_WINDOW 0
 #define TEST_RENDERER 1
 
+// Renderer test: keep 20k lights in a light set, replace some of them every frame and report what it costs
+#define TEST_LIGHT_CHURN 0
+
 class Test
 {
 public:
@@ -1,7 +1,9 @@
 #include "Platform/PlatformTypes.h"
 #include "Platform/Platform.h"
 #include "Graphics/Renderer.h"
+#ifdef _WIN64
 #include "Graphics/Direct3D12/D3D12Core.h"
+#endif // _WIN64
 #include "Content/ContentToEngine.h"
 #include "Components/Entity.h"
 #include "Components/Transform.h"
@@ -13,7 +15,9 @@
 #include <fstream>
 #include <iostream>
 
+#ifdef _WIN64
 #include "PythonScript.h"
+#endif // _WIN64
 
 #if TEST_RENDERER
 
@@ -30,6 +34,7 @@ utl::vector<u8>	null_buffer(1024 * 1024, 0);
 // Test worker for upload context
 void buffer_test_worker()
 {
+#ifdef _WIN64
 	while(!shutdown)
 	{
 		auto* resource = graphics::d3d12::d3dx::create_buffer(null_buffer.data(), (u32)null_buffer.size());
@@ -37,6 +42,7 @@ void buffer_test_worker()
 		//		 However, this is a nice test for deferred_release functionality.
 		graphics::d3d12::core::deferred_release(resource);
 	}
+#endif // _WIN64
 }
 
 template<class FnPtr, class... Args>
@@ -80,7 +86,9 @@ void destory_render_item(id::id_type item_id);
 void generate_lights();
 void remove_lights();
 void test_lights(f32 dt);
+void test_light_churn();
 
+#ifdef _WIN64
 LRESULT win_proc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam)
 {
 	bool toggle_fullscreen{ false };
@@ -161,6 +169,7 @@ LRESULT win_proc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam)
 
 	return DefWindowProc(hwnd, msg, wparam, lparam);
 }
+#endif // _WIN64
 
 game_entity::entity create_one_game_entity(math::v3 position, math::v3 rotation, const char* name)
 {
@@ -211,11 +220,12 @@ bool read_file(std::filesystem::path path, std::unique_ptr<u8[]>& data, u64& siz
 
 void create_camera_surface(camera_surface& surface, platform::window_init_info info)
 {
-	surface.surface.window = platform::create_window(&info);
+	// A headless surface renders offscreen at the size it's configured with, it needs no window
+	if (!graphics::is_headless()) surface.surface.window = platform::create_window(&info);
 	surface.surface.surface = graphics::create_surface(surface.surface.window);
 	surface.entity = create_one_game_entity({ 2.f, 0.8f, 1.0f }, { 0.0f, 0.0f, 1.0f }, "camera_script");
 	surface.camera = graphics::create_camera(graphics::perspective_camera_init_info{ surface.entity.get_id() });
-	surface.camera.aspect_ratio((f32)surface.surface.window.width() / surface.surface.window.height());
+	surface.camera.aspect_ratio((f32)surface.surface.surface.width() / surface.surface.surface.height());
 }
 
 void destroy_camera_surface(camera_surface& surface)
@@ -232,6 +242,8 @@ bool test_initialize()
 {
 #define GRAPHICS_API graphics::graphics_platform::vulkan_1
 
+	// The shaders and cooked content come from the Windows tools, other platforms use what they left in the assets
+#ifdef _WIN64
 	if constexpr (GRAPHICS_API == graphics::graphics_platform::direct3d12)
 	{
 		while (!compile_shaders())
@@ -262,13 +274,19 @@ bool test_initialize()
 	}
 	else
 	{ }
+#endif // _WIN64
 
 	if (!graphics::initialize(GRAPHICS_API)) return false;
 
 
+#ifdef _WIN64
+	constexpr platform::window_proc callback{ &win_proc };
+#else
+	constexpr void* callback{ nullptr };
+#endif // _WIN64
 	platform::window_init_info info[]
 	{
-		{&win_proc, nullptr, L"Render Window 1", 100, 100, 1600, 900},
+		{callback, nullptr, L"Render Window 1", 100, 100, 1600, 900},
 		//{&win_proc, nullptr, L"Render Window 2", 150, 150, 800, 400},
 		//{&win_proc, nullptr, L"Render Window 3", 200, 200, 400, 400},
 		//{&win_proc, nullptr, L"Render Window 4", 250, 250, 800, 600},
@@ -363,12 +381,21 @@ void test_shutdown()
 	graphics::shutdown();
 }
 
+#ifdef _WIN64
 bool Engine_Test::initialize()
 {
 	return test_initialize();
 }
 
 void Engine_Test::run()
+#elif __linux__
+bool Engine_Test::initialize(void*)
+{
+	return graphics::is_headless() && test_initialize();
+}
+
+void Engine_Test::run(void*)
+#endif
 {
 	static u32 counter{ 0 };
 	static u32 light_set_key{ 0 };
@@ -380,6 +407,9 @@ void Engine_Test::run()
 	const f32 dt{ timer.dt_avg() };
 	script::update(dt);
 	// test_lights(dt);
+#if TEST_LIGHT_CHURN
+	test_light_churn();
+#endif
 	for (u32 i{ 0 }; i < _countof(_surfaces); ++i)
 	{
 		if (_surfaces[i].surface.surface.is_valid())
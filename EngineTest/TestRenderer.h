@@ -4,7 +4,13 @@
 class Engine_Test : public Test
 {
 public :
+#ifdef _WIN64
 	bool initialize() override;
 	void run() override;
+#elif __linux__
+	// Only headless runs, without a display
+	bool initialize(void* disp) override;
+	void run(void* disp) override;
+#endif
 	void shutdown() override;
 };
\ No newline at end of file
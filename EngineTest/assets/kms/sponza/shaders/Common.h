@@ -1,8 +0,0 @@
-#ifndef PRIMAL_COMMON_GLSLI
-#define PRIMAL_COMMON_GLSLI
-
-#include "CommonTypes.glsli"
-#include "CommonFunction.glsli"
-#include "CommonConstant.glsli"
-
-#endif // !PRIMAL_COMMON_GLSLI
@@ -43,6 +43,8 @@ namespace PrimalEditor.Content
     class Mesh : ViewModelBase
     {
         public static int PositionSize => sizeof(float) * 3;
+        // Bounding sphere, normal cone and index range of a meshlet, see content::meshlet in the engine
+        public static int MeshletSize => sizeof(float) * 14;
         private int _elementSize;
         public int ElementSize
         {
@@ -120,6 +122,7 @@ namespace PrimalEditor.Content
         public byte[] Positions { get; set; }
         public byte[] Elements { get; set; }
         public byte[] Indices { get; set; }
+        public byte[] Meshlets { get; set; }
     }
 
     class MeshLOD : ViewModelBase
@@ -404,6 +407,8 @@ namespace PrimalEditor.Content
             mesh.Positions = reader.ReadBytes(Mesh.PositionSize * mesh.VertexCount);
             mesh.Elements = reader.ReadBytes(elementsBufferSize);
             mesh.Indices = reader.ReadBytes(indexBufferSize);
+            var meshletCount = reader.ReadInt32();
+            mesh.Meshlets = reader.ReadBytes(Mesh.MeshletSize * meshletCount);
 
             MeshLOD lod;
             if(ID.IsValid(lodId) && lodIds.Contains(lodId))